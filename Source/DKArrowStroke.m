@@ -6,6 +6,7 @@
 
 #import "DKArrowStroke.h"
 #import "DKDrawablePath.h"
+#import "DKGeometryCache.h"
 #import "DKShapeFactory.h"
 #import "DKStrokeDash.h"
 #import "DKStyle.h"
@@ -551,7 +552,8 @@ NSString* const kDKDimensionUnitsKey = @"DKDimensionUnits";
 
 	if ([self dimensioningLineOptions] != kDKDimensionNone) {
 		NSString* dimstr;
-		CGFloat lengthOfPath = [[obj renderingPath] length];
+		DKGeometryCacheEntry* entry = [obj respondsToSelector:@selector(geometryCacheEntry)] ? [obj geometryCacheEntry] : nil;
+		CGFloat lengthOfPath = entry ? [entry length] : [[obj renderingPath] length];
 
 		if ([obj respondsToSelector:@selector(convertLength:)])
 			lengthOfPath = [obj convertLength:lengthOfPath];
@@ -9,7 +9,7 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
-@class DKBSPIndexTree;
+@class DKBSPIndexTree, DKBSPTreeRebuild;
 
 /// node types
 typedef NS_ENUM(NSInteger, DKLeafType) {
@@ -30,30 +30,64 @@ typedef NS_ENUM(NSInteger, DKBSPOperation) {
  The actual storage object. This inherits the linear array which actually stores the objects, but maintains a BSP tree in parallel, which
  stores indexes that refer to this array. Thus the objects' Z-order is strictly maintained by the array as for the linear case, but objects can
  be extracted very rapidly when performing a spatial query.
+
+ When the number of objects changes enough to need a deeper or shallower tree, the new tree is built on a background queue from a snapshot
+ of the objects' bounds, while the existing tree carries on serving queries and receiving changes. Changes made while the new tree is being built
+ are recorded and replayed into it, and it then replaces the old tree in one step, the next time the storage is changed or the main queue runs.
 */
 @interface DKBSPObjectStorage : DKLinearObjectStorage {
 @private
 	DKBSPIndexTree* mTree;
 	NSUInteger mTreeDepth;
 	NSUInteger mLastItemCount;
+	DKBSPTreeRebuild* mRebuild;
+	NSUInteger mTreeRebuildCount;
+	NSTimeInterval mTreeRebuildTime;
+	NSTimeInterval mLastTreeRebuildTime;
 }
 
 - (void)setTreeDepth:(NSUInteger)aDepth;
 - (id)tree;
 
+/** @brief The number of times the tree has been rebuilt, whether in the background or not.
+ */
+@property (readonly) NSUInteger treeRebuildCount;
+
+/** @brief The total time spent rebuilding the tree, in seconds.
+
+ For a background rebuild, this is the time taken to build the new tree plus the time taken to replay the changes made meanwhile and swap
+ it in - only the latter holds up the caller.
+ */
+@property (readonly) NSTimeInterval treeRebuildDuration;
+
+/** @brief The time taken by the most recent rebuild, in seconds.
+ */
+@property (readonly) NSTimeInterval lastTreeRebuildDuration;
+
+/** @brief Is a new tree currently being built in the background?
+ */
+@property (readonly, getter=isRebuildingTree) BOOL rebuildingTree;
+
+/** @brief Waits for any background rebuild to finish, and swaps in the new tree.
+
+ Not normally needed, as the new tree is swapped in automatically, but useful when the tree itself is to be inspected.
+ */
+- (void)waitForTreeRebuild;
+
 @end
 
 #pragma mark -
 
-/** @brief tree object; this stores indexes in mutable index sets.
+/** @brief tree object; this stores indexes in packed, sorted arrays.
 
- this stores indexes in mutable index sets. The indexes refer to the index of the object within the linear array. Given a rect query, this returns an index set which
- is the indexes of all objects that intersect the rect. Using -objectsAtIndexes: on the linear array then returns the relevant objects sorted by Z-order. The tree only
- stores the indexes of visible objects, thus it doesn't need to test for visibility - the storage will manage adding and removing indexes as object visibility changes.
+ this stores indexes in packed, sorted arrays, one per leaf. The indexes refer to the index of the object within the linear array. Given a rect query, this returns
+ the indexes of all objects that intersect the rect, in ascending order, which is therefore also Z-order. The tree only stores the indexes of visible objects, thus it
+ doesn't need to test for visibility - the storage will manage adding and removing indexes as object visibility changes.
 
  note that this is equivalent to a binary search in 2 dimensions. The purpose is to weed out as many irrelevant objects as possible in advance of returning them to the
- client for drawing. Internally it is tuned for speed but it relies heavily on the performance of Cocoa's NSIndexSet class, and -addIndexes: in particular. If these turn
- out to be slow, this may be detrimental to drawing performance.
+ client for drawing. The leaves hit by a query are combined with a k-way merge that also removes duplicates (an item spanning several leaves is stored in each), into a
+ result buffer owned by the tree and reused by every query, so querying doesn't allocate. Shifting indexes (as objects are inserted or removed from the array) is recorded
+ and only applied to a leaf when it's next used.
 */
 @interface DKBSPIndexTree : NSObject {
 @protected
@@ -64,6 +98,16 @@ typedef NS_ENUM(NSInteger, DKBSPOperation) {
 	DKBSPOperation mOp;
 	NSUInteger mOpIndex;
 	NSBezierPath* mDebugPath;
+@private
+	NSUInteger* mResultBuffer;
+	NSUInteger mResultCount;
+	NSUInteger mResultCapacity;
+	struct DKBSPLeafCursor* mHitLeaves;
+	NSUInteger mHitCount;
+	NSUInteger mHitCapacity;
+	NSUInteger mQueryStamp;
+	struct DKBSPIndexShift* mPendingShifts;
+	NSUInteger mPendingShiftCount;
 }
 
 @property (class, readonly) Class leafClass;
@@ -78,12 +122,34 @@ typedef NS_ENUM(NSInteger, DKBSPOperation) {
 - (void)insertItemIndex:(NSUInteger)idx withRect:(NSRect)rect;
 - (void)removeItemIndex:(NSUInteger)idx withRect:(NSRect)rect;
 
+/** @brief Removes a set of indexes from the tree and renumbers the rest to close up the gaps, as when the items are removed from the array.
+
+ Equivalent to removing each item and shifting the indexes above it down by one, but visits each leaf only once.
+ */
+- (void)removeItemIndexes:(NSIndexSet*)indexes;
+
+/** @brief Returns the indexes of the items in the leaves that intersect the rects, in ascending order and without duplicates.
+
+ The returned buffer belongs to the tree and is only valid until the next query or change to the tree.
+ @param rects the rects to search, e.g. as returned by NSView's -getRectsBeingDrawn:count:
+ @param count the number of rects
+ @param resultCount receives the number of indexes returned
+ @return the indexes, or NULL if none were found
+ */
+- (nullable const NSUInteger*)indexesIntersectingRects:(const NSRect*)rects count:(NSUInteger)count resultCount:(NSUInteger*)resultCount NS_RETURNS_INNER_POINTER;
+- (nullable const NSUInteger*)indexesIntersectingRect:(NSRect)rect resultCount:(NSUInteger*)resultCount NS_RETURNS_INNER_POINTER;
+- (nullable const NSUInteger*)indexesIntersectingPoint:(NSPoint)point resultCount:(NSUInteger*)resultCount NS_RETURNS_INNER_POINTER;
+
 - (nullable NSIndexSet*)itemsIntersectingRects:(const NSRect*)rects count:(NSUInteger)count;
 - (nullable NSIndexSet*)itemsIntersectingRect:(NSRect)rect;
 - (nullable NSIndexSet*)itemsIntersectingPoint:(NSPoint)point;
 
 - (void)shiftIndexesStartingAtIndex:(NSUInteger)startIndex by:(NSInteger)delta;
 
+/** @brief Returns the indexes stored in a leaf, for debugging and verification.
+ */
+- (NSIndexSet*)indexesInLeafAtIndex:(NSUInteger)indx;
+
 - (NSBezierPath*)debugStorageDivisions;
 
 @end
@@ -91,5 +157,6 @@ typedef NS_ENUM(NSInteger, DKBSPOperation) {
 #define kDKBSPSlack 48
 #define kDKMinimumDepth 10U
 #define kDKMaximumDepth 0U // set 0 for no limit
+#define kDKBSPMaxPendingShifts 32 // pending index shifts are applied to every leaf once this many have built up
 
 NS_ASSUME_NONNULL_END
@@ -19,11 +19,105 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return (nodeIndex << 1) + 1;
 }
 
+/// kinds of change recorded while a replacement tree is built
+typedef NS_ENUM(NSInteger, DKBSPTreeEditType) {
+	kDKTreeEditInsert,
+	kDKTreeEditRemove,
+	kDKTreeEditShift
+};
+
+/// a change made to the tree while a replacement is being built, to be replayed into the replacement
+typedef struct {
+	DKBSPTreeEditType type;
+	NSUInteger index;
+	NSInteger delta;
+	NSRect rect;
+} DKBSPTreeEdit;
+
+/// the bounds of a visible object when a rebuild began
+typedef struct {
+	NSUInteger index;
+	NSRect bounds;
+} DKBSPTreeItem;
+
+/** a replacement tree being built in the background, and the changes made to the current tree since it was started.
+ */
+@interface DKBSPTreeRebuild : NSObject {
+@public
+	DKBSPIndexTree* mTree;
+	dispatch_group_t mGroup;
+	DKBSPTreeEdit* mEdits;
+	NSUInteger mEditCount;
+	NSUInteger mEditCapacity;
+	NSUInteger mItemCount; // the number of objects in the snapshot
+	NSTimeInterval mBuildTime; // set by the background build
+}
+
+- (void)recordEdit:(DKBSPTreeEdit)edit;
+- (void)replayEdits;
+
+@end
+
+@implementation DKBSPTreeRebuild
+
+- (void)recordEdit:(DKBSPTreeEdit)edit
+{
+	if (mEditCount == mEditCapacity) {
+		mEditCapacity = MAX(mEditCapacity * 2, 64U);
+		mEdits = reallocf(mEdits, sizeof(DKBSPTreeEdit) * mEditCapacity);
+		NSAssert(mEdits != NULL, @"unable to allocate BSP edit log");
+	}
+
+	mEdits[mEditCount++] = edit;
+}
+
+- (void)replayEdits
+{
+	for (NSUInteger i = 0; i < mEditCount; ++i) {
+		DKBSPTreeEdit* edit = &mEdits[i];
+
+		switch (edit->type) {
+		case kDKTreeEditInsert:
+			[mTree insertItemIndex:edit->index
+						  withRect:edit->rect];
+			break;
+
+		case kDKTreeEditRemove:
+			[mTree removeItemIndex:edit->index
+						  withRect:edit->rect];
+			break;
+
+		case kDKTreeEditShift:
+			[mTree shiftIndexesStartingAtIndex:edit->index
+											by:edit->delta];
+			break;
+		}
+	}
+
+	mEditCount = 0;
+}
+
+- (void)dealloc
+{
+	free(mEdits);
+}
+
+@end
+
+#pragma mark -
+
 @interface DKBSPObjectStorage ()
 
 - (void)setDepthAndLoadTree:(NSUInteger)aDepth;
 - (void)loadBSPTree;
-- (BOOL)checkForTreeRebuild;
+- (void)checkForTreeRebuild;
+- (void)beginTreeRebuildWithDepth:(NSUInteger)depth;
+- (void)adoptRebuiltTreeWaiting:(BOOL)wait;
+- (void)cancelTreeRebuild;
+- (void)recordTreeRebuildTime:(NSTimeInterval)t;
+- (void)treeInsertItemIndex:(NSUInteger)indx withRect:(NSRect)rect;
+- (void)treeRemoveItemIndex:(NSUInteger)indx withRect:(NSRect)rect;
+- (void)treeShiftIndexesStartingAtIndex:(NSUInteger)indx by:(NSInteger)delta;
 
 @end
 
@@ -50,30 +144,49 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return mTree;
 }
 
+@synthesize treeRebuildCount = mTreeRebuildCount;
+@synthesize treeRebuildDuration = mTreeRebuildTime;
+@synthesize lastTreeRebuildDuration = mLastTreeRebuildTime;
+
+- (BOOL)isRebuildingTree
+{
+	return mRebuild != nil;
+}
+
+- (void)waitForTreeRebuild
+{
+	[self adoptRebuiltTreeWaiting:YES];
+}
+
 - (NSArray*)objectsIntersectingRect:(NSRect)aRect inView:(NSView*)aView options:(DKObjectStorageOptions)options
 {
 #pragma unused(options)
 
-	NSIndexSet* indexes;
+	const NSUInteger* indexes;
+	NSUInteger count = 0;
 
 	if (aView) {
 		const NSRect* rects;
-		NSInteger count;
+		NSInteger rectCount;
 
 		[aView getRectsBeingDrawn:&rects
-							count:&count];
-		indexes = [mTree itemsIntersectingRects:rects
-										  count:count];
+							count:&rectCount];
+		indexes = [mTree indexesIntersectingRects:rects
+											count:rectCount
+									  resultCount:&count];
 	} else
-		indexes = [mTree itemsIntersectingRect:aRect];
+		indexes = [mTree indexesIntersectingRect:aRect
+									 resultCount:&count];
 
 	// ignore the options flags for now
 	// weed out any false positives which we don't need to draw. This is fairly common when the depth is low and the canvas isn't
-	// very finely divided. As depth increases this effect is diminished
+	// very finely divided. As depth increases this effect is diminished. The indexes are in ascending order, so the results are in Z-order.
 
-	NSMutableArray* array = [NSMutableArray array];
+	NSMutableArray* array = [NSMutableArray arrayWithCapacity:count];
+
+	for (NSUInteger i = 0; i < count; ++i) {
+		id<DKStorableObject> obj = [self objectInObjectsAtIndex:indexes[i]];
 
-	for (id<DKStorableObject> obj in [[self objects] objectsAtIndexes:indexes]) {
 		if (aView) {
 			if ([aView needsToDrawRect:[obj bounds]]) {
 				[array addObject:obj];
@@ -90,13 +203,15 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (NSArray*)objectsContainingPoint:(NSPoint)aPoint
 {
-	NSIndexSet* indexes = [mTree itemsIntersectingPoint:aPoint];
-
-	//NSLog(@"indexes returned for hit: %@", indexes );
+	NSUInteger count = 0;
+	const NSUInteger* indexes = [mTree indexesIntersectingPoint:aPoint
+													resultCount:&count];
 
 	NSMutableArray* array = [NSMutableArray array];
 
-	for (id<DKStorableObject> obj in [[self objects] objectsAtIndexes:indexes]) {
+	for (NSUInteger i = 0; i < count; ++i) {
+		id<DKStorableObject> obj = [self objectInObjectsAtIndex:indexes[i]];
+
 		if (NSPointInRect(aPoint, [obj bounds]))
 			[array addObject:obj];
 	}
@@ -112,45 +227,51 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)insertObject:(id<DKStorableObject>)obj inObjectsAtIndex:(NSUInteger)indx
 {
+	[self adoptRebuiltTreeWaiting:NO];
 	[super insertObject:obj
 		inObjectsAtIndex:indx];
 
-	if ([obj visible]) {
-		if (![self checkForTreeRebuild]) {
-			[mTree shiftIndexesStartingAtIndex:indx
-											by:1];
-			[mTree insertItemIndex:indx
-						  withRect:[obj bounds]];
-		}
-	}
+	// the items above move up whether or not this one is visible
+
+	[self treeShiftIndexesStartingAtIndex:indx
+									   by:1];
+
+	if ([obj visible])
+		[self treeInsertItemIndex:indx
+						 withRect:[obj bounds]];
+
+	[self checkForTreeRebuild];
 }
 
 - (void)removeObjectFromObjectsAtIndex:(NSUInteger)indx
 {
+	[self adoptRebuiltTreeWaiting:NO];
+
 	id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
 
-	if ([obj visible]) {
-		if (![self checkForTreeRebuild]) {
-			[mTree removeItemIndex:indx
-						  withRect:[obj bounds]];
-			[mTree shiftIndexesStartingAtIndex:indx + 1
-											by:-1];
-		}
-	}
+	if ([obj visible])
+		[self treeRemoveItemIndex:indx
+						 withRect:[obj bounds]];
+
+	[self treeShiftIndexesStartingAtIndex:indx + 1
+									   by:-1];
 
 	[super removeObjectFromObjectsAtIndex:indx];
+	[self checkForTreeRebuild];
 }
 
 - (void)replaceObjectInObjectsAtIndex:(NSUInteger)indx withObject:(id<DKStorableObject>)obj
 {
+	[self adoptRebuiltTreeWaiting:NO];
+
 	id<DKStorableObject> old = [self objectInObjectsAtIndex:indx];
 	if ([old visible])
-		[mTree removeItemIndex:indx
-					  withRect:[old bounds]];
+		[self treeRemoveItemIndex:indx
+						 withRect:[old bounds]];
 
 	if ([obj visible])
-		[mTree insertItemIndex:indx
-					  withRect:[obj bounds]];
+		[self treeInsertItemIndex:indx
+						 withRect:[obj bounds]];
 
 	[super replaceObjectInObjectsAtIndex:indx
 							  withObject:obj];
@@ -158,27 +279,53 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)insertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set
 {
-	// this may be expensive, as it rebuilds the entire tree due to the extensive renumbering of items
+	// if most of the objects are new, it's quicker to reload the whole tree. Otherwise each is added in ascending index order, which
+	// renumbers the existing items as it goes.
 
+	[self adoptRebuiltTreeWaiting:NO];
 	[super insertObjects:objs
 			   atIndexes:set];
 
-	if (![self checkForTreeRebuild])
+	if ([set count] * 2 > [self countOfObjects])
 		[self setDepthAndLoadTree:mTreeDepth];
+	else {
+		[set enumerateIndexesUsingBlock:^(NSUInteger indx, BOOL* stop) {
+#pragma unused(stop)
+			id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
+
+			[self treeShiftIndexesStartingAtIndex:indx
+											   by:1];
+
+			if ([obj visible])
+				[self treeInsertItemIndex:indx
+								 withRect:[obj bounds]];
+		}];
+
+		[self checkForTreeRebuild];
+	}
 }
 
 - (void)removeObjectsAtIndexes:(NSIndexSet*)set
 {
-	// this may be expensive, as it rebuilds the entire tree due to the extensive renumbering of items
+	[self adoptRebuiltTreeWaiting:NO];
 
-	[super removeObjectsAtIndexes:set];
-
-	if (![self checkForTreeRebuild])
+	if ([set count] * 2 > [self countOfObjects]) {
+		[super removeObjectsAtIndexes:set];
 		[self setDepthAndLoadTree:mTreeDepth];
+	} else {
+		// a replacement tree can't take this change as a simple edit, so any rebuild in progress is abandoned and started afresh
+
+		[self cancelTreeRebuild];
+		[mTree removeItemIndexes:set];
+		[super removeObjectsAtIndexes:set];
+		[self checkForTreeRebuild];
+	}
 }
 
 - (void)moveObject:(id<DKStorableObject>)obj toIndex:(NSUInteger)indx
 {
+	[self adoptRebuiltTreeWaiting:NO];
+
 	NSUInteger newIdx, oldIdx = [self indexOfObject:obj];
 	[super moveObject:obj
 			  toIndex:indx];
@@ -187,14 +334,14 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 		newIdx = [self indexOfObject:obj];
 
 		if (oldIdx != newIdx) {
-			[mTree removeItemIndex:oldIdx
-						  withRect:[obj bounds]];
-			[mTree shiftIndexesStartingAtIndex:oldIdx + 1
-											by:-1];
-			[mTree shiftIndexesStartingAtIndex:newIdx
-											by:1];
-			[mTree insertItemIndex:newIdx
-						  withRect:[obj bounds]];
+			[self treeRemoveItemIndex:oldIdx
+							 withRect:[obj bounds]];
+			[self treeShiftIndexesStartingAtIndex:oldIdx + 1
+											   by:-1];
+			[self treeShiftIndexesStartingAtIndex:newIdx
+											   by:1];
+			[self treeInsertItemIndex:newIdx
+							 withRect:[obj bounds]];
 		}
 	}
 }
@@ -203,25 +350,29 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 {
 	// n.b. only called if the bounds has actually changed, so we don't need to test that again
 
+	[self adoptRebuiltTreeWaiting:NO];
+
 	NSUInteger indx = [self indexOfObject:obj];
 	if ([obj visible]) {
-		[mTree removeItemIndex:indx
-					  withRect:oldBounds];
-		[mTree insertItemIndex:indx
-					  withRect:[obj bounds]];
+		[self treeRemoveItemIndex:indx
+						 withRect:oldBounds];
+		[self treeInsertItemIndex:indx
+						 withRect:[obj bounds]];
 	}
 }
 
 - (void)objectDidChangeVisibility:(id<DKStorableObject>)obj
 {
+	[self adoptRebuiltTreeWaiting:NO];
+
 	NSUInteger indx = [self indexOfObject:obj];
 
 	if ([obj visible])
-		[mTree insertItemIndex:indx
-					  withRect:[obj bounds]];
+		[self treeInsertItemIndex:indx
+						 withRect:[obj bounds]];
 	else
-		[mTree removeItemIndex:indx
-					  withRect:[obj bounds]];
+		[self treeRemoveItemIndex:indx
+						 withRect:[obj bounds]];
 }
 
 - (void)setCanvasSize:(NSSize)size
@@ -230,6 +381,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	// is first created, and whenever the canvas size changes.
 
 	if (!NSEqualSizes(size, [mTree canvasSize])) {
+		[self cancelTreeRebuild];
+
 		NSUInteger depth = (mTreeDepth == 0 ? depthForObjectCount([self countOfObjects]) : mTreeDepth);
 		mTree = [[DKBSPIndexTree alloc] initWithCanvasSize:size
 													 depth:MAX(depth, kDKMinimumDepth)];
@@ -241,12 +394,14 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 {
 	NSUInteger depth = (aDepth == 0 ? MAX(depthForObjectCount([self countOfObjects]), kDKMinimumDepth) : aDepth);
 
+	[self cancelTreeRebuild];
 	[mTree setDepth:MAX(depth, kDKMinimumDepth)];
 	[self loadBSPTree];
 }
 
 - (void)loadBSPTree
 {
+	NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
 	NSUInteger k = 0;
 
 	for (id<DKStorableObject> obj in self.objects) {
@@ -259,31 +414,145 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	}
 
 	mLastItemCount = k;
+	[self recordTreeRebuildTime:[NSDate timeIntervalSinceReferenceDate] - startTime];
 
 	//NSLog(@"loaded BSP tree with %d indexes (tree = %@)", k, mTree );
 }
 
-- (BOOL)checkForTreeRebuild
+- (void)checkForTreeRebuild
 {
 	// calculates an optimal tree depth given the current number of items stored. This is done if the depth is
 	// initialised to 0. If the depth is different and the item count exceeds the slack value, then the tree is
 	// rebuilt with the new depth. If the tree depth is preset to a fixed value, this dynamic resizing is never done.
-	// return YES if the tree was rebuilt, NO otherwise
+	// The tree is rebuilt in the background unless there isn't one yet.
 
-	if (mTreeDepth == 0) {
+	if (mTreeDepth == 0 && mRebuild == nil) {
 		NSUInteger oldDepth = MAX(depthForObjectCount(mLastItemCount), kDKMinimumDepth);
 		NSUInteger neuDepth = MAX(depthForObjectCount([self countOfObjects]), kDKMinimumDepth);
 
-		if ([mTree countOfLeaves] == 0 || (oldDepth != neuDepth && ABS((NSInteger)mLastItemCount - (NSInteger)[self countOfObjects]) > kDKBSPSlack)) {
-			// sufficient cause to rebuild the tree
-
+		if ([mTree countOfLeaves] == 0) {
 			[mTree setDepth:neuDepth];
 			[self loadBSPTree];
-			return YES;
+		} else if (oldDepth != neuDepth && ABS((NSInteger)mLastItemCount - (NSInteger)[self countOfObjects]) > kDKBSPSlack) {
+			// sufficient cause to rebuild the tree
+
+			[self beginTreeRebuildWithDepth:neuDepth];
 		}
 	}
+}
+
+- (void)beginTreeRebuildWithDepth:(NSUInteger)depth
+{
+	// snapshots the bounds of the visible objects, and builds a new tree from them on a background queue. Only the snapshot is
+	// touched by the background build - the objects themselves are not thread-safe.
 
-	return NO;
+	NSUInteger count = [self countOfObjects];
+	DKBSPTreeItem* items = malloc(sizeof(DKBSPTreeItem) * MAX(count, 1U));
+	NSUInteger n = 0, k = 0;
+
+	if (items == NULL)
+		return;
+
+	for (id<DKStorableObject> obj in self.objects) {
+		if ([obj visible]) {
+			items[n].index = k;
+			items[n].bounds = [obj bounds];
+			++n;
+		}
+
+		++k;
+	}
+
+	DKBSPTreeRebuild* rebuild = [[DKBSPTreeRebuild alloc] init];
+	DKBSPIndexTree* tree = [[DKBSPIndexTree alloc] initWithCanvasSize:[mTree canvasSize]
+																depth:depth];
+	rebuild->mTree = tree;
+	rebuild->mGroup = dispatch_group_create();
+	rebuild->mItemCount = count;
+
+	mRebuild = rebuild;
+
+	LogEvent_(kInfoEvent, @"%@ <%p> rebuilding BSP in background, depth = %lu, items = %lu", NSStringFromClass([self class]), self, (unsigned long)depth, (unsigned long)n);
+
+	dispatch_group_async(rebuild->mGroup, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+
+		for (NSUInteger i = 0; i < n; ++i)
+			[tree insertItemIndex:items[i].index
+						 withRect:items[i].bounds];
+
+		free(items);
+		rebuild->mBuildTime = [NSDate timeIntervalSinceReferenceDate] - startTime;
+	});
+
+	// if nothing else changes the storage in the meantime, swap the tree in when the main queue next runs
+
+	__weak DKBSPObjectStorage* weakSelf = self;
+
+	dispatch_group_notify(rebuild->mGroup, dispatch_get_main_queue(), ^{
+		DKBSPObjectStorage* strongSelf = weakSelf;
+
+		if (strongSelf && strongSelf->mRebuild == rebuild)
+			[strongSelf adoptRebuiltTreeWaiting:NO];
+	});
+}
+
+- (void)adoptRebuiltTreeWaiting:(BOOL)wait
+{
+	// if a background rebuild has finished (or <wait> is YES), replays the changes made since it began into the new tree and makes it current
+
+	DKBSPTreeRebuild* rebuild = mRebuild;
+
+	if (rebuild == nil)
+		return;
+
+	if (dispatch_group_wait(rebuild->mGroup, wait ? DISPATCH_TIME_FOREVER : DISPATCH_TIME_NOW) != 0)
+		return;
+
+	NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+
+	[rebuild replayEdits];
+
+	mTree = rebuild->mTree;
+
+	mRebuild = nil;
+	mLastItemCount = rebuild->mItemCount;
+	[self recordTreeRebuildTime:rebuild->mBuildTime + [NSDate timeIntervalSinceReferenceDate] - startTime];
+}
+
+- (void)cancelTreeRebuild
+{
+	// the background build runs to completion, but its result is discarded
+
+	mRebuild = nil;
+}
+
+- (void)recordTreeRebuildTime:(NSTimeInterval)t
+{
+	++mTreeRebuildCount;
+	mTreeRebuildTime += t;
+	mLastTreeRebuildTime = t;
+}
+
+- (void)treeInsertItemIndex:(NSUInteger)indx withRect:(NSRect)rect
+{
+	[mTree insertItemIndex:indx
+				  withRect:rect];
+	[mRebuild recordEdit:(DKBSPTreeEdit){ kDKTreeEditInsert, indx, 0, rect }];
+}
+
+- (void)treeRemoveItemIndex:(NSUInteger)indx withRect:(NSRect)rect
+{
+	[mTree removeItemIndex:indx
+				  withRect:rect];
+	[mRebuild recordEdit:(DKBSPTreeEdit){ kDKTreeEditRemove, indx, 0, rect }];
+}
+
+- (void)treeShiftIndexesStartingAtIndex:(NSUInteger)indx by:(NSInteger)delta
+{
+	[mTree shiftIndexesStartingAtIndex:indx
+									by:delta];
+	[mRebuild recordEdit:(DKBSPTreeEdit){ kDKTreeEditShift, indx, delta, NSZeroRect }];
 }
 
 #pragma mark -
@@ -301,9 +570,6 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return self;
 }
 
-#pragma mark -
-#pragma mark - as a NSObject
-
 @end
 
 #pragma mark -
@@ -355,6 +621,156 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 #pragma mark -
 
+/// a pending change to the stored indexes, recorded by -shiftIndexesStartingAtIndex:by:
+typedef struct DKBSPIndexShift {
+	NSUInteger start;
+	NSInteger delta;
+} DKBSPIndexShift;
+
+/// the unmerged remainder of one leaf's indexes during a k-way merge
+typedef struct DKBSPLeafCursor {
+	const NSUInteger* next;
+	const NSUInteger* end;
+} DKBSPLeafCursor;
+
+/** a leaf of the index tree; the indexes of the items that fall within it, kept sorted in a packed array.
+ */
+@interface DKBSPIndexLeaf : NSObject {
+@public
+	NSUInteger* mIndexes;
+	NSUInteger mCount;
+	NSUInteger mCapacity;
+	NSUInteger mShiftsApplied; // how many of the tree's pending shifts have already been applied to this leaf
+	NSUInteger mQueryStamp; // the last query that collected this leaf
+}
+
+- (void)addIndex:(NSUInteger)indx;
+- (void)removeIndex:(NSUInteger)indx;
+- (void)removeIndexes:(const NSUInteger*)removed count:(NSUInteger)count;
+- (void)shiftIndexesStartingAtIndex:(NSUInteger)startIndex by:(NSInteger)delta;
+- (NSIndexSet*)indexSet;
+
+@end
+
+static inline NSUInteger lowerBoundInLeaf(const DKBSPIndexLeaf* leaf, NSUInteger value)
+{
+	// returns the position of the first index >= <value>
+
+	NSUInteger lo = 0, hi = leaf->mCount;
+
+	while (lo < hi) {
+		NSUInteger mid = (lo + hi) >> 1;
+
+		if (leaf->mIndexes[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+@implementation DKBSPIndexLeaf
+
+- (void)addIndex:(NSUInteger)indx
+{
+	NSUInteger pos = lowerBoundInLeaf(self, indx);
+
+	if (pos < mCount && mIndexes[pos] == indx)
+		return;
+
+	if (mCount == mCapacity) {
+		mCapacity = MAX(mCapacity * 2, 8U);
+		mIndexes = reallocf(mIndexes, sizeof(NSUInteger) * mCapacity);
+		NSAssert(mIndexes != NULL, @"unable to allocate BSP leaf");
+	}
+
+	memmove(mIndexes + pos + 1, mIndexes + pos, sizeof(NSUInteger) * (mCount - pos));
+	mIndexes[pos] = indx;
+	++mCount;
+}
+
+- (void)removeIndex:(NSUInteger)indx
+{
+	NSUInteger pos = lowerBoundInLeaf(self, indx);
+
+	if (pos < mCount && mIndexes[pos] == indx) {
+		--mCount;
+		memmove(mIndexes + pos, mIndexes + pos + 1, sizeof(NSUInteger) * (mCount - pos));
+	}
+}
+
+- (void)removeIndexes:(const NSUInteger*)removed count:(NSUInteger)count
+{
+	// <removed> is sorted. Each index kept moves down by the number of removed indexes below it
+
+	NSUInteger i, n = 0;
+
+	for (i = 0; i < mCount; ++i) {
+		NSUInteger indx = mIndexes[i];
+		NSUInteger lo = 0, hi = count;
+
+		while (lo < hi) {
+			NSUInteger mid = (lo + hi) >> 1;
+
+			if (removed[mid] < indx)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo < count && removed[lo] == indx)
+			continue;
+
+		mIndexes[n++] = indx - lo;
+	}
+
+	mCount = n;
+}
+
+- (void)shiftIndexesStartingAtIndex:(NSUInteger)startIndex by:(NSInteger)delta
+{
+	// as for NSMutableIndexSet, shifting down overwrites any indexes in the gap, so those are dropped first
+
+	if (delta < 0) {
+		NSUInteger gapStart = (startIndex > (NSUInteger)-delta) ? startIndex + delta : 0;
+		NSUInteger from = lowerBoundInLeaf(self, gapStart);
+		NSUInteger to = lowerBoundInLeaf(self, startIndex);
+
+		if (to > from) {
+			memmove(mIndexes + from, mIndexes + to, sizeof(NSUInteger) * (mCount - to));
+			mCount -= to - from;
+		}
+	}
+
+	for (NSUInteger i = lowerBoundInLeaf(self, startIndex); i < mCount; ++i)
+		mIndexes[i] += delta;
+}
+
+- (NSIndexSet*)indexSet
+{
+	NSMutableIndexSet* set = [NSMutableIndexSet indexSet];
+
+	for (NSUInteger i = 0; i < mCount; ++i)
+		[set addIndex:mIndexes[i]];
+
+	return set;
+}
+
+- (NSString*)description
+{
+	return [[self indexSet] description];
+}
+
+- (void)dealloc
+{
+	free(mIndexes);
+}
+
+@end
+
+#pragma mark -
+
 @interface DKBSPIndexTree ()
 
 - (void)partition:(NSRect)rect depth:(NSUInteger)depth index:(NSUInteger)indx;
@@ -364,6 +780,10 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 - (void)removeNodesAndLeaves;
 - (void)allocateLeaves:(NSUInteger)howMany;
 - (void)removeIndex:(NSUInteger)indx;
+- (void)applyPendingShiftsToLeaf:(DKBSPIndexLeaf*)leaf;
+- (void)applyAllPendingShifts;
+- (void)beginAccumulating;
+- (const NSUInteger*)mergeAccumulatedLeavesWithResultCount:(NSUInteger*)resultCount;
 
 @end
 
@@ -373,7 +793,7 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 + (Class)leafClass
 {
-	return [NSMutableIndexSet class];
+	return [DKBSPIndexLeaf class];
 }
 
 - (instancetype)initWithCanvasSize:(NSSize)size depth:(NSUInteger)depth
@@ -451,48 +871,113 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	[self removeIndex:idx];
 }
 
-- (NSIndexSet*)itemsIntersectingRects:(const NSRect*)rects count:(NSUInteger)count
+- (void)removeItemIndexes:(NSIndexSet*)indexes
+{
+	NSUInteger count = [indexes count];
+
+	if ([mNodes count] == 0 || count == 0)
+		return;
+
+	NSUInteger* removed = malloc(sizeof(NSUInteger) * count);
+
+	if (removed == NULL)
+		return;
+
+	[indexes getIndexes:removed
+			   maxCount:count
+		   inIndexRange:NULL];
+
+	[self applyAllPendingShifts];
+
+	for (DKBSPIndexLeaf* leaf in mLeaves)
+		[leaf removeIndexes:removed
+					  count:count];
+
+	free(removed);
+}
+
+- (const NSUInteger*)indexesIntersectingRects:(const NSRect*)rects count:(NSUInteger)count resultCount:(NSUInteger*)resultCount
 {
 	// this may be used in conjunction with NSView's -getRectsBeingDrawn:count: to find those objects that intersect the non-rectangular update region.
 
-	if ([mNodes count] == 0)
-		return nil;
+	*resultCount = 0;
 
-	mOp = kDKOperationAccumulate;
-	[mResults removeAllIndexes];
+	if ([mNodes count] == 0)
+		return NULL;
 
-	NSUInteger i;
+	[self beginAccumulating];
 
-	for (i = 0; i < count; ++i)
+	for (NSUInteger i = 0; i < count; ++i)
 		[self recursivelySearchWithRect:rects[i]
 								  index:0];
 
-	return mResults;
+	return [self mergeAccumulatedLeavesWithResultCount:resultCount];
 }
 
-- (NSIndexSet*)itemsIntersectingRect:(NSRect)rect
+- (const NSUInteger*)indexesIntersectingRect:(NSRect)rect resultCount:(NSUInteger*)resultCount
+{
+	*resultCount = 0;
+
+	if ([mNodes count] == 0)
+		return NULL;
+
+	[self beginAccumulating];
+	[self recursivelySearchWithRect:rect
+							  index:0];
+
+	return [self mergeAccumulatedLeavesWithResultCount:resultCount];
+}
+
+- (const NSUInteger*)indexesIntersectingPoint:(NSPoint)point resultCount:(NSUInteger*)resultCount
+{
+	*resultCount = 0;
+
+	if ([mNodes count] == 0)
+		return NULL;
+
+	[self beginAccumulating];
+	[self recursivelySearchWithPoint:point
+							   index:0];
+
+	return [self mergeAccumulatedLeavesWithResultCount:resultCount];
+}
+
+- (NSIndexSet*)itemsIntersectingRects:(const NSRect*)rects count:(NSUInteger)count
 {
 	if ([mNodes count] == 0)
 		return nil;
 
-	mOp = kDKOperationAccumulate;
+	NSUInteger n;
+	const NSUInteger* indexes = [self indexesIntersectingRects:rects
+														 count:count
+												   resultCount:&n];
 	[mResults removeAllIndexes];
 
-	[self recursivelySearchWithRect:rect
-							  index:0];
+	for (NSUInteger i = 0; i < n; ++i)
+		[mResults addIndex:indexes[i]];
+
 	return mResults;
 }
 
+- (NSIndexSet*)itemsIntersectingRect:(NSRect)rect
+{
+	return [self itemsIntersectingRects:&rect
+								  count:1];
+}
+
 - (NSIndexSet*)itemsIntersectingPoint:(NSPoint)point
 {
 	if ([mNodes count] == 0)
 		return nil;
 
-	mOp = kDKOperationAccumulate;
+	NSUInteger n;
+	const NSUInteger* indexes = [self indexesIntersectingPoint:point
+												   resultCount:&n];
 	[mResults removeAllIndexes];
 
-	[self recursivelySearchWithPoint:point
-							   index:0];
+	for (NSUInteger i = 0; i < n; ++i)
+		[mResults addIndex:indexes[i]];
+
 	return mResults;
 }
 
@@ -504,11 +989,29 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 - (void)shiftIndexesStartingAtIndex:(NSUInteger)startIndex by:(NSInteger)delta
 {
 	// when an item is inserted or removed from the main array, all indexes above it will change. This method keeps the tree in synch by
-	// incrementing or decrementing the stored indices to match.
+	// incrementing or decrementing the stored indices to match. Rather than visit every leaf now, the shift is recorded and applied to each
+	// leaf the next time it is used - typically only a few leaves are touched before the next shift comes along.
+
+	if (delta == 0)
+		return;
+
+	if (mPendingShiftCount == kDKBSPMaxPendingShifts)
+		[self applyAllPendingShifts];
+
+	if (mPendingShifts == NULL)
+		mPendingShifts = malloc(sizeof(DKBSPIndexShift) * kDKBSPMaxPendingShifts);
+
+	mPendingShifts[mPendingShiftCount].start = startIndex;
+	mPendingShifts[mPendingShiftCount].delta = delta;
+	++mPendingShiftCount;
+}
 
-	for (NSMutableIndexSet* leafSet in mLeaves)
-		[leafSet shiftIndexesStartingAtIndex:startIndex
-										  by:delta];
+- (NSIndexSet*)indexesInLeafAtIndex:(NSUInteger)indx
+{
+	DKBSPIndexLeaf* leaf = [mLeaves objectAtIndex:indx];
+
+	[self applyPendingShiftsToLeaf:leaf];
+	return [leaf indexSet];
 }
 
 - (NSBezierPath*)debugStorageDivisions
@@ -690,19 +1193,38 @@ static NSUInteger sLeafCount = 0;
 
 - (void)operateOnLeaf:(id)leaf
 {
-	// <leaf> is a pointer to the NSMutableIndexSet at the leaf
+	// <leaf> is a pointer to the DKBSPIndexLeaf at the leaf
+
+	DKBSPIndexLeaf* lf = leaf;
+
+	[self applyPendingShiftsToLeaf:lf];
 
 	switch (mOp) {
 	case kDKOperationInsert:
-		[leaf addIndex:mOpIndex];
+		[lf addIndex:mOpIndex];
 		break;
 
 	case kDKOperationDelete:
-		[leaf removeIndex:mOpIndex];
+		[lf removeIndex:mOpIndex];
 		break;
 
 	case kDKOperationAccumulate:
-		[mResults addIndexes:leaf];
+		// just note the leaf - the leaves found are merged once the search is complete. A leaf can be reached more than once
+		// when searching several rects, but only needs merging once.
+
+		if (lf->mQueryStamp != mQueryStamp && lf->mCount > 0) {
+			lf->mQueryStamp = mQueryStamp;
+
+			if (mHitCount == mHitCapacity) {
+				mHitCapacity = MAX(mHitCapacity * 2, 64U);
+				mHitLeaves = reallocf(mHitLeaves, sizeof(DKBSPLeafCursor) * mHitCapacity);
+				NSAssert(mHitLeaves != NULL, @"unable to allocate BSP query buffer");
+			}
+
+			mHitLeaves[mHitCount].next = lf->mIndexes;
+			mHitLeaves[mHitCount].end = lf->mIndexes + lf->mCount;
+			++mHitCount;
+		}
 		break;
 
 	default:
@@ -714,6 +1236,7 @@ static NSUInteger sLeafCount = 0;
 {
 	[mNodes removeAllObjects];
 	[mLeaves removeAllObjects];
+	mPendingShiftCount = 0;
 }
 
 - (void)allocateLeaves:(NSUInteger)howMany
@@ -730,8 +1253,112 @@ static NSUInteger sLeafCount = 0;
 
 - (void)removeIndex:(NSUInteger)indx
 {
-	for (NSMutableIndexSet* is in mLeaves)
-		[is removeIndex:indx];
+	// this visits every leaf, so it's a convenient point to bring them all up to date
+
+	[self applyAllPendingShifts];
+
+	for (DKBSPIndexLeaf* leaf in mLeaves)
+		[leaf removeIndex:indx];
+}
+
+- (void)applyPendingShiftsToLeaf:(DKBSPIndexLeaf*)leaf
+{
+	while (leaf->mShiftsApplied < mPendingShiftCount) {
+		DKBSPIndexShift* shift = &mPendingShifts[leaf->mShiftsApplied++];
+
+		[leaf shiftIndexesStartingAtIndex:shift->start
+									   by:shift->delta];
+	}
+}
+
+- (void)applyAllPendingShifts
+{
+	if (mPendingShiftCount > 0) {
+		for (DKBSPIndexLeaf* leaf in mLeaves) {
+			[self applyPendingShiftsToLeaf:leaf];
+			leaf->mShiftsApplied = 0;
+		}
+
+		mPendingShiftCount = 0;
+	}
+}
+
+- (void)beginAccumulating
+{
+	mOp = kDKOperationAccumulate;
+	mHitCount = 0;
+	++mQueryStamp;
+}
+
+static inline void siftDownCursor(DKBSPLeafCursor* heap, NSUInteger count, NSUInteger i)
+{
+	// restores the min-heap order (on each cursor's next index) below position <i>
+
+	DKBSPLeafCursor c = heap[i];
+
+	while (YES) {
+		NSUInteger child = (i << 1) + 1;
+
+		if (child >= count)
+			break;
+
+		if (child + 1 < count && *heap[child + 1].next < *heap[child].next)
+			++child;
+
+		if (*heap[child].next >= *c.next)
+			break;
+
+		heap[i] = heap[child];
+		i = child;
+	}
+
+	heap[i] = c;
+}
+
+- (const NSUInteger*)mergeAccumulatedLeavesWithResultCount:(NSUInteger*)resultCount
+{
+	// merges the sorted index arrays of the leaves found by the search into the result buffer, dropping duplicates
+
+	NSUInteger total = 0, n = 0, i;
+
+	for (i = 0; i < mHitCount; ++i)
+		total += mHitLeaves[i].end - mHitLeaves[i].next;
+
+	if (total > mResultCapacity) {
+		mResultCapacity = MAX(total, mResultCapacity * 2);
+		mResultBuffer = reallocf(mResultBuffer, sizeof(NSUInteger) * mResultCapacity);
+		NSAssert(mResultBuffer != NULL, @"unable to allocate BSP query results");
+	}
+
+	if (mHitCount == 1) {
+		memcpy(mResultBuffer, mHitLeaves[0].next, sizeof(NSUInteger) * total);
+		n = total;
+	} else if (mHitCount > 1) {
+		DKBSPLeafCursor* heap = mHitLeaves;
+		NSUInteger heapCount = mHitCount;
+
+		for (i = heapCount / 2; i-- > 0;)
+			siftDownCursor(heap, heapCount, i);
+
+		while (heapCount > 0) {
+			NSUInteger indx = *heap[0].next++;
+
+			if (n == 0 || mResultBuffer[n - 1] != indx)
+				mResultBuffer[n++] = indx;
+
+			if (heap[0].next == heap[0].end)
+				heap[0] = heap[--heapCount];
+
+			if (heapCount > 0)
+				siftDownCursor(heap, heapCount, 0);
+		}
+	}
+
+	mHitCount = 0;
+	mResultCount = n;
+	*resultCount = n;
+
+	return (n > 0) ? mResultBuffer : NULL;
 }
 
 #pragma mark -
@@ -743,4 +1370,11 @@ static NSUInteger sLeafCount = 0;
 	return [NSString stringWithFormat:@"<%@ %p>, %ld leaves = %@", NSStringFromClass([self class]), self, (long)[self countOfLeaves], mLeaves];
 }
 
+- (void)dealloc
+{
+	free(mResultBuffer);
+	free(mHitLeaves);
+	free(mPendingShifts);
+}
+
 @end
@@ -0,0 +1,116 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Returns the length of a cubic bezier curve.
+
+ The length is found by Gauss-Legendre quadrature, with the interval subdivided wherever the estimated error of the quadrature exceeds
+ \c maxError. This is much faster than measuring the curve by subdividing it into line segments, and more accurate too.
+ @param bez the four control points of the curve
+ @param maxError the acceptable error in the result
+ @return the length of the curve */
+CGFloat DKBezierLength(const NSPoint bez[_Nonnull 4], const CGFloat maxError);
+
+/** @brief Measures many cubic bezier curves at once.
+
+ The curves are measured several at a time using the vector unit, then any curves whose error is too large are measured again as for
+ DKBezierLength(). For long paths made up mostly of curve segments, such as freehand drawings, this is several times faster than
+ measuring each curve separately.
+ @param bez the control points of the curves, four per curve
+ @param count the number of curves
+ @param maxError the acceptable error in each length
+ @param lengths receives the length of each curve, and must have room for \c count values */
+void DKBezierLengths(const NSPoint* bez, const NSInteger count, const CGFloat maxError, CGFloat* lengths);
+
+/** @brief Returns the parameter value of the point on a cubic bezier curve at a given distance from its start.
+ @param bez the four control points of the curve
+ @param length the distance along the curve
+ @param totalLength the length of the whole curve, as returned by DKBezierLength()
+ @param maxError the acceptable error in the distance
+ @return the parameter value, between 0 and 1 */
+CGFloat DKBezierParameterAtLength(const NSPoint bez[_Nonnull 4], const CGFloat length, const CGFloat totalLength, const CGFloat maxError);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @brief The length of every segment of a path, for finding points at given distances along it.
+
+ The length of every segment of a path, for finding points at given distances along it. The table is built in a single pass over the path,
+ measuring its curves all together, after which the point at any distance is found by a binary search for the segment containing it and
+ the evaluation of that one segment, rather than by measuring the path up to that point again. It's worth making one whenever more than one
+ point on the same path is wanted.
+
+ The table doesn't keep the path, so it must be made again if the path changes. Move-to elements start a new subpath but don't add to the length.
+ Tables are immutable, so may be shared between threads. Rather than making one directly, it's usually better to ask for a shared table with
+ +arcLengthTableForPath: (or -[NSBezierPath arcLengthTable]), which returns the same table for as long as the path is unchanged.
+*/
+@interface DKBezierArcLengthTable : NSObject {
+@private
+	struct DKArcLengthSegment* mSegments;
+	NSInteger mCount;
+	CGFloat mLength;
+	CGFloat mMaxError;
+}
+
+/** @brief Returns a shared table for a path, with an acceptable error of 0.1.
+
+ Recently used tables are kept, keyed by the path's checksum, and are checked against the path before being returned, so a path that
+ hasn't changed since its table was made gets the same table back without its curves being measured again.
+ @param path the path
+ @return the table */
++ (DKBezierArcLengthTable*)arcLengthTableForPath:(NSBezierPath*)path;
+
+/** @brief Makes a table for a path, with an acceptable error of 0.1.
+ @param path the path
+ @return the table */
+- (instancetype)initWithPath:(NSBezierPath*)path;
+
+/** @brief Makes a table for a path.
+ @param path the path
+ @param maxError the acceptable error in the lengths
+ @return the table */
+- (instancetype)initWithPath:(NSBezierPath*)path maximumError:(CGFloat)maxError NS_DESIGNATED_INITIALIZER;
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+
+/** @brief The total length of the path.
+ */
+@property (readonly) CGFloat length;
+
+/** @brief The number of line and curve segments in the path, counting close-path elements as lines.
+ */
+@property (readonly) NSInteger countOfSegments;
+
+/** @brief Returns the point at a given distance from the start of the path.
+ @param length the distance along the path - values outside the path are pinned to its ends
+ @param slope if not \c NULL, receives the angle of the path's tangent at the point, in radians
+ @return the point, or NSZeroPoint if the path has no segments */
+- (NSPoint)pointAtLength:(CGFloat)length slope:(nullable CGFloat*)slope;
+
+/** @brief Returns the angle of the path's tangent at a given distance from the start of the path.
+ @param length the distance along the path - values outside the path are pinned to its ends
+ @return the angle, in radians */
+- (CGFloat)slopeAtLength:(CGFloat)length;
+
+/** @brief Returns the part of the path between two distances from its start.
+
+ Curves that are cut are split exactly, so the result lies on the original path. Subpaths within the range are kept separate, and those that
+ are wholly within it remain closed.
+ @param startLength the distance along the path to start from
+ @param endLength the distance along the path to finish at
+ @return a new path, which is empty if the range doesn't overlap the path */
+- (NSBezierPath*)bezierPathFromLength:(CGFloat)startLength toLength:(CGFloat)endLength;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,635 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKBezierArcLengthTable.h"
+#import "DKDrawKitMacros.h"
+#import "DKGeometryUtilities.h"
+#import "NSBezierPath+Editing.h"
+#include <simd/simd.h>
+
+/// the most times an interval of a curve is halved when its quadrature error is too large - enough to cope with cusps
+#define kDKMaxLengthSubdivisions 16
+/// the most Newton steps taken to find the parameter for a length
+#define kDKMaxParameterIterations 20
+/// the number of shared tables kept by +arcLengthTableForPath:
+#define kDKArcLengthTableCacheLimit 64
+/// the acceptable error of shared tables
+#define kDKDefaultArcLengthError 0.1
+
+// Gauss-Kronrod 7-15 point rule on [-1, 1]. The nodes are symmetric about 0 so only the positive half is listed, centre last. Every other node,
+// and the centre, is also a node of the 7-point Gauss-Legendre rule, so both estimates come from the same 15 evaluations and the difference
+// between them is a good (pessimistic) estimate of the error.
+
+static const double sKronrodNodes[8] = {
+	0.991455371120812639206854697526329,
+	0.949107912342758524526189684047851,
+	0.864864423359769072789712788640926,
+	0.741531185599394439863864773280788,
+	0.586087235467691130294144845693013,
+	0.405845151377397166906606412076961,
+	0.207784955007898467600689403773245,
+	0.0
+};
+
+static const double sKronrodWeights[8] = {
+	0.022935322010529224963732008058970,
+	0.063092092629978553290700663189204,
+	0.104790010322250183839876322541518,
+	0.140653259715525918745189590510238,
+	0.169004726639267902826583426598550,
+	0.190350578064785409913256402421014,
+	0.204432940075298892414161999234649,
+	0.209482141084727828012999174891714
+};
+
+static const double sGaussWeights[4] = {
+	0.129484966168869693270611432679082,
+	0.279705391489276667901467771423780,
+	0.381830050505118944950369775488975,
+	0.417959183673469387755102040816327
+};
+
+/// one line or curve segment of a path
+typedef struct DKArcLengthSegment {
+	NSPoint p[4]; // the control points - for a line, the ends are p[0] and p[3]
+	CGFloat start; // the distance from the start of the path to the start of the segment
+	CGFloat length;
+	NSInteger element; // the index of the path element the segment was made from
+	BOOL isCurve;
+	BOOL isClose; // made from a close-path element
+	BOOL startsSubpath; // the first segment after a move-to
+} DKArcLengthSegment;
+
+/// the coefficients of the derivative of a cubic bezier, which is the quadratic at^2 + bt + c
+typedef struct {
+	NSPoint a, b, c;
+} DKBezierDerivative;
+
+static inline DKBezierDerivative derivativeOfBezier(const NSPoint bez[4])
+{
+	DKBezierDerivative d;
+
+	d.c.x = 3.0 * (bez[1].x - bez[0].x);
+	d.c.y = 3.0 * (bez[1].y - bez[0].y);
+	d.b.x = 6.0 * (bez[2].x - 2.0 * bez[1].x + bez[0].x);
+	d.b.y = 6.0 * (bez[2].y - 2.0 * bez[1].y + bez[0].y);
+	d.a.x = 3.0 * (bez[3].x - bez[0].x) + 9.0 * (bez[1].x - bez[2].x);
+	d.a.y = 3.0 * (bez[3].y - bez[0].y) + 9.0 * (bez[1].y - bez[2].y);
+
+	return d;
+}
+
+static inline CGFloat speedAtT(const DKBezierDerivative* d, const CGFloat t)
+{
+	CGFloat dx = (d->a.x * t + d->b.x) * t + d->c.x;
+	CGFloat dy = (d->a.y * t + d->b.y) * t + d->c.y;
+
+	return sqrt(dx * dx + dy * dy);
+}
+
+static CGFloat lengthOfInterval(const DKBezierDerivative* d, const CGFloat t0, const CGFloat t1, CGFloat* error)
+{
+	// the length of the curve between t0 and t1, which is negative if t1 < t0
+
+	CGFloat half = 0.5 * (t1 - t0);
+	CGFloat mid = 0.5 * (t0 + t1);
+	CGFloat kronrod = 0, gauss = 0, s;
+	NSInteger i;
+
+	for (i = 0; i < 7; ++i) {
+		s = speedAtT(d, mid - half * sKronrodNodes[i]) + speedAtT(d, mid + half * sKronrodNodes[i]);
+		kronrod += sKronrodWeights[i] * s;
+
+		if (i & 1)
+			gauss += sGaussWeights[i >> 1] * s;
+	}
+
+	s = speedAtT(d, mid);
+	kronrod += sKronrodWeights[7] * s;
+	gauss += sGaussWeights[3] * s;
+
+	if (error)
+		*error = fabs((kronrod - gauss) * half);
+
+	return kronrod * half;
+}
+
+static CGFloat adaptiveLengthOfInterval(const DKBezierDerivative* d, const CGFloat t0, const CGFloat t1, const CGFloat maxError, const NSInteger depth)
+{
+	CGFloat error;
+	CGFloat length = lengthOfInterval(d, t0, t1, &error);
+
+	if (error <= maxError || depth <= 0)
+		return length;
+
+	CGFloat tm = 0.5 * (t0 + t1);
+
+	return adaptiveLengthOfInterval(d, t0, tm, 0.5 * maxError, depth - 1) + adaptiveLengthOfInterval(d, tm, t1, 0.5 * maxError, depth - 1);
+}
+
+static inline simd_double4 batchSpeedAtT(const simd_double4 ax, const simd_double4 bx, const simd_double4 cx, const simd_double4 ay, const simd_double4 by, const simd_double4 cy, const double t)
+{
+	simd_double4 dx = (ax * t + bx) * t + cx;
+	simd_double4 dy = (ay * t + by) * t + cy;
+
+	return simd_sqrt(dx * dx + dy * dy);
+}
+
+static inline NSPoint pointOnBezierAtT(const NSPoint bez[4], const CGFloat t)
+{
+	CGFloat mt = 1.0 - t;
+	CGFloat a = mt * mt * mt, b = 3.0 * mt * mt * t, c = 3.0 * mt * t * t, e = t * t * t;
+
+	return NSMakePoint(a * bez[0].x + b * bez[1].x + c * bez[2].x + e * bez[3].x, a * bez[0].y + b * bez[1].y + c * bez[2].y + e * bez[3].y);
+}
+
+static CGFloat slopeOfBezierAtT(const NSPoint bez[4], CGFloat t)
+{
+	DKBezierDerivative d = derivativeOfBezier(bez);
+	CGFloat dx = (d.a.x * t + d.b.x) * t + d.c.x;
+	CGFloat dy = (d.a.y * t + d.b.y) * t + d.c.y;
+
+	// where a control point coincides with its end point the tangent there has no length, so take it from just inside the curve instead
+
+	if (fabs(dx) < 1e-9 && fabs(dy) < 1e-9) {
+		t = (t < 0.5) ? t + 1e-3 : t - 1e-3;
+		dx = (d.a.x * t + d.b.x) * t + d.c.x;
+		dy = (d.a.y * t + d.b.y) * t + d.c.y;
+	}
+
+	return atan2(dy, dx);
+}
+
+static void splitBezierAtT(const NSPoint bez[4], NSPoint left[4], NSPoint right[4], const CGFloat t)
+{
+	// de Casteljau's construction. Either result may be NULL if it's not wanted.
+
+	CGFloat mt = 1.0 - t;
+	NSPoint ab, bc, cd, abc, bcd, m;
+
+	ab = NSMakePoint(mt * bez[0].x + t * bez[1].x, mt * bez[0].y + t * bez[1].y);
+	bc = NSMakePoint(mt * bez[1].x + t * bez[2].x, mt * bez[1].y + t * bez[2].y);
+	cd = NSMakePoint(mt * bez[2].x + t * bez[3].x, mt * bez[2].y + t * bez[3].y);
+	abc = NSMakePoint(mt * ab.x + t * bc.x, mt * ab.y + t * bc.y);
+	bcd = NSMakePoint(mt * bc.x + t * cd.x, mt * bc.y + t * cd.y);
+	m = NSMakePoint(mt * abc.x + t * bcd.x, mt * abc.y + t * bcd.y);
+
+	if (left) {
+		left[0] = bez[0];
+		left[1] = ab;
+		left[2] = abc;
+		left[3] = m;
+	}
+
+	if (right) {
+		right[0] = m;
+		right[1] = bcd;
+		right[2] = cd;
+		right[3] = bez[3];
+	}
+}
+
+static inline BOOL samePoint(const NSPoint a, const NSPoint b)
+{
+	return a.x == b.x && a.y == b.y;
+}
+
+#pragma mark -
+
+CGFloat DKBezierLength(const NSPoint bez[4], const CGFloat maxError)
+{
+	DKBezierDerivative d = derivativeOfBezier(bez);
+
+	return adaptiveLengthOfInterval(&d, 0, 1, maxError, kDKMaxLengthSubdivisions);
+}
+
+void DKBezierLengths(const NSPoint* bez, const NSInteger count, const CGFloat maxError, CGFloat* lengths)
+{
+	NSInteger i, j, k;
+
+	for (i = 0; i < count; i += 4) {
+		// each lane of the vectors is one curve. Lanes past the end of the list are left as curves of no length.
+
+		NSInteger lanes = MIN(count - i, 4);
+		const NSPoint* p = bez + 4 * i;
+		simd_double4 px[4] = { 0 }, py[4] = { 0 };
+
+		for (j = 0; j < lanes; ++j) {
+			for (k = 0; k < 4; ++k) {
+				px[k][j] = p[4 * j + k].x;
+				py[k][j] = p[4 * j + k].y;
+			}
+		}
+
+		simd_double4 cx = 3.0 * (px[1] - px[0]);
+		simd_double4 cy = 3.0 * (py[1] - py[0]);
+		simd_double4 bx = 6.0 * (px[2] - 2.0 * px[1] + px[0]);
+		simd_double4 by = 6.0 * (py[2] - 2.0 * py[1] + py[0]);
+		simd_double4 ax = 3.0 * (px[3] - px[0]) + 9.0 * (px[1] - px[2]);
+		simd_double4 ay = 3.0 * (py[3] - py[0]) + 9.0 * (py[1] - py[2]);
+		simd_double4 kronrod = 0, gauss = 0, s;
+
+		for (k = 0; k < 7; ++k) {
+			s = batchSpeedAtT(ax, bx, cx, ay, by, cy, 0.5 - 0.5 * sKronrodNodes[k]) + batchSpeedAtT(ax, bx, cx, ay, by, cy, 0.5 + 0.5 * sKronrodNodes[k]);
+			kronrod += sKronrodWeights[k] * s;
+
+			if (k & 1)
+				gauss += sGaussWeights[k >> 1] * s;
+		}
+
+		s = batchSpeedAtT(ax, bx, cx, ay, by, cy, 0.5);
+		kronrod += sKronrodWeights[7] * s;
+		gauss += sGaussWeights[3] * s;
+
+		simd_double4 error = 0.5 * simd_abs(kronrod - gauss);
+		kronrod *= 0.5;
+
+		// the few curves that the single rule can't measure well enough (those with sharp bends or cusps) are measured again adaptively
+
+		for (j = 0; j < lanes; ++j) {
+			if (error[j] <= maxError)
+				lengths[i + j] = kronrod[j];
+			else
+				lengths[i + j] = DKBezierLength(p + 4 * j, maxError);
+		}
+	}
+}
+
+CGFloat DKBezierParameterAtLength(const NSPoint bez[4], const CGFloat length, const CGFloat totalLength, const CGFloat maxError)
+{
+	if (length <= 0 || totalLength <= 0)
+		return 0;
+
+	if (length >= totalLength)
+		return 1;
+
+	// Newton's method on s(t) - length, where s(t) is the length of the curve up to t and so its derivative is the speed at t. The root is
+	// kept bracketed, and a step that would leave the bracket is replaced by bisection. Each step measures only the interval between the
+	// old and new estimates rather than the whole curve up to the new one.
+
+	DKBezierDerivative d = derivativeOfBezier(bez);
+	CGFloat tolerance = 0.01 * maxError;
+	CGFloat lo = 0, hi = 1;
+	CGFloat t = length / totalLength;
+	CGFloat s = adaptiveLengthOfInterval(&d, 0, t, 0.5 * maxError, kDKMaxLengthSubdivisions);
+	NSInteger i;
+
+	for (i = 0; i < kDKMaxParameterIterations; ++i) {
+		CGFloat diff = s - length;
+
+		if (fabs(diff) <= tolerance)
+			break;
+
+		if (diff > 0)
+			hi = t;
+		else
+			lo = t;
+
+		CGFloat speed = speedAtT(&d, t);
+		CGFloat next = (speed > 0) ? t - diff / speed : -1;
+
+		if (next <= lo || next >= hi)
+			next = 0.5 * (lo + hi);
+
+		s += adaptiveLengthOfInterval(&d, t, next, 0.5 * maxError, kDKMaxLengthSubdivisions);
+		t = next;
+	}
+
+	return t;
+}
+
+#pragma mark -
+
+@interface DKBezierArcLengthTable ()
+
+- (BOOL)isTableForPath:(NSBezierPath*)path;
+- (NSInteger)indexOfSegmentAtLength:(CGFloat)length excludingEnds:(BOOL)excludeEnds;
+
+@end
+
+#pragma mark -
+
+@implementation DKBezierArcLengthTable
+
++ (DKBezierArcLengthTable*)arcLengthTableForPath:(NSBezierPath*)path
+{
+	static NSCache* sSharedTables = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sSharedTables = [[NSCache alloc] init];
+		[sSharedTables setCountLimit:kDKArcLengthTableCacheLimit];
+	});
+
+	// the checksum only says that the path is probably the same, so the table is checked against it too. That's a lot quicker than measuring
+	// the path again.
+
+	NSNumber* key = @([path checksum]);
+	DKBezierArcLengthTable* table = [sSharedTables objectForKey:key];
+
+	if (table == nil || ![table isTableForPath:path]) {
+		table = [[self alloc] initWithPath:path
+							  maximumError:kDKDefaultArcLengthError];
+		[sSharedTables setObject:table
+						  forKey:key];
+	}
+
+	return table;
+}
+
+#pragma mark -
+
+- (instancetype)initWithPath:(NSBezierPath*)path
+{
+	return [self initWithPath:path
+				 maximumError:kDKDefaultArcLengthError];
+}
+
+- (instancetype)initWithPath:(NSBezierPath*)path maximumError:(CGFloat)maxError
+{
+	self = [super init];
+	if (self) {
+		NSInteger i, ec = [path elementCount];
+		NSInteger curveCount = 0;
+		NSPoint ap[3];
+		NSPoint lastPoint = NSZeroPoint;
+		NSPoint pointForClose = NSZeroPoint;
+		BOOL startsSubpath = YES;
+		DKArcLengthSegment* seg;
+
+		mMaxError = maxError;
+		mSegments = malloc(sizeof(DKArcLengthSegment) * MAX(ec, 1));
+
+		if (mSegments == NULL)
+			return nil;
+
+		// first pass - make the segments, measuring the lines as we go
+
+		for (i = 0; i < ec; ++i) {
+			NSBezierPathElement element = [path elementAtIndex:i
+											  associatedPoints:ap];
+
+			if (element == NSMoveToBezierPathElement) {
+				pointForClose = lastPoint = ap[0];
+				startsSubpath = YES;
+				continue;
+			}
+
+			seg = &mSegments[mCount++];
+			seg->element = i;
+			seg->p[0] = lastPoint;
+			seg->isClose = (element == NSClosePathBezierPathElement);
+			seg->startsSubpath = startsSubpath;
+			startsSubpath = NO;
+
+			if (element == NSCurveToBezierPathElement) {
+				seg->p[1] = ap[0];
+				seg->p[2] = ap[1];
+				seg->p[3] = ap[2];
+				seg->isCurve = YES;
+				++curveCount;
+			} else {
+				seg->p[3] = seg->isClose ? pointForClose : ap[0];
+				seg->p[1] = seg->p[0];
+				seg->p[2] = seg->p[3];
+				seg->length = hypot(seg->p[3].x - seg->p[0].x, seg->p[3].y - seg->p[0].y);
+				seg->isCurve = NO;
+			}
+
+			lastPoint = seg->p[3];
+		}
+
+		// second pass - measure all the curves together
+
+		if (curveCount > 0) {
+			NSPoint* curves = malloc(sizeof(NSPoint) * 4 * curveCount);
+			CGFloat* lengths = malloc(sizeof(CGFloat) * curveCount);
+			NSInteger k = 0;
+
+			if (curves && lengths) {
+				for (i = 0; i < mCount; ++i) {
+					if (mSegments[i].isCurve)
+						memcpy(&curves[4 * k++], mSegments[i].p, sizeof(NSPoint) * 4);
+				}
+
+				DKBezierLengths(curves, curveCount, maxError, lengths);
+
+				for (i = 0, k = 0; i < mCount; ++i) {
+					if (mSegments[i].isCurve)
+						mSegments[i].length = lengths[k++];
+				}
+			} else {
+				for (i = 0; i < mCount; ++i) {
+					if (mSegments[i].isCurve)
+						mSegments[i].length = DKBezierLength(mSegments[i].p, maxError);
+				}
+			}
+
+			free(curves);
+			free(lengths);
+		}
+
+		// final pass - accumulate the distances
+
+		for (i = 0; i < mCount; ++i) {
+			mSegments[i].start = mLength;
+			mLength += mSegments[i].length;
+		}
+	}
+
+	return self;
+}
+
+@synthesize length = mLength;
+@synthesize countOfSegments = mCount;
+
+- (NSPoint)pointAtLength:(CGFloat)length slope:(CGFloat*)slope
+{
+	if (mCount == 0) {
+		if (slope)
+			*slope = 0;
+
+		return NSZeroPoint;
+	}
+
+	DKArcLengthSegment* seg = &mSegments[[self indexOfSegmentAtLength:length
+													   excludingEnds:NO]];
+	CGFloat within = LIMIT(length - seg->start, 0, seg->length);
+	NSPoint p;
+
+	if (seg->isCurve) {
+		CGFloat t = DKBezierParameterAtLength(seg->p, within, seg->length, mMaxError);
+
+		p = pointOnBezierAtT(seg->p, t);
+
+		if (slope)
+			*slope = slopeOfBezierAtT(seg->p, t);
+	} else {
+		p = Interpolate(seg->p[0], seg->p[3], (seg->length > 0) ? within / seg->length : 0);
+
+		if (slope)
+			*slope = Slope(seg->p[0], seg->p[3]);
+	}
+
+	return p;
+}
+
+- (CGFloat)slopeAtLength:(CGFloat)length
+{
+	CGFloat slope = 0;
+
+	[self pointAtLength:length
+				  slope:&slope];
+
+	return slope;
+}
+
+- (NSBezierPath*)bezierPathFromLength:(CGFloat)startLength toLength:(CGFloat)endLength
+{
+	NSBezierPath* path = [NSBezierPath bezierPath];
+
+	startLength = MAX(startLength, 0);
+	endLength = MIN(endLength, mLength);
+
+	if (mCount == 0 || endLength <= startLength)
+		return path;
+
+	NSInteger i = [self indexOfSegmentAtLength:startLength
+								 excludingEnds:YES];
+	NSInteger last = [self indexOfSegmentAtLength:endLength
+									excludingEnds:NO];
+	BOOL closable = NO;
+
+	for (; i <= last; ++i) {
+		DKArcLengthSegment* seg = &mSegments[i];
+		CGFloat from = MAX(startLength - seg->start, 0);
+		CGFloat to = MIN(endLength - seg->start, seg->length);
+		BOOL whole = (from <= 0 && to >= seg->length);
+		NSPoint part[4];
+
+		if (whole)
+			memcpy(part, seg->p, sizeof(NSPoint) * 4);
+		else if (seg->isCurve) {
+			// cut off the end first, then find the start as a proportion of what's left
+
+			CGFloat t0 = DKBezierParameterAtLength(seg->p, from, seg->length, mMaxError);
+			CGFloat t1 = DKBezierParameterAtLength(seg->p, to, seg->length, mMaxError);
+			NSPoint left[4];
+
+			splitBezierAtT(seg->p, left, NULL, t1);
+			splitBezierAtT(left, NULL, part, (t1 > 0) ? t0 / t1 : 0);
+		} else {
+			CGFloat f0 = (seg->length > 0) ? from / seg->length : 0;
+			CGFloat f1 = (seg->length > 0) ? to / seg->length : 0;
+
+			part[0] = Interpolate(seg->p[0], seg->p[3], f0);
+			part[3] = Interpolate(seg->p[0], seg->p[3], f1);
+		}
+
+		// a subpath can only be closed in the result if it was started from its beginning
+
+		if ([path isEmpty] || seg->startsSubpath) {
+			[path moveToPoint:part[0]];
+			closable = seg->startsSubpath && from <= 0;
+		}
+
+		if (seg->isCurve)
+			[path curveToPoint:part[3]
+				 controlPoint1:part[1]
+				 controlPoint2:part[2]];
+		else if (seg->isClose && closable && whole)
+			[path closePath];
+		else
+			[path lineToPoint:part[3]];
+	}
+
+	return path;
+}
+
+#pragma mark -
+
+- (BOOL)isTableForPath:(NSBezierPath*)path
+{
+	// YES if the table was made from exactly this path
+
+	NSInteger i, k = 0, ec = [path elementCount];
+	NSPoint ap[3];
+	NSPoint lastPoint = NSZeroPoint;
+	NSPoint pointForClose = NSZeroPoint;
+
+	for (i = 0; i < ec; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+
+		if (element == NSMoveToBezierPathElement) {
+			pointForClose = lastPoint = ap[0];
+			continue;
+		}
+
+		if (k >= mCount)
+			return NO;
+
+		DKArcLengthSegment* seg = &mSegments[k++];
+
+		if (seg->element != i || !samePoint(seg->p[0], lastPoint))
+			return NO;
+
+		switch (element) {
+		case NSCurveToBezierPathElement:
+			if (!seg->isCurve || !samePoint(seg->p[1], ap[0]) || !samePoint(seg->p[2], ap[1]) || !samePoint(seg->p[3], ap[2]))
+				return NO;
+			break;
+
+		case NSClosePathBezierPathElement:
+			if (!seg->isClose || !samePoint(seg->p[3], pointForClose))
+				return NO;
+			break;
+
+		default:
+			if (seg->isCurve || seg->isClose || !samePoint(seg->p[3], ap[0]))
+				return NO;
+			break;
+		}
+
+		lastPoint = seg->p[3];
+	}
+
+	return k == mCount;
+}
+
+- (NSInteger)indexOfSegmentAtLength:(CGFloat)length excludingEnds:(BOOL)excludeEnds
+{
+	// binary search for the first segment that ends beyond the length - or at it, unless excluding ends. Lengths beyond the end of the
+	// path fall in the last segment.
+
+	NSInteger lo = 0, hi = mCount - 1;
+
+	while (lo < hi) {
+		NSInteger mid = (lo + hi) / 2;
+		CGFloat end = mSegments[mid].start + mSegments[mid].length;
+
+		if (end < length || (excludeEnds && end == length))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (void)dealloc
+{
+	free(mSegments);
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %ld segments, length = %g", NSStringFromClass([self class]), self, (long)mCount, mLength];
+}
+
+@end
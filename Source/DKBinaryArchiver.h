@@ -0,0 +1,176 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class DKImageDataManager;
+
+/** @brief The version of the binary archive format written by DKBinaryArchiver.
+ */
+extern const uint32_t kDKBinaryArchiveVersion;
+
+/** @brief A keyed archiver that streams an object graph to a file in DrawKit's chunked binary format.
+
+ A keyed archiver that streams an object graph to a file in DrawKit's chunked binary format. It takes the same keyed coding calls as
+ \c NSKeyedArchiver, so anything that can be archived with \c -encodeWithCoder: can be written with it, but rather than building the whole
+ archive as a property list in memory, it writes the file as it goes and only holds on to the part of the graph still being encoded.
+
+ The file is a header followed by chunks, each a four-character type, a length and a payload:
+
+ - \c SECT a section of object records. Every layer below the root object gets a section of its own, written out as soon as the layer has been
+ encoded. All styles share one section, which is the drawing's style table; objects refer to the styles there rather than containing them.
+ - \c BLOB a single large \c NSData, such as image data, kept out of line so that a reader can map it from the file rather than copying it.
+ - \c STRS the string table, holding every class name, key and string value once.
+ - \c INDX the file offset of every object's record, by object number.
+ - \c LAYR the layer sections, listing each layer's object number and the extent of its section.
+ - \c ROOT the top-level keys and the objects encoded under them.
+
+ A fixed trailer at the end of the file locates the last four. Objects refer to each other by number, so a reader can decode any part of the
+ graph on its own without reading what comes before it, and objects that are shared are stored once. Foundation and AppKit objects other than
+ strings, numbers, data and collections are stored as a small \c NSKeyedArchiver archive of their own.
+*/
+@interface DKBinaryArchiver : NSCoder {
+@private
+	NSFileHandle* mFileHandle;
+	unsigned long long mFileOffset;
+	NSMapTable* mObjectIDs; // object -> number; keeps the objects alive so their addresses can't be reused by new ones
+	NSMutableIndexSet* mConditionalIDs; // numbers given out for conditional references to objects not yet encoded
+	NSMutableData* mRecordOffsets; // the file offset of each object's record, by number
+	NSMutableDictionary<NSString*, NSNumber*>* mStringIDs;
+	NSMutableArray<NSString*>* mStrings;
+	NSMutableDictionary<NSString*, NSNumber*>* mClassIDs; // class name -> string number of its class chain
+	NSMutableArray* mSections; // the sections being built, innermost last
+	NSMutableArray* mRecords; // the records being built, innermost last
+	id mStyleSection; // the section holding every style
+	NSMutableData* mLayerDirectory; // object number, offset and length of each layer section written
+	NSMutableDictionary<NSString*, NSNumber*>* mRootObjects;
+	id mRootObject;
+	BOOL mFinished;
+}
+
+/** @brief Writes an object graph to a file in the binary format.
+ @param rootObject the object to archive, under the key "root"
+ @param url the file to write; it is replaced if it exists
+ @param error receives an error if the file couldn't be written
+ @return YES if the file was written
+ */
++ (BOOL)archiveRootObject:(id)rootObject toURL:(NSURL*)url error:(NSError* _Nullable __autoreleasing* _Nullable)error;
+
+/** @brief Initializes an archiver that writes to a file handle, starting at its current position.
+ @param fileHandle a file handle open for writing
+ @return the archiver
+ */
+- (instancetype)initForWritingWithFileHandle:(NSFileHandle*)fileHandle NS_DESIGNATED_INITIALIZER;
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+
+/** @brief Writes the string table, index and trailer. No more objects may be encoded afterwards.
+ */
+- (void)finishEncoding;
+
+@end
+
+#pragma mark -
+
+/** @brief Decodes an object graph from DrawKit's chunked binary format.
+
+ Decodes an object graph from DrawKit's chunked binary format. Objects are decoded when they're first asked for, by looking up their record
+ in the index, so only the parts of the file that are used are read; given mapped data, the rest of the file is never paged in. Large data
+ objects refer directly to the bytes in the file without copying them.
+
+ Like \c DKKeyedUnarchiver, it carries a reference to the drawing's image manager. Its delegate is sent the same class substitution and
+ progress messages as an \c NSKeyedUnarchiver delegate, so \c DKUnarchivingHelper works with either.
+*/
+@interface DKBinaryUnarchiver : NSCoder {
+@private
+	NSData* mData;
+	const uint8_t* mBytes;
+	NSUInteger mLength;
+	NSArray<NSString*>* mStrings;
+	NSDictionary<NSString*, NSNumber*>* mStringIDs;
+	const uint8_t* mIndex;
+	uint32_t mObjectCount;
+	__strong id* mObjects; // the objects decoded so far, by number
+	NSDictionary<NSString*, NSNumber*>* mRootObjects;
+	NSArray<NSNumber*>* mLayerIDs;
+	NSMutableDictionary<NSNumber*, Class>* mClasses;
+	NSMutableData* mFrames; // the records being decoded, innermost last
+	id __weak mDelegate;
+	DKImageDataManager* __unsafe_unretained mImageManagerRef;
+}
+
+/** @brief Returns whether the data is in the binary archive format, judging from its header.
+ */
++ (BOOL)canReadData:(NSData*)data;
+
+/** @brief Initializes an unarchiver with archived data.
+
+ The data should preferably be mapped from the file, in which case only the parts of the file that are decoded will be read.
+ @param data data in the binary archive format
+ @return the unarchiver, or nil if the data isn't a readable binary archive
+ */
+- (nullable instancetype)initForReadingWithData:(NSData*)data NS_DESIGNATED_INITIALIZER;
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+
+/** @brief The delegate, which is sent the \c NSKeyedUnarchiverDelegate messages.
+ */
+@property (weak, nullable) id delegate;
+
+/** @brief The image manager for objects that dearchive their images through one.
+
+ Not retained because it's retained by the drawing and the unarchiver's lifetime is limited.
+ */
+@property (unsafe_unretained, nullable) DKImageDataManager* imageManager;
+
+/** @brief The object numbers of the layers that have their own sections, in the order they were written.
+ */
+@property (readonly, copy) NSArray<NSNumber*>* layerObjectIDs;
+
+/** @brief The archived data, from which other unarchivers can decode parts of the graph independently.
+ */
+@property (readonly, strong) NSData* data;
+
+/** @brief Returns the object with the given number, decoding it and anything it refers to if necessary.
+ @param objectID an object number, as given by \c -layerObjectIDs
+ @return the object
+ */
+- (nullable id)decodeObjectWithID:(uint32_t)objectID;
+
+/** @brief Supplies the object for an object number, which is then used wherever it's referred to instead of decoding its record.
+
+ This lets parts of the graph decoded elsewhere, such as by another unarchiver reading the same data on another thread, be joined to it.
+ Supplying nil makes references to the object decode as nil. Has no effect if the object has already been decoded.
+ @param object the object, or nil
+ @param objectID the object number
+ */
+- (void)setObject:(nullable id)object forObjectID:(uint32_t)objectID;
+
+/** @brief Allows an object's archived values to be examined without decoding the object.
+
+ While the block runs, the keyed decoding methods read the object's record. Decoding an object from it decodes that object as usual.
+ @param objectID the object number
+ @param block called with the object's class, or Nil if the object isn't a keyed object
+ */
+- (void)inspectObjectWithID:(uint32_t)objectID usingBlock:(void (^)(Class _Nullable objectClass))block;
+
+/** @brief Returns the number of the object encoded for a key in the record being decoded, without decoding the object.
+
+ Together with \c -decodeObjectWithID: this lets an object defer decoding part of itself until later, for as long as it keeps the
+ unarchiver. Decoding may be resumed from any thread; it is serialized with any other decoding. Outside any record, the top-level
+ keys are looked up.
+ @param key the key
+ @return the object number, or 0 if nothing was encoded for the key
+ */
+- (uint32_t)objectIDForKey:(NSString*)key;
+
+/** @brief Tells the delegate that decoding is complete.
+ */
+- (void)finishDecoding;
+
+@end
+
+NS_ASSUME_NONNULL_END
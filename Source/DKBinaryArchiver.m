@@ -0,0 +1,1819 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKBinaryArchiver.h"
+#import "DKLayer.h"
+#import "DKStyle.h"
+#import "LogEvent.h"
+
+const uint32_t kDKBinaryArchiveVersion = 1;
+
+#define DK_FOURCC(a, b, c, d) ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 | (uint32_t)(d))
+
+#define kDKBinaryArchiveMagic DK_FOURCC('D', 'K', 'B', 'D')
+#define kDKBinaryArchiveTrailerMagic DK_FOURCC('D', 'K', 'B', 'E')
+
+/// data objects at least this long are written as a chunk of their own, and referred to in place when read
+#define kDKBinaryArchiveBlobThreshold (64 * 1024)
+
+// sizes of the fixed parts of the file. The header is the magic number, the version and a reserved word; the trailer is the offsets of the
+// string table, index, layer directory and root table, the version and the magic number again
+
+#define kDKBinaryHeaderSize 16
+#define kDKBinaryChunkHeaderSize 12
+#define kDKBinarySectionHeaderSize 8
+#define kDKBinaryTrailerSize 40
+
+enum {
+	kDKBinaryChunkSection = DK_FOURCC('S', 'E', 'C', 'T'),
+	kDKBinaryChunkBlob = DK_FOURCC('B', 'L', 'O', 'B'),
+	kDKBinaryChunkStrings = DK_FOURCC('S', 'T', 'R', 'S'),
+	kDKBinaryChunkIndex = DK_FOURCC('I', 'N', 'D', 'X'),
+	kDKBinaryChunkLayers = DK_FOURCC('L', 'A', 'Y', 'R'),
+	kDKBinaryChunkRoot = DK_FOURCC('R', 'O', 'O', 'T')
+};
+
+enum {
+	kDKBinarySectionGeneral = 0,
+	kDKBinarySectionLayer = 1,
+	kDKBinarySectionStyles = 2
+};
+
+// the first byte of each object record
+
+enum {
+	kDKBinaryRecordObject = 'O',
+	kDKBinaryRecordString = 'T',
+	kDKBinaryRecordNumber = 'N',
+	kDKBinaryRecordData = 'B',
+	kDKBinaryRecordArray = 'A',
+	kDKBinaryRecordSet = 'S',
+	kDKBinaryRecordDictionary = 'D',
+	kDKBinaryRecordForeign = 'F'
+};
+
+enum {
+	kDKBinaryNumberSigned = 0,
+	kDKBinaryNumberUnsigned = 1,
+	kDKBinaryNumberDouble = 2,
+	kDKBinaryNumberBool = 3
+};
+
+// the type of each keyed field in an object record
+
+enum {
+	kDKBinaryFieldObject = 1,
+	kDKBinaryFieldBool = 2,
+	kDKBinaryFieldInteger = 3,
+	kDKBinaryFieldDouble = 4,
+	kDKBinaryFieldFloat = 5,
+	kDKBinaryFieldBytes = 6,
+	kDKBinaryFieldGeometry = 7,
+	kDKBinaryFieldArray = 8
+};
+
+typedef struct {
+	const uint8_t* fields;
+	uint32_t fieldCount;
+	NSUInteger unkeyedCount;
+} DKBinaryFrame;
+
+static void appendU8(NSMutableData* data, uint8_t value);
+static void appendU32(NSMutableData* data, uint32_t value);
+static void appendU64(NSMutableData* data, uint64_t value);
+static void appendF64(NSMutableData* data, double value);
+static uint32_t readU32(const uint8_t* p);
+static uint64_t readU64(const uint8_t* p);
+static double readF64(const uint8_t* p);
+static void raiseCorrupt(NSString* reason);
+
+#pragma mark -
+
+/// an object record being built, into which its keyed fields are written
+@interface DKBinaryRecord : NSObject {
+@public
+	NSMutableData* mData;
+	NSUInteger mFieldCountOffset;
+	uint32_t mFieldCount;
+	NSUInteger mUnkeyedCount;
+}
+@end
+
+@implementation DKBinaryRecord
+@end
+
+/// the records of a section being built, and where each one starts
+@interface DKBinarySection : NSObject {
+@public
+	uint32_t mKind;
+	uint32_t mRootID;
+	NSMutableData* mData;
+	NSMutableData* mRecordIDs; // uint32_t object numbers
+	NSMutableData* mRecordOffsets; // uint64_t offsets in mData
+}
+@end
+
+@implementation DKBinarySection
+
+- (instancetype)initWithKind:(uint32_t)kind rootID:(uint32_t)rootID
+{
+	self = [super init];
+	if (self) {
+		mKind = kind;
+		mRootID = rootID;
+		mData = [[NSMutableData alloc] init];
+		mRecordIDs = [[NSMutableData alloc] init];
+		mRecordOffsets = [[NSMutableData alloc] init];
+	}
+
+	return self;
+}
+
+- (void)appendRecord:(NSData*)record objectID:(uint32_t)objectID
+{
+	uint64_t offset = [mData length];
+
+	[mRecordIDs appendBytes:&objectID
+					 length:sizeof(uint32_t)];
+	[mRecordOffsets appendBytes:&offset
+						 length:sizeof(uint64_t)];
+	[mData appendData:record];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKBinaryArchiver ()
+
+- (unsigned long long)writeChunkOfType:(uint32_t)type header:(nullable NSData*)header body:(NSData*)body;
+- (void)writeSection:(DKBinarySection*)section;
+- (void)setRecordOffset:(uint64_t)offset forObjectID:(uint32_t)objectID;
+- (uint32_t)stringID:(NSString*)string;
+- (uint32_t)classIDForObject:(id)object;
+- (uint32_t)encodeObjectReturningID:(nullable id)object conditional:(BOOL)conditional;
+- (void)encodeRecordForObject:(id)object objectID:(uint32_t)objectID;
+- (NSMutableData*)newRecordForObject:(id)object;
+- (NSMutableData*)fieldDataForKey:(NSString*)key type:(uint8_t)type;
+- (NSString*)nextUnkeyedKey;
+
+@end
+
+#pragma mark -
+
+@implementation DKBinaryArchiver
+
++ (BOOL)archiveRootObject:(id)rootObject toURL:(NSURL*)url error:(NSError* _Nullable __autoreleasing*)error
+{
+	NSAssert(rootObject != nil, @"can't archive a nil root object");
+	NSAssert(url != nil, @"URL was nil");
+
+	// write beside the destination and swap the file in when it's complete, so that a failure never leaves a partly written file
+
+	NSFileManager* fm = [NSFileManager defaultManager];
+	NSURL* tempDir = [fm URLForDirectory:NSItemReplacementDirectory
+								inDomain:NSUserDomainMask
+					   appropriateForURL:url
+								  create:YES
+								   error:error];
+	if (tempDir == nil)
+		return NO;
+
+	NSURL* tempURL = [tempDir URLByAppendingPathComponent:[url lastPathComponent]];
+	NSFileHandle* fileHandle = nil;
+
+	if ([fm createFileAtPath:[tempURL path]
+					contents:nil
+				  attributes:nil])
+		fileHandle = [NSFileHandle fileHandleForWritingToURL:tempURL
+													   error:error];
+	else if (error)
+		*error = [NSError errorWithDomain:NSCocoaErrorDomain
+									 code:NSFileWriteUnknownError
+								 userInfo:@{ NSURLErrorKey : tempURL }];
+
+	BOOL result = (fileHandle != nil);
+
+	if (result) {
+		@try {
+			DKBinaryArchiver* archiver = [[self alloc] initForWritingWithFileHandle:fileHandle];
+			[archiver encodeObject:rootObject
+							forKey:@"root"];
+			[archiver finishEncoding];
+		}
+		@catch (NSException* excp) {
+			LogEvent_(kWheneverEvent, @"binary archiving failed: %@", excp);
+
+			result = NO;
+			if (error)
+				*error = [NSError errorWithDomain:NSCocoaErrorDomain
+											 code:NSFileWriteUnknownError
+										 userInfo:@{ NSURLErrorKey : url,
+											 NSLocalizedFailureReasonErrorKey : [excp reason] ?: @"" }];
+		}
+
+		[fileHandle closeFile];
+	}
+
+	if (result) {
+		if ([fm fileExistsAtPath:[url path]])
+			result = [fm replaceItemAtURL:url
+							withItemAtURL:tempURL
+						   backupItemName:nil
+								  options:0
+						 resultingItemURL:NULL
+									error:error];
+		else
+			result = [fm moveItemAtURL:tempURL
+								 toURL:url
+								 error:error];
+	}
+
+	[fm removeItemAtURL:tempDir
+				  error:NULL];
+
+	return result;
+}
+
+- (instancetype)initForWritingWithFileHandle:(NSFileHandle*)fileHandle
+{
+	NSAssert(fileHandle != nil, @"file handle was nil");
+
+	self = [super init];
+	if (self) {
+		mFileHandle = fileHandle;
+		mFileOffset = [fileHandle offsetInFile];
+
+		// objects are matched by address, not equality - two equal mutable arrays are still two arrays
+
+		mObjectIDs = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+											   valueOptions:NSPointerFunctionsStrongMemory
+												   capacity:256];
+		mConditionalIDs = [[NSMutableIndexSet alloc] init];
+		mRecordOffsets = [[NSMutableData alloc] initWithLength:sizeof(uint64_t)]; // object number 0 is nil
+		mStringIDs = [[NSMutableDictionary alloc] init];
+		mStrings = [[NSMutableArray alloc] init];
+		mClassIDs = [[NSMutableDictionary alloc] init];
+		mSections = [[NSMutableArray alloc] init];
+		mRecords = [[NSMutableArray alloc] init];
+		mLayerDirectory = [[NSMutableData alloc] init];
+		mRootObjects = [[NSMutableDictionary alloc] init];
+
+		[mSections addObject:[[DKBinarySection alloc] initWithKind:kDKBinarySectionGeneral
+															rootID:0]];
+
+		NSMutableData* header = [NSMutableData data];
+		appendU32(header, kDKBinaryArchiveMagic);
+		appendU32(header, kDKBinaryArchiveVersion);
+		appendU64(header, 0);
+
+		[mFileHandle writeData:header];
+		mFileOffset += [header length];
+	}
+
+	return self;
+}
+
+- (instancetype)init
+{
+	NSAssert(NO, @"-init is not a valid initializer for the class DKBinaryArchiver");
+	return nil;
+}
+
+- (void)finishEncoding
+{
+	if (mFinished)
+		return;
+
+	mFinished = YES;
+
+	// the general section holds everything that isn't in a layer section or the style table
+
+	[self writeSection:[mSections firstObject]];
+	[mSections removeAllObjects];
+
+	if (mStyleSection) {
+		[self writeSection:mStyleSection];
+		mStyleSection = nil;
+	}
+
+	// the root table goes last but is built first, since its keys add to the string table
+
+	NSMutableData* root = [NSMutableData data];
+	appendU32(root, (uint32_t)[mRootObjects count]);
+
+	for (NSString* key in mRootObjects) {
+		appendU32(root, [self stringID:key]);
+		appendU32(root, [[mRootObjects objectForKey:key] unsignedIntValue]);
+	}
+
+	NSMutableData* strings = [NSMutableData data];
+	appendU32(strings, (uint32_t)[mStrings count]);
+
+	for (NSString* string in mStrings) {
+		NSData* utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+		appendU32(strings, (uint32_t)[utf8 length]);
+		[strings appendData:utf8];
+	}
+
+	uint32_t objectCount = (uint32_t)([mRecordOffsets length] / sizeof(uint64_t));
+	const uint64_t* offsets = [mRecordOffsets bytes];
+	NSMutableData* index = [NSMutableData dataWithCapacity:sizeof(uint32_t) + [mRecordOffsets length]];
+	appendU32(index, objectCount);
+
+	for (uint32_t i = 0; i < objectCount; ++i)
+		appendU64(index, offsets[i]);
+
+	NSMutableData* layers = [NSMutableData data];
+	appendU32(layers, (uint32_t)([mLayerDirectory length] / 20));
+	[layers appendData:mLayerDirectory];
+
+	NSMutableData* trailer = [NSMutableData data];
+	appendU64(trailer, [self writeChunkOfType:kDKBinaryChunkStrings
+									   header:nil
+										 body:strings]);
+	appendU64(trailer, [self writeChunkOfType:kDKBinaryChunkIndex
+									   header:nil
+										 body:index]);
+	appendU64(trailer, [self writeChunkOfType:kDKBinaryChunkLayers
+									   header:nil
+										 body:layers]);
+	appendU64(trailer, [self writeChunkOfType:kDKBinaryChunkRoot
+									   header:nil
+										 body:root]);
+	appendU32(trailer, kDKBinaryArchiveVersion);
+	appendU32(trailer, kDKBinaryArchiveTrailerMagic);
+
+	[mFileHandle writeData:trailer];
+	mFileOffset += [trailer length];
+
+	[mObjectIDs removeAllObjects];
+	mRootObject = nil;
+}
+
+#pragma mark -
+
+- (unsigned long long)writeChunkOfType:(uint32_t)type header:(NSData*)header body:(NSData*)body
+{
+	// returns the file offset of the chunk's payload
+
+	NSMutableData* chunkHeader = [NSMutableData dataWithCapacity:kDKBinaryChunkHeaderSize + [header length]];
+	appendU32(chunkHeader, type);
+	appendU64(chunkHeader, [header length] + [body length]);
+
+	if (header)
+		[chunkHeader appendData:header];
+
+	unsigned long long payloadOffset = mFileOffset + kDKBinaryChunkHeaderSize;
+
+	[mFileHandle writeData:chunkHeader];
+	[mFileHandle writeData:body];
+	mFileOffset += [chunkHeader length] + [body length];
+
+	return payloadOffset;
+}
+
+- (void)writeSection:(DKBinarySection*)section
+{
+	NSUInteger recordCount = [section->mRecordIDs length] / sizeof(uint32_t);
+
+	if (recordCount == 0)
+		return;
+
+	NSMutableData* header = [NSMutableData dataWithCapacity:kDKBinarySectionHeaderSize];
+	appendU32(header, section->mKind);
+	appendU32(header, section->mRootID);
+
+	unsigned long long chunkOffset = mFileOffset;
+	unsigned long long base = [self writeChunkOfType:kDKBinaryChunkSection
+											  header:header
+												body:section->mData]
+		+ kDKBinarySectionHeaderSize;
+
+	const uint32_t* ids = [section->mRecordIDs bytes];
+	const uint64_t* offsets = [section->mRecordOffsets bytes];
+
+	for (NSUInteger i = 0; i < recordCount; ++i)
+		[self setRecordOffset:base + offsets[i]
+				  forObjectID:ids[i]];
+
+	if (section->mKind == kDKBinarySectionLayer) {
+		appendU32(mLayerDirectory, section->mRootID);
+		appendU64(mLayerDirectory, chunkOffset);
+		appendU64(mLayerDirectory, mFileOffset - chunkOffset);
+	}
+
+	// the section's records are on disk now, so its memory can go
+
+	section->mData = nil;
+	section->mRecordIDs = nil;
+	section->mRecordOffsets = nil;
+}
+
+- (void)setRecordOffset:(uint64_t)offset forObjectID:(uint32_t)objectID
+{
+	uint64_t* offsets = [mRecordOffsets mutableBytes];
+	offsets[objectID] = offset;
+}
+
+- (uint32_t)stringID:(NSString*)string
+{
+	NSNumber* num = [mStringIDs objectForKey:string];
+
+	if (num == nil) {
+		num = @((uint32_t)[mStrings count]);
+		string = [string copy];
+
+		[mStrings addObject:string];
+		[mStringIDs setObject:num
+					   forKey:string];
+	}
+
+	return [num unsignedIntValue];
+}
+
+- (uint32_t)classIDForObject:(id)object
+{
+	Class cls = [object classForCoder];
+	NSString* className = NSStringFromClass(cls);
+	NSNumber* num = [mClassIDs objectForKey:className];
+
+	if (num == nil) {
+		// as NSKeyedArchiver records it: the class, its fallbacks, then its superclasses, so a reader without the class can substitute another
+
+		NSMutableArray* names = [NSMutableArray array];
+
+		for (Class c = cls; c != Nil; c = [c superclass]) {
+			[names addObject:[NSKeyedArchiver classNameForClass:c] ?: NSStringFromClass(c)];
+
+			if (c == cls)
+				[names addObjectsFromArray:[cls classFallbacksForKeyedArchiver]];
+		}
+
+		num = @([self stringID:[names componentsJoinedByString:@","]]);
+		[mClassIDs setObject:num
+					  forKey:className];
+	}
+
+	return [num unsignedIntValue];
+}
+
+- (uint32_t)encodeObjectReturningID:(id)object conditional:(BOOL)conditional
+{
+	NSAssert(!mFinished, @"can't encode objects after -finishEncoding");
+
+	object = [object replacementObjectForCoder:self];
+
+	if (object == nil)
+		return 0;
+
+	NSNumber* existing = [mObjectIDs objectForKey:object];
+
+	if (existing) {
+		uint32_t objectID = [existing unsignedIntValue];
+
+		// an object previously only referred to conditionally gets its record when it's first encoded unconditionally
+
+		if (!conditional && [mConditionalIDs containsIndex:objectID]) {
+			[mConditionalIDs removeIndex:objectID];
+			[self encodeRecordForObject:object
+							   objectID:objectID];
+		}
+
+		return objectID;
+	}
+
+	uint32_t objectID = (uint32_t)([mRecordOffsets length] / sizeof(uint64_t));
+
+	[mRecordOffsets increaseLengthBy:sizeof(uint64_t)];
+	[mObjectIDs setObject:@(objectID)
+				   forKey:object];
+
+	if (conditional)
+		[mConditionalIDs addIndex:objectID];
+	else
+		[self encodeRecordForObject:object
+						   objectID:objectID];
+
+	return objectID;
+}
+
+- (void)encodeRecordForObject:(id)object objectID:(uint32_t)objectID
+{
+	if (mRootObject == nil)
+		mRootObject = object;
+
+	// styles go to the style table and each layer other than the root to a section of its own; everything else goes to the section of the
+	// innermost layer or style it's encoded within
+
+	DKBinarySection* section = nil;
+	BOOL isLayerSection = NO;
+
+	if ([object isKindOfClass:[DKStyle class]]) {
+		if (mStyleSection == nil)
+			mStyleSection = [[DKBinarySection alloc] initWithKind:kDKBinarySectionStyles
+														   rootID:0];
+		section = mStyleSection;
+	} else if ([object isKindOfClass:[DKLayer class]] && object != mRootObject) {
+		section = [[DKBinarySection alloc] initWithKind:kDKBinarySectionLayer
+												rootID:objectID];
+		isLayerSection = YES;
+	}
+
+	if (section)
+		[mSections addObject:section];
+
+	NSMutableData* record = [self newRecordForObject:object];
+
+	if ([object isKindOfClass:[NSData class]] && [object length] >= kDKBinaryArchiveBlobThreshold) {
+		[self setRecordOffset:[self writeChunkOfType:kDKBinaryChunkBlob
+											   header:nil
+												 body:record]
+				  forObjectID:objectID];
+	} else
+		[[mSections lastObject] appendRecord:record
+									objectID:objectID];
+
+	if (section) {
+		[mSections removeLastObject];
+
+		if (isLayerSection)
+			[self writeSection:section];
+	}
+}
+
+- (NSMutableData*)newRecordForObject:(id)object
+{
+	NSMutableData* data = [[NSMutableData alloc] init];
+	Class coderClass = [object classForCoder];
+
+	if ([object isKindOfClass:[NSString class]]) {
+		appendU8(data, kDKBinaryRecordString);
+		appendU8(data, [coderClass isSubclassOfClass:[NSMutableString class]]);
+		appendU32(data, [self stringID:object]);
+	} else if ([object isKindOfClass:[NSNumber class]]) {
+		const char* type = [object objCType];
+		uint64_t bits;
+		uint8_t kind;
+
+		if (object == (id)kCFBooleanTrue || object == (id)kCFBooleanFalse) {
+			kind = kDKBinaryNumberBool;
+			bits = [object boolValue];
+		} else if (strcmp(type, @encode(float)) == 0 || strcmp(type, @encode(double)) == 0) {
+			double value = [object doubleValue];
+			kind = kDKBinaryNumberDouble;
+			memcpy(&bits, &value, sizeof(double));
+		} else if (strcmp(type, @encode(unsigned long long)) == 0 || strcmp(type, @encode(unsigned long)) == 0) {
+			kind = kDKBinaryNumberUnsigned;
+			bits = [object unsignedLongLongValue];
+		} else {
+			kind = kDKBinaryNumberSigned;
+			bits = (uint64_t)[object longLongValue];
+		}
+
+		appendU8(data, kDKBinaryRecordNumber);
+		appendU8(data, kind);
+		appendU64(data, bits);
+	} else if ([object isKindOfClass:[NSData class]]) {
+		appendU8(data, kDKBinaryRecordData);
+		appendU8(data, [coderClass isSubclassOfClass:[NSMutableData class]]);
+		appendU64(data, [object length]);
+
+		[object enumerateByteRangesUsingBlock:^(const void* bytes, NSRange byteRange, BOOL* stop) {
+#pragma unused(stop)
+			[data appendBytes:bytes
+					   length:byteRange.length];
+		}];
+	} else if ([object isKindOfClass:[NSArray class]] || [object isKindOfClass:[NSSet class]]) {
+		BOOL isArray = [object isKindOfClass:[NSArray class]];
+
+		appendU8(data, isArray ? kDKBinaryRecordArray : kDKBinaryRecordSet);
+		appendU8(data, [coderClass isSubclassOfClass:isArray ? [NSMutableArray class] : [NSMutableSet class]]);
+		appendU32(data, (uint32_t)[object count]);
+
+		for (id member in object)
+			appendU32(data, [self encodeObjectReturningID:member
+											  conditional:NO]);
+	} else if ([object isKindOfClass:[NSDictionary class]]) {
+		appendU8(data, kDKBinaryRecordDictionary);
+		appendU8(data, [coderClass isSubclassOfClass:[NSMutableDictionary class]]);
+		appendU32(data, (uint32_t)[object count]);
+
+		for (id key in object) {
+			appendU32(data, [self encodeObjectReturningID:key
+											  conditional:NO]);
+			appendU32(data, [self encodeObjectReturningID:[object objectForKey:key]
+											  conditional:NO]);
+		}
+	} else if ([NSStringFromClass(coderClass) hasPrefix:@"NS"]) {
+		// other Foundation and AppKit objects (colours, fonts, dates, values and so on) are archived as they would be anyway
+
+		NSData* archive = [NSKeyedArchiver archivedDataWithRootObject:object];
+
+		appendU8(data, kDKBinaryRecordForeign);
+		appendU64(data, [archive length]);
+		[data appendData:archive];
+	} else {
+		DKBinaryRecord* record = [[DKBinaryRecord alloc] init];
+		record->mData = data;
+
+		appendU8(data, kDKBinaryRecordObject);
+		appendU32(data, [self classIDForObject:object]);
+		record->mFieldCountOffset = [data length];
+		appendU32(data, 0);
+
+		[mRecords addObject:record];
+		[object encodeWithCoder:self];
+		[mRecords removeLastObject];
+
+		// now the number of fields is known
+
+		uint32_t fieldCount = CFSwapInt32HostToLittle(record->mFieldCount);
+		[data replaceBytesInRange:NSMakeRange(record->mFieldCountOffset, sizeof(uint32_t))
+						withBytes:&fieldCount];
+	}
+
+	return data;
+}
+
+- (NSMutableData*)fieldDataForKey:(NSString*)key type:(uint8_t)type
+{
+	// starts a field in the record being built and returns the record's data for the field's value to be appended to
+
+	DKBinaryRecord* record = [mRecords lastObject];
+
+	if (record == nil)
+		[NSException raise:NSInvalidArchiveOperationException
+					format:@"DKBinaryArchiver can only encode objects at the top level (key '%@')", key];
+
+	appendU32(record->mData, [self stringID:key]);
+	appendU8(record->mData, type);
+	record->mFieldCount++;
+
+	return record->mData;
+}
+
+- (NSString*)nextUnkeyedKey
+{
+	DKBinaryRecord* record = [mRecords lastObject];
+	return [NSString stringWithFormat:@"$%lu", (unsigned long)(record ? record->mUnkeyedCount++ : 0)];
+}
+
+#pragma mark -
+#pragma mark As an NSCoder
+
+- (BOOL)allowsKeyedCoding
+{
+	return YES;
+}
+
+- (void)encodeObject:(id)object forKey:(NSString*)key
+{
+	uint32_t objectID = [self encodeObjectReturningID:object
+										  conditional:NO];
+
+	if ([mRecords count] == 0)
+		[mRootObjects setObject:@(objectID)
+						 forKey:key];
+	else
+		appendU32([self fieldDataForKey:key
+								   type:kDKBinaryFieldObject],
+			objectID);
+}
+
+- (void)encodeConditionalObject:(id)object forKey:(NSString*)key
+{
+	uint32_t objectID = [self encodeObjectReturningID:object
+										  conditional:[mRecords count] > 0];
+
+	if ([mRecords count] == 0)
+		[mRootObjects setObject:@(objectID)
+						 forKey:key];
+	else
+		appendU32([self fieldDataForKey:key
+								   type:kDKBinaryFieldObject],
+			objectID);
+}
+
+- (void)encodeBool:(BOOL)value forKey:(NSString*)key
+{
+	appendU8([self fieldDataForKey:key
+							  type:kDKBinaryFieldBool],
+		value ? 1 : 0);
+}
+
+- (void)encodeInt:(int)value forKey:(NSString*)key
+{
+	[self encodeInt64:value
+			   forKey:key];
+}
+
+- (void)encodeInt32:(int32_t)value forKey:(NSString*)key
+{
+	[self encodeInt64:value
+			   forKey:key];
+}
+
+- (void)encodeInteger:(NSInteger)value forKey:(NSString*)key
+{
+	[self encodeInt64:value
+			   forKey:key];
+}
+
+- (void)encodeInt64:(int64_t)value forKey:(NSString*)key
+{
+	appendU64([self fieldDataForKey:key
+							   type:kDKBinaryFieldInteger],
+		(uint64_t)value);
+}
+
+- (void)encodeFloat:(float)value forKey:(NSString*)key
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+
+	appendU32([self fieldDataForKey:key
+							   type:kDKBinaryFieldFloat],
+		bits);
+}
+
+- (void)encodeDouble:(double)value forKey:(NSString*)key
+{
+	appendF64([self fieldDataForKey:key
+							   type:kDKBinaryFieldDouble],
+		value);
+}
+
+- (void)encodeBytes:(const uint8_t*)bytes length:(NSUInteger)length forKey:(NSString*)key
+{
+	NSMutableData* data = [self fieldDataForKey:key
+										   type:kDKBinaryFieldBytes];
+	appendU64(data, length);
+	[data appendBytes:bytes
+			   length:length];
+}
+
+- (void)encodePoint:(NSPoint)point forKey:(NSString*)key
+{
+	NSMutableData* data = [self fieldDataForKey:key
+										   type:kDKBinaryFieldGeometry];
+	appendU8(data, 2);
+	appendF64(data, point.x);
+	appendF64(data, point.y);
+}
+
+- (void)encodeSize:(NSSize)size forKey:(NSString*)key
+{
+	NSMutableData* data = [self fieldDataForKey:key
+										   type:kDKBinaryFieldGeometry];
+	appendU8(data, 2);
+	appendF64(data, size.width);
+	appendF64(data, size.height);
+}
+
+- (void)encodeRect:(NSRect)rect forKey:(NSString*)key
+{
+	NSMutableData* data = [self fieldDataForKey:key
+										   type:kDKBinaryFieldGeometry];
+	appendU8(data, 4);
+	appendF64(data, rect.origin.x);
+	appendF64(data, rect.origin.y);
+	appendF64(data, rect.size.width);
+	appendF64(data, rect.size.height);
+}
+
+// unkeyed coding, which a few classes still use, is stored as keyed fields named in the order they were encoded
+
+- (void)encodeValueOfObjCType:(const char*)type at:(const void*)addr
+{
+	NSString* key = [self nextUnkeyedKey];
+
+	switch (*type) {
+	case _C_ID:
+	case _C_CLASS:
+		[self encodeObject:*(id const __unsafe_unretained*)addr
+					forKey:key];
+		break;
+
+	case _C_CHR:
+		[self encodeInt64:*(const char*)addr
+				   forKey:key];
+		break;
+
+	case _C_UCHR:
+		[self encodeInt64:*(const unsigned char*)addr
+				   forKey:key];
+		break;
+
+	case _C_SHT:
+		[self encodeInt64:*(const short*)addr
+				   forKey:key];
+		break;
+
+	case _C_USHT:
+		[self encodeInt64:*(const unsigned short*)addr
+				   forKey:key];
+		break;
+
+	case _C_INT:
+		[self encodeInt64:*(const int*)addr
+				   forKey:key];
+		break;
+
+	case _C_UINT:
+		[self encodeInt64:*(const unsigned int*)addr
+				   forKey:key];
+		break;
+
+	case _C_LNG:
+		[self encodeInt64:*(const long*)addr
+				   forKey:key];
+		break;
+
+	case _C_ULNG:
+		[self encodeInt64:(int64_t) * (const unsigned long*)addr
+				   forKey:key];
+		break;
+
+	case _C_LNG_LNG:
+		[self encodeInt64:*(const long long*)addr
+				   forKey:key];
+		break;
+
+	case _C_ULNG_LNG:
+		[self encodeInt64:(int64_t) * (const unsigned long long*)addr
+				   forKey:key];
+		break;
+
+	case _C_BOOL:
+		[self encodeBool:*(const bool*)addr
+				  forKey:key];
+		break;
+
+	case _C_FLT:
+		[self encodeFloat:*(const float*)addr
+				   forKey:key];
+		break;
+
+	case _C_DBL:
+		[self encodeDouble:*(const double*)addr
+					forKey:key];
+		break;
+
+	case _C_CHARPTR: {
+		const char* string = *(const char* const*)addr;
+		[self encodeObject:string ? @(string) : nil
+					forKey:key];
+	} break;
+
+	default: {
+		NSUInteger size = 0;
+		NSGetSizeAndAlignment(type, &size, NULL);
+
+		[self encodeBytes:addr
+				   length:size
+				   forKey:key];
+	} break;
+	}
+}
+
+- (void)encodeDataObject:(NSData*)data
+{
+	[self encodeObject:data
+				forKey:[self nextUnkeyedKey]];
+}
+
+- (void)encodeArrayOfObjCType:(const char*)type count:(NSUInteger)count at:(const void*)array
+{
+	NSUInteger size = 0;
+	NSGetSizeAndAlignment(type, &size, NULL);
+
+	uint32_t typeID = [self stringID:@(type)];
+	NSMutableData* data = [self fieldDataForKey:[self nextUnkeyedKey]
+										   type:kDKBinaryFieldArray];
+	appendU32(data, typeID);
+	appendU32(data, (uint32_t)count);
+	appendU64(data, size * count);
+	[data appendBytes:array
+			   length:size * count];
+}
+
+- (NSInteger)versionForClassName:(NSString*)className
+{
+#pragma unused(className)
+	return NSNotFound;
+}
+
+@end
+
+#pragma mark -
+
+@interface DKBinaryUnarchiver ()
+
+- (const uint8_t*)chunkPayloadAtOffset:(uint64_t)offset type:(uint32_t)type length:(uint64_t*)length;
+- (nullable NSString*)stringWithID:(uint32_t)stringID;
+- (Class)classForStringID:(uint32_t)stringID;
+- (nullable id)newObjectForRecordAt:(const uint8_t*)record objectID:(uint32_t)objectID;
+- (nullable const uint8_t*)fieldForKey:(NSString*)key type:(uint8_t*)type;
+- (nullable DKBinaryFrame*)currentFrame;
+- (NSString*)nextUnkeyedKey;
+
+@end
+
+#pragma mark -
+
+@implementation DKBinaryUnarchiver
+
+/// stands for an object whose members are being decoded, so that a collection which (indirectly) contains itself comes out as nil
+static id sDecodingPlaceholder = nil;
+
++ (void)initialize
+{
+	if (self == [DKBinaryUnarchiver class])
+		sDecodingPlaceholder = [[NSObject alloc] init];
+}
+
++ (BOOL)canReadData:(NSData*)data
+{
+	if ([data length] < kDKBinaryHeaderSize + kDKBinaryTrailerSize)
+		return NO;
+
+	uint8_t header[8];
+	[data getBytes:header
+			length:sizeof(header)];
+
+	return readU32(header) == kDKBinaryArchiveMagic && readU32(header + 4) <= kDKBinaryArchiveVersion;
+}
+
+- (instancetype)initForReadingWithData:(NSData*)data
+{
+	NSAssert(data != nil, @"data was nil");
+
+	if (![[self class] canReadData:data])
+		return nil;
+
+	self = [super init];
+	if (self) {
+		mData = data;
+		mBytes = [data bytes];
+		mLength = [data length];
+		mClasses = [[NSMutableDictionary alloc] init];
+		mFrames = [[NSMutableData alloc] init];
+
+		const uint8_t* trailer = mBytes + mLength - kDKBinaryTrailerSize;
+
+		if (readU32(trailer + 36) != kDKBinaryArchiveTrailerMagic)
+			return nil;
+
+		uint64_t length;
+		const uint8_t* p;
+		const uint8_t* end;
+
+		// string table
+
+		p = [self chunkPayloadAtOffset:readU64(trailer)
+								  type:kDKBinaryChunkStrings
+								length:&length];
+		if (p == NULL || length < 4)
+			return nil;
+
+		end = p + length;
+		uint32_t count = readU32(p);
+		p += 4;
+
+		NSMutableArray* strings = [NSMutableArray arrayWithCapacity:count];
+		NSMutableDictionary* stringIDs = [NSMutableDictionary dictionaryWithCapacity:count];
+
+		for (uint32_t i = 0; i < count; ++i) {
+			if (end - p < 4 || (uint64_t)(end - p - 4) < readU32(p))
+				return nil;
+
+			NSString* string = [[NSString alloc] initWithBytes:p + 4
+														length:readU32(p)
+													  encoding:NSUTF8StringEncoding];
+			if (string == nil)
+				return nil;
+
+			[strings addObject:string];
+			[stringIDs setObject:@(i)
+						  forKey:string];
+			p += 4 + readU32(p);
+		}
+
+		mStrings = strings;
+		mStringIDs = stringIDs;
+
+		// object index, which is used in place
+
+		p = [self chunkPayloadAtOffset:readU64(trailer + 8)
+								  type:kDKBinaryChunkIndex
+								length:&length];
+		if (p == NULL || length < 4 || (length - 4) / sizeof(uint64_t) < readU32(p))
+			return nil;
+
+		mObjectCount = readU32(p);
+		mIndex = p + 4;
+		mObjects = (__strong id*)calloc(mObjectCount, sizeof(id));
+
+		// layer directory
+
+		p = [self chunkPayloadAtOffset:readU64(trailer + 16)
+								  type:kDKBinaryChunkLayers
+								length:&length];
+		if (p == NULL || length < 4 || (length - 4) / 20 < readU32(p))
+			return nil;
+
+		count = readU32(p);
+		NSMutableArray* layerIDs = [NSMutableArray arrayWithCapacity:count];
+
+		for (uint32_t i = 0; i < count; ++i)
+			[layerIDs addObject:@(readU32(p + 4 + i * 20))];
+
+		mLayerIDs = layerIDs;
+
+		// root table
+
+		p = [self chunkPayloadAtOffset:readU64(trailer + 24)
+								  type:kDKBinaryChunkRoot
+								length:&length];
+		if (p == NULL || length < 4 || (length - 4) / 8 < readU32(p))
+			return nil;
+
+		count = readU32(p);
+		NSMutableDictionary* rootObjects = [NSMutableDictionary dictionaryWithCapacity:count];
+
+		for (uint32_t i = 0; i < count; ++i) {
+			NSString* key = [self stringWithID:readU32(p + 4 + i * 8)];
+
+			if (key)
+				[rootObjects setObject:@(readU32(p + 8 + i * 8))
+								forKey:key];
+		}
+
+		mRootObjects = rootObjects;
+	}
+
+	return self;
+}
+
+- (instancetype)init
+{
+	NSAssert(NO, @"-init is not a valid initializer for the class DKBinaryUnarchiver");
+	return nil;
+}
+
+@synthesize delegate = mDelegate;
+@synthesize imageManager = mImageManagerRef;
+@synthesize layerObjectIDs = mLayerIDs;
+@synthesize data = mData;
+
+- (id)decodeObjectWithID:(uint32_t)objectID
+{
+	if (objectID == 0 || objectID >= mObjectCount)
+		return nil;
+
+	id object = mObjects[objectID];
+
+	if (object == nil) {
+		uint64_t offset = readU64(mIndex + objectID * sizeof(uint64_t));
+
+		// an object only ever referred to conditionally has no record
+
+		if (offset >= mLength)
+			raiseCorrupt([NSString stringWithFormat:@"record %u is outside the file", objectID]);
+
+		if (offset > 0) {
+			object = [self newObjectForRecordAt:mBytes + offset
+									   objectID:objectID];
+			mObjects[objectID] = object;
+		}
+	}
+
+	return (object == sDecodingPlaceholder) ? nil : object;
+}
+
+- (void)setObject:(id)object forObjectID:(uint32_t)objectID
+{
+	if (objectID == 0 || objectID >= mObjectCount)
+		return;
+
+	if (mObjects[objectID] == nil)
+		mObjects[objectID] = object ?: sDecodingPlaceholder;
+}
+
+- (void)inspectObjectWithID:(uint32_t)objectID usingBlock:(void (^)(Class objectClass))block
+{
+	if (objectID == 0 || objectID >= mObjectCount)
+		return;
+
+	uint64_t offset = readU64(mIndex + objectID * sizeof(uint64_t));
+
+	if (offset == 0 || offset >= mLength || mBytes[offset] != kDKBinaryRecordObject || mLength - offset < 9)
+		block(Nil);
+	else {
+		const uint8_t* p = mBytes + offset + 1;
+		DKBinaryFrame frame = { p + 8, readU32(p + 4), 0 };
+
+		[mFrames appendBytes:&frame
+					  length:sizeof(DKBinaryFrame)];
+
+		@try {
+			block([self classForStringID:readU32(p)]);
+		}
+		@finally {
+			[mFrames setLength:[mFrames length] - sizeof(DKBinaryFrame)];
+		}
+	}
+}
+
+- (uint32_t)objectIDForKey:(NSString*)key
+{
+	if ([self currentFrame] == NULL)
+		return [[mRootObjects objectForKey:key] unsignedIntValue];
+
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	return (value && type == kDKBinaryFieldObject) ? readU32(value) : 0;
+}
+
+- (void)finishDecoding
+{
+	if ([mDelegate respondsToSelector:@selector(unarchiverDidFinish:)])
+		[mDelegate unarchiverDidFinish:(id)self];
+}
+
+#pragma mark -
+
+- (const uint8_t*)chunkPayloadAtOffset:(uint64_t)offset type:(uint32_t)type length:(uint64_t*)length
+{
+	if (offset < kDKBinaryChunkHeaderSize || offset > mLength)
+		return NULL;
+
+	const uint8_t* chunk = mBytes + offset - kDKBinaryChunkHeaderSize;
+
+	if (readU32(chunk) != type)
+		return NULL;
+
+	*length = readU64(chunk + 4);
+
+	if (*length > mLength - offset)
+		return NULL;
+
+	return mBytes + offset;
+}
+
+- (NSString*)stringWithID:(uint32_t)stringID
+{
+	return (stringID < [mStrings count]) ? [mStrings objectAtIndex:stringID] : nil;
+}
+
+- (Class)classForStringID:(uint32_t)stringID
+{
+	NSNumber* key = @(stringID);
+	Class cls = [mClasses objectForKey:key];
+
+	if (cls == Nil) {
+		NSArray<NSString*>* names = [[self stringWithID:stringID] componentsSeparatedByString:@","];
+		NSString* className = [names firstObject];
+
+		if (className == nil)
+			raiseCorrupt(@"an object's class is missing");
+
+		cls = [NSKeyedUnarchiver classForClassName:className];
+
+		if (cls == Nil)
+			cls = NSClassFromString(className);
+
+		if (cls == Nil && [mDelegate respondsToSelector:@selector(unarchiver:cannotDecodeObjectOfClassName:originalClasses:)])
+			cls = [mDelegate unarchiver:(id)self
+				cannotDecodeObjectOfClassName:className
+							  originalClasses:names];
+
+		if (cls == Nil)
+			[NSException raise:NSInvalidUnarchiveOperationException
+						format:@"cannot decode object of class (%@)", className];
+
+		[mClasses setObject:cls
+					 forKey:key];
+	}
+
+	return cls;
+}
+
+- (id)newObjectForRecordAt:(const uint8_t*)record objectID:(uint32_t)objectID
+{
+	const uint8_t* p = record + 1;
+	NSUInteger available = mLength - (NSUInteger)(p - mBytes);
+	id object = nil;
+
+	switch (*record) {
+	case kDKBinaryRecordString: {
+		if (available < 5)
+			raiseCorrupt(@"string record is truncated");
+
+		NSString* string = [self stringWithID:readU32(p + 1)];
+		object = p[0] ? [string mutableCopy] : string;
+	} break;
+
+	case kDKBinaryRecordNumber: {
+		if (available < 9)
+			raiseCorrupt(@"number record is truncated");
+
+		uint64_t bits = readU64(p + 1);
+
+		switch (p[0]) {
+		case kDKBinaryNumberUnsigned:
+			object = @(bits);
+			break;
+
+		case kDKBinaryNumberDouble:
+			object = @(readF64(p + 1));
+			break;
+
+		case kDKBinaryNumberBool:
+			object = bits ? @YES : @NO;
+			break;
+
+		default:
+			object = @((int64_t)bits);
+			break;
+		}
+	} break;
+
+	case kDKBinaryRecordData: {
+		if (available < 9 || available - 9 < readU64(p + 1))
+			raiseCorrupt(@"data record is truncated");
+
+		NSUInteger length = (NSUInteger)readU64(p + 1);
+		NSData* data;
+
+		if (p[0])
+			data = [NSMutableData dataWithBytes:p + 9
+										 length:length];
+		else if (length >= kDKBinaryArchiveBlobThreshold) {
+			// large data refers to the archive's bytes, keeping the archive alive, rather than copying them
+
+			NSData* archive = mData;
+			data = [[NSData alloc] initWithBytesNoCopy:(void*)(p + 9)
+												length:length
+										   deallocator:^(void* bytes, NSUInteger len) {
+#pragma unused(bytes, len)
+											   [archive length];
+										   }];
+		} else
+			data = [NSData dataWithBytes:p + 9
+								  length:length];
+
+		object = data;
+	} break;
+
+	case kDKBinaryRecordArray:
+	case kDKBinaryRecordSet: {
+		if (available < 5 || (available - 5) / 4 < readU32(p + 1))
+			raiseCorrupt(@"collection record is truncated");
+
+		uint32_t count = readU32(p + 1);
+		NSMutableArray* members = [NSMutableArray arrayWithCapacity:count];
+
+		mObjects[objectID] = sDecodingPlaceholder;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			id member = [self decodeObjectWithID:readU32(p + 5 + i * 4)];
+
+			if (member)
+				[members addObject:member];
+		}
+
+		if (*record == kDKBinaryRecordArray)
+			object = p[0] ? members : [members copy];
+		else
+			object = p[0] ? [NSMutableSet setWithArray:members] : [NSSet setWithArray:members];
+	} break;
+
+	case kDKBinaryRecordDictionary: {
+		if (available < 5 || (available - 5) / 8 < readU32(p + 1))
+			raiseCorrupt(@"dictionary record is truncated");
+
+		uint32_t count = readU32(p + 1);
+		NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:count];
+
+		mObjects[objectID] = sDecodingPlaceholder;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			id key = [self decodeObjectWithID:readU32(p + 5 + i * 8)];
+			id value = [self decodeObjectWithID:readU32(p + 9 + i * 8)];
+
+			if (key && value)
+				[dict setObject:value
+						 forKey:key];
+		}
+
+		object = p[0] ? dict : [dict copy];
+	} break;
+
+	case kDKBinaryRecordForeign: {
+		if (available < 8 || available - 8 < readU64(p))
+			raiseCorrupt(@"archived object record is truncated");
+
+		NSData* archive = [NSData dataWithBytesNoCopy:(void*)(p + 8)
+											   length:(NSUInteger)readU64(p)
+										 freeWhenDone:NO];
+		object = [NSKeyedUnarchiver unarchiveObjectWithData:archive];
+	} break;
+
+	case kDKBinaryRecordObject: {
+		if (available < 8)
+			raiseCorrupt(@"object record is truncated");
+
+		Class cls = [self classForStringID:readU32(p)];
+
+		// the object is registered before it's initialized, so that references back to it from the objects it decodes find it
+
+		object = [cls alloc];
+		mObjects[objectID] = object;
+
+		DKBinaryFrame frame = { p + 8, readU32(p + 4), 0 };
+		[mFrames appendBytes:&frame
+					  length:sizeof(DKBinaryFrame)];
+
+		object = [object initWithCoder:self];
+		object = [object awakeAfterUsingCoder:self];
+
+		[mFrames setLength:[mFrames length] - sizeof(DKBinaryFrame)];
+
+		if (object && [mDelegate respondsToSelector:@selector(unarchiver:didDecodeObject:)])
+			object = [mDelegate unarchiver:(id)self
+						   didDecodeObject:object];
+	} break;
+
+	default:
+		raiseCorrupt([NSString stringWithFormat:@"record %u has an unknown type", objectID]);
+		break;
+	}
+
+	return object;
+}
+
+- (DKBinaryFrame*)currentFrame
+{
+	NSUInteger length = [mFrames length];
+
+	if (length == 0)
+		return NULL;
+
+	return (DKBinaryFrame*)((uint8_t*)[mFrames mutableBytes] + length - sizeof(DKBinaryFrame));
+}
+
+- (const uint8_t*)fieldForKey:(NSString*)key type:(uint8_t*)type
+{
+	DKBinaryFrame* frame = [self currentFrame];
+	NSNumber* keyID = [mStringIDs objectForKey:key];
+
+	if (frame == NULL || keyID == nil)
+		return NULL;
+
+	uint32_t wanted = [keyID unsignedIntValue];
+	const uint8_t* p = frame->fields;
+	const uint8_t* end = mBytes + mLength;
+
+	for (uint32_t i = 0; i < frame->fieldCount; ++i) {
+		if (end - p < 5)
+			raiseCorrupt(@"object record is truncated");
+
+		const uint8_t* value = p + 5;
+		uint64_t length;
+
+		*type = p[4];
+
+		switch (*type) {
+		case kDKBinaryFieldObject:
+		case kDKBinaryFieldFloat:
+			length = 4;
+			break;
+
+		case kDKBinaryFieldBool:
+			length = 1;
+			break;
+
+		case kDKBinaryFieldInteger:
+		case kDKBinaryFieldDouble:
+			length = 8;
+			break;
+
+		case kDKBinaryFieldBytes:
+			length = (end - value < 8) ? UINT64_MAX : 8 + readU64(value);
+			break;
+
+		case kDKBinaryFieldGeometry:
+			length = (end - value < 1) ? UINT64_MAX : 1 + 8 * (uint64_t)value[0];
+			break;
+
+		case kDKBinaryFieldArray:
+			length = (end - value < 16) ? UINT64_MAX : 16 + readU64(value + 8);
+			break;
+
+		default:
+			length = UINT64_MAX;
+			break;
+		}
+
+		if (length > (uint64_t)(end - value))
+			raiseCorrupt([NSString stringWithFormat:@"field '%@' is truncated or of an unknown type", [self stringWithID:readU32(p)]]);
+
+		if (readU32(p) == wanted)
+			return value;
+
+		p = value + length;
+	}
+
+	return NULL;
+}
+
+- (NSString*)nextUnkeyedKey
+{
+	DKBinaryFrame* frame = [self currentFrame];
+	return [NSString stringWithFormat:@"$%lu", (unsigned long)(frame ? frame->unkeyedCount++ : 0)];
+}
+
+#pragma mark -
+#pragma mark As an NSCoder
+
+- (BOOL)allowsKeyedCoding
+{
+	return YES;
+}
+
+- (BOOL)containsValueForKey:(NSString*)key
+{
+	uint8_t type;
+
+	if ([self currentFrame] == NULL)
+		return [mRootObjects objectForKey:key] != nil;
+
+	return [self fieldForKey:key
+						type:&type]
+		!= NULL;
+}
+
+- (id)decodeObjectForKey:(NSString*)key
+{
+	if ([self currentFrame] == NULL)
+		return [self decodeObjectWithID:[[mRootObjects objectForKey:key] unsignedIntValue]];
+
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL || type != kDKBinaryFieldObject)
+		return nil;
+
+	return [self decodeObjectWithID:readU32(value)];
+}
+
+- (id)decodeObjectOfClass:(Class)aClass forKey:(NSString*)key
+{
+#pragma unused(aClass)
+	return [self decodeObjectForKey:key];
+}
+
+- (id)decodeObjectOfClasses:(NSSet<Class>*)classes forKey:(NSString*)key
+{
+#pragma unused(classes)
+	return [self decodeObjectForKey:key];
+}
+
+- (int64_t)decodeInt64ForKey:(NSString*)key
+{
+	// numeric fields are converted to whichever type they're asked for, as NSKeyedUnarchiver does
+
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL)
+		return 0;
+
+	switch (type) {
+	case kDKBinaryFieldBool:
+		return value[0];
+
+	case kDKBinaryFieldInteger:
+		return (int64_t)readU64(value);
+
+	case kDKBinaryFieldDouble:
+		return (int64_t)readF64(value);
+
+	case kDKBinaryFieldFloat: {
+		uint32_t bits = readU32(value);
+		float f;
+		memcpy(&f, &bits, sizeof(float));
+		return (int64_t)f;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+- (double)decodeDoubleForKey:(NSString*)key
+{
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL)
+		return 0.0;
+
+	switch (type) {
+	case kDKBinaryFieldDouble:
+		return readF64(value);
+
+	case kDKBinaryFieldFloat: {
+		uint32_t bits = readU32(value);
+		float f;
+		memcpy(&f, &bits, sizeof(float));
+		return f;
+	}
+
+	case kDKBinaryFieldBool:
+	case kDKBinaryFieldInteger:
+		return (double)[self decodeInt64ForKey:key];
+
+	default:
+		return 0.0;
+	}
+}
+
+- (BOOL)decodeBoolForKey:(NSString*)key
+{
+	return [self decodeInt64ForKey:key] != 0;
+}
+
+- (int)decodeIntForKey:(NSString*)key
+{
+	return (int)[self decodeInt64ForKey:key];
+}
+
+- (int32_t)decodeInt32ForKey:(NSString*)key
+{
+	return (int32_t)[self decodeInt64ForKey:key];
+}
+
+- (NSInteger)decodeIntegerForKey:(NSString*)key
+{
+	return (NSInteger)[self decodeInt64ForKey:key];
+}
+
+- (float)decodeFloatForKey:(NSString*)key
+{
+	return (float)[self decodeDoubleForKey:key];
+}
+
+- (const uint8_t*)decodeBytesForKey:(NSString*)key returnedLength:(NSUInteger*)length
+{
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL || type != kDKBinaryFieldBytes) {
+		if (length)
+			*length = 0;
+		return NULL;
+	}
+
+	if (length)
+		*length = (NSUInteger)readU64(value);
+
+	return value + 8;
+}
+
+- (NSPoint)decodePointForKey:(NSString*)key
+{
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL || type != kDKBinaryFieldGeometry || value[0] < 2)
+		return NSZeroPoint;
+
+	return NSMakePoint(readF64(value + 1), readF64(value + 9));
+}
+
+- (NSSize)decodeSizeForKey:(NSString*)key
+{
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL || type != kDKBinaryFieldGeometry || value[0] < 2)
+		return NSZeroSize;
+
+	return NSMakeSize(readF64(value + 1), readF64(value + 9));
+}
+
+- (NSRect)decodeRectForKey:(NSString*)key
+{
+	uint8_t type;
+	const uint8_t* value = [self fieldForKey:key
+										type:&type];
+
+	if (value == NULL || type != kDKBinaryFieldGeometry || value[0] < 4)
+		return NSZeroRect;
+
+	return NSMakeRect(readF64(value + 1), readF64(value + 9), readF64(value + 17), readF64(value + 25));
+}
+
+- (void)decodeValueOfObjCType:(const char*)type at:(void*)data size:(NSUInteger)size
+{
+	NSString* key = [self nextUnkeyedKey];
+
+	switch (*type) {
+	case _C_ID:
+	case _C_CLASS:
+		// as with any coder, the object is returned retained
+		*(void**)data = (__bridge_retained void*)[self decodeObjectForKey:key];
+		break;
+
+	case _C_CHR:
+		*(char*)data = (char)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_UCHR:
+		*(unsigned char*)data = (unsigned char)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_SHT:
+		*(short*)data = (short)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_USHT:
+		*(unsigned short*)data = (unsigned short)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_INT:
+		*(int*)data = (int)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_UINT:
+		*(unsigned int*)data = (unsigned int)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_LNG:
+		*(long*)data = (long)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_ULNG:
+		*(unsigned long*)data = (unsigned long)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_LNG_LNG:
+		*(long long*)data = [self decodeInt64ForKey:key];
+		break;
+
+	case _C_ULNG_LNG:
+		*(unsigned long long*)data = (unsigned long long)[self decodeInt64ForKey:key];
+		break;
+
+	case _C_BOOL:
+		*(bool*)data = [self decodeBoolForKey:key];
+		break;
+
+	case _C_FLT:
+		*(float*)data = [self decodeFloatForKey:key];
+		break;
+
+	case _C_DBL:
+		*(double*)data = [self decodeDoubleForKey:key];
+		break;
+
+	case _C_CHARPTR: {
+		// the string is kept alive by the autorelease pool, as NSUnarchiver's are
+		NSString* string = [self decodeObjectForKey:key];
+		*(const char**)data = [string UTF8String];
+	} break;
+
+	default: {
+		NSUInteger length = 0;
+		const uint8_t* bytes = [self decodeBytesForKey:key
+										returnedLength:&length];
+
+		memset(data, 0, size);
+		if (bytes)
+			memcpy(data, bytes, MIN(length, size));
+	} break;
+	}
+}
+
+- (void)decodeValueOfObjCType:(const char*)type at:(void*)data
+{
+	NSUInteger size = 0;
+	NSGetSizeAndAlignment(type, &size, NULL);
+
+	[self decodeValueOfObjCType:type
+							 at:data
+						   size:size];
+}
+
+- (NSData*)decodeDataObject
+{
+	return [self decodeObjectForKey:[self nextUnkeyedKey]];
+}
+
+- (void)decodeArrayOfObjCType:(const char*)type count:(NSUInteger)count at:(void*)array
+{
+	NSUInteger size = 0;
+	NSGetSizeAndAlignment(type, &size, NULL);
+
+	uint8_t fieldType;
+	NSString* key = [self nextUnkeyedKey];
+	const uint8_t* value = [self fieldForKey:key
+										type:&fieldType];
+
+	memset(array, 0, size * count);
+
+	if (value && fieldType == kDKBinaryFieldArray && [[self stringWithID:readU32(value)] isEqualToString:@(type)])
+		memcpy(array, value + 16, MIN((NSUInteger)readU64(value + 8), size * count));
+}
+
+- (NSInteger)versionForClassName:(NSString*)className
+{
+#pragma unused(className)
+	return NSNotFound;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	// the decoded objects must be released before the memory holding them is freed
+
+	for (uint32_t i = 0; i < mObjectCount; ++i)
+		mObjects[i] = nil;
+
+	free(mObjects);
+}
+
+@end
+
+#pragma mark -
+
+static void appendU8(NSMutableData* data, uint8_t value)
+{
+	[data appendBytes:&value
+			   length:sizeof(uint8_t)];
+}
+
+static void appendU32(NSMutableData* data, uint32_t value)
+{
+	value = CFSwapInt32HostToLittle(value);
+	[data appendBytes:&value
+			   length:sizeof(uint32_t)];
+}
+
+static void appendU64(NSMutableData* data, uint64_t value)
+{
+	value = CFSwapInt64HostToLittle(value);
+	[data appendBytes:&value
+			   length:sizeof(uint64_t)];
+}
+
+static void appendF64(NSMutableData* data, double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(double));
+	appendU64(data, bits);
+}
+
+static uint32_t readU32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(uint32_t));
+	return CFSwapInt32LittleToHost(value);
+}
+
+static uint64_t readU64(const uint8_t* p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(uint64_t));
+	return CFSwapInt64LittleToHost(value);
+}
+
+static double readF64(const uint8_t* p)
+{
+	uint64_t bits = readU64(p);
+	double value;
+	memcpy(&value, &bits, sizeof(double));
+	return value;
+}
+
+static void raiseCorrupt(NSString* reason)
+{
+	[NSException raise:NSInvalidUnarchiveOperationException
+				format:@"binary archive is damaged: %@", reason];
+}
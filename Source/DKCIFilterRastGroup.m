@@ -93,6 +93,12 @@
 	return es;
 }
 
+- (BOOL)supportsGeometricHitTesting
+{
+	// a filter can move, blur or knock out pixels arbitrarily, so the path can't stand in for the output
+	return NO;
+}
+
 - (void)render:(DKDrawableObject*)object
 {
 	if (![self enabled])
@@ -21,6 +21,7 @@ FOUNDATION_EXPORT const unsigned char DKDrawKitVersionString[];
 #import "DKLinearObjectStorage.h"
 #import "DKBSPObjectStorage.h"
 #import "DKBSPDirectObjectStorage.h"
+#import "DKRTreeObjectStorage.h"
 
 #import "DKDrawing.h"
 #import "DKDrawing+Paper.h"
@@ -47,6 +48,7 @@ FOUNDATION_EXPORT const unsigned char DKDrawKitVersionString[];
 #import "DKImageShape.h"
 #import "DKShapeGroup.h"
 #import "DKDrawablePath.h"
+#import "DKPathDelta.h"
 #import "DKTextShape.h"
 #import "DKTextPath.h"
 #import "DKArcPath.h"
@@ -54,6 +56,7 @@ FOUNDATION_EXPORT const unsigned char DKDrawKitVersionString[];
 
 #import "DKStyleRegistry.h"
 #import "DKStyle.h"
+#import "DKStyleDisplayList.h"
 #import "DKStyle+Text.h"
 #import "DKStyle+SimpleAccess.h"
 #import "DKRasterizer.h"
@@ -90,6 +93,10 @@ FOUNDATION_EXPORT const unsigned char DKDrawKitVersionString[];
 
 #import "DKRandom.h"
 #import "DKUniqueID.h"
+#import "DKBezierArcLengthTable.h"
+#import "DKGeometryCache.h"
+#import "DKImagePyramid.h"
+#import "DKBinaryArchiver.h"
 #import "DKGeometryUtilities.h"
 #import "DKDistortionTransform.h"
 #import "DKCategoryManager.h"
@@ -28,6 +28,15 @@ NS_ASSUME_NONNULL_BEGIN
 - (DKMetadataItem*)metadataItemForKey:(NSString*)key;
 - (id)metadataObjectForKey:(NSString*)key;
 
+/** @brief Told that part of a contained object needs redrawing.
+
+ Containers that don't implement this are passed over, and the object's layer is told instead. Containers that do should pass it on
+ to their own container in the same way.
+ @param obj the object, which may be contained indirectly
+ @param rect the area needing redrawing
+ */
+- (void)drawable:(DKDrawableObject*)obj needsDisplayInRect:(NSRect)rect;
+
 @end
 
 NS_ASSUME_NONNULL_END
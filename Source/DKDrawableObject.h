@@ -12,7 +12,7 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
-@class DKObjectOwnerLayer, DKStyle, DKDrawing, DKDrawingTool, DKShapeGroup;
+@class DKObjectOwnerLayer, DKStyle, DKDrawing, DKDrawingTool, DKShapeGroup, DKGeometryCacheEntry;
 
 /** @brief This object is responsible for the visual representation of the selection as well as any content.
 
@@ -64,6 +64,14 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (class) BOOL displaysSizeInfoWhenDragging;
 
+/** @brief Whether objects are hit-tested analytically where possible, rather than by rendering into a bitmap.
+
+ Geometric hit-testing works directly from the rendering path, the fill state and the stroke width and is
+ very much faster than the bitmap test. Objects that can't be described that way use the bitmap test
+ regardless. The default is <code>YES</code>.
+ */
+@property (class) BOOL usesGeometricHitTesting;
+
 /** @brief Returns the union of the bounds of the objects in the array.
 
  Utility method as this is a very common task - throws exception if any object in the list is
@@ -875,6 +883,22 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)rectHitsPath:(NSRect)r;
 
+/** @brief Whether the object's hit-testable area can be computed from its path rather than rendered.
+
+ The default is <code>NO</code>. Subclasses whose hit-test drawing is a plain fill and/or stroke of the rendering
+ path override this, and <code>-geometricHitTestRect:</code>, so that \c -rectHitsPath: can skip the bitmap test.
+ */
+@property (readonly) BOOL canHitTestGeometrically;
+
+/** @brief Test if a rect hits the object using its path geometry only.
+
+ Called by \c -rectHitsPath: when \c -canHitTestGeometrically returns <code>YES</code>. The default tests the
+ filled rendering path; subclasses should override to match what they draw when being hit-tested.
+ @param r The rect to test, already clipped to the object's bounds.
+ @return \c YES if the rect hits the object, \c NO otherwise.
+ */
+- (BOOL)geometricHitTestRect:(NSRect)r;
+
 /** @brief Test a point against the offscreen bitmap representation of the shape
 
  Special case of the \crectHitsPath call, which is now the fastest way to perform this test.
@@ -1046,6 +1070,27 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)invalidateRenderingCache;
 
+/** @brief Returns the cached geometry for the object's current state.
+
+ The entry is held by the drawing's geometry cache, and is replaced whenever the geometryCacheKey changes. Drawing,
+ hit-testing and export all share the same entry, so derived values such as stroke outlines are only calculated once.
+ @return the entry, or nil if the object isn't part of a drawing
+ */
+- (nullable DKGeometryCacheEntry*)geometryCacheEntry;
+
+/** @brief A number that changes whenever anything that affects the rendering path changes.
+
+ The default combines the geometryChecksum with the container's transform and the drawing's rendering quality. Subclasses
+ whose paths can change in ways the checksum doesn't reflect should mix in something that does.
+ */
+@property (readonly) NSUInteger geometryCacheKey;
+
+/** @brief Discard the object's cached geometry.
+
+ This is done by -invalidateRenderingCache, but should also be called directly when the object's path is changed in place.
+ */
+- (void)invalidateGeometryCache;
+
 /** @brief Returns an image of the object representing its current appearance at 100% scale.
 
  This image is stored in the rendering cache. If the cache is empty the image is recreated. This
@@ -10,6 +10,7 @@
 #import "DKDrawableContainerProtocol.h"
 #import "DKDrawableObject+Metadata.h"
 #import "DKDrawing.h"
+#import "DKGeometryCache.h"
 #import "DKGeometryUtilities.h"
 #import "DKKnob.h"
 #import "DKObjectDrawingLayer+Alignment.h"
@@ -20,6 +21,7 @@
 #import "LogEvent.h"
 #import "NSAffineTransform+DKAdditions.h"
 #import "NSBezierPath+Combinatorial.h"
+#import "NSBezierPath+Geometry.h"
 #import "NSColor+DKAdditions.h"
 #import "NSDictionary+DeepCopy.h"
 
@@ -47,8 +49,25 @@ NSString* const kDKDrawableCachedImageKey = @"DKD_Cached_Img";
 #pragma mark Static vars
 
 static NSColor* s_ghostColour = nil;
+static BOOL s_geometricHitTesting = YES;
 static NSDictionary<NSString*, Class>* s_interconversionTable = nil;
 
+/** @brief Tells an object's container that part of the object needs redrawing, or its layer if the container doesn't want to know
+
+ Groups use this to find out that their content has changed.
+ */
+static void drawableNeedsDisplayInRect(DKDrawableObject* obj, NSRect rect)
+{
+	id<DKDrawableContainer> container = [obj container];
+
+	if ([container respondsToSelector:@selector(drawable:needsDisplayInRect:)])
+		[container drawable:obj
+			needsDisplayInRect:rect];
+	else
+		[[obj layer] drawable:obj
+			needsDisplayInRect:rect];
+}
+
 #pragma mark -
 @implementation DKDrawableObject
 #pragma mark As a DKDrawableObject
@@ -64,6 +83,16 @@ static NSDictionary<NSString*, Class>* s_interconversionTable = nil;
 											forKey:kDKDragFeedbackEnabledPreferencesKey];
 }
 
++ (BOOL)usesGeometricHitTesting
+{
+	return s_geometricHitTesting;
+}
+
++ (void)setUsesGeometricHitTesting:(BOOL)geometric
+{
+	s_geometricHitTesting = geometric;
+}
+
 + (NSRect)unionOfBoundsOfDrawablesInArray:(NSArray*)array
 {
 	NSAssert(array != nil, @"array cannot be nil");
@@ -495,8 +524,7 @@ static NSDictionary<NSString*, Class>* s_interconversionTable = nil;
 - (void)notifyVisualChange
 {
 	if ([self layer])
-		[[self layer] drawable:self
-			needsDisplayInRect:[self bounds]];
+		drawableNeedsDisplayInRect(self, [self bounds]);
 }
 
 - (void)notifyStatusChange
@@ -521,21 +549,18 @@ static NSDictionary<NSString*, Class>* s_interconversionTable = nil;
 
 - (void)setNeedsDisplayInRect:(NSRect)rect
 {
-	[[self layer] drawable:self
-		needsDisplayInRect:rect];
+	drawableNeedsDisplayInRect(self, rect);
 }
 
 - (void)setNeedsDisplayInRects:(NSSet*)setOfRects
 {
-	[[self layer] drawable:self
-		needsDisplayInRect:NSZeroRect];
+	drawableNeedsDisplayInRect(self, NSZeroRect);
 	[[self layer] setNeedsDisplayInRects:setOfRects];
 }
 
 - (void)setNeedsDisplayInRects:(NSSet*)setOfRects withExtraPadding:(NSSize)padding
 {
-	[[self layer] drawable:self
-		needsDisplayInRect:NSZeroRect];
+	drawableNeedsDisplayInRect(self, NSZeroRect);
 	[[self layer] setNeedsDisplayInRects:setOfRects
 						withExtraPadding:padding];
 }
@@ -834,6 +859,44 @@ static NSRect s_oldBounds;
 - (void)invalidateRenderingCache
 {
 	[mRenderingCache removeAllObjects];
+	[self invalidateGeometryCache];
+}
+
+- (DKGeometryCacheEntry*)geometryCacheEntry
+{
+	DKGeometryCache* cache = [[self drawing] geometryCache];
+
+	if (cache == nil)
+		return nil;
+
+	return [cache entryForObject:self
+							 key:[self geometryCacheKey]];
+}
+
+- (NSUInteger)geometryCacheKey
+{
+	NSUInteger key = [self geometryChecksum];
+	NSAffineTransform* ct = [[self container] renderingTransform];
+
+	if (ct) {
+		NSAffineTransformStruct ts = [ct transformStruct];
+		NSUInteger words[sizeof(ts) / sizeof(NSUInteger)];
+
+		memcpy(words, &ts, sizeof(words));
+
+		for (NSUInteger i = 0; i < sizeof(ts) / sizeof(NSUInteger); ++i)
+			key = (key * 31) ^ words[i];
+	}
+
+	if ([self useLowQualityDrawing])
+		key = ~key;
+
+	return key;
+}
+
+- (void)invalidateGeometryCache
+{
+	[[[self drawing] geometryCache] removeEntryForObject:self];
 }
 
 - (NSImage*)cachedImage
@@ -1059,7 +1122,12 @@ static NSRect s_oldBounds;
 
 		if (NSEqualRects(ir, [self bounds]))
 			return YES;
-		else {
+		else if ([[self class] usesGeometricHitTesting] && [self canHitTestGeometrically]) {
+			// the object can describe what it draws for hit-testing as a fill and/or stroke of its path, so test that
+			// directly. This avoids rendering anything at all.
+
+			hit = [self geometricHitTestRect:ir];
+		} else {
 			// this method scales the whole hit rect directly down into a 1x1 bitmap context - if it ends up opaque, it's hit. If transparent, it's not.
 			// this method suggested by Ken Ferry (Apple), as it avoids the need for writable access to NSBimapImageRep and so should
 			// perform best on most graphics architectures. This also doesn't require any style substitution.
@@ -1124,6 +1192,18 @@ static NSRect s_oldBounds;
 	return hit;
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	return NO;
+}
+
+- (BOOL)geometricHitTestRect:(NSRect)r
+{
+	return [[self renderingPath] isHitByRect:r
+									  filled:YES
+								 strokeWidth:0];
+}
+
 - (BOOL)pointHitsPath:(NSPoint)p
 {
 	if (NSPointInRect(p, [self bounds])) {
@@ -1709,18 +1789,20 @@ static NSRect s_oldBounds;
 
 - (NSUInteger)geometryChecksum
 {
+	// the values are mixed in one after another at full precision, as the geometry cache is keyed by this. Rounding them and
+	// combining them with XOR alone let small moves, and changes that cancelled each other out, go unnoticed
+
 	NSUInteger cd = 282735623; // arbitrary
-	NSPoint loc;
-	NSSize size;
-	CGFloat angle;
-	NSSize offset;
+	NSPoint loc = [self location];
+	NSSize size = [self size];
+	NSSize offset = [self offset];
+	CGFloat values[] = { loc.x, loc.y, size.width, size.height, [self angle], offset.width, offset.height };
+	NSUInteger words[sizeof(values) / sizeof(NSUInteger)];
 
-	loc = [self location];
-	size = [self size];
-	angle = [self angleInDegrees] * 10;
-	offset = [self offset];
+	memcpy(words, values, sizeof(words));
 
-	cd ^= lround(loc.x) ^ lround(loc.y) ^ lround(size.width) ^ lround(size.height) ^ lround(angle) ^ lround(offset.width) ^ lround(offset.height);
+	for (NSUInteger i = 0; i < sizeof(values) / sizeof(NSUInteger); ++i)
+		cd = (cd * 31) ^ words[i];
 
 	return cd;
 }
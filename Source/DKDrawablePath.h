@@ -11,6 +11,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 @class DKDrawableShape;
 @class DKKnob;
+@class DKPathDelta;
 
 //! editing modes:
 typedef NS_ENUM(NSInteger, DKDrawablePathCreationMode) {
@@ -53,6 +54,7 @@ typedef NS_ENUM(NSInteger, DKDrawablePathInsertType) {
 	NSBezierPath* m_undoPath;
 	DKDrawablePathCreationMode m_editPathMode;
 	CGFloat m_freehandEpsilon;
+	NSUInteger mGeometryChecksum; // cached by -geometryChecksum, or 0 if the path has changed since
 	BOOL m_extending;
 }
 
@@ -160,6 +162,14 @@ typedef NS_ENUM(NSInteger, DKDrawablePathInsertType) {
 - (NSBezierPath*)undoPath;
 - (void)clearUndoPath;
 
+/** @brief Changes the path's points in place as described by a delta, registering the reverse change for undo
+
+ Used to undo edits that moved points without adding or removing any, which are recorded as a \c DKPathDelta rather than a copy of
+ the path.
+ @param delta the change to make
+ */
+- (void)applyPathDelta:(DKPathDelta*)delta;
+
 // modifying paths
 
 /** @brief Merges two paths by simply appending them
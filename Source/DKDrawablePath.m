@@ -7,8 +7,10 @@
 #import "DKDrawablePath.h"
 #import "CurveFit.h"
 #import "DKDrawing.h"
+#import "DKGeometryCache.h"
 #import "DKKnob.h"
 #import "DKObjectDrawingLayer.h"
+#import "DKPathDelta.h"
 #import "DKShapeGroup.h"
 #import "DKStroke.h"
 #import "DKStyle.h"
@@ -196,6 +198,7 @@ static NSColor* sInfoWindowColour = nil;
 											object:oldPath];
 
 		m_path = path;
+		mGeometryChecksum = 0;
 
 		[self notifyVisualChange];
 		[self notifyGeometryChange:oldBounds];
@@ -419,6 +422,23 @@ static NSColor* sInfoWindowColour = nil;
 	m_undoPath = nil;
 }
 
+- (void)applyPathDelta:(DKPathDelta*)delta
+{
+	NSRect oldBounds = [self bounds];
+
+	[self notifyVisualChange];
+
+	DKPathDelta* inverse = [delta applyToPath:[self path]];
+
+	if (inverse)
+		[[self undoManager] registerUndoWithTarget:self
+										  selector:@selector(applyPathDelta:)
+											object:inverse];
+
+	[self notifyGeometryChange:oldBounds];
+	[self notifyVisualChange];
+}
+
 #pragma mark -
 
 /** @brief Merges two paths by simply appending them
@@ -2090,6 +2110,29 @@ finish:
 		[super drawContent];
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	return [self style] == nil || [[self style] supportsGeometricHitTesting];
+}
+
+/** @brief Hit-tests the path analytically
+
+ Tests the same fill and thickened stroke that -drawContent substitutes when hit-testing.
+ */
+- (BOOL)geometricHitTestRect:(NSRect)r
+{
+	CGFloat strokeWidth = MAX(4, [[self style] maxStrokeWidth]);
+	BOOL hasFill = [[self style] hasFill] || [[self style] hasHatch];
+	NSBezierPath* path = [[self geometryCacheEntry] path];
+
+	if (path == nil)
+		path = [self renderingPath];
+
+	return [path isHitByRect:r
+					  filled:hasFill
+				 strokeWidth:strokeWidth];
+}
+
 /** @brief Draws the seleciton highlight on the object when requested
  */
 - (void)drawSelectedState
@@ -2121,12 +2164,18 @@ finish:
 - (void)drawGhostedContent
 {
 	[[[self class] ghostColour] set];
-	NSBezierPath* rp = [self renderingPath];
+	DKGeometryCacheEntry* entry = [self geometryCacheEntry];
+	NSBezierPath* rp;
 
-	// if the path is usually drawn wider than 2, outline it
+	// if the path is usually drawn wider than 2, outline it. The cached paths are shared, so are copied before their line width is changed
 
-	if ([[self style] maxStrokeWidth] > 2)
-		rp = [rp strokedPathWithStrokeWidth:[[self style] maxStrokeWidth]];
+	if ([[self style] maxStrokeWidth] > 2) {
+		if (entry)
+			rp = [[entry strokeOutlineWithWidth:[[self style] maxStrokeWidth]] copy];
+		else
+			rp = [[self renderingPath] strokedPathWithStrokeWidth:[[self style] maxStrokeWidth]];
+	} else
+		rp = entry ? [[entry path] copy] : [self renderingPath];
 
 	[rp setLineWidth:0];
 	[rp stroke];
@@ -2327,9 +2376,20 @@ finish:
 						event:evt];
 	else {
 		if ([self mouseHasMovedSinceStartOfTracking] && [self undoPath]) {
-			[[self undoManager] registerUndoWithTarget:self
-											  selector:@selector(setPath:)
-												object:[self undoPath]];
+			// dragging points only moves them, so usually just the points that moved need be kept for undo rather than the whole path
+
+			DKPathDelta* delta = [DKPathDelta deltaFromPath:[self path]
+													 toPath:[self undoPath]];
+
+			if (delta)
+				[[self undoManager] registerUndoWithTarget:self
+												  selector:@selector(applyPathDelta:)
+													object:delta];
+			else
+				[[self undoManager] registerUndoWithTarget:self
+												  selector:@selector(setPath:)
+													object:[self undoPath]];
+
 			[[self undoManager] setActionName:NSLocalizedString(@"Change Path", @"undo string for change path")];
 			[self clearUndoPath];
 		}
@@ -2436,6 +2496,59 @@ finish:
 	return rPath;
 }
 
+/** @brief Return a number that changes when any aspect of the geometry changes
+
+ A path's geometry is its path, so this is derived from every point of the path. Unlike the location and size, this also changes when
+ a control point is moved within the path's bounds, and it doesn't have to transform the path to find out. The number is kept until
+ the path is next set or changed.
+ @return a number
+ */
+- (NSUInteger)geometryChecksum
+{
+	if (mGeometryChecksum != 0)
+		return mGeometryChecksum;
+
+	NSBezierPath* path = [self path];
+	NSInteger i, count = [path elementCount];
+	NSUInteger cd = 282735623 ^ count; // arbitrary
+	NSPoint ap[3];
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+		NSInteger j, n = (element == NSCurveToBezierPathElement) ? 3 : (element == NSClosePathBezierPathElement) ? 0 : 1;
+
+		cd = (cd * 31) ^ element;
+
+		for (j = 0; j < n; ++j) {
+			NSUInteger words[sizeof(NSPoint) / sizeof(NSUInteger)];
+
+			memcpy(words, &ap[j], sizeof(words));
+
+			for (NSUInteger k = 0; k < sizeof(NSPoint) / sizeof(NSUInteger); ++k)
+				cd = (cd * 31) ^ words[k];
+		}
+	}
+
+	mGeometryChecksum = (cd != 0) ? cd : 1;
+
+	return mGeometryChecksum;
+}
+
+- (void)notifyGeometryChange:(NSRect)oldBounds
+{
+	mGeometryChecksum = 0;
+	[super notifyGeometryChange:oldBounds];
+}
+
+- (void)notifyVisualChange
+{
+	// while a path is being created its points are changed in place, and only a visual change is notified
+
+	mGeometryChecksum = 0;
+	[super notifyVisualChange];
+}
+
 /** @brief Rotates the path to the given angle
 
  Paths are not rotatable like shapes, but in special circumstances you may want to rotate the path
@@ -10,6 +10,7 @@
 #import "DKDrawablePath.h"
 #import "DKDrawableShape+Hotspots.h"
 #import "DKDrawing.h"
+#import "DKGeometryCache.h"
 #import "DKGeometryUtilities.h"
 #import "DKGridLayer.h"
 #import "DKKnob.h"
@@ -388,6 +389,7 @@ static NSSize sTempSavedOffset;
 										object:m_path];
 
 	m_path = path;
+	[self invalidateGeometryCache];
 	[self notifyVisualChange];
 	[self notifyGeometryChange:oldBounds];
 }
@@ -1159,6 +1161,7 @@ static NSSize sTempSavedOffset;
 		break;
 	}
 
+	[self invalidateGeometryCache];
 	[self notifyVisualChange];
 }
 
@@ -1308,6 +1311,7 @@ static NSSize sTempSavedOffset;
 	if (dt != m_distortTransform) {
 		m_distortTransform = dt;
 
+		[self invalidateGeometryCache];
 		[self notifyVisualChange];
 
 		if (m_distortTransform == nil)
@@ -1654,6 +1658,30 @@ static NSSize sTempSavedOffset;
 		[super drawContent];
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	return [self style] == nil || [[self style] supportsGeometricHitTesting];
+}
+
+/**
+ Tests the same fill and thickened stroke that -drawContent substitutes when hit-testing, but analytically
+ */
+- (BOOL)geometricHitTestRect:(NSRect)r
+{
+	BOOL hasStroke = [[self style] hasStroke];
+	BOOL hasFill = !hasStroke || [[self style] hasFill] || [[self style] hasHatch];
+
+	CGFloat strokeWidth = hasStroke ? MAX(2, [[self style] maxStrokeWidth]) : 0;
+	NSBezierPath* path = [[self geometryCacheEntry] path];
+
+	if (path == nil)
+		path = [self renderingPath];
+
+	return [path isHitByRect:r
+					  filled:hasFill
+				 strokeWidth:strokeWidth];
+}
+
 /**
  Return if knobs should be drawn. Default is true, override to change
  */
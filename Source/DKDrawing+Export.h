@@ -15,9 +15,9 @@ This category provides methods for exporting drawings in a variety of formats, s
 a way to specify the resolution of the exported image is also provided. All methods return NSData that is the formatted image data - this can be
 written directly as a file of the designated kind.
 
-All image export starts with the pdf representation of the drawing as exported directly by DKDrawing. This is then imaged into a new bitmap image
-rep before conversion to the final format. The use of the pdf data ensures that results are consistent and require no major knowledge of the
-drawing's internals.
+All image export starts by rendering the drawing's layers into a single bitmap, which is then converted to the final format. The bitmap is divided into
+tiles which are rendered in turn, each into its own context over its part of the bitmap. Each layer only draws the objects that its storage
+returns for the tile, so large, high resolution exports don't walk every object for every part of the image.
 
 All images are exported in 24/32 bit full colour.
 
@@ -29,7 +29,7 @@ This uses Image I/O to perform the data encoding.
 */
 @interface DKDrawing (Export)
 
-// generate the master bitmap (from pdf data):
+// generate the master bitmap:
 
 /** @brief Creates the initial bitmap image that the various bitmap formats are created from.
 
@@ -6,13 +6,15 @@
 
 #import "DKDrawing+Export.h"
 #import "DKLayer+Metadata.h"
-#import "DKSelectionPDFView.h"
 #import "LogEvent.h"
 
 NSString* const kDKExportPropertiesResolution = @"kDKExportPropertiesResolution";
 NSString* const kDKExportedImageHasAlpha = @"kDKExportedImageHasAlpha";
 NSString* const kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
 
+/// edge length in pixels of the square tiles that bitmap export is divided into
+static const size_t kDKExportTileSize = 512;
+
 @interface DKGraphicsContextNoPrint : NSGraphicsContext
 
 - (instancetype)initWithCGContext:(CGContextRef)ctx;
@@ -141,73 +143,132 @@ NSString* const kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale"
  */
 - (CGImageRef)CGImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale
 {
+	NSAssert(relScale > 0, @"scale factor must be greater than zero");
+
 	[self finalizePriorToSaving];
-	NSRect frame = NSZeroRect;
-	frame.size = [[self drawing] drawingSize];
 
-	DKLayerPDFView* pdfView = [[DKLayerPDFView alloc] initWithFrame:frame
-														  withLayer:self];
-	/* spiderr - this was removed as it precludes rasterizing on a background thread (which is essential for hi-dpi images).
-	             It's possible this will need to be re-added, though for now it appears the DKViewController is not needed when dumping the canvas to a CGImage
-	DKViewController* vc = [pdfView makeViewController];
+	// create a bitmap of the requisite size. The pixels are allocated once here; each tile renders through its own
+	// context directly into its part of this buffer, so no stitching is needed once the tiles are done.
 
-	[[self drawing] addController:vc];
-    */
-	NSAssert(relScale > 0, @"scale factor must be greater than zero");
+	CGFloat scale = ((CGFloat)dpi * relScale) / 72.0;
+	NSSize bmSize = [self drawingSize];
 
-	// create a bitmap rep of the requisite size.
+	bmSize.width = ceil(bmSize.width * scale);
+	bmSize.height = ceil(bmSize.height * scale);
 
-	NSSize bmSize = [self drawingSize];
+	size_t width = (size_t)bmSize.width;
+	size_t height = (size_t)bmSize.height;
+	size_t bytesPerRow = width * 4;
+
+	if (width == 0 || height == 0)
+		return NULL;
 
-	bmSize.width = ceil((bmSize.width * (CGFloat)dpi * relScale) / 72.0);
-	bmSize.height = ceil((bmSize.height * (CGFloat)dpi * relScale) / 72.0);
+	CGColorSpaceRef clrSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+	CGBitmapInfo bmInfo = kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedLast;
+	CGContextRef bmCtx = CGBitmapContextCreate(NULL, width, height, 8, bytesPerRow, clrSpace, bmInfo);
 
-	CGContextRef bmCtx;
-	{
-		CGColorSpaceRef clrSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
-		bmCtx = CGBitmapContextCreate(NULL, bmSize.width, bmSize.height, 8, bmSize.width * 4, clrSpace, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedLast);
+	if (bmCtx == NULL) {
 		CGColorSpaceRelease(clrSpace);
+		return NULL;
+	}
+
+	CGContextClearRect(bmCtx, CGRectMake(0, 0, width, height));
+
+	uint8_t* pixels = CGBitmapContextGetData(bmCtx);
+	size_t tilesAcross = (width + kDKExportTileSize - 1) / kDKExportTileSize;
+	size_t tilesDown = (height + kDKExportTileSize - 1) / kDKExportTileSize;
+	NSColor* paper = (hasAlpha && ![self paperColourIsPrinted]) ? nil : [self paperColour];
+
+	LogEvent_(kInfoEvent, @"size = %@, dpi = %ld, tiles = %lu x %lu", NSStringFromSize(bmSize), (long)dpi, (unsigned long)tilesAcross, (unsigned long)tilesDown);
+
+	// render the tiles one after another. The renderers keep per-object caches and shared state (rough stroke caches,
+	// the style's current client, gradient angles and so on) that aren't safe to touch from several threads at once,
+	// so the tiles aren't farmed out concurrently - tiling still bounds the size of each pass over the storage. Likewise the
+	// storage classes and hit-testing assume they're used from one thread at a time, and aren't locked.
+
+	[self beginDrawing];
+
+	size_t tile, tileCount = tilesAcross * tilesDown;
+
+	for (tile = 0; tile < tileCount; ++tile) {
+		size_t tx = (tile % tilesAcross) * kDKExportTileSize;
+		size_t ty = (tile / tilesAcross) * kDKExportTileSize;
+		size_t tw = MIN(kDKExportTileSize, width - tx);
+		size_t th = MIN(kDKExportTileSize, height - ty);
+
+		// rows in the buffer run top to bottom, so this tile's first row is <ty> rows down
+
+		CGContextRef tileCtx = CGBitmapContextCreate(pixels + ty * bytesPerRow + tx * 4, tw, th, 8, bytesPerRow, clrSpace, bmInfo);
+
+		if (tileCtx) {
+			@autoreleasepool {
+				[self drawTileIntoContext:tileCtx
+							 pixelOrigin:NSMakePoint((CGFloat)tx, (CGFloat)ty)
+								pixelSize:NSMakeSize((CGFloat)tw, (CGFloat)th)
+									scale:scale
+							  paperColour:paper];
+			}
+			CGContextRelease(tileCtx);
+		}
 	}
 
-	CGContextClearRect(bmCtx, CGRectMake(0, 0, bmSize.width, bmSize.height));
+	[self endDrawing];
+
+	CGImageRef image = CGBitmapContextCreateImage(bmCtx);
+	CGContextRelease(bmCtx);
+	CGColorSpaceRelease(clrSpace);
 
-	LogEvent_(kInfoEvent, @"size = %@, dpi = %ld, ctx = %@", NSStringFromSize(bmSize), (long)dpi, bmCtx);
+	return (CGImageRef)CFAutorelease(image);
+}
 
-	NSGraphicsContext* context = [[DKGraphicsContextNoPrint alloc] initWithCGContext:bmCtx];
+/** @brief Renders one tile of a bitmap export into the given context.
+
+ Avoids anything that goes through the view - the layers are drawn with a nil view, which makes them query their
+ storage with the tile's rect in drawing coordinates.
+ @param ctx a bitmap context covering the tile's pixels
+ @param origin the tile's top, left corner in pixels within the whole image
+ @param size the tile's size in pixels
+ @param scale pixels per drawing unit
+ @param paper the colour to fill the background with, or nil to leave it transparent
+ */
+- (void)drawTileIntoContext:(CGContextRef)ctx pixelOrigin:(NSPoint)origin pixelSize:(NSSize)size scale:(CGFloat)scale paperColour:(NSColor*)paper
+{
+	NSGraphicsContext* context = [[DKGraphicsContextNoPrint alloc] initWithCGContext:ctx];
 
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
 		[NSGraphicsContext setCurrentContext:context];
 
 	NSAffineTransform* flipTrans = [[NSAffineTransform alloc] init];
 	[flipTrans scaleXBy:1 yBy:-1];
-	[flipTrans translateXBy:0 yBy:-bmSize.height];
-	[flipTrans scaleXBy:(((CGFloat)dpi * relScale) / 72.0) yBy:(((CGFloat)dpi * relScale) / 72.0)];
+	[flipTrans translateXBy:-origin.x yBy:-(size.height + origin.y)];
+	[flipTrans scaleXBy:scale yBy:scale];
 	[context setShouldAntialias:YES];
 	[context setImageInterpolation:NSImageInterpolationHigh];
-	NSRect destRect = NSZeroRect;
-	destRect.size = bmSize;
+	[flipTrans concat];
 
-	// if not preserving alpha, paint the background in the paper colour
+	// the tile in drawing coordinates, grown by a pixel so that objects just touching its edge still antialias into it
 
-	if (!hasAlpha) {
-		[[self paperColour] set];
-		NSRectFill(destRect);
-	}
+	NSRect tileRect = NSMakeRect(origin.x / scale, origin.y / scale, size.width / scale, size.height / scale);
+	tileRect = NSInsetRect(tileRect, -1.0 / scale, -1.0 / scale);
 
-	[flipTrans concat];
-	// draw the PDF rep into the bitmap rep.
+	// paint the background in the paper colour unless it's being left transparent
 
-	[pdfView drawRect:destRect];
-	//[pdfView displayRectIgnoringOpacity:destRect inContext:context];
+	if (paper) {
+		[paper set];
+		NSRectFill(tileRect);
+	}
 
-	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
-		CGImageRef image
-		= CGBitmapContextCreateImage(bmCtx);
-	CGContextRelease(bmCtx);
+	// draw the layers directly (as a layer group), bypassing the drawing's view-related housekeeping
 
-	pdfView = nil; // removes the controller
+	@try {
+		[super drawRect:tileRect
+				 inView:nil];
+	}
+	@catch (id exc) {
+		NSLog(@"### DK: An exception occurred while exporting - (%@) - will be ignored ###", exc);
+	}
 
-	return (CGImageRef)CFAutorelease(image);
+	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
 
 /** @brief Returns JPEG data for the drawing.
@@ -6,7 +6,7 @@
 
 #import "DKLayerGroup.h"
 
-@class DKGridLayer, DKGuideLayer, DKKnob, DKViewController, DKImageDataManager, DKUndoManager;
+@class DKGridLayer, DKGuideLayer, DKKnob, DKViewController, DKImageDataManager, DKUndoManager, DKGeometryCache;
 @protocol DKDrawingDelegate;
 
 typedef NSString* DKDrawingUnits NS_TYPED_EXTENSIBLE_ENUM;
@@ -58,6 +58,7 @@ NS_ASSUME_NONNULL_BEGIN
 	NSRect m_lastRectUpdated; /**< for refresh in HQ mode */
 	NSMutableSet<DKViewController*>* mControllers; /**< the set of current controllers */
 	DKImageDataManager* mImageManager; /**< internal object used to substantially improve efficiency of image archiving */
+	DKGeometryCache* mGeometryCache; /**< cached geometry of the drawing's objects */
 	id<DKDrawingDelegate> __weak mDelegateRef; /**< delegate, if any */
 	id __weak mOwnerRef; /**< back pointer to document or view that owns this */
 }
@@ -98,6 +99,39 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (nullable DKDrawing*)drawingWithData:(NSData*)drawingData;
 
+/** @brief Creates a drawing from data in the binary archive format written by \c -writeBinaryToURL:error:
+ @param drawingData data written by DKBinaryArchiver, preferably mapped from the file
+ @return the unarchived drawing, or nil if the data isn't a binary archive
+ */
++ (nullable DKDrawing*)drawingWithBinaryData:(NSData*)drawingData;
+
+/** @brief Creates a drawing from data in the binary archive format, reporting why if it can't
+
+ A damaged archive is reported as an \c NSFileReadCorruptFileError rather than raising.
+ @param drawingData data written by DKBinaryArchiver, preferably mapped from the file
+ @param error receives an error if the data isn't a binary archive or is damaged
+ @return the unarchived drawing, or nil
+ */
++ (nullable DKDrawing*)drawingWithBinaryData:(NSData*)drawingData error:(NSError* _Nullable __autoreleasing* _Nullable)error;
+
+/** @brief Whether the layers of a drawing in a binary archive are decoded concurrently. The default is NO.
+
+ Each layer that isn't a group or a placeholder is decoded on a thread of its own, by its own unarchiver. This requires that the
+ \c -initWithCoder: methods of layers and drawables, including those of application subclasses, are safe to run concurrently for
+ different layers, so it's left to the application to turn on once it knows they are.
+ */
+@property (class) BOOL decodesLayersConcurrently;
+
+/** @brief Creates a drawing from a file in either the keyed or the binary archive format
+ 
+ The file is mapped rather than read, so for the binary format only the parts of it that are decoded are read from disk. Empty or
+ damaged files are reported as an \c NSFileReadCorruptFileError.
+ @param url the file URL of the drawing
+ @param error receives an error if the file couldn't be read or decoded
+ @return the unarchived drawing
+ */
++ (nullable DKDrawing*)drawingWithContentsOfURL:(NSURL*)url error:(NSError* _Nullable __autoreleasing* _Nullable)error;
+
 /** @brief Return the default derachiving helper for deaerchiving a drawing
 
  This helper is a delegate of the dearchiver during dearchiving and translates older or obsolete
@@ -627,6 +661,17 @@ NS_ASSUME_NONNULL_BEGIN
  @return \c YES if succesfully written, \c NO otherwise.
  */
 - (BOOL)writeToURL:(NSURL*)url options:(NSDataWritingOptions)writeOptionsMask error:(NSError* _Nullable __autoreleasing* _Nullable)errorPtr;
+
+/** @brief Saves the entire drawing to a file URL in DrawKit's streaming binary format.
+ 
+ The drawing is written as it is encoded rather than first being built in memory, and the file is swapped into place once complete. Each
+ layer is stored in a section of its own and styles in a shared table, so a reader can locate and decode parts of the drawing separately.
+ Read it back with \c +drawingWithContentsOfURL:error: or \c +drawingWithData:.
+ @param url the full file URL of the file.
+ @param errorPtr if the file couldn't be written, upon return contains an error object that describes the problem.
+ @return \c YES if succesfully written, \c NO otherwise.
+ */
+- (BOOL)writeBinaryToURL:(NSURL*)url error:(NSError* _Nullable __autoreleasing* _Nullable)errorPtr;
 - (NSData*)drawingAsXMLDataAtRoot;
 - (NSData*)drawingAsXMLDataForKey:(NSString*)key;
 - (NSData*)drawingData;
@@ -644,6 +689,19 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (readonly, strong) DKImageDataManager* imageManager;
 
+/** @} */
+/** @name geometry cache
+ @{ */
+
+/** @brief Returns the geometry cache
+
+ The geometry cache holds the transformed paths of the drawing's objects, and values derived from them such as
+ stroke outlines, so that they don't have to be recalculated every time an object is drawn or hit-tested. Its memory
+ budget and hit/miss counts can be adjusted and read through this object.
+ @return the drawing's geometry cache
+ */
+@property (readonly, strong) DKGeometryCache* geometryCache;
+
 /** @} */
 @end
 
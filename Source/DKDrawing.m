@@ -5,11 +5,13 @@
 */
 
 #import "DKDrawing.h"
+#import "DKBinaryArchiver.h"
 #import "DKCategoryManager.h"
 #import "DKDrawKitMacros.h"
 #import "DKDrawing+Paper.h"
 #import "DKDrawingTool.h"
 #import "DKDrawingView.h"
+#import "DKGeometryCache.h"
 #import "DKGridLayer.h"
 #import "DKGuideLayer.h"
 #import "DKImageDataManager.h"
@@ -81,6 +83,15 @@ NSString* const DKDrawingUnitsMiles = @"miles";
 #pragma mark Static vars
 
 static id sDearchivingHelper = nil;
+static BOOL sDecodesLayersConcurrently = NO;
+
+@interface DKDrawing ()
+
++ (NSArray<DKLayer*>*)decodeLayersConcurrentlyWithUnarchiver:(DKBinaryUnarchiver*)unarch data:(NSData*)drawingData;
++ (NSError*)unreadableDrawingErrorWithReason:(NSString*)reason URL:(NSURL*)url;
+- (void)adoptSharedStylesForLayers:(NSArray<DKLayer*>*)layers;
+
+@end
 
 #pragma mark -
 @implementation DKDrawing
@@ -209,6 +220,9 @@ static id sDearchivingHelper = nil;
 	NSAssert(drawingData != nil, @"drawing data was nil - unable to proceed");
 	NSAssert([drawingData length] > 0, @"drawing data was empty - unable to proceed");
 
+	if ([DKBinaryUnarchiver canReadData:drawingData])
+		return [self drawingWithBinaryData:drawingData];
+
 	// using DKKeyedUnarchiver allows passing of image data manager to dearchiving methods for certain objects
 
 	DKKeyedUnarchiver* unarch = [[DKKeyedUnarchiver alloc] initForReadingWithData:drawingData];
@@ -231,6 +245,249 @@ static id sDearchivingHelper = nil;
 	return dwg;
 }
 
+/** @brief Creates a drawing from data in the binary archive format
+ @param drawingData data written by DKBinaryArchiver, preferably mapped from the file
+ @return the unarchived drawing
+ */
++ (DKDrawing*)drawingWithBinaryData:(NSData*)drawingData
+{
+	return [self drawingWithBinaryData:drawingData
+								 error:NULL];
+}
+
+/** @brief Creates a drawing from data in the binary archive format, reporting why if it can't
+ @param drawingData data written by DKBinaryArchiver, preferably mapped from the file
+ @param error receives an error if the data isn't a binary archive or is damaged
+ @return the unarchived drawing, or nil
+ */
++ (DKDrawing*)drawingWithBinaryData:(NSData*)drawingData error:(NSError* _Nullable __autoreleasing*)error
+{
+	DKBinaryUnarchiver* unarch = [[DKBinaryUnarchiver alloc] initForReadingWithData:drawingData];
+
+	if (unarch == nil) {
+		if (error)
+			*error = [self unreadableDrawingErrorWithReason:@"The data is not a binary drawing archive."
+														URL:nil];
+		return nil;
+	}
+
+	DKUnarchivingHelper* dearchivingHelper = [self dearchivingHelper];
+	if ([dearchivingHelper respondsToSelector:@selector(reset)])
+		[dearchivingHelper reset];
+
+	[unarch setDelegate:dearchivingHelper];
+
+	// a damaged archive raises as soon as decoding runs into the damage, which is reported as an error rather than passed on
+
+	DKDrawing* dwg = nil;
+
+	@try {
+		NSArray* concurrentLayers = nil;
+
+		if ([self decodesLayersConcurrently])
+			concurrentLayers = [self decodeLayersConcurrentlyWithUnarchiver:unarch
+																	   data:drawingData];
+
+		LogEvent_(kReactiveEvent, @"decoding drawing root object from binary archive......");
+
+		dwg = [unarch decodeObjectForKey:@"root"];
+
+		if ([concurrentLayers count] > 0)
+			[dwg adoptSharedStylesForLayers:concurrentLayers];
+	}
+	@catch (NSException* excp) {
+		LogEvent_(kFileEvent, @"binary drawing could not be decoded: %@", excp);
+
+		if (error)
+			*error = [self unreadableDrawingErrorWithReason:[excp reason]
+														URL:nil];
+		return nil;
+	}
+
+	[unarch finishDecoding];
+
+	if (dwg == nil && error)
+		*error = [self unreadableDrawingErrorWithReason:@"The archive does not contain a drawing."
+													URL:nil];
+
+	return dwg;
+}
+
++ (void)setDecodesLayersConcurrently:(BOOL)concurrently
+{
+	sDecodesLayersConcurrently = concurrently;
+}
+
++ (BOOL)decodesLayersConcurrently
+{
+	return sDecodesLayersConcurrently;
+}
+
+/** @brief Decodes the layers of a drawing in a binary archive concurrently, each into an object graph of its own
+
+ Apart from the styles they share, layers are independent of one another, so each is decoded on its own thread by an unarchiver of its
+ own reading the same data. The main unarchiver is then given the layers to use in place of decoding them when it decodes the drawing.
+ Layer groups, which refer to other layers, and layers that will be loaded as placeholders are left to the main unarchiver.
+ @param unarch the unarchiver that will decode the drawing
+ @param drawingData the archive
+ @return the layers decoded, in the order they were archived, or nil if there weren't enough to be worth decoding concurrently
+ */
++ (NSArray*)decodeLayersConcurrentlyWithUnarchiver:(DKBinaryUnarchiver*)unarch data:(NSData*)drawingData
+{
+	NSArray<NSNumber*>* layerIDs = [unarch layerObjectIDs];
+	NSMutableArray<NSNumber*>* candidateIDs = [NSMutableArray array];
+	BOOL defersHiddenLayers = [DKObjectOwnerLayer defersLoadingHiddenLayers];
+
+	for (NSNumber* layerID in layerIDs) {
+		__block BOOL suitable = NO;
+
+		[unarch inspectObjectWithID:[layerID unsignedIntValue]
+						 usingBlock:^(Class objectClass) {
+							 if (objectClass == Nil || [objectClass isSubclassOfClass:[DKLayerGroup class]])
+								 return;
+
+							 if (defersHiddenLayers && [objectClass isSubclassOfClass:[DKObjectOwnerLayer class]] && [unarch containsValueForKey:@"DKObjectOwnerLayer_objectCount"])
+								 suitable = [unarch decodeBoolForKey:@"visible"] && ![unarch decodeBoolForKey:@"locked"];
+							 else
+								 suitable = YES;
+						 }];
+
+		if (suitable)
+			[candidateIDs addObject:layerID];
+	}
+
+	if ([candidateIDs count] < 2)
+		return nil;
+
+	NSUInteger count = [candidateIDs count];
+	NSMutableArray* results = [NSMutableArray arrayWithCapacity:count];
+	uint32_t rootID = [unarch objectIDForKey:@"root"];
+	id helper = [unarch delegate];
+
+	for (NSUInteger i = 0; i < count; ++i)
+		[results addObject:[NSNull null]];
+
+	dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+		uint32_t layerID = [[candidateIDs objectAtIndex:i] unsignedIntValue];
+		DKBinaryUnarchiver* worker = [[DKBinaryUnarchiver alloc] initForReadingWithData:drawingData];
+
+		[worker setDelegate:helper];
+
+		// references to the drawing and to other layers are left unresolved. Each layer's group is set when the drawing adds it
+
+		[worker setObject:nil
+			  forObjectID:rootID];
+
+		for (NSNumber* otherID in layerIDs) {
+			if ([otherID unsignedIntValue] != layerID)
+				[worker setObject:nil
+					  forObjectID:[otherID unsignedIntValue]];
+		}
+
+		DKLayer* layer = nil;
+
+		@try {
+			layer = [worker decodeObjectWithID:layerID];
+		}
+		@catch (NSException* excp) {
+			// the main unarchiver will decode the layer instead, and report the problem if there is one
+
+			LogEvent_(kFileEvent, @"concurrent decoding of layer %u failed: %@", layerID, excp);
+		}
+
+		if (layer) {
+			@synchronized(results)
+			{
+				[results replaceObjectAtIndex:i
+								   withObject:layer];
+			}
+		}
+	});
+
+	NSMutableArray* layers = [NSMutableArray arrayWithCapacity:count];
+
+	for (NSUInteger i = 0; i < count; ++i) {
+		id layer = [results objectAtIndex:i];
+
+		if (layer != [NSNull null]) {
+			[unarch setObject:layer
+				  forObjectID:[[candidateIDs objectAtIndex:i] unsignedIntValue]];
+			[layers addObject:layer];
+		}
+	}
+
+	return layers;
+}
+
+/** @brief Creates a drawing from a file in either archive format
+ @param url the file URL of the drawing
+ @param error receives an error if the file couldn't be read
+ @return the unarchived drawing
+ */
++ (DKDrawing*)drawingWithContentsOfURL:(NSURL*)url error:(NSError* _Nullable __autoreleasing*)error
+{
+	// mapping the file means that only the parts of a binary archive which are decoded are read
+
+	NSData* data = [NSData dataWithContentsOfURL:url
+										 options:NSDataReadingMappedIfSafe
+										   error:error];
+	if (data == nil)
+		return nil;
+
+	if ([data length] == 0) {
+		if (error)
+			*error = [self unreadableDrawingErrorWithReason:@"The file is empty."
+														URL:url];
+		return nil;
+	}
+
+	if ([DKBinaryUnarchiver canReadData:data]) {
+		NSError* binaryError = nil;
+		DKDrawing* dwg = [self drawingWithBinaryData:data
+											   error:&binaryError];
+
+		if (dwg == nil && error)
+			*error = [self unreadableDrawingErrorWithReason:[binaryError localizedFailureReason]
+														URL:url];
+		return dwg;
+	}
+
+	// keyed archives raise on damaged data too
+
+	DKDrawing* dwg = nil;
+	NSString* reason = nil;
+
+	@try {
+		dwg = [self drawingWithData:data];
+	}
+	@catch (NSException* excp) {
+		LogEvent_(kFileEvent, @"drawing could not be decoded: %@", excp);
+		reason = [excp reason];
+	}
+
+	if (dwg == nil && error)
+		*error = [self unreadableDrawingErrorWithReason:reason
+													URL:url];
+
+	return dwg;
+}
+
++ (NSError*)unreadableDrawingErrorWithReason:(NSString*)reason URL:(NSURL*)url
+{
+	NSMutableDictionary* userInfo = [NSMutableDictionary dictionary];
+
+	if (reason)
+		[userInfo setObject:reason
+					 forKey:NSLocalizedFailureReasonErrorKey];
+	if (url)
+		[userInfo setObject:url
+					 forKey:NSURLErrorKey];
+
+	return [NSError errorWithDomain:NSCocoaErrorDomain
+							   code:NSFileReadCorruptFileError
+						   userInfo:userInfo];
+}
+
 /** @brief Return the default derachiving helper for deaerchiving a drawing
 
  This helper is a delegate of the dearchiver during dearchiving and translates older or obsolete
@@ -402,6 +659,7 @@ static id sDearchivingHelper = nil;
 		[self setLowQualityTriggerInterval:0.2];
 
 		mImageManager = [[DKImageDataManager alloc] init];
+		mGeometryCache = [[DKGeometryCache alloc] init];
 
 		if (m_units == nil
 			|| [self knobs] == nil
@@ -1208,6 +1466,20 @@ static id sDearchivingHelper = nil;
 	return [[self drawingData] writeToURL:url options:writeOptionsMask error:errorPtr];
 }
 
+- (BOOL)writeBinaryToURL:(NSURL*)url error:(NSError* _Nullable __autoreleasing*)errorPtr
+{
+	NSAssert(url != nil, @"URL was nil");
+	NSAssert([[url path] length] > 0, @"filename was empty");
+
+	[[self drawingInfo] setObject:url.path
+						   forKey:kDKDrawingInfoOriginalFilename];
+	[self finalizePriorToSaving];
+
+	return [DKBinaryArchiver archiveRootObject:self
+										 toURL:url
+										 error:errorPtr];
+}
+
 /** @brief Returns the entire drawing's data in XML format, having the key "root"
 
  Specifies NSPropertyListXMLFormat_v1_0
@@ -1270,6 +1542,7 @@ static id sDearchivingHelper = nil;
 }
 
 @synthesize imageManager = mImageManager;
+@synthesize geometryCache = mGeometryCache;
 
 #pragma mark -
 #pragma mark As a DKLayerGroup
@@ -1632,6 +1905,7 @@ static id sDearchivingHelper = nil;
 		[self setDrawingUnits:[coder decodeObjectForKey:@"drawing_units"]
 			unitToPointsConversionFactor:[coder decodeDoubleForKey:@"utp_conv"]];
 		mImageManager = imageManager;
+		mGeometryCache = [[DKGeometryCache alloc] init];
 
 		if ([coder containsValueForKey:@"DKDrawing_isFlipped"])
 			[self setFlipped:[coder decodeBoolForKey:@"DKDrawing_isFlipped"]];
@@ -1693,6 +1967,40 @@ static id sDearchivingHelper = nil;
 	return self;
 }
 
+/** @brief Makes layers that were decoded separately share one copy of each style
+
+ Layers decoded concurrently each have their own copies of the styles they share with other layers. For each style key the copy kept is
+ the one the main unarchiver decoded if there is one, otherwise that of the first of the layers, in archive order, to use it, so the
+ outcome depends only on the file and not on which thread finished first. The drawing's registered styles can then be remerged with the
+ registry as usual.
+ @param layers the layers that were decoded concurrently
+ */
+- (void)adoptSharedStylesForLayers:(NSArray*)layers
+{
+	NSMutableDictionary<NSString*, DKStyle*>* stylesByKey = [NSMutableDictionary dictionary];
+	NSMutableArray* layerOrder = [NSMutableArray array];
+
+	for (DKLayer* layer in [self flattenedLayers]) {
+		if ([layers indexOfObjectIdenticalTo:layer] == NSNotFound)
+			[layerOrder addObject:layer];
+	}
+
+	[layerOrder addObjectsFromArray:layers];
+
+	for (DKLayer* layer in layerOrder) {
+		for (DKStyle* style in [layer allStyles]) {
+			if ([stylesByKey objectForKey:[style uniqueKey]] == nil)
+				[stylesByKey setObject:style
+								forKey:[style uniqueKey]];
+		}
+	}
+
+	NSSet* sharedStyles = [NSSet setWithArray:[stylesByKey allValues]];
+
+	[layers makeObjectsPerformSelector:@selector(replaceMatchingStylesFromSet:)
+							withObject:sharedStyles];
+}
+
 @end
 
 @implementation DKDrawing (Deprecated)
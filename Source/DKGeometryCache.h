@@ -0,0 +1,154 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKRasterizerProtocol.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class DKGeometryCache;
+
+/** @brief The cached geometry of one object, as it was when the entry was made.
+
+ The cached geometry of one object, as it was when the entry was made. The rendering path and its bounds are captured up front; everything else is
+ derived from the path the first time it's asked for, and kept from then on. Entries are made and handed out by a DKGeometryCache, and are
+ shared by every client of the object's geometry - drawing, hit-testing, snapping and export - on any thread.
+
+ The paths returned are shared, so must not be modified - copy them first if necessary.
+*/
+@interface DKGeometryCacheEntry : NSObject {
+@public // for the use of DKGeometryCache only
+	DKGeometryCache* __weak mCache;
+	id __weak mOwner;
+	const void* mOwnerAddress;
+	NSUInteger mKey;
+	NSBezierPath* mPath;
+	NSRect mBounds;
+	NSBezierPath* mFlattenedPath;
+	CGPathRef mQuartzPath;
+	NSMutableDictionary<NSNumber*, NSBezierPath*>* mStrokeOutlines;
+	CGFloat* mElementLengths;
+	CGFloat mLength;
+	NSUInteger mCost;
+	BOOL mInCache;
+	DKGeometryCacheEntry* __unsafe_unretained mPrev;
+	DKGeometryCacheEntry* __unsafe_unretained mNext;
+	dispatch_semaphore_t mLock;
+}
+
+/** @brief The object's rendering path, in its final position.
+ */
+@property (readonly, strong, nullable) NSBezierPath* path;
+
+/** @brief The bounds of the rendering path.
+ */
+@property (readonly) NSRect bounds;
+
+/** @brief The rendering path flattened to a polyline, at the path's own flatness.
+ */
+@property (readonly, strong, nullable) NSBezierPath* flattenedPath;
+
+/** @brief The rendering path as a Quartz path, for drawing it straight into a graphics context.
+ */
+@property (readonly, nullable) CGPathRef quartzPath;
+
+/** @brief The outline of the rendering path when stroked at the given width.
+ @param width the stroke width
+ @return a closed path, or nil if the object has no path
+ */
+- (nullable NSBezierPath*)strokeOutlineWithWidth:(CGFloat)width;
+
+/** @brief The length of each element of the rendering path, indexed as the path's elements.
+ */
+@property (readonly, nullable) const CGFloat* elementLengths NS_RETURNS_INNER_POINTER;
+
+/** @brief The total length of the rendering path.
+ */
+@property (readonly) CGFloat length;
+
+/** @brief An estimate of the memory used by the entry, in bytes.
+ */
+@property (readonly) NSUInteger cost;
+
+@end
+
+#pragma mark -
+
+/** @brief A memory-limited cache of objects' geometry.
+
+ A memory-limited cache of objects' geometry. Each drawing owns one of these, and its drawable objects keep their transformed paths and values
+ derived from them here rather than recomputing them every time they're drawn or hit-tested.
+
+ An object's entry is keyed by a number the object supplies (see -[DKDrawableObject geometryCacheKey]) that changes whenever its geometry changes;
+ a request with a different key replaces the entry. When the estimated size of all entries exceeds the memory budget, the least recently used
+ entries are discarded. The cache counts its hits and misses so that its effectiveness can be measured. It may be used from any thread.
+*/
+@interface DKGeometryCache : NSObject {
+@private
+	NSMapTable* mEntries;
+	DKGeometryCacheEntry* __unsafe_unretained mHead;
+	DKGeometryCacheEntry* __unsafe_unretained mTail;
+	NSUInteger mMemoryBudget;
+	NSUInteger mMemoryUsed;
+	NSUInteger mHitCount;
+	NSUInteger mMissCount;
+	NSUInteger mEvictionCount;
+	dispatch_semaphore_t mLock;
+}
+
+/** @brief The memory budget given to new caches, in bytes. The default is 16MB.
+ */
+@property (class) NSUInteger defaultMemoryBudget;
+
+/** @brief The most memory the cache's entries may use, in bytes.
+
+ Lowering the budget discards entries immediately if necessary.
+ */
+@property NSUInteger memoryBudget;
+
+/** @brief The memory currently used by the cache's entries, in bytes.
+ */
+@property (readonly) NSUInteger memoryUsed;
+
+/** @brief The number of requests answered from the cache.
+ */
+@property (readonly) NSUInteger hitCount;
+
+/** @brief The number of requests that had to compute their result.
+ */
+@property (readonly) NSUInteger missCount;
+
+/** @brief The number of entries discarded to keep within the memory budget.
+ */
+@property (readonly) NSUInteger evictionCount;
+
+/** @brief The number of entries in the cache.
+ */
+@property (readonly) NSUInteger countOfEntries;
+
+/** @brief Returns the entry for an object, making a new one if there's none or its key is different.
+ @param object the object whose geometry is wanted
+ @param key a number that changes whenever the object's geometry changes
+ @return the entry
+ */
+- (DKGeometryCacheEntry*)entryForObject:(id<DKRenderable>)object key:(NSUInteger)key;
+
+/** @brief Discards the entry for an object, if there is one.
+ @param object the object
+ */
+- (void)removeEntryForObject:(id)object;
+
+/** @brief Discards every entry.
+ */
+- (void)removeAllEntries;
+
+/** @brief Zeroes the hit, miss and eviction counts.
+ */
+- (void)resetStatistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
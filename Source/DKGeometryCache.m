@@ -0,0 +1,448 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKGeometryCache.h"
+#import "NSBezierPath+Geometry.h"
+
+/// the most stroke outlines kept per entry - objects are rarely stroked at more than a couple of widths
+#define kDKGeometryCacheMaxStrokeOutlines 4
+/// an allowance for the entry object itself
+#define kDKGeometryCacheEntryOverhead 128
+
+static NSUInteger sDefaultMemoryBudget = 16 * 1024 * 1024;
+
+static inline NSUInteger costOfPath(NSBezierPath* path)
+{
+	// a rough estimate - each element holds up to three points
+
+	return (path != nil) ? 64 + [path elementCount] * (3 * sizeof(NSPoint) + sizeof(NSInteger)) : 0;
+}
+
+@interface DKGeometryCache ()
+
+- (void)entry:(DKGeometryCacheEntry*)entry didAddCost:(NSUInteger)cost;
+- (void)noteHit:(BOOL)hit;
+- (void)linkEntryAtHead:(DKGeometryCacheEntry*)entry;
+- (void)unlinkEntry:(DKGeometryCacheEntry*)entry;
+- (void)discardEntry:(DKGeometryCacheEntry*)entry;
+- (void)evictEntriesToFitBudget;
+
+@end
+
+@interface DKGeometryCacheEntry ()
+
+- (instancetype)initWithCache:(DKGeometryCache*)cache object:(id<DKRenderable>)object key:(NSUInteger)key NS_DESIGNATED_INITIALIZER;
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+
+@end
+
+#pragma mark -
+
+@implementation DKGeometryCacheEntry
+
+- (instancetype)initWithCache:(DKGeometryCache*)cache object:(id<DKRenderable>)object key:(NSUInteger)key
+{
+	self = [super init];
+	if (self) {
+		mCache = cache;
+		mOwner = object;
+		mOwnerAddress = (__bridge const void*)object;
+		mKey = key;
+		mPath = [object renderingPath];
+
+		if (mPath != nil && ![mPath isEmpty])
+			mBounds = [mPath bounds];
+
+		mLength = -1;
+		mCost = kDKGeometryCacheEntryOverhead + costOfPath(mPath);
+		mLock = dispatch_semaphore_create(1);
+	}
+
+	return self;
+}
+
+@synthesize path = mPath;
+@synthesize bounds = mBounds;
+@synthesize cost = mCost;
+
+- (NSBezierPath*)flattenedPath
+{
+	if (mPath == nil)
+		return nil;
+
+	DKGeometryCache* cache = mCache;
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	[cache noteHit:mFlattenedPath != nil];
+
+	if (mFlattenedPath == nil) {
+		mFlattenedPath = [mPath bezierPathByFlatteningPath];
+		[cache entry:self
+			didAddCost:costOfPath(mFlattenedPath)];
+	}
+
+	NSBezierPath* path = mFlattenedPath;
+	dispatch_semaphore_signal(mLock);
+
+	return path;
+}
+
+- (CGPathRef)quartzPath
+{
+	if (mPath == nil)
+		return NULL;
+
+	DKGeometryCache* cache = mCache;
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	[cache noteHit:mQuartzPath != NULL];
+
+	if (mQuartzPath == NULL) {
+		mQuartzPath = [mPath newQuartzPath];
+		[cache entry:self
+			didAddCost:costOfPath(mPath)];
+	}
+
+	CGPathRef path = mQuartzPath;
+	dispatch_semaphore_signal(mLock);
+
+	return path;
+}
+
+- (NSBezierPath*)strokeOutlineWithWidth:(CGFloat)width
+{
+	if (mPath == nil)
+		return nil;
+
+	DKGeometryCache* cache = mCache;
+	NSNumber* key = @(width);
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	NSBezierPath* outline = [mStrokeOutlines objectForKey:key];
+
+	[cache noteHit:outline != nil];
+
+	if (outline == nil) {
+		outline = [mPath strokedPathWithStrokeWidth:width];
+
+		if (mStrokeOutlines == nil)
+			mStrokeOutlines = [[NSMutableDictionary alloc] init];
+		else if ([mStrokeOutlines count] >= kDKGeometryCacheMaxStrokeOutlines)
+			[mStrokeOutlines removeAllObjects];
+
+		if (outline) {
+			[mStrokeOutlines setObject:outline
+								forKey:key];
+			[cache entry:self
+				didAddCost:costOfPath(outline)];
+		}
+	}
+
+	dispatch_semaphore_signal(mLock);
+
+	return outline;
+}
+
+- (const CGFloat*)elementLengths
+{
+	if (mPath == nil)
+		return NULL;
+
+	DKGeometryCache* cache = mCache;
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	[cache noteHit:mElementLengths != NULL];
+
+	if (mElementLengths == NULL) {
+		NSInteger i, count = [mPath elementCount];
+		CGFloat* lengths = malloc(sizeof(CGFloat) * MAX(count, 1));
+		CGFloat total = 0;
+
+		if (lengths != NULL) {
+			for (i = 0; i < count; ++i) {
+				lengths[i] = [mPath lengthOfElement:i];
+				total += lengths[i];
+			}
+
+			mElementLengths = lengths;
+			mLength = total;
+			[cache entry:self
+				didAddCost:sizeof(CGFloat) * count];
+		}
+	}
+
+	const CGFloat* lengths = mElementLengths;
+	dispatch_semaphore_signal(mLock);
+
+	return lengths;
+}
+
+- (CGFloat)length
+{
+	if (mPath == nil)
+		return 0;
+
+	[self elementLengths];
+	return MAX(mLength, 0);
+}
+
+- (void)dealloc
+{
+	free(mElementLengths);
+	CGPathRelease(mQuartzPath);
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> key = %lu, bounds = %@, cost = %lu", NSStringFromClass([self class]), self, (unsigned long)mKey, NSStringFromRect(mBounds), (unsigned long)mCost];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKGeometryCache
+
++ (NSUInteger)defaultMemoryBudget
+{
+	return sDefaultMemoryBudget;
+}
+
++ (void)setDefaultMemoryBudget:(NSUInteger)budget
+{
+	sDefaultMemoryBudget = budget;
+}
+
+#pragma mark -
+
+- (NSUInteger)memoryBudget
+{
+	return mMemoryBudget;
+}
+
+- (void)setMemoryBudget:(NSUInteger)budget
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+	mMemoryBudget = budget;
+	[self evictEntriesToFitBudget];
+	dispatch_semaphore_signal(mLock);
+}
+
+@synthesize memoryUsed = mMemoryUsed;
+@synthesize hitCount = mHitCount;
+@synthesize missCount = mMissCount;
+@synthesize evictionCount = mEvictionCount;
+
+- (NSUInteger)countOfEntries
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+	NSUInteger count = [mEntries count];
+	dispatch_semaphore_signal(mLock);
+
+	return count;
+}
+
+- (DKGeometryCacheEntry*)entryForObject:(id<DKRenderable>)object key:(NSUInteger)key
+{
+	NSAssert(object != nil, @"can't cache the geometry of a nil object");
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	DKGeometryCacheEntry* entry = [mEntries objectForKey:object];
+
+	// the table is keyed by address, so also check that the entry belongs to this object and not a previous one at the same address
+
+	if (entry && entry->mKey == key && entry->mOwner == object) {
+		++mHitCount;
+
+		if (entry != mHead) {
+			[self unlinkEntry:entry];
+			[self linkEntryAtHead:entry];
+		}
+
+		dispatch_semaphore_signal(mLock);
+		return entry;
+	}
+
+	++mMissCount;
+
+	if (entry)
+		[self discardEntry:entry];
+
+	dispatch_semaphore_signal(mLock);
+
+	// build the new entry outside the lock, as it calls back into the object
+
+	entry = [[DKGeometryCacheEntry alloc] initWithCache:self
+												 object:object
+													key:key];
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	// another thread may have made an entry for the same object in the meantime - the newer one wins
+
+	DKGeometryCacheEntry* other = [mEntries objectForKey:object];
+
+	if (other)
+		[self discardEntry:other];
+
+	[mEntries setObject:entry
+				 forKey:object];
+	[self linkEntryAtHead:entry];
+
+	entry->mInCache = YES;
+	mMemoryUsed += entry->mCost;
+	[self evictEntriesToFitBudget];
+
+	dispatch_semaphore_signal(mLock);
+
+	return entry;
+}
+
+- (void)removeEntryForObject:(id)object
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	DKGeometryCacheEntry* entry = [mEntries objectForKey:object];
+
+	if (entry)
+		[self discardEntry:entry];
+
+	dispatch_semaphore_signal(mLock);
+}
+
+- (void)removeAllEntries
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	while (mHead)
+		[self discardEntry:mHead];
+
+	mMemoryUsed = 0;
+
+	dispatch_semaphore_signal(mLock);
+}
+
+- (void)resetStatistics
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+	mHitCount = mMissCount = mEvictionCount = 0;
+	dispatch_semaphore_signal(mLock);
+}
+
+#pragma mark -
+
+- (void)entry:(DKGeometryCacheEntry*)entry didAddCost:(NSUInteger)cost
+{
+	// called by an entry when it caches something new
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	entry->mCost += cost;
+
+	if (entry->mInCache) {
+		mMemoryUsed += cost;
+		[self evictEntriesToFitBudget];
+	}
+
+	dispatch_semaphore_signal(mLock);
+}
+
+- (void)noteHit:(BOOL)hit
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	if (hit)
+		++mHitCount;
+	else
+		++mMissCount;
+
+	dispatch_semaphore_signal(mLock);
+}
+
+// the following must be called with the lock held
+
+- (void)linkEntryAtHead:(DKGeometryCacheEntry*)entry
+{
+	entry->mPrev = nil;
+	entry->mNext = mHead;
+
+	if (mHead)
+		mHead->mPrev = entry;
+
+	mHead = entry;
+
+	if (mTail == nil)
+		mTail = entry;
+}
+
+- (void)unlinkEntry:(DKGeometryCacheEntry*)entry
+{
+	if (entry->mPrev)
+		entry->mPrev->mNext = entry->mNext;
+	else
+		mHead = entry->mNext;
+
+	if (entry->mNext)
+		entry->mNext->mPrev = entry->mPrev;
+	else
+		mTail = entry->mPrev;
+
+	entry->mPrev = entry->mNext = nil;
+}
+
+- (void)discardEntry:(DKGeometryCacheEntry*)entry
+{
+	// the entry's owner may have gone, so it's removed from the table by address rather than by messaging the owner. Anyone
+	// still holding the entry can carry on using it.
+
+	[self unlinkEntry:entry];
+
+	entry->mInCache = NO;
+	mMemoryUsed -= MIN(entry->mCost, mMemoryUsed);
+
+	NSMapRemove(mEntries, entry->mOwnerAddress);
+}
+
+- (void)evictEntriesToFitBudget
+{
+	// the most recently used entry is always kept, however large
+
+	while (mMemoryUsed > mMemoryBudget && mTail != nil && mTail != mHead) {
+		[self discardEntry:mTail];
+		++mEvictionCount;
+	}
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		// keys are compared by address and not retained - the entries refer weakly to their objects instead
+
+		mEntries = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsObjectPointerPersonality
+											 valueOptions:NSPointerFunctionsStrongMemory
+												 capacity:0];
+		mMemoryBudget = [[self class] defaultMemoryBudget];
+		mLock = dispatch_semaphore_create(1);
+	}
+
+	return self;
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %lu entries, %lu of %lu bytes used, %lu hits, %lu misses, %lu evictions", NSStringFromClass([self class]), self, (unsigned long)[mEntries count], (unsigned long)mMemoryUsed, (unsigned long)mMemoryBudget, (unsigned long)mHitCount, (unsigned long)mMissCount, (unsigned long)mEvictionCount];
+}
+
+@end
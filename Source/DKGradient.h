@@ -9,7 +9,7 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
-@class DKColorStop;
+@class DKColorStop, DKGradientColorTable;
 
 //! gradient type:
 typedef NS_ENUM(NSInteger, DKGradientType) {
@@ -42,6 +42,7 @@ typedef NS_ENUM(NSInteger, DKGradientInterpolation) {
 	DKGradientType m_gradType; // type
 	DKGradientBlending m_blending; // method to blend colours
 	DKGradientInterpolation m_interp; // interpolation function
+	DKGradientColorTable* m_colorTable; // sampled colours, built on demand
 }
 
 // simple gradient convenience methods
@@ -205,6 +206,17 @@ typedef NS_ENUM(NSInteger, DKGradientInterpolation) {
  */
 - (NSColor*)colorAtValue:(CGFloat)val;
 
+/** @brief The gradient's colours, sampled into a table.
+
+ The table is built on first use and is discarded whenever the stops, blending or interpolation change, so always ask the gradient
+ for it rather than keeping it. This may be called from any thread.
+ */
+@property (readonly, strong) DKGradientColorTable* colorTable;
+
+/** @brief Discards the colour table so that it is rebuilt the next time it is needed.
+ */
+- (void)invalidateColorTable;
+
 // setting the angle
 
 /** @brief The gradient's angle in radians.
@@ -291,6 +303,44 @@ typedef NS_ENUM(NSInteger, DKGradientInterpolation) {
 
 @end
 
+#define kDKGradientColorTableSize 1024
+
+/** @brief An immutable table of colours sampled evenly along a gradient's ramp.
+
+ The table captures the gradient's stops, interpolation and blending mode at the time it was built. Entries are premultiplied RGBA,
+ four floats each, with the first entry at 0 and the last at 1. Being immutable, a table can be read from any thread.
+ */
+@interface DKGradientColorTable : NSObject {
+@private
+	float* mComponents;
+	NSGradient* mGradient;
+}
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+
+/** @brief The number of entries in the table.
+ */
+@property (readonly) NSUInteger count;
+
+/** @brief The table itself, \c count entries of premultiplied red, green, blue and alpha.
+ */
+- (const float*)components NS_RETURNS_INNER_POINTER;
+
+/** @brief Looks up the colour at a point on the ramp, interpolating between the nearest entries.
+ @param components receives premultiplied red, green, blue and alpha.
+ @param val the proportion of the ramp from start (0) to finish (1.0). Values outside this range are clamped.
+ */
+- (void)getComponents:(CGFloat*)components atValue:(CGFloat)val;
+
+/** @brief An \c NSGradient that draws the same ramp.
+
+ Where the stops alone describe the ramp, this uses the stops. For other interpolations and blending modes, it uses colours sampled
+ from the table.
+ */
+@property (readonly, strong) NSGradient* gradient;
+
+@end
+
 // notifications sent by DKGradient:
 
 extern NSNotificationName const kDKNotificationGradientWillAddColorStop;
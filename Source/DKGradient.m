@@ -33,6 +33,16 @@ static inline void transformHSV_RGB(CGFloat* components);
 static inline void transformRGB_HSV(CGFloat* components);
 static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 
+/** @brief A copy of a colour stop's position and components, so that colours can be worked out without touching the stop objects.
+ */
+typedef struct {
+	CGFloat position;
+	CGFloat rgba[4];
+} DKGradientStopValue;
+
+static NSInteger copyStopValues(NSArray<DKColorStop*>* stops, DKGradientStopValue** values);
+static void colorAtValueOfStops(const DKGradientStopValue* stops, NSInteger count, CGFloat val, DKGradientInterpolation interp, DKGradientBlending blending, CGFloat* components);
+
 #pragma mark -
 @interface DKColorStop ()
 
@@ -40,6 +50,12 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 
 @end
 
+@interface DKGradientColorTable ()
+
+- (instancetype)initWithGradient:(DKGradient*)gradient;
+
+@end
+
 #pragma mark -
 @implementation DKGradient
 #pragma mark As a DKGradient
@@ -127,6 +143,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 			inColorStopsAtIndex:[m_colorStops count]];
 		[stop setOwner:self];
 		[self sortColorStops];
+		[self invalidateColorTable];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidAddColorStop
 															object:self];
 	}
@@ -144,6 +161,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 															object:self];
 		NSUInteger indx = [m_colorStops indexOfObject:stop];
 		[self removeObjectFromColorStopsAtIndex:indx];
+		[self invalidateColorTable];
 
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidRemoveColorStop
 															object:self];
@@ -155,6 +173,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientWillRemoveColorStop
 														object:self];
 	[m_colorStops removeAllObjects];
+	[self invalidateColorTable];
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidRemoveColorStop
 														object:self];
 }
@@ -176,6 +195,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 
 	[m_colorStops makeObjectsPerformSelector:@selector(setOwner:)
 								  withObject:self];
+	[self invalidateColorTable];
 
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidAddColorStop
 														object:self];
@@ -218,6 +238,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 	}
 
 	[self sortColorStops];
+	[self invalidateColorTable];
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidChange
 														object:self];
 }
@@ -242,11 +263,14 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 	else
 		[m_colorStops insertObject:stop
 						   atIndex:ix];
+
+	[self invalidateColorTable];
 }
 
 - (void)removeObjectFromColorStopsAtIndex:(NSUInteger)ix
 {
 	[m_colorStops removeObjectAtIndex:ix];
+	[self invalidateColorTable];
 }
 
 #pragma mark -
@@ -314,164 +338,23 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 		 endRadius:er];
 }
 
-/** if \c ra is <code>NO</code>, this is optimised on the basis that it will be called from a loop with \c val going from 0 -> 1. In
- that case sequential access to the stops can be assumed and so no lookup loop is required. For random access, where
- \c val can be any value in or out of sequence, the lookup loop is required. If in doubt, pass YES.
+/** \c ra is no longer used; the colour is worked out directly from the stops whichever order values are asked for in.
  */
 - (void)private_colorAtValue:(CGFloat)val components:(CGFloat*)components randomAccess:(BOOL)ra
 {
-	// if <ra> is NO, this is optimised on the basis that it will be called from a loop with <val> going from 0 -> 1. In
-	// that case sequential access to the stops can be assumed and so no lookup loop is required. For random access, where
-	// <val> can be any value in or out of sequence, the lookup loop is required. If in doubt, pass YES.
-
-	NSInteger keys, k2;
-	static DKColorStop* key1 = nil;
-	static DKColorStop* key2 = nil;
-	static NSColor* kk1;
-	static NSColor* kk2;
-	static CGFloat k1pos, k2pos;
-	static NSInteger indx = 0;
-
-	keys = CFArrayGetCount((CFArrayRef)m_colorStops);
-
-	if (keys < 2)
-		return;
-
-	if (ra) {
-		// random access - need to find the right stop pair to use
-
-		key1 = [[self colorStops] objectAtIndex:0];
-		key2 = [[self colorStops] objectAtIndex:1];
-		k2 = 1;
+#pragma unused(ra)
 
-		while (k2 < (keys - 1) && [key2 position] < val) {
-			key1 = key2;
-			key2 = [[self colorStops] objectAtIndex:++k2];
-		}
+	// this used to keep the position of the last lookup in static variables, which made it unsafe to use from more than one
+	// thread. The stops are now copied and searched on each call - there are rarely more than a handful of them. Anything
+	// that needs many colours should use the colour table instead.
 
-		kk1 = [key1 color];
-		kk2 = [key2 color];
-		k1pos = [key1 position];
-		k2pos = [key2 position];
-	} else {
-		// sequential access - can assume that the previous value of <val> already set up the right pair, so we just need
-		// to see if it's crossed to the next stop position
-
-		// first check we have intialised the starting stops:
-
-		if (key1 == nil || val <= 0.0) {
-			key1 = (DKColorStop*)CFArrayGetValueAtIndex((CFArrayRef)m_colorStops, 0); // [_colorStops objectAtIndex:0];
-			key2 = (DKColorStop*)CFArrayGetValueAtIndex((CFArrayRef)m_colorStops, 1); // [_colorStops objectAtIndex:1];
-			kk1 = [key1 color];
-			kk2 = [key2 color];
-			k1pos = [key1 position];
-			k2pos = [key2 position];
-			indx = 2;
-		}
+	DKGradientStopValue* stops;
+	NSInteger keys = copyStopValues(m_colorStops, &stops);
 
-		// need to get next pair?
+	if (keys >= 2)
+		colorAtValueOfStops(stops, keys, val, m_interp, m_blending, components);
 
-		if (val > k2pos && indx < keys) {
-			key1 = key2;
-			kk1 = kk2;
-			k1pos = k2pos;
-			key2 = (DKColorStop*)CFArrayGetValueAtIndex((CFArrayRef)m_colorStops, indx++); //[[self colorStops] objectAtIndex:index++];
-			kk2 = [key2 color];
-			k2pos = [key2 position];
-		}
-	}
-
-	if (val <= k1pos) {
-		[kk1 getRed:&components[0]
-			  green:&components[1]
-			   blue:&components[2]
-			  alpha:&components[3]];
-	} else if (val >= k2pos) {
-		[kk2 getRed:&components[0]
-			  green:&components[1]
-			   blue:&components[2]
-			  alpha:&components[3]];
-
-		if (!ra && val >= 1.0) {
-			// reached the end - reset for next sequential run
-
-			key1 = key2 = nil;
-		}
-	} else {
-		CGFloat p = (val - k1pos) / (k2pos - k1pos);
-
-		switch (m_interp) {
-		default:
-		case DKGradientInterpolationLinear:
-			break;
-
-		case DKGradientInterpolationQuadratic:
-			p = powerMap(p, 2);
-			break;
-
-		case DKGradientInterpolationCubic:
-			p = powerMap(p, 3);
-			break;
-
-		case DKGradientInterpolationSinus:
-			p = sineMap(p, 1);
-			break;
-
-		case DKGradientInterpolationSinus2:
-			p = sineMap(p, 2);
-			break;
-		}
-
-		if (m_blending == DKGradientBlendingRGB) {
-			// access the stop's precached components directly for best speed:
-
-			CGFloat* ca;
-			CGFloat* cb;
-
-			ca = key1->components;
-			cb = key2->components;
-
-			components[0] = (cb[0] - ca[0]) * p + ca[0];
-			components[1] = (cb[1] - ca[1]) * p + ca[1];
-			components[2] = (cb[2] - ca[2]) * p + ca[2];
-			components[3] = (cb[3] - ca[3]) * p + ca[3];
-		} else if (m_blending == DKGradientBlendingHSB) {
-			// blend in HSV space - this method almost entirely lifted from Chad Weider (thanks!)
-
-			CGFloat ca[4];
-			CGFloat cb[4];
-			[kk1 getRed:&ca[0]
-				  green:&ca[1]
-				   blue:&ca[2]
-				  alpha:&ca[3]];
-			[kk2 getRed:&cb[0]
-				  green:&cb[1]
-				   blue:&cb[2]
-				  alpha:&cb[3]];
-
-			transformRGB_HSV(ca);
-			transformRGB_HSV(cb);
-			resolveHSV(ca, cb);
-
-			if (ca[0] > cb[0]) //if color1's hue is higher than color2's hue then
-				cb[0] += 360; //	we need to move c2 one revolution around the wheel
-
-			components[0] = (cb[0] - ca[0]) * p + ca[0];
-			components[1] = (cb[1] - ca[1]) * p + ca[1];
-			components[2] = (cb[2] - ca[2]) * p + ca[2];
-			components[3] = (cb[3] - ca[3]) * p + ca[3];
-
-			transformHSV_RGB(components);
-		} else if (m_blending == DKGradientBlendingAlpha) {
-			CGFloat* ca;
-			CGFloat* cb;
-
-			ca = key1->components;
-			cb = key2->components;
-
-			components[3] = (cb[3] - ca[3]) * p + ca[3];
-		}
-	}
+	free(stops);
 }
 
 #define qLogPerformanceMetrics 0
@@ -535,18 +418,28 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 
 - (NSGradient*)newNSGradient
 {
-	NSMutableArray* colArr = [[NSMutableArray alloc] initWithCapacity:m_colorStops.count];
-	CGFloat* stopsArr = calloc(m_colorStops.count, sizeof(CGFloat));
-	NSInteger i = 0;
-	for (DKColorStop* stop in m_colorStops) {
-		[colArr addObject:stop.color];
-		stopsArr[i++] = stop.position;
-	}
+	// the colour table builds the NSGradient once and keeps it until the gradient changes
 
-	NSGradient* grad = [[NSGradient alloc] initWithColors:colArr atLocations:stopsArr colorSpace:[NSColorSpace genericRGBColorSpace]];
-	free(stopsArr);
+	return [[self colorTable] gradient];
+}
 
-	return grad;
+- (DKGradientColorTable*)colorTable
+{
+	@synchronized(self)
+	{
+		if (m_colorTable == nil)
+			m_colorTable = [[DKGradientColorTable alloc] initWithGradient:self];
+
+		return m_colorTable;
+	}
+}
+
+- (void)invalidateColorTable
+{
+	@synchronized(self)
+	{
+		m_colorTable = nil;
+	}
 }
 
 #pragma mark -
@@ -706,6 +599,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientWillChange
 															object:self];
 		m_blending = bt;
+		[self invalidateColorTable];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidChange
 															object:self];
 	}
@@ -724,6 +618,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientWillChange
 															object:self];
 		m_interp = intrp;
+		[self invalidateColorTable];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidChange
 															object:self];
 	}
@@ -767,6 +662,8 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 #pragma unused(stop)
 
 	//	LogEvent_(kStateEvent, @"stop changed color (%@)", stop);
+
+	[self invalidateColorTable];
 }
 
 - (void)colorStopWillChangePosition:(DKColorStop*)stop
@@ -779,6 +676,8 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 #pragma unused(stop)
 
 	//	LogEvent_(kStateEvent, @"stop changed position (%@)", stop);
+
+	[self invalidateColorTable];
 }
 
 #pragma mark -
@@ -1107,6 +1006,219 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 @end
 
 #pragma mark -
+@implementation DKGradientColorTable
+
+- (instancetype)initWithGradient:(DKGradient*)gradient
+{
+	self = [super init];
+	if (self != nil) {
+		DKGradientStopValue* stops;
+		NSInteger k, keys = copyStopValues([gradient colorStops], &stops);
+		DKGradientInterpolation interp = [gradient gradientInterpolation];
+		DKGradientBlending blending = [gradient gradientBlending];
+
+		mComponents = malloc(sizeof(float) * 4 * kDKGradientColorTableSize);
+
+		for (k = 0; k < kDKGradientColorTableSize; ++k) {
+			CGFloat c[4] = { 0.5, 0.5, 0.5, 1.0 };
+
+			// a gradient without enough stops to blend is a flat colour - mid grey if it has none at all, as for -colorAtValue:
+
+			if (keys >= 2)
+				colorAtValueOfStops(stops, keys, (CGFloat)k / (CGFloat)(kDKGradientColorTableSize - 1), interp, blending, c);
+			else if (keys == 1)
+				memcpy(c, stops[0].rgba, sizeof(c));
+
+			mComponents[k * 4 + 0] = c[0] * c[3];
+			mComponents[k * 4 + 1] = c[1] * c[3];
+			mComponents[k * 4 + 2] = c[2] * c[3];
+			mComponents[k * 4 + 3] = c[3];
+		}
+
+		// build the equivalent NSGradient. NSGradient blends linearly in RGB, so the stops can be passed straight to it in that case;
+		// otherwise it is given enough samples from the table that the difference can't be seen.
+
+		NSMutableArray<NSColor*>* colors = [NSMutableArray array];
+		CGFloat* locations;
+
+		if (keys >= 2 && interp == DKGradientInterpolationLinear && blending == DKGradientBlendingRGB) {
+			locations = malloc(sizeof(CGFloat) * keys);
+
+			for (k = 0; k < keys; ++k) {
+				[colors addObject:[NSColor colorWithCalibratedRed:stops[k].rgba[0]
+															green:stops[k].rgba[1]
+															 blue:stops[k].rgba[2]
+															alpha:stops[k].rgba[3]]];
+				locations[k] = stops[k].position;
+			}
+		} else {
+			NSInteger samples = 65;
+
+			locations = malloc(sizeof(CGFloat) * samples);
+
+			for (k = 0; k < samples; ++k) {
+				const float* c = &mComponents[((k * (kDKGradientColorTableSize - 1)) / (samples - 1)) * 4];
+				CGFloat alpha = c[3];
+				CGFloat scale = (alpha > 0.0) ? 1.0 / alpha : 0.0;
+
+				[colors addObject:[NSColor colorWithCalibratedRed:c[0] * scale
+															green:c[1] * scale
+															 blue:c[2] * scale
+															alpha:alpha]];
+				locations[k] = (CGFloat)k / (CGFloat)(samples - 1);
+			}
+		}
+
+		mGradient = [[NSGradient alloc] initWithColors:colors
+										   atLocations:locations
+											colorSpace:[NSColorSpace genericRGBColorSpace]];
+		free(locations);
+		free(stops);
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	free(mComponents);
+}
+
+- (NSUInteger)count
+{
+	return kDKGradientColorTableSize;
+}
+
+- (const float*)components
+{
+	return mComponents;
+}
+
+- (void)getComponents:(CGFloat*)components atValue:(CGFloat)val
+{
+	CGFloat v = LIMIT(val, 0.0, 1.0) * (kDKGradientColorTableSize - 1);
+	NSInteger i = MIN((NSInteger)v, kDKGradientColorTableSize - 2);
+	CGFloat p = v - i;
+	const float* ca = &mComponents[i * 4];
+	const float* cb = ca + 4;
+
+	components[0] = (cb[0] - ca[0]) * p + ca[0];
+	components[1] = (cb[1] - ca[1]) * p + ca[1];
+	components[2] = (cb[2] - ca[2]) * p + ca[2];
+	components[3] = (cb[3] - ca[3]) * p + ca[3];
+}
+
+@synthesize gradient = mGradient;
+
+@end
+
+#pragma mark -
+
+static NSInteger copyStopValues(NSArray<DKColorStop*>* stops, DKGradientStopValue** values)
+{
+	// copies the positions and components of <stops> into a new C array, which the caller must free. Stops are normally kept
+	// sorted, but moving one doesn't re-sort them, so the copy is sorted by position here.
+
+	NSInteger i, j, count = [stops count];
+	DKGradientStopValue* v = malloc(sizeof(DKGradientStopValue) * MAX(count, 1));
+
+	for (i = 0; i < count; ++i) {
+		DKColorStop* stop = (DKColorStop*)CFArrayGetValueAtIndex((CFArrayRef)stops, i);
+		DKGradientStopValue sv;
+
+		sv.position = [stop position];
+		memcpy(sv.rgba, stop->components, sizeof(sv.rgba));
+
+		for (j = i; j > 0 && v[j - 1].position > sv.position; --j)
+			v[j] = v[j - 1];
+
+		v[j] = sv;
+	}
+
+	*values = v;
+	return count;
+}
+
+static void colorAtValueOfStops(const DKGradientStopValue* stops, NSInteger count, CGFloat val, DKGradientInterpolation interp, DKGradientBlending blending, CGFloat* components)
+{
+	// works out the colour at <val> along the ramp described by <count> (at least 2) sorted stops, returning unpremultiplied RGBA.
+
+	NSInteger k2 = 1;
+
+	while (k2 < (count - 1) && stops[k2].position < val)
+		++k2;
+
+	const DKGradientStopValue* key1 = &stops[k2 - 1];
+	const DKGradientStopValue* key2 = &stops[k2];
+
+	if (val <= key1->position)
+		memcpy(components, key1->rgba, sizeof(CGFloat) * 4);
+	else if (val >= key2->position)
+		memcpy(components, key2->rgba, sizeof(CGFloat) * 4);
+	else {
+		CGFloat p = (val - key1->position) / (key2->position - key1->position);
+
+		switch (interp) {
+		default:
+		case DKGradientInterpolationLinear:
+			break;
+
+		case DKGradientInterpolationQuadratic:
+			p = powerMap(p, 2);
+			break;
+
+		case DKGradientInterpolationCubic:
+			p = powerMap(p, 3);
+			break;
+
+		case DKGradientInterpolationSinus:
+			p = sineMap(p, 1);
+			break;
+
+		case DKGradientInterpolationSinus2:
+			p = sineMap(p, 2);
+			break;
+		}
+
+		const CGFloat* ca = key1->rgba;
+		const CGFloat* cb = key2->rgba;
+
+		if (blending == DKGradientBlendingHSB) {
+			// blend in HSV space - this method almost entirely lifted from Chad Weider (thanks!)
+
+			CGFloat ha[4], hb[4];
+
+			memcpy(ha, ca, sizeof(ha));
+			memcpy(hb, cb, sizeof(hb));
+
+			transformRGB_HSV(ha);
+			transformRGB_HSV(hb);
+			resolveHSV(ha, hb);
+
+			if (ha[0] > hb[0]) //if color1's hue is higher than color2's hue then
+				hb[0] += 360; //	we need to move c2 one revolution around the wheel
+
+			components[0] = (hb[0] - ha[0]) * p + ha[0];
+			components[1] = (hb[1] - ha[1]) * p + ha[1];
+			components[2] = (hb[2] - ha[2]) * p + ha[2];
+			components[3] = (hb[3] - ha[3]) * p + ha[3];
+
+			transformHSV_RGB(components);
+		} else if (blending == DKGradientBlendingAlpha) {
+			// only the alpha is blended - the colour is that of the stop below
+
+			components[0] = ca[0];
+			components[1] = ca[1];
+			components[2] = ca[2];
+			components[3] = (cb[3] - ca[3]) * p + ca[3];
+		} else {
+			components[0] = (cb[0] - ca[0]) * p + ca[0];
+			components[1] = (cb[1] - ca[1]) * p + ca[1];
+			components[2] = (cb[2] - ca[2]) * p + ca[2];
+			components[3] = (cb[3] - ca[3]) * p + ca[3];
+		}
+	}
+}
 
 static inline double powerMap(double x, double y)
 {
@@ -43,16 +43,16 @@ typedef NS_ENUM(NSInteger, DKGridMeasurementSystem) {
 
  General-purpose "snap to grid" type methods are implemented by \c DKDrawing using the grid as a basis - the grid itself doesn't implement snapping.
 
- Note: caching in a \c CGLayer is not recommended - the code is here but it doesn't draw nicely at high zooms. Turned off by default.
+ The grid is drawn from tiles that are cached per zoom level. Each tile holds just the lines that fall within it, worked out
+ directly from the division and span distances, so only the tiles that intersect the area being redrawn are built or stroked
+ however large the drawing is.
 */
 @interface DKGridLayer : DKLayer <NSCoding> {
 @private
 	NSColor* m_spanColour; // the colour of the spans grid
 	NSColor* m_divisionColour; // the colour of the divisions grid
 	NSColor* m_majorColour; // the colour of the majors grid
-	NSBezierPath* m_divsCache; // the path for the divisions grid
-	NSBezierPath* m_spanCache; // the path for the spans grid
-	NSBezierPath* m_majorsCache; // the path for the majors grid
+	NSCache* mTileCache; // grid tiles already built, keyed by zoom level and tile position
 	NSPoint m_zeroDatum; // where "zero" is supposed to be
 	BOOL mDrawsDivisions; // YES to draw divisions
 	BOOL mDrawsSpans; // YES to draw spans
@@ -61,8 +61,6 @@ typedef NS_ENUM(NSInteger, DKGridMeasurementSystem) {
 	CGFloat m_divisionLineWidth; // the line width to draw the divisions
 	CGFloat m_majorLineWidth; // the line width to draw the majors
 	NSUInteger m_rulerStepUpCycle; // the ruler step-up cycle to use
-	BOOL m_cacheInLayer; // YES if the grid is cache dusing a CGLayer
-	CGLayerRef m_cgl; // the CGLayer when the grid is cached there
 	NSUInteger mSpanCycle; // span increment cycle (typically 1)
 	CGFloat mDivsSupressionScale; // scale below which divs are not drawn at all (default = 0.5)
 	CGFloat mSpanSupressionScale; // scale below which span is not drawn at all (default = 0.1)
@@ -367,16 +365,17 @@ typedef NS_ENUM(NSInteger, DKGridMeasurementSystem) {
  */
 - (void)adjustSpanCycleForViewScale:(CGFloat)scale;
 
-/** @brief Removes the cached paths used to draw the grid when a grid parameter is changed
+/** @brief Removes the cached tiles used to draw the grid when a grid parameter is changed
  
  The grid is cached to help speed up drawing, and is only recalculated when necessary.
  */
 - (void)invalidateCache;
 
-/** @brief Recreates the cached paths used to draw the grid when required
+/** @brief Builds any cached tiles needed to draw the grid in the given area at the current zoom level
  
- The grid is cached to help speed up drawing, and is only recalculated when necessary.
- @param r the rect in which the grid is defined (typically the drawing interior)
+ The grid is cached to help speed up drawing, and is only recalculated when necessary. Tiles are built on demand
+ when drawn, so calling this is only needed to prepare an area ahead of time.
+ @param r the area of the drawing to cover; it is limited to the drawing interior
  */
 - (void)createGridCacheInRect:(NSRect)r;
 - (void)drawBorderOutline:(DKDrawingView*)aView;
@@ -18,11 +18,52 @@ NSString* const kDKGridDrawingLayerStandardMetric = @"DK_std_metric";
 NSString* const kDKGridDrawingLayerStandardImperial = @"DK_std_imperial";
 NSString* const kDKGridDrawingLayerStandardImperialPCB = @"DK_std_imperial_pcb";
 
+/** the size of a grid tile in view pixels - in drawing units it shrinks as the zoom level goes up */
+static const CGFloat kDKGridTileSize = 512.0;
+
+/** tiles are made for zoom levels that are powers of two within this range */
+static const NSInteger kDKGridMinTileLevel = -8;
+static const NSInteger kDKGridMaxTileLevel = 8;
+
 #pragma mark Static Vars
 static NSColor* sSpanColour = nil;
 static NSColor* sDivisionColour = nil;
 static NSColor* sMajorColour = nil;
 
+typedef NS_ENUM(NSInteger, DKGridTilePath) {
+	kDKGridTileDivisions = 0,
+	kDKGridTileSpans,
+	kDKGridTileMajors,
+	kDKGridTilePathCount
+};
+
+/** @brief The grid lines falling within one tile of the drawing interior, made for a given zoom level.
+
+ The paths never change once the tile is made, so a tile may be drawn any number of times until the grid is invalidated.
+ */
+@interface DKGridTile : NSObject {
+@private
+	CGPathRef mPaths[kDKGridTilePathCount]; // the lines of each kind, or NULL where the tile has none
+}
+
+- (instancetype)initWithPaths:(const CGMutablePathRef*)paths;
+- (nullable CGPathRef)pathOfKind:(DKGridTilePath)kind;
+
+@end
+
+static NSInteger gridTileLevelForScale(CGFloat scale);
+static id gridTileKey(NSInteger level, NSInteger column, NSInteger row);
+static void gridLineIndexRange(CGFloat origin, CGFloat step, CGFloat lo, CGFloat hi, BOOL closed, NSInteger* first, NSInteger* last);
+static void addGridLine(CGMutablePathRef path, BOOL vertical, CGFloat position, CGFloat from, CGFloat to);
+static void strokeGridTiles(CGContextRef context, NSArray<DKGridTile*>* tiles, DKGridTilePath kind, CGFloat lineWidth);
+
+@interface DKGridLayer ()
+
+- (NSArray<DKGridTile*>*)gridTilesInRect:(NSRect)r level:(NSInteger)level;
+- (DKGridTile*)makeGridTileAtColumn:(NSInteger)column row:(NSInteger)row size:(CGFloat)tileSize level:(NSInteger)level interior:(NSRect)interior;
+
+@end
+
 @implementation DKGridLayer
 #pragma mark As a DKGridLayer
 
@@ -508,114 +549,142 @@ static NSColor* sMajorColour = nil;
 
 - (void)invalidateCache
 {
-	m_divsCache = nil;
-	m_spanCache = nil;
-	m_majorsCache = nil;
-
-	if (m_cgl)
-		CGLayerRelease(m_cgl);
-	m_cgl = nil;
+	[mTileCache removeAllObjects];
 }
 
 - (void)createGridCacheInRect:(NSRect)r
 {
-	CGFloat sp = NSMinX(r);
-	CGFloat lp = 0.0;
-	CGFloat divs;
-	NSUInteger i, m;
-	NSPoint a, b;
+	[self gridTilesInRect:r level:gridTileLevelForScale(mCachedViewScale)];
+}
 
-	m = 0;
-	divs = [self divisionDistance];
-	a.y = NSMinY(r);
-	b.y = NSMaxY(r);
+/** @brief Returns the tiles covering an area of the drawing interior, making any not already cached
 
-	if (mSpanCycle <= 0)
-		mSpanCycle = 1;
+ The tiles' size in the drawing depends on the zoom level, so they always cover about the same area of the view.
+ @param r the area of the drawing to cover
+ @param level the zoom level as a power of two
+ @return the tiles intersecting <r>, which may be none if it lies outside the interior
+ */
+- (NSArray<DKGridTile*>*)gridTilesInRect:(NSRect)r level:(NSInteger)level
+{
+	NSRect interior = [[self drawing] interior];
+	NSRect vr = NSIntersectionRect(r, interior);
 
-	if (m_divsCache == nil) {
-		//CGFloat divsDash[2] = { divs * 0.5, divs * 0.5 };
+	if (NSIsEmptyRect(vr))
+		return @[];
 
-		m_divsCache = [NSBezierPath bezierPath];
-		//[m_divsCache setLineDash:divsDash count:2 phase:divs * 0.25];
+	if (mTileCache == nil) {
+		mTileCache = [[NSCache alloc] init];
+		[mTileCache setCountLimit:256];
 	}
 
-	if (m_spanCache == nil) {
-		//float spanDash[2] = { divs * 2, m_spanDistance - ( divs * 2 )};
+	CGFloat tileSize = ldexp(kDKGridTileSize, -(int)level);
+	NSInteger lastColumn = MAX(0, (NSInteger)ceil(NSWidth(interior) / tileSize) - 1);
+	NSInteger lastRow = MAX(0, (NSInteger)ceil(NSHeight(interior) / tileSize) - 1);
 
-		m_spanCache = [NSBezierPath bezierPath];
-		//[m_spanCache setLineDash:spanDash count:2 phase:divs];
-	}
+	NSInteger c0 = LIMIT((NSInteger)floor((NSMinX(vr) - NSMinX(interior)) / tileSize), 0, lastColumn);
+	NSInteger c1 = LIMIT((NSInteger)floor((NSMaxX(vr) - NSMinX(interior)) / tileSize), 0, lastColumn);
+	NSInteger r0 = LIMIT((NSInteger)floor((NSMinY(vr) - NSMinY(interior)) / tileSize), 0, lastRow);
+	NSInteger r1 = LIMIT((NSInteger)floor((NSMaxY(vr) - NSMinY(interior)) / tileSize), 0, lastRow);
+
+	NSMutableArray<DKGridTile*>* tiles = [NSMutableArray arrayWithCapacity:(c1 - c0 + 1) * (r1 - r0 + 1)];
 
-	if (m_majorsCache == nil) {
-		//float majDash[2] = { divs * 4, m_spansPerMajor * m_spanDistance - (divs * 4)};
+	for (NSInteger row = r0; row <= r1; ++row) {
+		for (NSInteger column = c0; column <= c1; ++column) {
+			id key = gridTileKey(level, column, row);
+			DKGridTile* tile = [mTileCache objectForKey:key];
 
-		m_majorsCache = [NSBezierPath bezierPath];
-		//[m_majorsCache setLineDash:majDash count:2 phase:divs * 2];
+			if (tile == nil) {
+				tile = [self makeGridTileAtColumn:column row:row size:tileSize level:level interior:interior];
+				[mTileCache setObject:tile forKey:key];
+			}
+			[tiles addObject:tile];
+		}
 	}
-	// first all the vertical lines
 
+	return tiles;
+}
+
+/** @brief Works out the grid lines within one tile of the interior
+
+ Lines lie at whole multiples of the division and span distances from the interior's top, left corner, so each tile
+ can be made on its own without walking the lines that come before it. A tile owns lines on its top and left edges
+ but not those on its bottom and right edges, which belong to its neighbour, except at the far edges of the interior.
+ Kinds of line that can't be seen at any zoom within the level are left out.
+ @param column, row the tile's position counting from the interior's top, left corner
+ @param tileSize the width and height of a tile in drawing units
+ @param level the zoom level as a power of two
+ @param interior the drawing interior
+ @return a new tile
+ */
+- (DKGridTile*)makeGridTileAtColumn:(NSInteger)column row:(NSInteger)row size:(CGFloat)tileSize level:(NSInteger)level interior:(NSRect)interior
+{
+	// the largest zoom this level is drawn at decides which of the suppressed kinds of line are worth making
+
+	CGFloat levelMaxScale = ldexp(1.0, (int)level + 1);
+	CGFloat divs = [self divisionDistance];
 	CGFloat span = [self spanDistance] * mSpanMultiplier;
+	NSInteger cycle = MAX(1, (NSInteger)mSpanCycle);
+	NSInteger perMajor = MAX(1, (NSInteger)m_spansPerMajor);
 
-	while (lp < NSMaxX(r)) {
-		lp = sp + (m * span);
-
-		if ((m % m_spansPerMajor) == 0) {
-			// drawing a major line
-			a.x = b.x = lp;
-			[m_majorsCache moveToPoint:a];
-			[m_majorsCache lineToPoint:b];
-		} else {
-			a.x = b.x = lp;
-			[m_spanCache moveToPoint:a];
-			[m_spanCache lineToPoint:b];
-		}
+	CGMutablePathRef paths[kDKGridTilePathCount];
 
-		// subdivide each span into the number of divisions
+	paths[kDKGridTileDivisions] = (levelMaxScale > mDivsSupressionScale && divs > 0) ? CGPathCreateMutable() : NULL;
+	paths[kDKGridTileSpans] = (levelMaxScale > mSpanSupressionScale) ? CGPathCreateMutable() : NULL;
+	paths[kDKGridTileMajors] = CGPathCreateMutable();
 
-		for (i = 0; i < (m_divisionsPerSpan * mSpanCycle); ++i) {
-			if (lp <= NSMaxX(r)) {
-				a.x = b.x = lp;
-				[m_divsCache moveToPoint:a];
-				[m_divsCache lineToPoint:b];
-			} else
-				break;
-			lp += divs;
-		}
-		m += mSpanCycle;
+	// tile edges are always computed the same way, so neighbouring tiles agree exactly on where they meet
+
+	CGFloat minEdge[2], maxEdge[2];
+	BOOL closed[2];
+	NSInteger index[2] = { column, row };
+	CGFloat origin[2] = { NSMinX(interior), NSMinY(interior) };
+	CGFloat limit[2] = { NSMaxX(interior), NSMaxY(interior) };
+
+	for (NSUInteger axis = 0; axis < 2; ++axis) {
+		minEdge[axis] = origin[axis] + index[axis] * tileSize;
+		maxEdge[axis] = origin[axis] + (index[axis] + 1) * tileSize;
+		closed[axis] = (maxEdge[axis] >= limit[axis]);
+
+		if (closed[axis])
+			maxEdge[axis] = limit[axis];
 	}
 
-	// horizontal lines:
-
-	sp = lp = NSMinY(r);
-	m = 0;
-	a.x = NSMinX(r);
-	b.x = NSMaxX(r);
-
-	while (lp <= NSMaxY(r)) {
-		lp = sp + (m * span);
-
-		if ((m % m_spansPerMajor) == 0) {
-			// drawing a major line
-			a.y = b.y = lp;
-			[m_majorsCache moveToPoint:a];
-			[m_majorsCache lineToPoint:b];
-		} else {
-			a.y = b.y = lp;
-			[m_spanCache moveToPoint:a];
-			[m_spanCache lineToPoint:b];
+	// axis 0 places the vertical lines across the tile, axis 1 the horizontal ones down it
+
+	for (NSUInteger axis = 0; axis < 2; ++axis) {
+		BOOL vertical = (axis == 0);
+		NSUInteger other = 1 - axis;
+		NSInteger first, last, k;
+
+		if (paths[kDKGridTileDivisions]) {
+			gridLineIndexRange(origin[axis], divs, minEdge[axis], maxEdge[axis], closed[axis], &first, &last);
+
+			for (k = first; k <= last; ++k)
+				addGridLine(paths[kDKGridTileDivisions], vertical, origin[axis] + k * divs, minEdge[other], maxEdge[other]);
 		}
-		for (i = 0; i < (m_divisionsPerSpan * mSpanCycle); ++i) {
-			if (lp <= NSMaxY(r)) {
-				a.y = b.y = lp;
-				[m_divsCache moveToPoint:a];
-				[m_divsCache lineToPoint:b];
-			} else
-				break;
-			lp += divs;
+
+		if (span > 0) {
+			gridLineIndexRange(origin[axis], span, minEdge[axis], maxEdge[axis], closed[axis], &first, &last);
+
+			// when zoomed out the span cycle thins the span lines to every <cycle>th one
+
+			first = ((first + cycle - 1) / cycle) * cycle;
+
+			for (k = first; k <= last; k += cycle) {
+				CGMutablePathRef path = (k % perMajor) == 0 ? paths[kDKGridTileMajors] : paths[kDKGridTileSpans];
+
+				if (path)
+					addGridLine(path, vertical, origin[axis] + k * span, minEdge[other], maxEdge[other]);
+			}
 		}
-		m += mSpanCycle;
 	}
+
+	DKGridTile* tile = [[DKGridTile alloc] initWithPaths:paths];
+
+	for (NSUInteger i = 0; i < kDKGridTilePathCount; ++i)
+		CGPathRelease(paths[i]);
+
+	return tile;
 }
 
 - (void)drawBorderOutline:(DKDrawingView*)aView
@@ -659,17 +728,10 @@ static NSColor* sMajorColour = nil;
  */
 - (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView
 {
-#pragma unused(rect)
-
 	// if the view scale has crossed the threshold for span cycle change, invalidate the cache
 
 	[self adjustSpanCycleForViewScale:[aView scale]];
 
-	NSRect mr = [[self drawing] interior];
-
-	if (m_divsCache == nil)
-		[self createGridCacheInRect:mr];
-
 	// be smart about colour: if the drawing has a dark background, switch the divs and majors colours to give better contrast
 	// this is very rarely required but for some unusual situations gives a more usable/visible grid.
 
@@ -683,7 +745,7 @@ static NSColor* sMajorColour = nil;
 		dc = m_majorColour;
 	}
 
-	// draw directly from the cache. Apply the linewidth accounting for the view's scale factor
+	// draw from the cached tiles that the rect touches. Apply the linewidth accounting for the view's scale factor
 
 	CGFloat zoom = [aView scale];
 	CGFloat dlw, slw, mlw;
@@ -692,31 +754,31 @@ static NSColor* sMajorColour = nil;
 	slw = MIN(m_spanLineWidth / zoom, 1.0);
 	mlw = MIN(m_majorLineWidth / zoom, 1.0);
 
+	NSArray<DKGridTile*>* tiles = [self gridTilesInRect:rect level:gridTileLevelForScale(zoom)];
+	CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
 	if (mDrawsDivisions && zoom >= mDivsSupressionScale) {
 		if (zoom * dlw > 1.0)
 			dlw = 0;
 
-		[m_divsCache setLineWidth:dlw];
 		[dc setStroke];
-		[m_divsCache stroke];
+		strokeGridTiles(context, tiles, kDKGridTileDivisions, dlw);
 	}
 
 	if (mDrawsSpans && zoom >= mSpanSupressionScale) {
 		if (zoom * slw > 1.0)
 			slw = 0;
 
-		[m_spanCache setLineWidth:slw];
 		[m_spanColour setStroke];
-		[m_spanCache stroke];
+		strokeGridTiles(context, tiles, kDKGridTileSpans, slw);
 	}
 
 	if (mDrawsMajors) {
 		if (zoom * mlw > 1.0)
 			mlw = 0;
 
-		[m_majorsCache setLineWidth:mlw];
 		[mc setStroke];
-		[m_majorsCache stroke];
+		strokeGridTiles(context, tiles, kDKGridTileMajors, mlw);
 	}
 
 	[self drawBorderOutline:aView];
@@ -792,11 +854,6 @@ static NSColor* sMajorColour = nil;
 
 #pragma mark - As an NSObject
 
-- (void)dealloc
-{
-	[self invalidateCache]; // Releases cache
-}
-
 - (instancetype)init
 {
 	self = [super init];
@@ -949,3 +1006,94 @@ static NSColor* sMajorColour = nil;
 }
 
 @end
+
+#pragma mark -
+
+@implementation DKGridTile
+
+- (instancetype)initWithPaths:(const CGMutablePathRef*)paths
+{
+	self = [super init];
+	if (self != nil) {
+		for (NSUInteger i = 0; i < kDKGridTilePathCount; ++i)
+			mPaths[i] = paths[i] ? CGPathCreateCopy(paths[i]) : NULL;
+	}
+	return self;
+}
+
+- (CGPathRef)pathOfKind:(DKGridTilePath)kind
+{
+	return mPaths[kind];
+}
+
+- (void)dealloc
+{
+	for (NSUInteger i = 0; i < kDKGridTilePathCount; ++i)
+		CGPathRelease(mPaths[i]);
+}
+
+@end
+
+/** @brief Returns the power of two zoom level that tiles are made for at a given view scale
+ */
+static NSInteger gridTileLevelForScale(CGFloat scale)
+{
+	if (scale <= 0)
+		return kDKGridMinTileLevel;
+
+	return LIMIT((NSInteger)floor(log2(scale)), kDKGridMinTileLevel, kDKGridMaxTileLevel);
+}
+
+/** @brief Returns the tile cache key for the tile at a given position and zoom level
+ */
+static id gridTileKey(NSInteger level, NSInteger column, NSInteger row)
+{
+	uint64_t key = ((uint64_t)(level - kDKGridMinTileLevel) << 48) | ((uint64_t)column << 24) | (uint64_t)row;
+
+	return @(key);
+}
+
+/** @brief Finds which of the lines spaced <step> apart from <origin> lie within [lo, hi), or [lo, hi] if <closed> is YES
+
+ A small tolerance stops a line that rounding puts a hair either side of a tile edge from being lost or drawn twice.
+ If no lines fall in the range, <last> is less than <first>.
+ */
+static void gridLineIndexRange(CGFloat origin, CGFloat step, CGFloat lo, CGFloat hi, BOOL closed, NSInteger* first, NSInteger* last)
+{
+	CGFloat fuzz = 1.0e-6;
+
+	*first = MAX(0, (NSInteger)ceil((lo - origin) / step - fuzz));
+
+	if (closed)
+		*last = (NSInteger)floor((hi - origin) / step + fuzz);
+	else
+		*last = (NSInteger)ceil((hi - origin) / step - fuzz) - 1;
+}
+
+static void addGridLine(CGMutablePathRef path, BOOL vertical, CGFloat position, CGFloat from, CGFloat to)
+{
+	if (vertical) {
+		CGPathMoveToPoint(path, NULL, position, from);
+		CGPathAddLineToPoint(path, NULL, position, to);
+	} else {
+		CGPathMoveToPoint(path, NULL, from, position);
+		CGPathAddLineToPoint(path, NULL, to, position);
+	}
+}
+
+/** @brief Strokes one kind of line from each of the tiles in a single pass, using the context's current stroke colour
+ */
+static void strokeGridTiles(CGContextRef context, NSArray<DKGridTile*>* tiles, DKGridTilePath kind, CGFloat lineWidth)
+{
+	CGContextBeginPath(context);
+
+	for (DKGridTile* tile in tiles) {
+		CGPathRef path = [tile pathOfKind:kind];
+
+		if (path)
+			CGContextAddPath(context, path);
+	}
+
+	CGContextSetLineWidth(context, lineWidth);
+	CGContextStrokePath(context);
+}
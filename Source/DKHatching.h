@@ -19,14 +19,21 @@ NS_ASSUME_NONNULL_BEGIN
 
  Can be set as a fill style in a \c DKStyle object.
 
- The hatch is cached in an \c NSBezierPath object based on the bounds of the path. If another path is hatched that is smaller
- than the cached size, it is not rebuilt. It is rebuilt if the angle or spacing changes or a bigger path is hatched. Linewidth also
- doesn't change the cache.
+ When drawing to the screen or a bitmap, the hatch is drawn as a pattern fill. A single repeat of the hatch is outlined once into a
+ small tile, which is kept until the spacing, line width, dash, cap or join change. The angle and lead-in only move the
+ pattern so they don't affect the tile.
+
+ For vector output such as PDF or printing, and for wobbly or roughened hatches whose lines don't repeat, the hatch is cached in an \c NSBezierPath
+ object based on the bounds of the path. If another path is hatched that is smaller than the cached size, it is not rebuilt. It is
+ rebuilt if the angle or spacing changes or a bigger path is hatched. Linewidth also doesn't change the cache.
 */
 @interface DKHatching : DKRasterizer <NSCoding, NSCopying, DKDashable> {
 @private
 	NSBezierPath* m_cache;
 	NSBezierPath* mRoughenedCache;
+	CGPathRef mTilePath; // one repeat of the hatch, outlined ready to fill, for drawing it as a pattern
+	NSSize mTileSize; // the size of the pattern cell that mTilePath fills
+	NSData* mTileKey; // the hatch parameters mTilePath was made with
 	NSColor* m_hatchColour;
 	DKStrokeDash* m_hatchDash;
 	NSLineCapStyle m_cap;
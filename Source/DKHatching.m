@@ -10,9 +10,29 @@
 #import "DKStrokeDash.h"
 #import "NSBezierPath+Geometry.h"
 
+/** the smallest side of a hatch pattern tile - narrow hatches put several lines in one tile to keep the number of tiles down */
+static const CGFloat kDKHatchMinimumTileSize = 32.0;
+
+/** the hatch parameters that shape a pattern tile; compared byte for byte to tell when a tile is stale */
+typedef struct {
+	CGFloat spacing;
+	CGFloat width;
+	NSInteger cap;
+	NSInteger join;
+	NSInteger dashCount;
+	CGFloat dash[8];
+	CGFloat dashPhase;
+	BOOL dashScales;
+} DKHatchTileKey;
+
+static void drawHatchTile(void* info, CGContextRef context);
+static void releaseHatchTile(void* info);
+
 @interface DKHatching ()
 
 - (void)invalidateRoughnessCache;
+- (BOOL)patternHatchPath:(NSBezierPath*)path objectAngle:(CGFloat)oa;
+- (nullable CGPathRef)newHatchTileOfSize:(NSSize*)tileSize CF_RETURNS_RETAINED;
 
 @end
 
@@ -116,6 +136,12 @@
  */
 - (void)hatchPath:(NSBezierPath*)path objectAngle:(CGFloat)oa
 {
+	// on screen the hatch can be drawn as a pattern from a single cached tile, which costs the same however big the path is
+
+	if ([self patternHatchPath:path
+				   objectAngle:oa])
+		return;
+
 	// if the bounds size of <path> is larger than the cached hatch, then we'll need to enlarge the cache, so invalidate
 	// it.
 
@@ -202,6 +228,153 @@
 	}
 }
 
+/** @brief Fill the path with the hatch drawn as a pattern
+
+ A pattern would end up as a bitmap in vector output, so this declines when drawing to a printer or PDF. It also declines for wobbly
+ and roughened hatches, whose lines are each displaced at random and so can't repeat without seams where the tiles meet, and for
+ zero widths which only the path mode draws.
+ @param path the path to fill
+ @param oa the additional angle to apply, in radians
+ @return YES if the path was hatched, NO if the caller should draw the hatch as a path instead
+ */
+- (BOOL)patternHatchPath:(NSBezierPath*)path objectAngle:(CGFloat)oa
+{
+	if (![NSGraphicsContext currentContextDrawingToScreen] || mWobblyness > 0.0 || mRoughenStrokes || [self width] <= 0.0 || [path isEmpty])
+		return NO;
+
+	NSColor* rgb = [[self colour] colorUsingColorSpace:[NSColorSpace genericRGBColorSpace]];
+
+	if (rgb == nil)
+		return NO;
+
+	NSSize tileSize;
+	CGPathRef tile = [self newHatchTileOfSize:&tileSize];
+
+	if (tile == NULL)
+		return NO;
+
+	// the pattern cell has its lines centred in spacing-wide columns, so shift it by half a spacing to put a line on the
+	// lead-in, then rotate it about the centre of the path as the path mode does. Patterns are placed relative to the
+	// context's base space rather than the current user space, so the CTM has to be folded in as well.
+
+	CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+	NSRect br = [path bounds];
+
+	CGAffineTransform pm = CGAffineTransformMakeTranslation([self leadIn] - [self spacing] * 0.5, 0);
+	pm = CGAffineTransformConcat(pm, CGAffineTransformMakeRotation([self angle] + oa));
+	pm = CGAffineTransformConcat(pm, CGAffineTransformMakeTranslation(NSMidX(br), NSMidY(br)));
+	pm = CGAffineTransformConcat(pm, CGContextGetCTM(context));
+
+	static const CGPatternCallbacks callbacks = { 0, drawHatchTile, releaseHatchTile };
+
+	// the pattern takes over the reference to the tile and releases it when done
+
+	CGPatternRef pattern = CGPatternCreate((void*)tile, CGRectMake(0, 0, tileSize.width, tileSize.height), pm,
+		tileSize.width, tileSize.height, kCGPatternTilingConstantSpacing, false, &callbacks);
+
+	if (pattern == NULL) {
+		CGPathRelease(tile);
+		return NO;
+	}
+
+	CGFloat components[4];
+	[rgb getRed:&components[0]
+		  green:&components[1]
+		   blue:&components[2]
+		  alpha:&components[3]];
+
+	CGColorSpaceRef rgbSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGColorSpaceRef patternSpace = CGColorSpaceCreatePattern(rgbSpace);
+
+	SAVE_GRAPHICS_CONTEXT
+
+	CGContextSetFillColorSpace(context, patternSpace);
+	CGContextSetFillPattern(context, pattern, components);
+	[path fill];
+
+	RESTORE_GRAPHICS_CONTEXT
+
+	CGColorSpaceRelease(patternSpace);
+	CGColorSpaceRelease(rgbSpace);
+	CGPatternRelease(pattern);
+
+	return YES;
+}
+
+/** @brief Returns one repeat of the hatch, outlined so that it only needs filling
+
+ The tile is cached and made again only when one of the parameters that shape it has changed. Plain lines can be given
+ in a tile just one spacing wide, but narrow hatches get several lines per tile. A dashed hatch is made a whole number of dash lengths tall so the dashes line up from
+ one tile to the next. Each line runs on past the tile into its neighbours, so caps and dashes that cross a tile edge
+ are drawn in full by the pattern's adjoining tiles.
+ @param tileSize receives the size of the tile's pattern cell
+ @return the tile's path, which the caller must release, or NULL if it couldn't be made
+ */
+- (CGPathRef)newHatchTileOfSize:(NSSize*)tileSize
+{
+	DKHatchTileKey key;
+	memset(&key, 0, sizeof(key));
+
+	DKStrokeDash* dash = [self dash];
+
+	key.spacing = [self spacing];
+	key.width = [self width];
+	key.cap = [self lineCapStyle];
+	key.join = [self lineJoinStyle];
+
+	if (dash) {
+		[dash getDashPattern:key.dash
+					   count:&key.dashCount];
+		key.dashPhase = [dash phase];
+		key.dashScales = [dash scalesToLineWidth];
+	}
+
+	NSData* keyData = [NSData dataWithBytes:&key
+									 length:sizeof(key)];
+
+	@synchronized(self)
+	{
+		if (mTilePath == NULL || ![keyData isEqualToData:mTileKey]) {
+			CGPathRelease(mTilePath);
+			mTilePath = NULL;
+
+			NSUInteger lines = (NSUInteger)ceil(kDKHatchMinimumTileSize / key.spacing);
+			CGFloat width = lines * key.spacing;
+			CGFloat period = 0.0;
+
+			for (NSInteger i = 0; i < key.dashCount; ++i)
+				period += key.dash[i];
+
+			if (key.dashScales)
+				period *= key.width;
+
+			CGFloat height = (period > 0.0) ? period * ceil(width / period) : width;
+			NSBezierPath* hatch = [NSBezierPath bezierPath];
+
+			for (NSUInteger i = 0; i < lines; ++i) {
+				CGFloat x = (i + 0.5) * key.spacing;
+
+				[hatch moveToPoint:NSMakePoint(x, -height)];
+				[hatch lineToPoint:NSMakePoint(x, height * 2.0)];
+			}
+
+			[hatch setLineWidth:key.width];
+			[hatch setLineCapStyle:key.cap];
+			[hatch setLineJoinStyle:key.join];
+
+			if (period > 0.0)
+				[dash applyToPath:hatch];
+
+			mTilePath = [[hatch strokedPath] newQuartzPath];
+			mTileSize = NSMakeSize(width, height);
+			mTileKey = keyData;
+		}
+
+		*tileSize = mTileSize;
+		return CGPathRetain(mTilePath);
+	}
+}
+
 #pragma mark -
 
 /** @brief Set the angle of the hatching
@@ -390,6 +563,13 @@
 - (void)invalidateRoughnessCache
 {
 	mRoughenedCache = nil;
+
+	@synchronized(self)
+	{
+		CGPathRelease(mTilePath);
+		mTilePath = NULL;
+		mTileKey = nil;
+	}
 }
 
 #pragma mark -
@@ -590,3 +770,16 @@
 }
 
 @end
+
+/** @brief Draws a hatch pattern cell by filling its tile
+ */
+static void drawHatchTile(void* info, CGContextRef context)
+{
+	CGContextAddPath(context, (CGPathRef)info);
+	CGContextFillPath(context);
+}
+
+static void releaseHatchTile(void* info)
+{
+	CGPathRelease((CGPathRef)info);
+}
@@ -279,6 +279,12 @@
 	return YES;
 }
 
+- (BOOL)supportsGeometricHitTesting
+{
+	// the image may have transparent areas and need not be aligned with the path
+	return NO;
+}
+
 #pragma mark -
 #pragma mark As part of NSCoding Protocol
 - (void)encodeWithCoder:(NSCoder*)coder
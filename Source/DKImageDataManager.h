@@ -16,12 +16,24 @@ The purpose of this class is to allow images to be archived much more efficientl
  This only comes into play when archiving, dearchiving or creating images - each object still maintains an NSImage derived from the data stored here.
  
  When images are cut/pasted within the framework, the image key can be used to effect that operation without having to move the actual image data.
+
+ Image data is content-addressed by its SHA-256 hash, so the same image added twice is only stored once. Data larger than
+ \c kDKImageDataOutOfLineThreshold is written to a private store directory on disk and held as a memory-mapped \c NSData, so
+ it takes no heap and is only paged in when an image is made from it. The store is removed along with the manager, and files
+ whose keys are removed are deleted straight away. Stores left behind by processes that have since exited are swept away in the
+ background when the class is first used.
+
+ A dearchived manager doesn't hash its data, or move large data out to the store, until something first needs the hashes, so
+ opening a drawing with many images isn't held up by it.
 */
 @interface DKImageDataManager : NSObject <NSCoding> {
 @private
 	NSMutableDictionary<NSString*, NSData*>* mRepository;
-	NSMutableDictionary<NSString*, NSString*>* mHashList;
+	NSMutableDictionary<NSString*, NSMutableOrderedSet<NSString*>*>* mHashList; // every key holding each hash's data, the first being the one given out
+	NSMutableDictionary<NSString*, NSString*>* mKeyHashes; // inverse of mHashList, so removing a key needn't hash its data again
 	NSMutableDictionary<NSString*, NSNumber*>* mKeyUsage;
+	NSURL* mStoreURL; // the directory holding out-of-line image data, created when first needed
+	BOOL mHashListIsStale; // YES after dearchiving until the data is first hashed
 }
 
 - (nullable NSData*)imageDataForKey:(NSString*)key;
@@ -29,6 +41,10 @@ The purpose of this class is to allow images to be archived much more efficientl
 - (BOOL)hasImageDataForKey:(NSString*)key;
 - (NSString*)generateKey;
 - (nullable NSString*)keyForImageData:(NSData*)imageData;
+
+/** @brief The content hash of the data stored under a key, as given by \c -contentHashString, without hashing it again.
+ */
+- (nullable NSString*)contentHashForKey:(NSString*)key;
 @property (readonly, copy) NSArray<NSString*>* allKeys;
 - (void)removeKey:(NSString*)key;
 
@@ -48,14 +64,26 @@ The purpose of this class is to allow images to be archived much more efficientl
 
 extern NSPasteboardType const kDKImageDataManagerPasteboardType NS_SWIFT_NAME(dkImageDataManager);
 
+/** image data of at least this many bytes is kept out of line in a memory-mapped file */
+extern const NSUInteger kDKImageDataOutOfLineThreshold;
+
 @interface NSData (Checksum)
 
 /** @brief The checksum is a weighted sum of the first 1024 bytes (or less) of the data XOR the length. This value should be reasonably unique for quickly comparing
  image data.
+
+ Data that differs only after the first 1024 bytes has the same checksum, so use \c -contentHashString to tell whether two lots of
+ data are the same.
  */
 - (NSUInteger)checksum;
 - (NSString*)checksumString;
 
+/** @brief The SHA-256 hash of the whole of the data as a hex string.
+
+ The data is hashed a range at a time, so large or non-contiguous data is never copied.
+ */
+- (NSString*)contentHashString;
+
 @end
 
 NS_ASSUME_NONNULL_END
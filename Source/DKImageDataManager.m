@@ -7,20 +7,44 @@
 #import "DKImageDataManager.h"
 #import "DKKeyedUnarchiver.h"
 #import "DKUniqueID.h"
+#import <CommonCrypto/CommonDigest.h>
+#include <signal.h>
 
 NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrtype";
+const NSUInteger kDKImageDataOutOfLineThreshold = 256 * 1024;
+
+static NSString* const kDKImageDataStorePrefix = @"DKImageDataStore-";
+
+static void removeStaleStores(void);
 
 @interface DKImageDataManager ()
 
-/** hash list maps hash (or checksum) -> key, so is inverse to repository. As it can be built from the repo, it is safer to do this following dearchiving
+/** hash list maps hash (or checksum) -> keys, so is inverse to repository. As it can be built from the repo, it is safer to do this following dearchiving
  rather than archive the hash list itself. Earlier versions did archive the hash list but that data can be ignored.
 */
 - (void)buildHashList;
+- (void)buildHashListIfNeeded;
+- (void)setImageData:(NSData*)imageData forKey:(NSString*)key hash:(NSString*)hash;
+
+/** returns the data to keep for <imageData> - either the data itself, or for large data, a memory-mapped copy of it in the store */
+- (NSData*)storedDataForData:(NSData*)imageData hash:(NSString*)hash;
+- (nullable NSURL*)storeURL;
 
 @end
 
 @implementation DKImageDataManager
 
++ (void)initialize
+{
+	// stores are normally removed with their managers, but a process that crashed or was killed leaves its stores behind
+
+	if (self == [DKImageDataManager class]) {
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+			removeStaleStores();
+		});
+	}
+}
+
 - (NSData*)imageDataForKey:(NSString*)key
 {
 	return [mRepository objectForKey:key];
@@ -30,12 +54,88 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 {
 	NSAssert(imageData != nil, @"cannot set nil image data");
 
+	[self setImageData:imageData
+				forKey:key
+				  hash:[imageData contentHashString]];
+}
+
+- (void)setImageData:(NSData*)imageData forKey:(NSString*)key hash:(NSString*)hash
+{
 	//NSLog(@"%@ set data (%d bytes), key = %@", self, [imageData length], key);
 
-	[mRepository setObject:imageData
+	[self buildHashListIfNeeded];
+
+	// a key being reused for different data lets go of its old data first
+
+	NSString* oldHash = [mKeyHashes objectForKey:key];
+
+	if (oldHash && ![oldHash isEqualToString:hash])
+		[self removeKey:key];
+
+	// if another key already has this data, share its copy rather than storing another
+
+	NSMutableOrderedSet<NSString*>* keys = [mHashList objectForKey:hash];
+	NSString* existingKey = [keys firstObject];
+	NSData* stored = existingKey ? [mRepository objectForKey:existingKey] : nil;
+
+	if (stored == nil)
+		stored = [self storedDataForData:imageData
+									hash:hash];
+
+	if (keys == nil) {
+		keys = [NSMutableOrderedSet orderedSet];
+		[mHashList setObject:keys
+					  forKey:hash];
+	}
+
+	[mRepository setObject:stored
 					forKey:key];
-	[mHashList setObject:key
-				  forKey:[imageData checksumString]];
+	[keys addObject:key];
+	[mKeyHashes setObject:hash
+				   forKey:key];
+}
+
+- (NSData*)storedDataForData:(NSData*)imageData hash:(NSString*)hash
+{
+	if ([imageData length] < kDKImageDataOutOfLineThreshold)
+		return imageData;
+
+	// files are named by their hash, so a file that's already there already holds this data
+
+	NSURL* url = [[self storeURL] URLByAppendingPathComponent:hash];
+
+	if (url == nil)
+		return imageData;
+
+	if (![url checkResourceIsReachableAndReturnError:NULL] && ![imageData writeToURL:url
+																			  options:NSDataWritingAtomic
+																				error:NULL])
+		return imageData;
+
+	NSData* mapped = [NSData dataWithContentsOfURL:url
+										   options:NSDataReadingMappedAlways
+											 error:NULL];
+
+	return mapped ? mapped : imageData;
+}
+
+- (NSURL*)storeURL
+{
+	if (mStoreURL == nil) {
+		// the name includes the process ID, so that stores left behind can be told from those still in use
+
+		NSString* name = [NSString stringWithFormat:@"%@%d-%@", kDKImageDataStorePrefix, getpid(), [DKUniqueID uniqueKey]];
+		NSURL* url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]
+								isDirectory:YES];
+
+		if ([[NSFileManager defaultManager] createDirectoryAtURL:url
+									 withIntermediateDirectories:YES
+													  attributes:nil
+														   error:NULL])
+			mStoreURL = url;
+	}
+
+	return mStoreURL;
 }
 
 - (BOOL)hasImageDataForKey:(NSString*)key
@@ -47,12 +147,21 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 {
 	// if the imagedata is known to the repository, its key is returned, otherwise nil.
 
+	[self buildHashListIfNeeded];
+
 	if (imageData)
-		return [mHashList objectForKey:[imageData checksumString]];
+		return [[mHashList objectForKey:[imageData contentHashString]] firstObject];
 	else
 		return nil;
 }
 
+- (NSString*)contentHashForKey:(NSString*)key
+{
+	[self buildHashListIfNeeded];
+
+	return [mKeyHashes objectForKey:key];
+}
+
 - (NSString*)generateKey
 {
 	return [DKUniqueID uniqueKey];
@@ -67,11 +176,27 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 {
 	// removes the key and all data associated with it
 
-	NSData* data = [self imageDataForKey:key];
+	[self buildHashListIfNeeded];
+
+	NSString* hash = [mKeyHashes objectForKey:key];
+
+	if (hash) {
+		[mKeyHashes removeObjectForKey:key];
 
-	if (data) {
-		NSString* cs = [data checksumString];
-		[mHashList removeObjectForKey:cs];
+		// other keys may have been given the same data. If so, they keep the hash, otherwise the data's file in the store
+		// can go. Anyone still holding the mapped data can go on using it, as the mapping outlives the file.
+
+		NSMutableOrderedSet<NSString*>* keys = [mHashList objectForKey:hash];
+
+		[keys removeObject:key];
+
+		if ([keys count] == 0) {
+			[mHashList removeObjectForKey:hash];
+
+			if (mStoreURL)
+				[[NSFileManager defaultManager] removeItemAtURL:[mStoreURL URLByAppendingPathComponent:hash]
+														  error:NULL];
+		}
 	}
 
 	[mRepository removeObjectForKey:key];
@@ -84,14 +209,18 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 
 	NSAssert(imageData != nil, @"cannot create image from nil data");
 
-	NSString* theKey = [self keyForImageData:imageData];
+	[self buildHashListIfNeeded];
+
+	NSString* hash = [imageData contentHashString];
+	NSString* theKey = [[mHashList objectForKey:hash] firstObject];
 
 	if (theKey == nil) {
 		// not known, so store the data using a new key
 
 		theKey = [self generateKey];
 		[self setImageData:imageData
-					forKey:theKey];
+					forKey:theKey
+					  hash:hash];
 	}
 
 	// return the key
@@ -99,9 +228,9 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 	if (key != NULL)
 		*key = theKey;
 
-	// create and return the image
+	// create and return the image from the stored data, so that the caller's copy of large data needn't be kept around
 
-	return [[NSImage alloc] initWithData:imageData];
+	return [[NSImage alloc] initWithData:[self imageDataForKey:theKey]];
 }
 
 - (NSImage*)makeImageWithPasteboard:(NSPasteboard*)pb key:(NSString**)key
@@ -210,15 +339,28 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 
 - (void)buildHashList
 {
+	// storing each item again hashes it and moves large data out to the store
+
+	NSDictionary<NSString*, NSData*>* repo = [mRepository copy];
+
+	mHashListIsStale = NO;
+
+	[mRepository removeAllObjects];
 	[mHashList removeAllObjects];
+	[mKeyHashes removeAllObjects];
 
-	for (NSString* key in mRepository) {
-		NSData* data = [mRepository objectForKey:key];
-		[mHashList setObject:key
-					  forKey:[data checksumString]];
+	for (NSString* key in repo) {
+		[self setImageData:[repo objectForKey:key]
+					forKey:key];
 	}
 }
 
+- (void)buildHashListIfNeeded
+{
+	if (mHashListIsStale)
+		[self buildHashList];
+}
+
 #pragma mark -
 
 - (instancetype)init
@@ -227,12 +369,20 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 	if (self) {
 		mRepository = [[NSMutableDictionary alloc] init];
 		mHashList = [[NSMutableDictionary alloc] init];
+		mKeyHashes = [[NSMutableDictionary alloc] init];
 		mKeyUsage = [[NSMutableDictionary alloc] init];
 	}
 
 	return self;
 }
 
+- (void)dealloc
+{
+	if (mStoreURL)
+		[[NSFileManager defaultManager] removeItemAtURL:mStoreURL
+												  error:NULL];
+}
+
 - (void)encodeWithCoder:(NSCoder*)coder
 {
 	[coder encodeObject:mRepository
@@ -244,10 +394,15 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 	if (self = [super init]) {
 		mRepository = [[coder decodeObjectForKey:@"DKImageDataManager_repo"] mutableCopy];
 		mHashList = [[NSMutableDictionary alloc] init];
+		mKeyHashes = [[NSMutableDictionary alloc] init];
 
-		// hash list is built from repository, so there is no need to archive it.
+		if (mRepository == nil)
+			mRepository = [[NSMutableDictionary alloc] init];
 
-		[self buildHashList];
+		// hash list is built from repository, so there is no need to archive it. Hashing everything takes a while for large
+		// images, so it waits until something needs it.
+
+		mHashListIsStale = ([mRepository count] > 0);
 
 		// key usage isn't archived, will manage itself as clients make use of the object
 
@@ -270,6 +425,38 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 
 @end
 
+static void removeStaleStores(void)
+{
+	// removes the stores of processes that are no longer running. Stores are named with their process ID, so any whose process
+	// has gone can't be in use. A store whose name doesn't parse is left alone.
+
+	NSFileManager* fm = [NSFileManager defaultManager];
+	NSURL* tempURL = [NSURL fileURLWithPath:NSTemporaryDirectory()
+								isDirectory:YES];
+	NSArray<NSURL*>* contents = [fm contentsOfDirectoryAtURL:tempURL
+								  includingPropertiesForKeys:nil
+													 options:NSDirectoryEnumerationSkipsHiddenFiles
+													   error:NULL];
+
+	for (NSURL* url in contents) {
+		NSString* name = [url lastPathComponent];
+
+		if (![name hasPrefix:kDKImageDataStorePrefix])
+			continue;
+
+		NSScanner* scanner = [NSScanner scannerWithString:[name substringFromIndex:[kDKImageDataStorePrefix length]]];
+		int pid;
+
+		if (![scanner scanInt:&pid] || ![scanner scanString:@"-"
+												 intoString:NULL] || pid <= 0)
+			continue;
+
+		if (pid != getpid() && kill(pid, 0) != 0 && errno == ESRCH)
+			[fm removeItemAtURL:url
+						  error:NULL];
+	}
+}
+
 #pragma mark -
 
 @implementation NSData (Checksum)
@@ -295,4 +482,37 @@ NSString* const kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdat
 	return [NSString stringWithFormat:@"%ld", (long)[self checksum]];
 }
 
+- (NSString*)contentHashString
+{
+	CC_SHA256_CTX context;
+	CC_SHA256_CTX* ctx = &context;
+	unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+
+	CC_SHA256_Init(ctx);
+
+	[self enumerateByteRangesUsingBlock:^(const void* bytes, NSRange byteRange, BOOL* stop) {
+#pragma unused(stop)
+		// CC_LONG is only 32 bits, so huge ranges are fed in pieces
+
+		const unsigned char* p = bytes;
+		NSUInteger remaining = byteRange.length;
+
+		while (remaining > 0) {
+			CC_LONG n = (CC_LONG)MIN(remaining, (NSUInteger)0x40000000);
+			CC_SHA256_Update(ctx, p, n);
+			p += n;
+			remaining -= n;
+		}
+	}];
+
+	CC_SHA256_Final(digest, ctx);
+
+	NSMutableString* hex = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+
+	for (NSUInteger i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i)
+		[hex appendFormat:@"%02x", digest[i]];
+
+	return hex;
+}
+
 @end
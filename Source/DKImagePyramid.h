@@ -0,0 +1,73 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** @brief A process-wide cache of reduced-resolution copies of images, for drawing large images small.
+
+ A process-wide cache of reduced-resolution copies of images. Each image, identified by the hash of its original data, has a pyramid of levels,
+ each half the width and height of the one before. A level is decoded in the background the first time it's asked for, straight from the original
+ data using ImageIO's subsampled decoding, so the full-size image is never decoded just to make a small copy of it. Until the level is ready the
+ caller carries on drawing the full image, and is told when to draw again.
+
+ Decoded levels are kept within a memory budget shared by every image; when it is exceeded, the least recently used levels are discarded. Images
+ smaller than \c kDKImagePyramidMinimumSize pixels across, and data that ImageIO can't decode, such as PDF, don't get a pyramid. It may be used
+ from any thread.
+*/
+@interface DKImagePyramid : NSObject {
+@private
+	NSMutableDictionary<NSString*, NSImage*>* mLevels;
+	NSMutableDictionary<NSString*, NSNumber*>* mLevelCosts;
+	NSMutableOrderedSet<NSString*>* mRecentLevels; // least recently used first
+	NSMutableDictionary<NSString*, NSMutableArray*>* mPendingLevels; // levels being decoded -> blocks waiting for them
+	NSMutableSet<NSString*>* mUndecodableHashes; // images ImageIO couldn't make levels from
+	NSUInteger mMemoryBudget;
+	NSUInteger mMemoryUsed;
+	dispatch_semaphore_t mLock;
+}
+
+/** @brief The pyramid cache shared by all image shapes.
+ */
+@property (class, readonly, strong) DKImagePyramid* sharedPyramid;
+
+/** @brief The most memory the decoded levels may use, in bytes. The default is 128MB.
+
+ Lowering the budget discards levels immediately if necessary.
+ */
+@property NSUInteger memoryBudget;
+
+/** @brief The memory currently used by decoded levels, in bytes.
+ */
+@property (readonly) NSUInteger memoryUsed;
+
+/** @brief Returns a reduced copy of an image suitable for drawing it at the given resolution.
+
+ The copy returned is the smallest level that still has at least \c requiredWidth pixels across. If that level hasn't been made yet it is
+ queued for decoding, and in the meantime a larger level is returned if one is cached.
+ @param hash a hash of the image data, which identifies the image's levels
+ @param data the original image data
+ @param pixelSize the size of the full image in pixels
+ @param size the size of the full image in points; the level returned has this size so it can be drawn in its place. Levels are
+ always upright, so for an image with an EXIF orientation that swaps its axes the level's size is the upright one
+ @param requiredWidth the number of pixels across that the image will cover where it's drawn
+ @param ready called on the main thread when a level that was queued becomes available, so the caller can draw again. Every caller
+ that asks for a level while it's being decoded is called, not just the one that queued it.
+ @return a reduced copy of the image, or nil if the full image should be drawn
+ */
+- (nullable NSImage*)imageForHash:(NSString*)hash data:(NSData*)data pixelSize:(NSSize)pixelSize size:(NSSize)size requiredPixelWidth:(CGFloat)requiredWidth whenReady:(nullable void (^)(void))ready;
+
+/** @brief Discards the levels of every image.
+ */
+- (void)removeAllImages;
+
+@end
+
+/** images with neither side at least this many pixels are drawn as they are */
+extern const CGFloat kDKImagePyramidMinimumSize;
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,237 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKImagePyramid.h"
+#import <ImageIO/ImageIO.h>
+
+const CGFloat kDKImagePyramidMinimumSize = 1024.0;
+
+/// levels below this many pixels across aren't worth making - the last one is used for anything smaller
+#define kDKImagePyramidSmallestLevel 32.0
+
+static NSString* levelKey(NSString* hash, NSUInteger level);
+
+@interface DKImagePyramid ()
+
+- (void)decodeLevel:(NSUInteger)level hash:(NSString*)hash data:(NSData*)data maxPixels:(CGFloat)maxPixels size:(NSSize)size;
+- (void)evictLevelsToFitBudget;
+
+@end
+
+#pragma mark -
+
+@implementation DKImagePyramid
+
++ (DKImagePyramid*)sharedPyramid
+{
+	static DKImagePyramid* sSharedPyramid = nil;
+	static dispatch_once_t onceToken;
+
+	dispatch_once(&onceToken, ^{
+		sSharedPyramid = [[DKImagePyramid alloc] init];
+	});
+
+	return sSharedPyramid;
+}
+
+- (NSUInteger)memoryBudget
+{
+	return mMemoryBudget;
+}
+
+- (void)setMemoryBudget:(NSUInteger)budget
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+	mMemoryBudget = budget;
+	[self evictLevelsToFitBudget];
+	dispatch_semaphore_signal(mLock);
+}
+
+- (NSUInteger)memoryUsed
+{
+	return mMemoryUsed;
+}
+
+- (NSImage*)imageForHash:(NSString*)hash data:(NSData*)data pixelSize:(NSSize)pixelSize size:(NSSize)size requiredPixelWidth:(CGFloat)requiredWidth whenReady:(void (^)(void))ready
+{
+	CGFloat maxPixels = MAX(pixelSize.width, pixelSize.height);
+
+	if (maxPixels < kDKImagePyramidMinimumSize || requiredWidth <= 0 || pixelSize.width <= 0)
+		return nil;
+
+	// level n is 1/2^n of the full size. Pick the smallest that still covers the required width, stopping where levels get too small to matter
+
+	NSUInteger level = (NSUInteger)MAX(0.0, floor(log2(pixelSize.width / requiredWidth)));
+	NSUInteger lastLevel = (NSUInteger)MAX(0.0, floor(log2(maxPixels / kDKImagePyramidSmallestLevel)));
+
+	level = MIN(level, lastLevel);
+
+	if (level == 0)
+		return nil;
+
+	NSImage* image = nil;
+	BOOL decode = NO;
+
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	if (![mUndecodableHashes containsObject:hash]) {
+		NSString* key = levelKey(hash, level);
+		image = [mLevels objectForKey:key];
+
+		if (image) {
+			[mRecentLevels removeObject:key];
+			[mRecentLevels addObject:key];
+		} else {
+			// the first to ask queues the decoding; everyone who asks while it's under way is called back when it's done
+
+			NSMutableArray* waiting = [mPendingLevels objectForKey:key];
+
+			if (waiting == nil) {
+				waiting = [NSMutableArray array];
+				[mPendingLevels setObject:waiting
+								   forKey:key];
+				decode = YES;
+			}
+
+			if (ready)
+				[waiting addObject:[ready copy]];
+
+			// meanwhile a larger level will do, if there is one
+
+			for (NSUInteger n = level - 1; n > 0 && image == nil; --n)
+				image = [mLevels objectForKey:levelKey(hash, n)];
+		}
+	}
+
+	dispatch_semaphore_signal(mLock);
+
+	if (decode)
+		[self decodeLevel:level
+					 hash:hash
+					 data:data
+				maxPixels:ceil(maxPixels / (CGFloat)(1 << level))
+					 size:size];
+
+	return image;
+}
+
+- (void)decodeLevel:(NSUInteger)level hash:(NSString*)hash data:(NSData*)data maxPixels:(CGFloat)maxPixels size:(NSSize)size
+{
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSImage* image = nil;
+		NSUInteger cost = 0;
+
+		// the thumbnail functions decode at a reduced size where the format allows it (JPEG, for example), and decoding
+		// immediately keeps the work here rather than on the thread that first draws the level. The thumbnail is turned upright
+		// as the full image is drawn, so an image with an EXIF orientation doesn't flip as the view zooms
+
+		CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+
+		if (source) {
+			NSDictionary* options = @{ (id)kCGImageSourceCreateThumbnailFromImageAlways : @YES,
+				(id)kCGImageSourceThumbnailMaxPixelSize : @(maxPixels),
+				(id)kCGImageSourceCreateThumbnailWithTransform : @YES,
+				(id)kCGImageSourceShouldCacheImmediately : @YES };
+
+			CGImageRef cgImage = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+
+			if (cgImage) {
+				// orientations 5 to 8 swap the axes. If the size given is the stored one rather than the upright one, swap it to match
+
+				NSDictionary* properties = (__bridge_transfer NSDictionary*)CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+				NSInteger orientation = [[properties objectForKey:(id)kCGImagePropertyOrientation] integerValue];
+				NSSize levelSize = size;
+
+				if (orientation >= kCGImagePropertyOrientationLeftMirrored && (CGImageGetWidth(cgImage) > CGImageGetHeight(cgImage)) != (size.width > size.height))
+					levelSize = NSMakeSize(size.height, size.width);
+
+				image = [[NSImage alloc] initWithCGImage:cgImage
+													size:levelSize];
+				cost = CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage);
+				CGImageRelease(cgImage);
+			}
+
+			CFRelease(source);
+		}
+
+		NSString* key = levelKey(hash, level);
+
+		dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+		NSArray* waiting = [mPendingLevels objectForKey:key];
+		[mPendingLevels removeObjectForKey:key];
+
+		if (image) {
+			[mLevels setObject:image
+						forKey:key];
+			[mLevelCosts setObject:@(cost)
+							forKey:key];
+			[mRecentLevels addObject:key];
+			mMemoryUsed += cost;
+			[self evictLevelsToFitBudget];
+		} else
+			[mUndecodableHashes addObject:hash];
+
+		dispatch_semaphore_signal(mLock);
+
+		if (image) {
+			for (void (^ready)(void) in waiting)
+				dispatch_async(dispatch_get_main_queue(), ready);
+		}
+	});
+}
+
+- (void)evictLevelsToFitBudget
+{
+	// the lock must be held. The newest level is always kept, otherwise one bigger than the budget would be decoded over and over
+
+	while (mMemoryUsed > mMemoryBudget && [mRecentLevels count] > 1) {
+		NSString* key = [mRecentLevels firstObject];
+
+		mMemoryUsed -= [[mLevelCosts objectForKey:key] unsignedIntegerValue];
+		[mLevels removeObjectForKey:key];
+		[mLevelCosts removeObjectForKey:key];
+		[mRecentLevels removeObjectAtIndex:0];
+	}
+}
+
+- (void)removeAllImages
+{
+	dispatch_semaphore_wait(mLock, DISPATCH_TIME_FOREVER);
+
+	[mLevels removeAllObjects];
+	[mLevelCosts removeAllObjects];
+	[mRecentLevels removeAllObjects];
+	mMemoryUsed = 0;
+
+	dispatch_semaphore_signal(mLock);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		mLevels = [[NSMutableDictionary alloc] init];
+		mLevelCosts = [[NSMutableDictionary alloc] init];
+		mRecentLevels = [[NSMutableOrderedSet alloc] init];
+		mPendingLevels = [[NSMutableDictionary alloc] init];
+		mUndecodableHashes = [[NSMutableSet alloc] init];
+		mMemoryBudget = 128 * 1024 * 1024;
+		mLock = dispatch_semaphore_create(1);
+	}
+
+	return self;
+}
+
+@end
+
+static NSString* levelKey(NSString* hash, NSUInteger level)
+{
+	return [NSString stringWithFormat:@"%@/%lu", hash, (unsigned long)level];
+}
@@ -10,10 +10,12 @@
 #import "DKDrawableShape+Hotspots.h"
 #import "DKDrawing.h"
 #import "DKImageDataManager.h"
+#import "DKImagePyramid.h"
 #import "DKKeyedUnarchiver.h"
 #import "DKObjectOwnerLayer.h"
 #import "DKStyle.h"
 #import "LogEvent.h"
+#import "NSBezierPath+Geometry.h"
 
 #pragma mark Constants
 
@@ -42,6 +44,19 @@ NSString* const kDKOriginalNameMetadataKey = @"dk_original_name";
  */
 - (void)drawImage;
 
+/** @brief Returns a reduced copy of the image from the shared pyramid, if the image will be drawn well below its full resolution
+
+ The resolution needed is worked out from the current graphics context, so this must be called with the image's transform
+ already applied to it. If a better level is still being decoded the shape is redrawn when it's ready.
+ @param ir the rect the image will be drawn into
+ @return an image the same size as the shape's image, or nil to draw the full image
+ */
+- (NSImage*)pyramidImageForRect:(NSRect)ir;
+
+/** @brief The content hash of the original image data, or nil if there is none
+ */
+- (NSString*)imageContentHash;
+
 @end
 
 @implementation DKImageShape
@@ -219,6 +234,11 @@ NSString* const kDKOriginalNameMetadataKey = @"dk_original_name";
 
 		m_image = anImage;
 
+		@synchronized(self)
+		{
+			mContentHash = nil;
+		}
+
 		[m_image setCacheMode:NSImageCacheNever];
 		[m_image recache];
 		[self notifyVisualChange];
@@ -360,6 +380,10 @@ NSString* const kDKOriginalNameMetadataKey = @"dk_original_name";
 							 forKey:key];
 				[self setImageKey:key];
 
+				// hold the manager's copy, which for large images is mapped from disk rather than on the heap
+
+				mOriginalImageData = [newIM imageDataForKey:key];
+
 				//NSLog(@"image data was added to new IM, key: %@", key );
 			}
 		}
@@ -389,6 +413,8 @@ NSString* const kDKOriginalNameMetadataKey = @"dk_original_name";
 
 		[self setImage:image];
 		[self setImageKey:key];
+
+		mOriginalImageData = [imgMgr imageDataForKey:key];
 	} else {
 		image = [[NSImage alloc] initWithData:data];
 		[self setImage:image];
@@ -630,21 +656,80 @@ NSString* const kDKOriginalNameMetadataKey = @"dk_original_name";
 		ir.origin.y = m_imageOffset.y;
 	}
 
-	// render at high quality
+	// render at high quality. On screen, an image drawn much smaller than its full resolution is drawn from a reduced copy,
+	// which looks the same but is far less work to draw. Printing and PDF always get the full image.
 
 	[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
 	//[[self image] setFlipped:[[NSGraphicsContext currentContext] isFlipped]];
 
-	[[self image] drawInRect:ir
-					fromRect:NSZeroRect
-				   operation:[self compositingOperation]
-					fraction:[self imageOpacity]
-			  respectFlipped:YES
-					   hints:nil];
+	NSImage* image = nil;
+
+	if ([NSGraphicsContext currentContextDrawingToScreen])
+		image = [self pyramidImageForRect:ir];
+
+	if (image == nil)
+		image = [self image];
+
+	[image drawInRect:ir
+			 fromRect:NSZeroRect
+			operation:[self compositingOperation]
+			 fraction:[self imageOpacity]
+	   respectFlipped:YES
+				hints:nil];
 
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
 
+- (NSImage*)pyramidImageForRect:(NSRect)ir
+{
+	NSImage* fullImage = [self image];
+	NSImageRep* rep = [[fullImage representations] firstObject];
+	NSData* data = [self imageData];
+
+	// only bitmaps benefit - vector images are already drawn at whatever resolution is needed
+
+	if (data == nil || ![rep isKindOfClass:[NSBitmapImageRep class]])
+		return nil;
+
+	NSString* hash = [self imageContentHash];
+
+	if (hash == nil)
+		return nil;
+
+	// the CTM maps the image rect to device pixels, so its scale gives the pixels the image will cover
+
+	CGAffineTransform ctm = CGContextGetCTM([[NSGraphicsContext currentContext] graphicsPort]);
+	CGFloat deviceScale = sqrt(fabs(ctm.a * ctm.d - ctm.b * ctm.c));
+
+	__weak DKImageShape* weakSelf = self;
+
+	return [[DKImagePyramid sharedPyramid] imageForHash:hash
+												   data:data
+											  pixelSize:NSMakeSize([rep pixelsWide], [rep pixelsHigh])
+												   size:[fullImage size]
+									 requiredPixelWidth:NSWidth(ir) * deviceScale
+											  whenReady:^{
+												  [weakSelf notifyVisualChange];
+											  }];
+}
+
+- (NSString*)imageContentHash
+{
+	// the image manager already knows the hash for data it holds; otherwise hash it here
+
+	if (mContentHash == nil) {
+		NSString* key = [self imageKey];
+
+		if (key)
+			mContentHash = [[[self container] imageManager] contentHashForKey:key];
+
+		if (mContentHash == nil)
+			mContentHash = [[self imageData] contentHashString];
+	}
+
+	return mContentHash;
+}
+
 - (NSAffineTransform*)imageTransform
 {
 	NSAffineTransform* tfm = [NSAffineTransform transform];
@@ -826,6 +911,19 @@ NSString* const kDKOriginalNameMetadataKey = @"dk_original_name";
 	}
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	// hit-testing only ever fills the path, so the style doesn't matter
+	return YES;
+}
+
+- (BOOL)geometricHitTestRect:(NSRect)r
+{
+	return [[self renderingPath] isHitByRect:r
+									  filled:YES
+								 strokeWidth:0];
+}
+
 /** @brief Add contextual menu items pertaining to the current object's context
  @param theMenu a menu object to add items to
  @return YES
@@ -171,6 +171,15 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)moveSelectedObjectsByX:(CGFloat)dx byY:(CGFloat)dy NS_SWIFT_NAME(moveSelectedObjectsBy(x:y:));
 
+/** @brief Moves a number of objects to new locations as a single undoable change
+
+ Rather than each object registering its own undo task, one task is registered that restores all of the objects' previous
+ locations, which keeps undo registration cheap when many objects are moved at once.
+ @param locations the new locations, as NSValues wrapping points, one per object
+ @param objects the objects to move
+ */
+- (void)setLocations:(NSArray<NSValue*>*)locations ofObjects:(NSArray<DKDrawableObject*>*)objects;
+
 // the selection:
 
 /** @brief Sets the selection to a given set of objects
@@ -383,16 +383,48 @@ enum {
 	NSArray* arr = [self selectedAvailableObjects];
 
 	if (([arr count] > 0) && ((dx != 0.0) || (dy != 0.0))) {
+		NSMutableArray* locations = [NSMutableArray arrayWithCapacity:[arr count]];
+
 		for (DKDrawableObject* od in arr) {
-			[od offsetLocationByX:dx
-							  byY:dy];
+			NSPoint loc = [od location];
+
+			loc.x += dx;
+			loc.y += dy;
+			[locations addObject:[NSValue valueWithPoint:loc]];
 		}
 
+		[self setLocations:locations
+				 ofObjects:arr];
+
 		return YES;
 	} else
 		return NO;
 }
 
+- (void)setLocations:(NSArray<NSValue*>*)locations ofObjects:(NSArray<DKDrawableObject*>*)objects
+{
+	NSAssert([locations count] == [objects count], @"expected a location for each object");
+
+	NSMutableArray* oldLocations = [NSMutableArray arrayWithCapacity:[objects count]];
+
+	for (DKDrawableObject* od in objects)
+		[oldLocations addObject:[NSValue valueWithPoint:[od location]]];
+
+	[[[self undoManager] prepareWithInvocationTarget:self] setLocations:oldLocations
+															  ofObjects:objects];
+
+	// the objects' own undo tasks are redundant with the one above
+
+	NSUInteger i;
+
+	[[self undoManager] disableUndoRegistration];
+
+	for (i = 0; i < [objects count]; ++i)
+		[[objects objectAtIndex:i] setLocation:[[locations objectAtIndex:i] pointValue]];
+
+	[[self undoManager] enableUndoRegistration];
+}
+
 #pragma mark -
 #pragma mark - the selection
 
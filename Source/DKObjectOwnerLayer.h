@@ -44,7 +44,9 @@ application needs.
  fastest rendering but will show pixellation at higher zooms. If both pdf and CGLayer are set, both caches will be created and
  the CGLayer one used when DKDrawing has its "low quality" hint set, and the PDF rep otherwise.
 
- The cache is only used for screen drawing.
+ The cache is divided into tiles of a fixed size in the view, made for the power of two zoom level at or above the view's scale, so
+ bitmaps are never enlarged to draw them. Tiles are made as they're first drawn, and a change to an object discards only the tiles it
+ touches. Changing the zoom level starts the cache afresh. The cache is only used for screen drawing.
  
  NOTE: PDF caching has been shown to be actually slower when there are many objects, espcially with advanced storage in use. This is
  because it's an all-or-nothing rendering proposition which direct drawing of a layer's objects is not.
@@ -57,18 +59,62 @@ application needs.
 	BOOL m_allowSnapToObjects; // YES to let snapping look for other objects
 	DKDrawableObject* mNewObjectPending; // temporary object being created - is drawn and handled as a normal object but can be deleted without undo
 	DKLayerCacheOption mLayerCachingOption; // see constants defined above
-	NSRect mCacheBounds; // the bounds rect of the cached layer or PDF rep - used to accurately position the cache when drawn
+	NSRect mCacheBounds; // the area that has cached tiles, which is where the objects were when the cache was started, plus any changes
+	NSCache* mTileCache; // the cached tiles, keyed by tile position, or nil if there's no cache
+	NSInteger mCacheLevel; // the zoom level the cached tiles were made for
 	BOOL m_inDragOp; // YES if a drag is happening over the layer
 	NSSize m_pasteOffset; // distance to offset a pasted object
 	BOOL m_recordPasteOffset; // set to YES following a paste, and NO following a drag. When YES, paste offset is recorded.
 	NSInteger mPasteboardLastChange; // last change count recorded during a paste
 	NSInteger mPasteCount; // number of repeated paste operations since last new paste
+	NSData* mPendingData; // while the layer is a placeholder, the archive its objects are still to be decoded from
+	id mPendingHelper; // the dearchiving helper the layer was decoded with, which decodes its objects too
+	uint32_t mPendingObjectsID; // the archived object number of the objects array
+	NSUInteger mPendingObjectCount; // the number of objects, as archived
+	NSRect mPendingObjectBounds; // the bounds of the visible objects, as archived
+	BOOL mPendingLoadStarted; // YES once the objects are being decoded in the background
 @protected
 	BOOL mShowStorageDebugging; // if YES, draws the debugging path for the storage on top (debugging feature only)
 }
 
 @property (class) DKLayerCacheOption defaultLayerCacheOption;
 
+/** @brief Whether hidden or locked layers are loaded as placeholders when opening a binary archive. The default is YES.
+
+ A placeholder knows how many objects it has and their bounds, but doesn't decode the objects themselves until it's made visible or
+ unlocked, is first drawn, or its objects are asked for. See \c -hasPendingObjects.
+ */
+@property (class) BOOL defersLoadingHiddenLayers;
+
+/** @name Deferred Loading
+ @{ */
+
+/** @brief Whether the layer is a placeholder whose objects haven't yet been decoded.
+
+ Layers are only loaded as placeholders from a binary archive (see \c DKBinaryArchiver), and only if hidden or locked when saved. Until
+ the objects are decoded, \c -countOfObjects and \c -unionOfAllObjectBounds answer from what was archived; anything else that needs the
+ objects decodes them first, waiting for a background load if one is under way.
+ */
+@property (readonly) BOOL hasPendingObjects;
+
+/** @brief Starts decoding the objects of a placeholder layer on a background thread.
+
+ The objects are decoded by an unarchiver of their own, so any styles they share with the rest of the drawing are decoded as separate
+ copies, which are replaced by the drawing's own when the objects are added to the layer on the main thread. The layer is then redrawn.
+ The dearchiving helper is told when the load starts and finishes, so progress can be shown. Does nothing if the layer isn't a placeholder
+ or is already loading.
+ */
+- (void)loadPendingObjectsInBackground;
+
+/** @brief Decodes the objects of a placeholder layer immediately.
+
+ Like a background load, the objects are decoded by an unarchiver of their own. If a background load is under way, its objects are
+ discarded in favour of these.
+ */
+- (void)loadPendingObjects;
+
+/** @} */
+
 /** @name Setting The Storage
  @brief n.b. Storage is set by default, this is an advanced feature that you can ignore 99% of the time.
  @{ */
@@ -697,7 +743,8 @@ application needs.
 
  Layers can cache their entire contents offscreen when they are inactive. This can boost
  drawing performance when there are many layers, or the layers have complex contents. When the
- layer is deactivated the cache is updated, on activation the "real" content is drawn.
+ layer is deactivated the cache is updated, on activation the "real" content is drawn. Changing the option
+ discards the cache.
  */
 @property (nonatomic) DKLayerCacheOption layerCacheOption;
 
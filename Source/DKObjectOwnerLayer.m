@@ -6,6 +6,7 @@
 
 #import "DKObjectOwnerLayer.h"
 #import "DKBSPObjectStorage.h"
+#import "DKBinaryArchiver.h"
 #import "DKDrawKitMacros.h"
 #import "DKDrawing.h"
 #import "DKDrawingView.h"
@@ -15,9 +16,11 @@
 #import "DKImageShape.h"
 #import "DKLayer+Metadata.h"
 #import "DKPasteboardInfo.h"
+#import "DKQuartzCache.h"
 #import "DKSelectionPDFView.h"
 #import "DKStyle.h"
 #import "DKTextShape.h"
+#import "DKUnarchivingHelper.h"
 #import "DKUndoManager.h"
 #import "LogEvent.h"
 
@@ -28,13 +31,47 @@ NSString* const kDKLayerDidAddObject = @"kDKLayerDidAddObject";
 NSString* const kDKLayerWillRemoveObject = @"kDKLayerWillRemoveObject";
 NSString* const kDKLayerDidRemoveObject = @"kDKLayerDidRemoveObject";
 
+/** the size of a cache tile in view points - in drawing units it shrinks as the zoom level goes up */
+static const CGFloat kDKLayerCacheTileSize = 512.0;
+
+/** tiles are made for zoom levels that are powers of two within this range */
+static const NSInteger kDKLayerCacheMinTileLevel = -8;
+static const NSInteger kDKLayerCacheMaxTileLevel = 8;
+
+/** the most memory the tiles of one layer may use before the least recently used are discarded */
+static const NSUInteger kDKLayerCacheCostLimit = 64 * 1024 * 1024;
+
+/** @brief The content of one tile of an inactive layer, rendered offscreen.
+
+ A tile has a bitmap, a PDF or both, according to the layer's cache option. A tile that covers no objects has neither.
+ */
+@interface DKLayerCacheTile : NSObject
+
+@property (nonatomic, strong, nullable) DKQuartzCache* bitmap;
+@property (nonatomic, strong, nullable) NSPDFImageRep* pdf;
+@property (nonatomic) NSUInteger cost; // the tile's memory use in bytes
+
+@end
+
+static NSInteger layerCacheTileLevelForScale(CGFloat scale);
+static id layerCacheTileKey(NSInteger column, NSInteger row);
+static void layerCacheTileRange(CGFloat lo, CGFloat hi, CGFloat tileSize, NSInteger* first, NSInteger* last);
+
 @interface DKObjectOwnerLayer ()
 - (void)updateCache;
 - (void)invalidateCache;
+- (void)invalidateCacheInRect:(NSRect)rect;
+- (void)drawCachedObjectsInRect:(NSRect)rect inView:(DKDrawingView*)aView;
+- (DKLayerCacheTile*)makeCacheTileForRect:(NSRect)tileRect level:(NSInteger)level inView:(DKDrawingView*)aView;
+- (void)drawObjects:(NSArray<DKDrawableObject*>*)objects asOutlines:(BOOL)outlines;
+- (BOOL)shouldDeferObjectsWithCoder:(NSCoder*)coder;
+- (DKBinaryUnarchiver*)pendingObjectsUnarchiver;
+- (void)installPendingObjects:(nullable NSArray*)objects fromUnarchiver:(DKBinaryUnarchiver*)unarchiver;
 @end
 
 static Class sStorageClass = nil;
 static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
+static BOOL sDefersLoadingHiddenLayers = YES;
 
 @implementation DKObjectOwnerLayer
 #pragma mark As a DKObjectOwnerLayer
@@ -49,6 +86,16 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	return sDefaultCacheOption;
 }
 
++ (void)setDefersLoadingHiddenLayers:(BOOL)defers
+{
+	sDefersLoadingHiddenLayers = defers;
+}
+
++ (BOOL)defersLoadingHiddenLayers
+{
+	return sDefersLoadingHiddenLayers;
+}
+
 + (void)setStorageClass:(Class)aClass
 {
 	if ([aClass conformsToProtocol:@protocol(DKObjectStorage)] || aClass == nil)
@@ -69,10 +116,19 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		LogEvent_(kReactiveEvent, @"owner layer (%@) setting storage = %@", self, storage);
 
 		mStorage = storage;
+		[self invalidateCache];
 	}
 }
 
-@synthesize storage = mStorage;
+- (id<DKObjectStorage>)storage
+{
+	// a placeholder decodes its objects the first time anything needs them
+
+	if (mPendingData)
+		[self loadPendingObjects];
+
+	return mStorage;
+}
 
 #pragma mark - the list of objects
 
@@ -216,6 +272,9 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 - (NSUInteger)countOfObjects
 {
+	if (mPendingData)
+		return mPendingObjectCount;
+
 	return [[self storage] countOfObjects];
 }
 
@@ -552,33 +611,17 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 {
 #pragma unused(obj)
 
-	// if the layer is cached, invalidate it. This forces the cache to get rebuilt when a change occurs while inactive,
-	// for example an undo was performed on a contained object that changed its appearance
+	// if the layer is cached, invalidate the tiles the object touches. This forces them to get rebuilt when a change occurs while
+	// inactive, for example an undo was performed on a contained object that changed its appearance
 
-	[self invalidateCache];
+	[self invalidateCacheInRect:rect];
 	[self setNeedsDisplayInRect:rect];
 }
 
 - (void)drawVisibleObjects
 {
-	BOOL outlines;
-	DKStyle* tempStyle = nil;
-
-	//NSLog(@"drawing %d objects in view: %@", [[self visibleObjects] count], [self currentView]);
-
-	outlines = (([self layerCacheOption] & kDKLayerCacheObjectOutlines) != 0);
-
-	if (outlines)
-		tempStyle = [DKStyle styleWithFillColour:nil
-									strokeColour:[NSColor blackColor]
-									 strokeWidth:1.0];
-
-	for (DKDrawableObject* od in self.visibleObjects) {
-		if (outlines)
-			[od drawContentWithStyle:tempStyle];
-		else
-			[od drawContentWithSelectedState:NO];
-	}
+	[self drawObjects:[self visibleObjects]
+		   asOutlines:(([self layerCacheOption] & kDKLayerCacheObjectOutlines) != 0)];
 }
 
 - (NSImage*)imageOfObjects
@@ -677,6 +720,9 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 - (NSRect)unionOfAllObjectBounds
 {
+	if (mPendingData)
+		return [self visible] ? mPendingObjectBounds : NSZeroRect;
+
 	NSRect u = NSZeroRect;
 
 	for (DKDrawableObject* obj in self.visibleObjects) {
@@ -1073,6 +1119,15 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 @synthesize allowsSnapToObjects = m_allowSnapToObjects;
 @synthesize layerCacheOption = mLayerCachingOption;
 
+- (void)setLayerCacheOption:(DKLayerCacheOption)option
+{
+	if (option != mLayerCachingOption) {
+		mLayerCachingOption = option;
+		[self invalidateCache];
+		[self setNeedsDisplay:YES];
+	}
+}
+
 - (void)setHighlightedForDrag:(BOOL)highlight
 {
 	if (highlight != m_inDragOp) {
@@ -1108,16 +1163,169 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	[self setNeedsDisplay:YES];
 }
 
+#pragma mark -
+#pragma mark - deferred loading
+
+- (BOOL)hasPendingObjects
+{
+	return mPendingData != nil;
+}
+
+- (DKBinaryUnarchiver*)pendingObjectsUnarchiver
+{
+	// the objects are decoded by an unarchiver of their own rather than the one the layer was decoded by, which the layer doesn't keep
+	// because its decoded objects include the drawing, and so the layer. They get their own copies of any styles, which are reconciled
+	// with the drawing's styles when the objects are installed
+
+	DKBinaryUnarchiver* unarchiver = [[DKBinaryUnarchiver alloc] initForReadingWithData:mPendingData];
+
+	[unarchiver setDelegate:mPendingHelper];
+	[unarchiver setImageManager:[[self drawing] imageManager]];
+
+	// references to the drawing and its layers, including this one, are left unresolved. Installing the objects sets their container
+
+	[unarchiver setObject:nil
+			  forObjectID:[unarchiver objectIDForKey:@"root"]];
+
+	for (NSNumber* layerID in [unarchiver layerObjectIDs])
+		[unarchiver setObject:nil
+				  forObjectID:[layerID unsignedIntValue]];
+
+	return unarchiver;
+}
+
+- (void)loadPendingObjectsInBackground
+{
+	@synchronized(self)
+	{
+		if (mPendingData == nil || mPendingLoadStarted)
+			return;
+
+		mPendingLoadStarted = YES;
+	}
+
+	DKBinaryUnarchiver* worker = [self pendingObjectsUnarchiver];
+	id helper = [worker delegate];
+
+	if ([helper respondsToSelector:@selector(unarchiver:willLoadLayer:)])
+		[helper unarchiver:worker
+			willLoadLayer:self];
+
+	uint32_t objectsID = mPendingObjectsID;
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSArray* objects = nil;
+
+		@try {
+			objects = [worker decodeObjectWithID:objectsID];
+		}
+		@catch (NSException* excp) {
+			NSLog(@"layer '%@' couldn't load its objects: %@", [self layerName], excp);
+		}
+
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[self installPendingObjects:objects
+						fromUnarchiver:worker];
+		});
+	});
+}
+
+- (void)loadPendingObjects
+{
+	BOOL started;
+
+	@synchronized(self)
+	{
+		if (mPendingData == nil)
+			return;
+
+		started = mPendingLoadStarted;
+		mPendingLoadStarted = YES;
+	}
+
+	DKBinaryUnarchiver* worker = [self pendingObjectsUnarchiver];
+	id helper = [worker delegate];
+
+	if (!started && [helper respondsToSelector:@selector(unarchiver:willLoadLayer:)])
+		[helper unarchiver:worker
+			willLoadLayer:self];
+
+	// a background load under way decodes the objects separately, so whichever finishes first is installed and the other's are discarded
+
+	[self installPendingObjects:[worker decodeObjectWithID:mPendingObjectsID]
+				fromUnarchiver:worker];
+}
+
+- (void)installPendingObjects:(NSArray*)objects fromUnarchiver:(DKBinaryUnarchiver*)unarchiver
+{
+	@synchronized(self)
+	{
+		// the background load finishing after a synchronous one has nothing left to do
+
+		if (mPendingData == nil)
+			return;
+
+		mPendingData = nil;
+		mPendingHelper = nil;
+	}
+
+	// the objects may use their own copies of styles that the rest of the drawing already uses, which they adopt instead. The drawing's
+	// styles are gathered before the objects are added so that only the existing ones are candidates
+
+	NSSet* drawingStyles = [[self drawing] allStyles];
+
+	if ([drawingStyles count] > 0)
+		[objects makeObjectsPerformSelector:@selector(replaceMatchingStylesFromSet:)
+								 withObject:drawingStyles];
+
+	// the objects are added as they would have been when the layer was decoded, so not as an undoable change
+
+	if (objects)
+		[mStorage setObjects:objects];
+
+	[objects makeObjectsPerformSelector:@selector(setContainer:)
+							 withObject:self];
+	[objects makeObjectsPerformSelector:@selector(objectWasAddedToLayer:)
+							 withObject:self];
+
+	if ([self undoManager])
+		[self drawingHasNewUndoManager:[self undoManager]];
+
+	[self setNeedsDisplay:YES];
+
+	id helper = [unarchiver delegate];
+
+	if ([helper respondsToSelector:@selector(unarchiver:didLoadLayer:)])
+		[helper unarchiver:unarchiver
+			  didLoadLayer:self];
+}
+
+- (BOOL)shouldDeferObjectsWithCoder:(NSCoder*)coder
+{
+	// only a binary archive can decode part of itself later, and only layers archived with their object count can stand in for themselves.
+	// The locked flag is decoded by DKLayer after initialization, so is read directly here
+
+	if (![[self class] defersLoadingHiddenLayers] || ![coder isKindOfClass:[DKBinaryUnarchiver class]])
+		return NO;
+
+	if (![coder containsValueForKey:@"DKObjectOwnerLayer_objectCount"])
+		return NO;
+
+	return ![coder decodeBoolForKey:@"visible"] || [coder decodeBoolForKey:@"locked"];
+}
+
 #pragma mark -
 #pragma mark - private
 
 /** @brief Builds the offscreen cache(s) for drawing the layer more quickly when it's inactive
 
- Application code shouldn't call this directly
+ The tiles are made in the context of the view they're drawn in and at its scale, so the cache is started afresh and
+ the tiles are made as the layer is redrawn. Application code shouldn't call this directly
  */
 - (void)updateCache
 {
-	// not implemented
+	[self invalidateCache];
+	[self setNeedsDisplay:YES];
 }
 
 /** @brief Discard the offscreen cache(s) used for drawing the layer more quickly when it's inactive
@@ -1126,7 +1334,203 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)invalidateCache
 {
-	// not implemented
+	mTileCache = nil;
+	mCacheBounds = NSZeroRect;
+}
+
+/** @brief Discards the cached tiles that intersect an area, so they're made again when next drawn
+
+ Application code shouldn't call this directly
+ @param rect the area that has changed
+ */
+- (void)invalidateCacheInRect:(NSRect)rect
+{
+	if (mTileCache == nil || NSIsEmptyRect(rect))
+		return;
+
+	// the area may now have objects where there were none when the cache was started
+
+	mCacheBounds = NSUnionRect(mCacheBounds, rect);
+
+	CGFloat tileSize = ldexp(kDKLayerCacheTileSize, -(int)mCacheLevel);
+	NSInteger c0, c1, r0, r1;
+
+	layerCacheTileRange(NSMinX(rect), NSMaxX(rect), tileSize, &c0, &c1);
+	layerCacheTileRange(NSMinY(rect), NSMaxY(rect), tileSize, &r0, &r1);
+
+	for (NSInteger row = r0; row <= r1; ++row)
+		for (NSInteger column = c0; column <= c1; ++column)
+			[mTileCache removeObjectForKey:layerCacheTileKey(column, row)];
+}
+
+/** @brief Draws the objects in an area from the cached tiles, making any not already cached
+
+ Tiles are kept for one zoom level at a time, that of the view they were last drawn in.
+ @param rect the area being updated
+ @param aView the view being drawn
+ */
+- (void)drawCachedObjectsInRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+	NSInteger level = layerCacheTileLevelForScale([aView scale]);
+
+	if (mTileCache == nil || level != mCacheLevel) {
+		[self invalidateCache];
+
+		mTileCache = [[NSCache alloc] init];
+		[mTileCache setTotalCostLimit:kDKLayerCacheCostLimit];
+		mCacheLevel = level;
+		mCacheBounds = [self unionOfAllObjectBounds];
+	}
+
+	// only the area that had objects when the cache was started, or has changed since, needs tiles
+
+	NSRect vr = NSIntersectionRect(rect, mCacheBounds);
+
+	if (NSIsEmptyRect(vr))
+		return;
+
+	CGFloat tileSize = ldexp(kDKLayerCacheTileSize, -(int)level);
+	NSInteger c0, c1, r0, r1;
+
+	layerCacheTileRange(NSMinX(vr), NSMaxX(vr), tileSize, &c0, &c1);
+	layerCacheTileRange(NSMinY(vr), NSMaxY(vr), tileSize, &r0, &r1);
+
+	// with both kinds of cache, the bitmap is drawn while the drawing wants speed and the PDF otherwise
+
+	DKLayerCacheOption option = [self layerCacheOption];
+	BOOL useBitmap = (option & kDKLayerCacheUsingCGLayer) != 0 && ((option & kDKLayerCacheUsingPDF) == 0 || [[self drawing] lowRenderingQuality]);
+
+	for (NSInteger row = r0; row <= r1; ++row) {
+		for (NSInteger column = c0; column <= c1; ++column) {
+			id key = layerCacheTileKey(column, row);
+			NSRect tileRect = NSMakeRect(column * tileSize, row * tileSize, tileSize, tileSize);
+			DKLayerCacheTile* tile = [mTileCache objectForKey:key];
+
+			if (tile == nil) {
+				tile = [self makeCacheTileForRect:tileRect
+											level:level
+										   inView:aView];
+				[mTileCache setObject:tile
+							   forKey:key
+							     cost:[tile cost]];
+			}
+
+			if (useBitmap)
+				[[tile bitmap] drawInRect:tileRect];
+			else
+				[[tile pdf] drawInRect:tileRect
+							  fromRect:NSZeroRect
+							 operation:NSCompositeSourceOver
+							  fraction:1.0
+						respectFlipped:YES
+								 hints:nil];
+		}
+	}
+}
+
+/** @brief Renders the objects within one tile of the layer offscreen
+
+ The bitmap is rendered unflipped, which the flipped view reverses when it's drawn, so the view and the tile agree on where
+ everything goes. The PDF is rendered upright, as PDF is drawn the right way up in a flipped view.
+ @param tileRect the area of the drawing the tile covers
+ @param level the zoom level the tile is for; the bitmap has the view's resolution at a scale of 2^level
+ @param aView the view the tile will be drawn in, whose context the bitmap is made for
+ @return a new tile
+ */
+- (DKLayerCacheTile*)makeCacheTileForRect:(NSRect)tileRect level:(NSInteger)level inView:(DKDrawingView*)aView
+{
+	DKLayerCacheTile* tile = [[DKLayerCacheTile alloc] init];
+	NSArray<DKDrawableObject*>* objects = [self objectsForUpdateRect:tileRect
+															  inView:nil];
+
+	if ([objects count] == 0)
+		return tile;
+
+	DKLayerCacheOption option = [self layerCacheOption];
+	BOOL outlines = (option & kDKLayerCacheObjectOutlines) != 0;
+
+	if (option & kDKLayerCacheUsingCGLayer) {
+		DKQuartzCache* bitmap = [DKQuartzCache cacheForCurrentContextWithSize:NSMakeSize(kDKLayerCacheTileSize, kDKLayerCacheTileSize)];
+		CGFloat backing = [aView window] ? [[aView window] backingScaleFactor] : 1.0;
+
+		[bitmap lockFocusFlipped:YES];
+
+		NSAffineTransform* tfm = [NSAffineTransform transform];
+		[tfm scaleBy:ldexp(1.0, (int)level)];
+		[tfm translateXBy:-NSMinX(tileRect)
+					  yBy:-NSMinY(tileRect)];
+		[tfm concat];
+
+		NSRectClip(tileRect);
+		[self drawObjects:objects
+			   asOutlines:outlines];
+		[bitmap unlockFocus];
+
+		[tile setBitmap:bitmap];
+		[tile setCost:[tile cost] + (NSUInteger)(kDKLayerCacheTileSize * kDKLayerCacheTileSize * 4 * backing * backing)];
+	}
+
+	if (option & kDKLayerCacheUsingPDF) {
+		NSMutableData* pdfData = [NSMutableData data];
+		CGDataConsumerRef consumer = CGDataConsumerCreateWithCFData((__bridge CFMutableDataRef)pdfData);
+		CGRect mediaBox = CGRectMake(0, 0, NSWidth(tileRect), NSHeight(tileRect));
+		CGContextRef pdfContext = CGPDFContextCreate(consumer, &mediaBox, NULL);
+
+		CGDataConsumerRelease(consumer);
+
+		if (pdfContext) {
+			CGPDFContextBeginPage(pdfContext, NULL);
+
+			[NSGraphicsContext saveGraphicsState];
+			[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:pdfContext
+																							flipped:YES]];
+
+			NSAffineTransform* tfm = [NSAffineTransform transform];
+			[tfm translateXBy:0
+						  yBy:NSHeight(tileRect)];
+			[tfm scaleXBy:1
+					  yBy:-1];
+			[tfm translateXBy:-NSMinX(tileRect)
+						  yBy:-NSMinY(tileRect)];
+			[tfm concat];
+
+			NSRectClip(tileRect);
+			[self drawObjects:objects
+				   asOutlines:outlines];
+
+			[NSGraphicsContext restoreGraphicsState];
+
+			CGPDFContextEndPage(pdfContext);
+			CGPDFContextClose(pdfContext);
+			CGContextRelease(pdfContext);
+
+			[tile setPdf:[NSPDFImageRep imageRepWithData:pdfData]];
+			[tile setCost:[tile cost] + [pdfData length]];
+		}
+	}
+
+	return tile;
+}
+
+/** @brief Draws objects unselected, or as plain outlines
+ @param objects the objects to draw, bottom to top
+ @param outlines YES to stroke each object's outline with a thin black line instead of drawing its style
+ */
+- (void)drawObjects:(NSArray<DKDrawableObject*>*)objects asOutlines:(BOOL)outlines
+{
+	DKStyle* tempStyle = nil;
+
+	if (outlines)
+		tempStyle = [DKStyle styleWithFillColour:nil
+									strokeColour:[NSColor blackColor]
+									 strokeWidth:1.0];
+
+	for (DKDrawableObject* od in objects) {
+		if (outlines)
+			[od drawContentWithStyle:tempStyle];
+		else
+			[od drawContentWithSelectedState:NO];
+	}
 }
 
 #pragma mark -
@@ -1140,10 +1544,31 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)drawingHasNewUndoManager:(NSUndoManager*)um
 {
+	// a placeholder's styles are given the undo manager when its objects are loaded
+
+	if (mPendingData)
+		return;
+
 	[[self allStyles] makeObjectsPerformSelector:@selector(setUndoManager:)
 									  withObject:um];
 }
 
+- (void)setVisible:(BOOL)visible
+{
+	[super setVisible:visible];
+
+	if (visible)
+		[self loadPendingObjectsInBackground];
+}
+
+- (void)setLocked:(BOOL)locked
+{
+	[super setLocked:locked];
+
+	if (!locked && [self visible])
+		[self loadPendingObjectsInBackground];
+}
+
 /** @brief Called when the drawing's size changed - this gives layers that need to know about this a
  direct notification
 
@@ -1183,16 +1608,27 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView
 {
-#pragma unused(rect)
-
-	if ([self countOfObjects] > 0) {
-		NSEnumerator* iter = [self objectEnumeratorForUpdateRect:rect
-														  inView:aView];
+	// a placeholder has nothing to draw until its objects have loaded; it's redrawn when they have
 
-		// draw the objects - this enumerator has already excluded any not needing to be drawn
+	if (mPendingData) {
+		[self loadPendingObjectsInBackground];
+		return;
+	}
 
-		for (DKDrawableObject* obj in iter)
-			[obj drawContentWithSelectedState:NO];
+	if ([self countOfObjects] > 0) {
+		DKLayerCacheOption option = [self layerCacheOption];
+		BOOL inactive = ![self isActive];
+
+		if (inactive && (option & (kDKLayerCacheUsingPDF | kDKLayerCacheUsingCGLayer)) != 0 && [NSGraphicsContext currentContextDrawingToScreen])
+			[self drawCachedObjectsInRect:rect
+								   inView:aView];
+		else {
+			// draw the objects - the update rect has already excluded any not needing to be drawn
+
+			[self drawObjects:[self objectsForUpdateRect:rect
+												  inView:aView]
+				   asOutlines:inactive && (option & kDKLayerCacheObjectOutlines) != 0];
+		}
 	}
 
 	// draw any pending object on top of the others
@@ -1227,6 +1663,11 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (NSSet*)allStyles
 {
+	// a placeholder's styles aren't known until its objects are loaded, when they're reconciled with the drawing's
+
+	if (mPendingData)
+		return nil;
+
 	NSEnumerator<DKDrawableObject*>* iter = [[self objects] reverseObjectEnumerator];
 	NSMutableSet<DKStyle*>* unionOfAllStyles = nil;
 
@@ -1253,6 +1694,9 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (NSSet*)allRegisteredStyles
 {
+	if (mPendingData)
+		return nil;
+
 	NSEnumerator<DKDrawableObject*>* iter = [[self objects] reverseObjectEnumerator];
 	NSMutableSet<DKStyle*>* unionOfAllStyles = nil;
 
@@ -1279,6 +1723,9 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)replaceMatchingStylesFromSet:(NSSet*)aSet
 {
+	if (mPendingData)
+		return;
+
 	// propagate this to all drawables in the layer
 
 	[[self objects] makeObjectsPerformSelector:@selector(replaceMatchingStylesFromSet:)
@@ -1329,11 +1776,13 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 }
 
 /** @brief Invoked when the layer resigned the active layer
+
+ Starts the layer cache afresh, as the layer draws from it from now on
  */
 - (void)layerDidResignActiveLayer
 {
-	if (([self layerCacheOption] & kDKLayerCacheObjectOutlines) != 0)
-		[self setNeedsDisplay:YES];
+	if ([self layerCacheOption] != kDKLayerCacheNone)
+		[self updateCache];
 }
 
 #pragma mark -
@@ -1343,8 +1792,8 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	// though we are about to release all the objects, set their container to nil - this ensures that
 	// if anything else is retaining them, when they are later released they won't have stale refs to the drawing, owner, et. al.
 
-	[[self objects] makeObjectsPerformSelector:@selector(setContainer:)
-									withObject:nil];
+	[[mStorage objects] makeObjectsPerformSelector:@selector(setContainer:)
+										withObject:nil];
 }
 
 - (instancetype)init
@@ -1367,7 +1816,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 - (NSString*)description
 {
-	return [NSString stringWithFormat:@"%@,\nstorage = %@", [super description], [self storage]];
+	return [NSString stringWithFormat:@"%@,\nstorage = %@", [super description], mStorage];
 }
 
 #pragma mark -
@@ -1411,6 +1860,20 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 			   forKey:@"snappable"];
 	[coder encodeInteger:[self layerCacheOption]
 				  forKey:@"DKObjectOwnerLayer_cacheOption"];
+
+	// the count and bounds of the objects let a reader stand in for the layer without decoding them - see -initWithCoder:
+
+	NSRect bounds = NSZeroRect;
+
+	for (DKDrawableObject* obj in [self objects]) {
+		if ([obj visible])
+			bounds = UnionOfTwoRects(bounds, [obj bounds]);
+	}
+
+	[coder encodeInteger:[self countOfObjects]
+				  forKey:@"DKObjectOwnerLayer_objectCount"];
+	[coder encodeRect:bounds
+			   forKey:@"DKObjectOwnerLayer_objectBounds"];
 }
 
 - (instancetype)initWithCoder:(NSCoder*)coder
@@ -1438,6 +1901,17 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 			// storage was archived, so get its objects and assign them to the real storage
 
 			[self setObjects:[tempStorage objects]];
+		} else if ([self shouldDeferObjectsWithCoder:coder]) {
+			// hidden and locked layers are left as placeholders, which decode their objects when they're first shown or needed
+
+			mPendingObjectsID = [(DKBinaryUnarchiver*)coder objectIDForKey:@"objects"];
+			mPendingObjectCount = [coder decodeIntegerForKey:@"DKObjectOwnerLayer_objectCount"];
+			mPendingObjectBounds = [coder decodeRectForKey:@"DKObjectOwnerLayer_objectBounds"];
+
+			if (mPendingObjectsID != 0) {
+				mPendingData = [(DKBinaryUnarchiver*)coder data];
+				mPendingHelper = [(DKBinaryUnarchiver*)coder delegate];
+			}
 		} else {
 			// common case: storage wasn't archived but objects were
 
@@ -1592,3 +2066,37 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 }
 
 @end
+
+#pragma mark -
+
+@implementation DKLayerCacheTile
+@end
+
+/** @brief Returns the power of two zoom level that tiles are made for at a given view scale
+
+ Rounding up means a bitmap is only ever reduced to draw it, never enlarged.
+ */
+static NSInteger layerCacheTileLevelForScale(CGFloat scale)
+{
+	if (scale <= 0)
+		return kDKLayerCacheMinTileLevel;
+
+	return LIMIT((NSInteger)ceil(log2(scale)), kDKLayerCacheMinTileLevel, kDKLayerCacheMaxTileLevel);
+}
+
+/** @brief Returns the tile cache key for the tile at a given position, which may be negative
+ */
+static id layerCacheTileKey(NSInteger column, NSInteger row)
+{
+	uint64_t key = ((uint64_t)(uint32_t)column << 32) | (uint64_t)(uint32_t)row;
+
+	return @(key);
+}
+
+/** @brief Finds the tiles spanning [lo, hi) along one axis, counting from the drawing's origin
+ */
+static void layerCacheTileRange(CGFloat lo, CGFloat hi, CGFloat tileSize, NSInteger* first, NSInteger* last)
+{
+	*first = (NSInteger)floor(lo / tileSize);
+	*last = MAX(*first, (NSInteger)ceil(hi / tileSize) - 1);
+}
@@ -37,6 +37,7 @@ NS_ASSUME_NONNULL_BEGIN
 	BOOL m_useChainMethod;
 	DKQuartzCache* mDKCache;
 	BOOL m_lowQuality;
+	CGFloat mPlacementPathLength; // length of the path being decorated by -renderPath:, or 0 when not known
 @protected
 	NSUInteger mPlacementCount;
 	NSMutableArray* mWobbleCache;
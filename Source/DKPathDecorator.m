@@ -6,6 +6,7 @@
 
 #import "DKPathDecorator.h"
 
+#import "DKBezierArcLengthTable.h"
 #import "DKDrawKitMacros.h"
 #import "DKDrawing.h"
 #import "DKDrawingView.h"
@@ -289,7 +290,10 @@
 		CGFloat leadScale = 1.0;
 
 		if (path != nil) {
-			CGFloat loLen = [path length] - m_leadOutLength;
+			// -renderPath: measures the path once for all of its motifs; other callers' paths are measured here
+
+			CGFloat pathLength = (mPlacementPathLength > 0) ? mPlacementPathLength : [[path arcLengthTable] length];
+			CGFloat loLen = pathLength - m_leadOutLength;
 
 			if (m_leadInLength != 0 && pos <= m_leadInLength)
 				leadScale = [self rampFunction:pos / m_leadInLength];
@@ -436,6 +440,12 @@
 	return es;
 }
 
+- (BOOL)supportsGeometricHitTesting
+{
+	// motifs are placed along or within the path but their shape has nothing to do with it
+	return NO;
+}
+
 - (void)render:(id<DKRenderable>)obj
 {
 	if (![obj conformsToProtocol:@protocol(DKRenderable)])
@@ -449,14 +459,17 @@
 
 		NSBezierPath* path = [self renderingPathForObject:obj];
 
-		if ([self leaderDistance] > 0)
-			path = [path bezierPathByTrimmingFromLength:[self leaderDistance]];
+		if ([self leaderDistance] > 0) {
+			DKBezierArcLengthTable* table = [path arcLengthTable];
+			path = [table bezierPathFromLength:[self leaderDistance]
+									  toLength:[table length]];
+		}
 
 		if ([self leadInAndOutLengthProportion] != 0) {
 			// set up lead in and out lengths as a proportion of path length - this will scale the image
 			// proportional to length over that distance so that the effect tapers off at both ends of the path
 
-			CGFloat pathLength = [path length];
+			CGFloat pathLength = [[path arcLengthTable] length];
 			CGFloat lilo = pathLength * [self leadInAndOutLengthProportion];
 
 			[self setLeadInLength:lilo];
@@ -496,10 +509,15 @@
 		[path placeLinksOnPathWithLinkLength:[self interval]
 							   factoryObject:self
 									userInfo:&pass];
-	} else
+	} else {
+		mPlacementPathLength = [[path arcLengthTable] length];
+
 		[path placeObjectsOnPathAtInterval:[self interval]
 							 factoryObject:self
 								  userInfo:NULL];
+
+		mPlacementPathLength = 0;
+	}
 }
 
 #pragma mark -
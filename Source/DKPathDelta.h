@@ -0,0 +1,47 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "GCUndoManager.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** @brief A compact record of how one path's points differ from another's, for undoing edits to a path.
+
+ A compact record of how one path's points differ from another's. Editing a path by dragging its points changes only a few of its
+ elements, so rather than keep a copy of the whole path to undo the edit, a delta keeps just the indexes of the elements that changed
+ and their points. It can only describe paths with the same elements in the same order; adding or deleting points, or changing the
+ kind of an element, needs a copy of the path as before.
+*/
+@interface DKPathDelta : NSObject <GCUndoMemoryCost> {
+@private
+	NSInteger mElementCount; // the number of elements in the paths the delta applies to
+	NSUInteger mCount; // the number of elements changed
+	NSUInteger mCapacity;
+	NSInteger* mIndexes;
+	NSPoint* mPoints; // three for each element changed
+}
+
+/** @brief Returns the delta that turns one path into another.
+ @param path the path as it is
+ @param otherPath the path as it should become
+ @return the delta, or nil if the paths' elements differ in number or kind
+ */
++ (nullable DKPathDelta*)deltaFromPath:(NSBezierPath*)path toPath:(NSBezierPath*)otherPath;
+
+/** @brief The number of elements that the delta changes.
+ */
+@property (readonly) NSUInteger countOfChangedElements;
+
+/** @brief Applies the delta to a path, changing its points in place.
+ @param path a path with the same elements as the one the delta was made from
+ @return the delta that reverses the change, or nil if the path doesn't have the same number of elements, in which case it's left alone
+ */
+- (nullable DKPathDelta*)applyToPath:(NSBezierPath*)path;
+
+@end
+
+NS_ASSUME_NONNULL_END
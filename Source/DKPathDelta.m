@@ -0,0 +1,164 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKPathDelta.h"
+#import <objc/runtime.h>
+
+static NSInteger pointCountForElement(NSBezierPathElement element);
+
+@interface DKPathDelta ()
+
+- (instancetype)initWithElementCount:(NSInteger)count capacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+- (void)addElementAtIndex:(NSInteger)indx points:(const NSPoint*)points;
+
+@end
+
+#pragma mark -
+
+@implementation DKPathDelta
+
++ (DKPathDelta*)deltaFromPath:(NSBezierPath*)path toPath:(NSBezierPath*)otherPath
+{
+	NSParameterAssert(path);
+	NSParameterAssert(otherPath);
+
+	NSInteger i, k, n, count = [path elementCount];
+
+	if (count != [otherPath elementCount])
+		return nil;
+
+	DKPathDelta* delta = [[self alloc] initWithElementCount:count
+												   capacity:1];
+	NSPoint a[3], b[3] = { NSZeroPoint, NSZeroPoint, NSZeroPoint };
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:a];
+
+		if ([otherPath elementAtIndex:i
+					 associatedPoints:b] != element)
+			return nil;
+
+		n = pointCountForElement(element);
+
+		for (k = 0; k < n; ++k) {
+			if (!NSEqualPoints(a[k], b[k])) {
+				[delta addElementAtIndex:i
+								  points:b];
+				break;
+			}
+		}
+	}
+
+	return delta;
+}
+
+- (instancetype)initWithElementCount:(NSInteger)count capacity:(NSUInteger)capacity
+{
+	self = [super init];
+	if (self) {
+		mElementCount = count;
+		mCapacity = MAX(capacity, 1);
+		mIndexes = malloc(sizeof(NSInteger) * mCapacity);
+		mPoints = malloc(sizeof(NSPoint) * 3 * mCapacity);
+
+		if (mIndexes == NULL || mPoints == NULL)
+			return nil;
+	}
+
+	return self;
+}
+
+- (void)addElementAtIndex:(NSInteger)indx points:(const NSPoint*)points
+{
+	// grows the arrays as needed, doubling them when they fill up
+
+	if (mCount >= mCapacity) {
+		mCapacity *= 2;
+		mIndexes = reallocf(mIndexes, sizeof(NSInteger) * mCapacity);
+		mPoints = reallocf(mPoints, sizeof(NSPoint) * 3 * mCapacity);
+
+		NSAssert(mIndexes != NULL && mPoints != NULL, @"couldn't allocate path delta");
+	}
+
+	mIndexes[mCount] = indx;
+	memcpy(&mPoints[3 * mCount], points, sizeof(NSPoint) * 3);
+	++mCount;
+}
+
+- (NSUInteger)countOfChangedElements
+{
+	return mCount;
+}
+
+- (DKPathDelta*)applyToPath:(NSBezierPath*)path
+{
+	NSParameterAssert(path);
+
+	if ([path elementCount] != mElementCount)
+		return nil;
+
+	DKPathDelta* inverse = [[DKPathDelta alloc] initWithElementCount:mElementCount
+															capacity:mCount];
+	NSPoint old[3] = { NSZeroPoint, NSZeroPoint, NSZeroPoint };
+	NSUInteger i;
+
+	for (i = 0; i < mCount; ++i) {
+		[path elementAtIndex:mIndexes[i]
+			associatedPoints:old];
+		[inverse addElementAtIndex:mIndexes[i]
+							points:old];
+		[path setAssociatedPoints:&mPoints[3 * i]
+						  atIndex:mIndexes[i]];
+	}
+
+	return inverse;
+}
+
+#pragma mark -
+#pragma mark As part of GCUndoMemoryCost Protocol
+
+- (NSUInteger)undoMemoryCost
+{
+	return class_getInstanceSize([self class]) + mCapacity * (sizeof(NSInteger) + 3 * sizeof(NSPoint));
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (instancetype)init
+{
+	return [self initWithElementCount:0
+							 capacity:1];
+}
+
+- (void)dealloc
+{
+	free(mIndexes);
+	free(mPoints);
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %lu of %ld elements", NSStringFromClass([self class]), (void*)self, (unsigned long)mCount, (long)mElementCount];
+}
+
+@end
+
+static NSInteger pointCountForElement(NSBezierPathElement element)
+{
+	switch (element) {
+	case NSMoveToBezierPathElement:
+	case NSLineToBezierPathElement:
+		return 1;
+
+	case NSCurveToBezierPathElement:
+		return 3;
+
+	default:
+		return 0;
+	}
+}
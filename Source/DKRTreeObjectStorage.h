@@ -0,0 +1,61 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKLinearObjectStorage.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+struct DKRTreeNode;
+struct DKRTreeHit;
+
+/** @brief Storage that indexes its objects with a packed R-tree.
+
+ Storage that indexes its objects with a packed R-tree. Like the BSP storage it inherits the linear array, which maintains the Z-order, and keeps
+ a spatial index in parallel. Unlike the BSP storage, the R-tree adapts to where the objects actually are rather than partitioning the canvas up
+ front, so it never needs to know the canvas size and doesn't need rebuilding as the number of objects changes.
+
+ The tree is bulk-loaded using Sort-Tile-Recursive (STR) packing whenever the objects are set as a whole, and is updated incrementally as objects are
+ inserted, removed or change their bounds. An object that moves within the area of its leaf is updated in place; otherwise it is removed and reinserted.
+ Once the number of incremental changes since the last bulk load exceeds the number of objects, the tree is repacked.
+
+ Nodes are held in a single flat array, with each node storing its entries' rects inline, so a query is a walk over contiguous memory. Each object
+ records its Z-position (index), and results are sorted on that unless the \c kDKZOrderMayBeRelaxed option is passed. Inserting or removing
+ objects only notes the lowest index whose followers have moved, and they are renumbered by the next query, so a run of insertions low in the
+ Z-order doesn't renumber everything above them each time.
+*/
+@interface DKRTreeObjectStorage : DKLinearObjectStorage {
+@private
+	struct DKRTreeNode* mNodes;
+	NSUInteger mNodeCount;
+	NSUInteger mNodeCapacity;
+	NSUInteger mFreeNode;
+	NSUInteger mRoot;
+	NSMapTable* mLeafForObject;
+	NSUInteger mLoadedCount;
+	NSUInteger mUpdatesSinceLoad;
+	NSUInteger mFirstStaleIndex; // objects from this index on may have out of date Z-positions, or NSNotFound
+	struct DKRTreeHit* mHits;
+	NSUInteger mHitCount;
+	NSUInteger mHitCapacity;
+}
+
+/** @brief The number of levels in the tree; 1 if the root is a leaf.
+ */
+@property (readonly) NSUInteger treeHeight;
+
+/** @brief Returns a path consisting of the bounds of every node in the tree, for debugging.
+ */
+- (NSBezierPath*)debugStorageDivisions;
+
+@end
+
+/// maximum number of entries in a node
+#define kDKRTreeNodeCapacity 16
+/// minimum number of incremental changes before the tree is considered for repacking
+#define kDKRTreeRepackSlack 64
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,907 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKRTreeObjectStorage.h"
+#import "LogEvent.h"
+
+#define kDKRTreeNoNode NSNotFound
+
+/// a node of the tree. For leaves, <refs> are the (unretained) stored objects; for inner nodes they are the indexes of the child nodes.
+/// A node on the free list has a count of NSNotFound and links to the next free node through <parent>.
+typedef struct DKRTreeNode {
+	NSRect bounds;
+	NSUInteger parent;
+	NSUInteger count;
+	BOOL isLeaf;
+	NSRect rects[kDKRTreeNodeCapacity];
+	uintptr_t refs[kDKRTreeNodeCapacity];
+} DKRTreeNode;
+
+/// an object found by a query, with its Z-position captured for sorting
+typedef struct DKRTreeHit {
+	NSUInteger z;
+	uintptr_t obj;
+} DKRTreeHit;
+
+/// an entry being packed or redistributed
+typedef struct {
+	NSRect rect;
+	uintptr_t ref;
+} DKRTreeEntry;
+
+// utility functions:
+
+static inline NSRect rectUnion(NSRect a, NSRect b)
+{
+	// unlike NSUnionRect, this doesn't ignore empty rects, which objects such as straight lines can have
+
+	CGFloat minX = MIN(NSMinX(a), NSMinX(b));
+	CGFloat minY = MIN(NSMinY(a), NSMinY(b));
+
+	return NSMakeRect(minX, minY, MAX(NSMaxX(a), NSMaxX(b)) - minX, MAX(NSMaxY(a), NSMaxY(b)) - minY);
+}
+
+static inline BOOL rectsOverlap(NSRect a, NSRect b)
+{
+	return NSMinX(a) <= NSMaxX(b) && NSMinX(b) <= NSMaxX(a) && NSMinY(a) <= NSMaxY(b) && NSMinY(b) <= NSMaxY(a);
+}
+
+static inline BOOL rectEncloses(NSRect outer, NSRect inner)
+{
+	return NSMinX(inner) >= NSMinX(outer) && NSMaxX(inner) <= NSMaxX(outer) && NSMinY(inner) >= NSMinY(outer) && NSMaxY(inner) <= NSMaxY(outer);
+}
+
+static inline CGFloat rectArea(NSRect r)
+{
+	return r.size.width * r.size.height;
+}
+
+static NSRect boundsOfNode(const DKRTreeNode* node)
+{
+	if (node->count == 0)
+		return NSZeroRect;
+
+	NSRect br = node->rects[0];
+
+	for (NSUInteger i = 1; i < node->count; ++i)
+		br = rectUnion(br, node->rects[i]);
+
+	return br;
+}
+
+static int compareEntriesX(const void* a, const void* b)
+{
+	CGFloat ca = NSMidX(((const DKRTreeEntry*)a)->rect);
+	CGFloat cb = NSMidX(((const DKRTreeEntry*)b)->rect);
+
+	return (ca < cb) ? -1 : (ca > cb) ? 1 : 0;
+}
+
+static int compareEntriesY(const void* a, const void* b)
+{
+	CGFloat ca = NSMidY(((const DKRTreeEntry*)a)->rect);
+	CGFloat cb = NSMidY(((const DKRTreeEntry*)b)->rect);
+
+	return (ca < cb) ? -1 : (ca > cb) ? 1 : 0;
+}
+
+static int compareHitsAscending(const void* a, const void* b)
+{
+	NSUInteger za = ((const DKRTreeHit*)a)->z;
+	NSUInteger zb = ((const DKRTreeHit*)b)->z;
+
+	return (za < zb) ? -1 : (za > zb) ? 1 : 0;
+}
+
+static int compareHitsDescending(const void* a, const void* b)
+{
+	return compareHitsAscending(b, a);
+}
+
+/** Sort-Tile-Recursive ordering: sorts the entries into vertical slabs by x, then each slab by y, so that consecutive runs of
+ kDKRTreeNodeCapacity entries form compact, roughly square nodes.
+ */
+static void sortTileRecursive(DKRTreeEntry* entries, NSUInteger count)
+{
+	NSUInteger nodeCount = (count + kDKRTreeNodeCapacity - 1) / kDKRTreeNodeCapacity;
+	NSUInteger slabCount = (NSUInteger)ceil(sqrt((double)nodeCount));
+	NSUInteger slabSize = slabCount * kDKRTreeNodeCapacity;
+
+	qsort(entries, count, sizeof(DKRTreeEntry), compareEntriesX);
+
+	for (NSUInteger s = 0; s < count; s += slabSize)
+		qsort(entries + s, MIN(slabSize, count - s), sizeof(DKRTreeEntry), compareEntriesY);
+}
+
+@interface DKRTreeObjectStorage ()
+
+- (void)setUpTree;
+- (void)loadRTree;
+- (void)checkForTreeRepackAfterUpdates:(NSUInteger)updates;
+- (void)invalidateIndexesFromIndex:(NSUInteger)indx;
+- (void)updateStaleIndexes;
+
+- (NSUInteger)newNodeIsLeaf:(BOOL)leaf;
+- (void)freeNode:(NSUInteger)ni;
+- (void)setEntryRect:(NSRect)rect ref:(uintptr_t)ref atIndex:(NSUInteger)k ofNode:(NSUInteger)ni;
+- (NSUInteger)slotOfChild:(NSUInteger)child inNode:(NSUInteger)ni;
+- (void)updateBoundsFromNode:(NSUInteger)ni;
+
+- (void)insertObjectIntoTree:(id<DKStorableObject>)obj;
+- (void)addEntryWithRect:(NSRect)rect ref:(uintptr_t)ref toNode:(NSUInteger)ni;
+- (void)splitNode:(NSUInteger)ni addingEntryWithRect:(NSRect)rect ref:(uintptr_t)ref;
+- (void)removeObjectFromTree:(id<DKStorableObject>)obj;
+- (void)condenseFromNode:(NSUInteger)ni;
+
+- (void)searchNode:(NSUInteger)ni rect:(NSRect)rect inView:(NSView*)aView includeInvisible:(BOOL)invisible;
+- (void)searchNode:(NSUInteger)ni point:(NSPoint)point;
+- (void)addHit:(id<DKStorableObject>)obj;
+- (NSArray*)hitsSortedWithOptions:(DKObjectStorageOptions)options;
+
+@end
+
+#pragma mark -
+
+@implementation DKRTreeObjectStorage
+
+- (NSUInteger)treeHeight
+{
+	NSUInteger height = 1;
+	NSUInteger ni = mRoot;
+
+	while (ni != kDKRTreeNoNode && !mNodes[ni].isLeaf && mNodes[ni].count > 0) {
+		ni = mNodes[ni].refs[0];
+		++height;
+	}
+
+	return height;
+}
+
+- (NSBezierPath*)debugStorageDivisions
+{
+	NSBezierPath* path = [NSBezierPath bezierPath];
+
+	for (NSUInteger ni = 0; ni < mNodeCount; ++ni) {
+		if (mNodes[ni].count != NSNotFound && mNodes[ni].count > 0)
+			[path appendBezierPathWithRect:mNodes[ni].bounds];
+	}
+
+	return path;
+}
+
+#pragma mark -
+#pragma mark - as implementor of the DKObjectStorage protocol
+
+- (NSArray*)objectsIntersectingRect:(NSRect)aRect inView:(NSView*)aView options:(DKObjectStorageOptions)options
+{
+	// when the update rect is to be ignored, there's nothing for the tree to do
+
+	if (options & kDKIgnoreUpdateRect)
+		return [super objectsIntersectingRect:aRect
+									   inView:aView
+									  options:options];
+
+	if (aView) {
+		const NSRect* rects;
+		NSInteger count;
+
+		[aView getRectsBeingDrawn:&rects
+							count:&count];
+
+		// search the tree with the overall update area; each object is then checked against the actual update region
+
+		if (count > 0) {
+			aRect = rects[0];
+
+			for (NSInteger i = 1; i < count; ++i)
+				aRect = rectUnion(aRect, rects[i]);
+		} else
+			return @[];
+	}
+
+	[self updateStaleIndexes];
+	mHitCount = 0;
+
+	if (mRoot != kDKRTreeNoNode)
+		[self searchNode:mRoot
+					rect:aRect
+				  inView:aView
+		includeInvisible:(options & kDKIncludeInvisible) != 0];
+
+	return [self hitsSortedWithOptions:options];
+}
+
+- (NSArray*)objectsContainingPoint:(NSPoint)aPoint
+{
+	[self updateStaleIndexes];
+	mHitCount = 0;
+
+	if (mRoot != kDKRTreeNoNode)
+		[self searchNode:mRoot
+				   point:aPoint];
+
+	return [self hitsSortedWithOptions:0];
+}
+
+- (void)setObjects:(NSArray*)objects
+{
+	[[self objects] makeObjectsPerformSelector:@selector(setStorage:)
+									withObject:nil];
+	[super setObjects:objects];
+	[self loadRTree];
+}
+
+- (void)insertObject:(id<DKStorableObject>)obj inObjectsAtIndex:(NSUInteger)indx
+{
+	NSAssert(obj != nil, @"can't insert a nil object");
+
+	if ([obj conformsToProtocol:@protocol(DKStorableObject)]) {
+		[super insertObject:obj
+			inObjectsAtIndex:indx];
+		[obj setIndex:indx];
+		[self invalidateIndexesFromIndex:indx + 1];
+		[self insertObjectIntoTree:obj];
+		[self checkForTreeRepackAfterUpdates:1];
+	}
+}
+
+- (void)removeObjectFromObjectsAtIndex:(NSUInteger)indx
+{
+	id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
+
+	if (obj) {
+		NSAssert1(indx >= mFirstStaleIndex || [obj index] == indx, @"index mismatch when removing object from storage, obj = %@", obj);
+
+		[self removeObjectFromTree:obj];
+		[super removeObjectFromObjectsAtIndex:indx];
+		[self invalidateIndexesFromIndex:indx];
+		[self checkForTreeRepackAfterUpdates:1];
+	}
+}
+
+- (void)replaceObjectInObjectsAtIndex:(NSUInteger)indx withObject:(id<DKStorableObject>)obj
+{
+	NSAssert(obj != nil, @"cannot replace an object with nil");
+
+	id<DKStorableObject> old = [self objectInObjectsAtIndex:indx];
+
+	if ((old != obj) && [obj conformsToProtocol:@protocol(DKStorableObject)]) {
+		if (old)
+			[self removeObjectFromTree:old];
+
+		[obj setIndex:indx];
+		[super replaceObjectInObjectsAtIndex:indx
+								  withObject:obj];
+		[self insertObjectIntoTree:obj];
+		[self checkForTreeRepackAfterUpdates:1];
+	}
+}
+
+- (void)insertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set
+{
+	NSAssert(objs != nil, @"objects were nil in insertObjects:atIndexes");
+	NSAssert(set != nil, @"set was nil in insertObjects:atIndexes");
+	NSAssert([objs count] == [set count], @"objects and set counts do not agree");
+
+	if ([set count] == 0)
+		return;
+
+	[super insertObjects:objs
+			   atIndexes:set];
+
+	// when a large proportion of the objects are new, repacking the whole tree is quicker than inserting them one by one
+
+	if ([set count] > [self countOfObjects] / 4)
+		[self loadRTree];
+	else {
+		// the indexes given are where the new objects end up, so only the objects they displaced need renumbering later
+
+		NSUInteger i = [set firstIndex];
+
+		for (id<DKStorableObject> obj in objs) {
+			[obj setIndex:i];
+			[self insertObjectIntoTree:obj];
+			i = [set indexGreaterThanIndex:i];
+		}
+
+		[self invalidateIndexesFromIndex:[set firstIndex]];
+
+		[self checkForTreeRepackAfterUpdates:[objs count]];
+	}
+}
+
+- (void)removeObjectsAtIndexes:(NSIndexSet*)set
+{
+	NSAssert(set != nil, @"indexes were nil");
+
+	if ([set count] > 0) {
+		for (id<DKStorableObject> obj in [self objectsAtIndexes:set])
+			[self removeObjectFromTree:obj];
+
+		[super removeObjectsAtIndexes:set];
+		[self invalidateIndexesFromIndex:[set firstIndex]];
+		[self checkForTreeRepackAfterUpdates:[set count]];
+	}
+}
+
+- (BOOL)containsObject:(id<DKStorableObject>)object
+{
+	// for a quick answer, return YES if the storage is set to self
+
+	return [object storage] == self;
+}
+
+- (void)moveObject:(id<DKStorableObject>)obj toIndex:(NSUInteger)indx
+{
+	// the tree is unaffected by a change of Z-order - only the objects' recorded indexes need updating. An object's recorded
+	// index can only be trusted if it's below the first stale one
+
+	NSUInteger oldIndex = ([obj index] < mFirstStaleIndex) ? [obj index] : [self indexOfObject:obj];
+
+	if (oldIndex != indx) {
+		[super moveObject:obj
+				  toIndex:indx];
+		[self invalidateIndexesFromIndex:MIN(oldIndex, indx)];
+	}
+}
+
+- (void)object:(id<DKStorableObject>)obj didChangeBoundsFrom:(NSRect)oldBounds
+{
+#pragma unused(oldBounds)
+
+	NSUInteger leaf = (NSUInteger)NSMapGet(mLeafForObject, (__bridge void*)obj);
+
+	if (leaf == 0)
+		return;
+
+	--leaf;
+
+	NSRect newBounds = [obj bounds];
+	DKRTreeNode* node = &mNodes[leaf];
+
+	// if the object is still within its leaf, just update its entry. The leaf's bounds may end up a little larger than they
+	// need be, but that only costs a few extra comparisons. This keeps dragging and nudging objects very cheap.
+
+	if (rectEncloses(node->bounds, newBounds)) {
+		for (NSUInteger i = 0; i < node->count; ++i) {
+			if (node->refs[i] == (uintptr_t)(__bridge void*)obj) {
+				node->rects[i] = newBounds;
+				return;
+			}
+		}
+	}
+
+	[self removeObjectFromTree:obj];
+	[self insertObjectIntoTree:obj];
+	[self checkForTreeRepackAfterUpdates:1];
+}
+
+- (void)objectDidChangeVisibility:(id<DKStorableObject>)obj
+{
+#pragma unused(obj)
+
+	// all objects are kept in the tree regardless of visibility; visibility is checked when the tree is queried
+}
+
+- (void)setCanvasSize:(NSSize)size
+{
+#pragma unused(size)
+
+	// the tree is sized by its content, not the canvas, so there's nothing to do
+}
+
+#pragma mark -
+#pragma mark - tree maintenance
+
+- (void)setUpTree
+{
+	if (mLeafForObject == nil) {
+		mLeafForObject = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality
+												   valueOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsIntegerPersonality
+													   capacity:0];
+		mFreeNode = kDKRTreeNoNode;
+		mRoot = kDKRTreeNoNode;
+		mFirstStaleIndex = NSNotFound;
+	}
+}
+
+- (void)loadRTree
+{
+	// (re)builds the whole tree from the current objects using Sort-Tile-Recursive packing. Leaves are completely filled
+	// except the last in each slab, and each level above is packed the same way from the bounds of the level below.
+
+	[self setUpTree];
+
+	mNodeCount = 0;
+	mFreeNode = kDKRTreeNoNode;
+	[mLeafForObject removeAllObjects];
+
+	NSArray* objects = [self objects];
+	NSUInteger count = [objects count];
+	NSUInteger z = 0;
+	DKRTreeEntry* entries = malloc(sizeof(DKRTreeEntry) * MAX(count, 1U));
+
+	for (id<DKStorableObject> obj in objects) {
+		[obj setIndex:z];
+		[obj setStorage:self];
+		entries[z].rect = [obj bounds];
+		entries[z].ref = (uintptr_t)(__bridge void*)obj;
+		++z;
+	}
+
+	mLoadedCount = count;
+	mUpdatesSinceLoad = 0;
+	mFirstStaleIndex = NSNotFound;
+
+	if (count == 0) {
+		mRoot = [self newNodeIsLeaf:YES];
+		free(entries);
+		return;
+	}
+
+	BOOL leaves = YES;
+
+	while (YES) {
+		sortTileRecursive(entries, count);
+
+		NSUInteger nodeCount = (count + kDKRTreeNodeCapacity - 1) / kDKRTreeNodeCapacity;
+		DKRTreeEntry* parents = malloc(sizeof(DKRTreeEntry) * nodeCount);
+
+		for (NSUInteger i = 0; i < nodeCount; ++i) {
+			NSUInteger ni = [self newNodeIsLeaf:leaves];
+			NSUInteger first = i * kDKRTreeNodeCapacity;
+			NSUInteger n = MIN((NSUInteger)kDKRTreeNodeCapacity, count - first);
+
+			for (NSUInteger i = 0; i < n; ++i)
+				[self setEntryRect:entries[first + i].rect
+							   ref:entries[first + i].ref
+						   atIndex:i
+							ofNode:ni];
+
+			mNodes[ni].count = n;
+			mNodes[ni].bounds = boundsOfNode(&mNodes[ni]);
+
+			parents[i].rect = mNodes[ni].bounds;
+			parents[i].ref = ni;
+		}
+
+		free(entries);
+		entries = parents;
+		count = nodeCount;
+		leaves = NO;
+
+		if (nodeCount == 1) {
+			mRoot = parents[0].ref;
+			mNodes[mRoot].parent = kDKRTreeNoNode;
+			break;
+		}
+	}
+
+	free(entries);
+
+	LogEvent_(kInfoEvent, @"%@ <%p> packed R-tree, objects = %lu, nodes = %lu, height = %lu", NSStringFromClass([self class]), self, (unsigned long)mLoadedCount, (unsigned long)mNodeCount, (unsigned long)[self treeHeight]);
+}
+
+- (void)checkForTreeRepackAfterUpdates:(NSUInteger)updates
+{
+	// incremental insertion produces a tree that's reasonable but not as tight as a packed one. Once there have been as many
+	// changes as there were objects when it was last packed, it's worth repacking.
+
+	mUpdatesSinceLoad += updates;
+
+	if (mUpdatesSinceLoad > MAX(mLoadedCount, (NSUInteger)kDKRTreeRepackSlack))
+		[self loadRTree];
+}
+
+- (void)invalidateIndexesFromIndex:(NSUInteger)indx
+{
+	// notes that the objects from <indx> on may have moved. Renumbering them is left to the next query, so that a run of
+	// changes low in the Z-order costs one renumbering rather than one each
+
+	mFirstStaleIndex = MIN(mFirstStaleIndex, indx);
+}
+
+- (void)updateStaleIndexes
+{
+	// renumbers the index value of objects starting from the first stale one
+
+	NSUInteger count = [self countOfObjects];
+
+	if (mFirstStaleIndex < count) {
+		NSUInteger i = mFirstStaleIndex;
+
+		for (id<DKStorableObject> obj in [self objectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(i, count - i)]])
+			[obj setIndex:i++];
+	}
+
+	mFirstStaleIndex = NSNotFound;
+}
+
+- (NSUInteger)newNodeIsLeaf:(BOOL)leaf
+{
+	NSUInteger ni;
+
+	if (mFreeNode != kDKRTreeNoNode) {
+		ni = mFreeNode;
+		mFreeNode = mNodes[ni].parent;
+	} else {
+		if (mNodeCount == mNodeCapacity) {
+			mNodeCapacity = MAX(mNodeCapacity * 2, 16U);
+			mNodes = reallocf(mNodes, sizeof(DKRTreeNode) * mNodeCapacity);
+			NSAssert(mNodes != NULL, @"unable to allocate R-tree nodes");
+		}
+
+		ni = mNodeCount++;
+	}
+
+	mNodes[ni].bounds = NSZeroRect;
+	mNodes[ni].parent = kDKRTreeNoNode;
+	mNodes[ni].count = 0;
+	mNodes[ni].isLeaf = leaf;
+
+	return ni;
+}
+
+- (void)freeNode:(NSUInteger)ni
+{
+	mNodes[ni].count = NSNotFound;
+	mNodes[ni].parent = mFreeNode;
+	mFreeNode = ni;
+}
+
+- (void)setEntryRect:(NSRect)rect ref:(uintptr_t)ref atIndex:(NSUInteger)i ofNode:(NSUInteger)ni
+{
+	// places an entry in a node and records where it went - for an object, in the leaf map, for a node, in its parent link
+
+	mNodes[ni].rects[i] = rect;
+	mNodes[ni].refs[i] = ref;
+
+	if (mNodes[ni].isLeaf)
+		NSMapInsert(mLeafForObject, (void*)ref, (void*)(uintptr_t)(ni + 1));
+	else
+		mNodes[ref].parent = ni;
+}
+
+- (NSUInteger)slotOfChild:(NSUInteger)child inNode:(NSUInteger)ni
+{
+	for (NSUInteger i = 0; i < mNodes[ni].count; ++i) {
+		if (mNodes[ni].refs[i] == child)
+			return i;
+	}
+
+	return NSNotFound;
+}
+
+- (void)updateBoundsFromNode:(NSUInteger)ni
+{
+	// recalculates the bounds of <ni> and each of its ancestors, updating the entry for each node in its parent as it goes
+
+	while (ni != kDKRTreeNoNode) {
+		mNodes[ni].bounds = boundsOfNode(&mNodes[ni]);
+
+		NSUInteger parent = mNodes[ni].parent;
+
+		if (parent != kDKRTreeNoNode) {
+			NSUInteger i = [self slotOfChild:ni
+									  inNode:parent];
+			NSAssert(i != NSNotFound, @"R-tree node is missing from its parent");
+			mNodes[parent].rects[i] = mNodes[ni].bounds;
+		}
+
+		ni = parent;
+	}
+}
+
+- (void)insertObjectIntoTree:(id<DKStorableObject>)obj
+{
+	[self setUpTree];
+
+	if (mRoot == kDKRTreeNoNode)
+		mRoot = [self newNodeIsLeaf:YES];
+
+	// descend to the leaf whose bounds need enlarging least to take the object, preferring the smaller on a tie
+
+	NSRect rect = [obj bounds];
+	NSUInteger ni = mRoot;
+
+	while (!mNodes[ni].isLeaf) {
+		const DKRTreeNode* node = &mNodes[ni];
+		NSUInteger best = 0;
+		CGFloat bestGrowth = CGFLOAT_MAX, bestArea = CGFLOAT_MAX;
+
+		for (NSUInteger i = 0; i < node->count; ++i) {
+			CGFloat area = rectArea(node->rects[i]);
+			CGFloat growth = rectArea(rectUnion(node->rects[i], rect)) - area;
+
+			if (growth < bestGrowth || (growth == bestGrowth && area < bestArea)) {
+				best = i;
+				bestGrowth = growth;
+				bestArea = area;
+			}
+		}
+
+		ni = node->refs[best];
+	}
+
+	uintptr_t ref = (uintptr_t)(__bridge void*)obj;
+
+	[self addEntryWithRect:rect
+					   ref:ref
+					toNode:ni];
+
+	// the object's path to the root is the only one whose bounds can have grown; any node split off along the way
+	// already has correct bounds recorded in its parent
+
+	[self updateBoundsFromNode:(NSUInteger)NSMapGet(mLeafForObject, (void*)ref) - 1];
+}
+
+- (void)addEntryWithRect:(NSRect)rect ref:(uintptr_t)ref toNode:(NSUInteger)ni
+{
+	if (mNodes[ni].count < kDKRTreeNodeCapacity) {
+		[self setEntryRect:rect
+					   ref:ref
+				   atIndex:mNodes[ni].count++
+					ofNode:ni];
+	} else
+		[self splitNode:ni
+			addingEntryWithRect:rect
+							ref:ref];
+}
+
+- (void)splitNode:(NSUInteger)ni addingEntryWithRect:(NSRect)rect ref:(uintptr_t)ref
+{
+	// divides a full node plus the new entry into two halves, along whichever axis the entries are most spread out on.
+	// The first half stays in <ni>, the second goes into a new sibling which is added to the parent (which may split in turn).
+
+	DKRTreeEntry entries[kDKRTreeNodeCapacity + 1];
+	NSUInteger i, n = kDKRTreeNodeCapacity + 1;
+	CGFloat minX = CGFLOAT_MAX, maxX = -CGFLOAT_MAX, minY = CGFLOAT_MAX, maxY = -CGFLOAT_MAX;
+
+	for (i = 0; i < kDKRTreeNodeCapacity; ++i) {
+		entries[i].rect = mNodes[ni].rects[i];
+		entries[i].ref = mNodes[ni].refs[i];
+	}
+
+	entries[kDKRTreeNodeCapacity].rect = rect;
+	entries[kDKRTreeNodeCapacity].ref = ref;
+
+	for (i = 0; i < n; ++i) {
+		minX = MIN(minX, NSMidX(entries[i].rect));
+		maxX = MAX(maxX, NSMidX(entries[i].rect));
+		minY = MIN(minY, NSMidY(entries[i].rect));
+		maxY = MAX(maxY, NSMidY(entries[i].rect));
+	}
+
+	qsort(entries, n, sizeof(DKRTreeEntry), (maxX - minX >= maxY - minY) ? compareEntriesX : compareEntriesY);
+
+	NSUInteger half = n / 2;
+	NSUInteger sibling = [self newNodeIsLeaf:mNodes[ni].isLeaf];
+
+	for (i = 0; i < half; ++i)
+		[self setEntryRect:entries[i].rect
+					   ref:entries[i].ref
+				   atIndex:i
+					ofNode:ni];
+
+	for (i = half; i < n; ++i)
+		[self setEntryRect:entries[i].rect
+					   ref:entries[i].ref
+				   atIndex:i - half
+					ofNode:sibling];
+
+	mNodes[ni].count = half;
+	mNodes[sibling].count = n - half;
+	mNodes[ni].bounds = boundsOfNode(&mNodes[ni]);
+	mNodes[sibling].bounds = boundsOfNode(&mNodes[sibling]);
+
+	NSUInteger parent = mNodes[ni].parent;
+
+	if (parent == kDKRTreeNoNode) {
+		// splitting the root - grow the tree by one level
+
+		NSUInteger root = [self newNodeIsLeaf:NO];
+
+		[self setEntryRect:mNodes[ni].bounds
+					   ref:ni
+				   atIndex:0
+					ofNode:root];
+		[self setEntryRect:mNodes[sibling].bounds
+					   ref:sibling
+				   atIndex:1
+					ofNode:root];
+		mNodes[root].count = 2;
+		mNodes[root].bounds = boundsOfNode(&mNodes[root]);
+		mRoot = root;
+	} else {
+		NSUInteger k = [self slotOfChild:ni
+								  inNode:parent];
+
+		mNodes[parent].rects[k] = mNodes[ni].bounds;
+
+		[self addEntryWithRect:mNodes[sibling].bounds
+						   ref:sibling
+						toNode:parent];
+	}
+}
+
+- (void)removeObjectFromTree:(id<DKStorableObject>)obj
+{
+	uintptr_t ref = (uintptr_t)(__bridge void*)obj;
+	NSUInteger leaf = (NSUInteger)NSMapGet(mLeafForObject, (void*)ref);
+
+	if (leaf == 0)
+		return;
+
+	--leaf;
+	NSMapRemove(mLeafForObject, (void*)ref);
+
+	DKRTreeNode* node = &mNodes[leaf];
+
+	for (NSUInteger k = 0; k < node->count; ++k) {
+		if (node->refs[k] == ref) {
+			// fill the gap with the last entry
+
+			node->count--;
+			node->rects[k] = node->rects[node->count];
+			node->refs[k] = node->refs[node->count];
+			break;
+		}
+	}
+
+	[self condenseFromNode:leaf];
+}
+
+- (void)condenseFromNode:(NSUInteger)ni
+{
+	// removes any nodes left empty by a deletion, then tightens the bounds above. Underfull nodes are otherwise left
+	// alone - they are tidied up when the tree is next repacked.
+
+	while (mNodes[ni].count == 0 && mNodes[ni].parent != kDKRTreeNoNode) {
+		NSUInteger parent = mNodes[ni].parent;
+		NSUInteger k = [self slotOfChild:ni
+								  inNode:parent];
+
+		mNodes[parent].count--;
+		mNodes[parent].rects[k] = mNodes[parent].rects[mNodes[parent].count];
+		mNodes[parent].refs[k] = mNodes[parent].refs[mNodes[parent].count];
+
+		[self freeNode:ni];
+		ni = parent;
+	}
+
+	[self updateBoundsFromNode:ni];
+
+	// shorten the tree if the root has been left with a single child, and make an emptied root a leaf again
+
+	while (!mNodes[mRoot].isLeaf && mNodes[mRoot].count <= 1) {
+		if (mNodes[mRoot].count == 0) {
+			mNodes[mRoot].isLeaf = YES;
+			break;
+		}
+
+		NSUInteger child = mNodes[mRoot].refs[0];
+
+		[self freeNode:mRoot];
+		mRoot = child;
+		mNodes[mRoot].parent = kDKRTreeNoNode;
+	}
+}
+
+#pragma mark -
+#pragma mark - queries
+
+- (void)searchNode:(NSUInteger)ni rect:(NSRect)rect inView:(NSView*)aView includeInvisible:(BOOL)invisible
+{
+	const DKRTreeNode* node = &mNodes[ni];
+
+	if (node->isLeaf) {
+		for (NSUInteger k = 0; k < node->count; ++k) {
+			if (NSIntersectsRect(rect, node->rects[k])) {
+				id<DKStorableObject> obj = (__bridge id<DKStorableObject>)(void*)node->refs[k];
+
+				if ((invisible || [obj visible]) && (aView == nil || [aView needsToDrawRect:node->rects[k]]))
+					[self addHit:obj];
+			}
+		}
+	} else {
+		for (NSUInteger k = 0; k < node->count; ++k) {
+			if (rectsOverlap(rect, node->rects[k]))
+				[self searchNode:node->refs[k]
+							rect:rect
+						  inView:aView
+				includeInvisible:invisible];
+		}
+	}
+}
+
+- (void)searchNode:(NSUInteger)ni point:(NSPoint)point
+{
+	const DKRTreeNode* node = &mNodes[ni];
+
+	for (NSUInteger k = 0; k < node->count; ++k) {
+		NSRect r = node->rects[k];
+
+		if (node->isLeaf) {
+			id<DKStorableObject> obj = (__bridge id<DKStorableObject>)(void*)node->refs[k];
+
+			if (NSPointInRect(point, r) && [obj visible])
+				[self addHit:obj];
+		} else if (point.x >= NSMinX(r) && point.x <= NSMaxX(r) && point.y >= NSMinY(r) && point.y <= NSMaxY(r))
+			[self searchNode:node->refs[k]
+					   point:point];
+	}
+}
+
+- (void)addHit:(id<DKStorableObject>)obj
+{
+	if (mHitCount == mHitCapacity) {
+		mHitCapacity = MAX(mHitCapacity * 2, 64U);
+		mHits = reallocf(mHits, sizeof(DKRTreeHit) * mHitCapacity);
+		NSAssert(mHits != NULL, @"unable to allocate R-tree query results");
+	}
+
+	mHits[mHitCount].z = [obj index];
+	mHits[mHitCount].obj = (uintptr_t)(__bridge void*)obj;
+	mHitCount++;
+}
+
+- (NSArray*)hitsSortedWithOptions:(DKObjectStorageOptions)options
+{
+	if (mHitCount == 0)
+		return @[];
+
+	if ((options & kDKZOrderMayBeRelaxed) == 0)
+		qsort(mHits, mHitCount, sizeof(DKRTreeHit), (options & kDKReverseOrder) ? compareHitsDescending : compareHitsAscending);
+
+	__unsafe_unretained id* objs = (__unsafe_unretained id*)malloc(sizeof(id) * mHitCount);
+
+	for (NSUInteger i = 0; i < mHitCount; ++i)
+		objs[i] = (__bridge id)(void*)mHits[i].obj;
+
+	NSArray* results = [NSArray arrayWithObjects:objs
+										   count:mHitCount];
+	free(objs);
+
+	return results;
+}
+
+#pragma mark -
+#pragma mark - as implementor of the NSCoding protocol
+
+- (instancetype)initWithCoder:(NSCoder*)aCoder
+{
+	// storage is no longer archived, but files from beta 5 may contain it. The tree is packed from whatever objects were decoded,
+	// if setting them hasn't already done so
+
+	self = [super initWithCoder:aCoder];
+	if (self && mNodes == NULL) {
+		[self loadRTree];
+	}
+
+	return self;
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		[self setUpTree];
+		mRoot = [self newNodeIsLeaf:YES];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	free(mNodes);
+	free(mHits);
+}
+
+@end
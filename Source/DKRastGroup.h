@@ -34,9 +34,8 @@ as well.
 */
 @interface DKRastGroup : DKRasterizer <NSCoding, NSCopying> {
 @private
-	NSMutableArray<DKRasterizer*>* m_renderList;
-	dispatch_semaphore_t m_renderListLock;
-	dispatch_time_t m_renderListLockTimeOutSeconds;
+	NSArray<DKRasterizer*>* m_renderList; // immutable snapshot, replaced wholesale by writers
+	dispatch_semaphore_t m_renderListWriteLock; // serialises writers of this group only
 }
 
 /** @brief The list of contained renderers.
@@ -44,6 +43,11 @@ as well.
  The setter no longer attempts to try and manage observing of the objects. The observer must
  properly stop observing before this is called, or start observing after it is called when
  initialising from an archive.
+
+ The list is held as an immutable snapshot. Rendering and other read-only operations take a reference
+ to the current snapshot and iterate it without holding any lock, so any number of threads can render
+ with the same group at once. Changes build a new list and swap it in, serialised by a lock private to
+ each group, so a reader always sees either the old list or the new one in full.
 */
 @property (atomic, copy, nullable) NSArray<DKRasterizer*>* renderList;
 
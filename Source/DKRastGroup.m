@@ -11,10 +11,24 @@
 #import "LogEvent.h"
 #import "NSDictionary+DeepCopy.h"
 
+@interface DKRastGroup ()
+
+/** the current render list snapshot. The atomic accessors guarantee that a reader always retains a complete list even if
+ a writer swaps in a new one concurrently - no lock is held while the list is iterated.
+ */
+@property (atomic, strong) NSArray<DKRasterizer*>* renderListSnapshot;
+
+- (void)performRenderListUpdate:(void (^)(NSMutableArray<DKRasterizer*>* list))update;
+
+@end
+
+#pragma mark -
+
 @implementation DKRastGroup
 #pragma mark As a DKRenderGroup
-dispatch_semaphore_t m_renderListLock;
-dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TIME_FOREVER
+
+@synthesize renderListSnapshot = m_renderList;
+
 /** @brief Set the contained objects to those in array
 
  This method no longer attempts to try and manage observing of the objects. The observer must
@@ -24,38 +38,47 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
  */
 - (void)setRenderList:(NSArray*)list
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	if (list != m_renderList) {
-		NSMutableArray* rl = [list mutableCopy];
-		m_renderList = rl;
-
-		// set the container ref for each item in the list - when unarchiving newer files this is already done but
-		// for older files may not be. It's a weak ref so doing it anyway here is harmless. The added objects are not
-		// yet notified to the root for observation as we don't want them getting observed twice. When the style
-		// completes unarchiving it will start observing the whole tree itself. When individual rasterizers are added and
-		// removed their observation is managed individually (inclusing the adding/removal of groups, which deals with
-		// all the subordinate objects).
-
-		[m_renderList makeObjectsPerformSelector:@selector(setContainer:)
-										   withObject:self];
-	}
-	
-	dispatch_semaphore_signal(m_renderListLock);
+	// set the container ref for each item in the list - when unarchiving newer files this is already done but
+	// for older files may not be. It's a weak ref so doing it anyway here is harmless. The added objects are not
+	// yet notified to the root for observation as we don't want them getting observed twice. When the style
+	// completes unarchiving it will start observing the whole tree itself. When individual rasterizers are added and
+	// removed their observation is managed individually (inclusing the adding/removal of groups, which deals with
+	// all the subordinate objects).
+
+	[self performRenderListUpdate:^(NSMutableArray<DKRasterizer*>* rl) {
+		[rl setArray:list ? list : @[]];
+		[rl makeObjectsPerformSelector:@selector(setContainer:)
+							withObject:self];
+	}];
 }
 
 /** @brief Get the list of contained renderers
- @return an array containing the list of renderers
+ @return an immutable array containing the list of renderers
  */
 - (NSArray*)renderList
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	NSArray* ret = [m_renderList copy];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-	
-	return ret;
+	return self.renderListSnapshot;
+}
+
+/** @brief Applies a change to the render list
+
+ The change is made to a mutable copy of the current snapshot, which then replaces it. Writers to the same group
+ are serialised; readers are never blocked.
+ @param update a block that modifies the list passed to it
+ */
+- (void)performRenderListUpdate:(void (^)(NSMutableArray<DKRasterizer*>* list))update
+{
+	dispatch_semaphore_wait(m_renderListWriteLock, DISPATCH_TIME_FOREVER);
+
+	NSMutableArray* rl = [self.renderListSnapshot mutableCopy];
+
+	if (rl == nil)
+		rl = [[NSMutableArray alloc] init];
+
+	update(rl);
+	self.renderListSnapshot = [rl copy];
+
+	dispatch_semaphore_signal(m_renderListWriteLock);
 }
 
 #pragma mark -
@@ -83,106 +106,77 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 
 - (void)addRenderer:(DKRasterizer*)renderer
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	if (![m_renderList containsObject:renderer]) {
-		[renderer setContainer:self];
-		[m_renderList insertObject:renderer atIndex:[m_renderList count]];
-		// let the root object know so it can start observing the added renderer
-
-		[[self root] observableWasAdded:renderer];
-	}
-	
-	dispatch_semaphore_signal(m_renderListLock);
+	[self insertRenderer:renderer
+				 atIndex:[self countOfRenderList]];
 }
 
 - (void)removeRenderer:(DKRasterizer*)renderer
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	[self removeRendererUnsafe:renderer];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-}
-
-- (void)removeRendererUnsafe:(DKRasterizer*)renderer
-{
-	
-	if ([m_renderList containsObject:renderer]) {
+	if ([self.renderList containsObject:renderer]) {
 		// let the root object know so it can stop observing the renderer that is about to vanish
 
 		[[self root] observableWillBeRemoved:renderer];
+
+		[self performRenderListUpdate:^(NSMutableArray<DKRasterizer*>* rl) {
+			[rl removeObject:renderer];
+		}];
+
 		[renderer setContainer:nil];
-		NSUInteger indexOfRenderer = [m_renderList indexOfObject:renderer];
-		[m_renderList removeObjectAtIndex:indexOfRenderer];
 	}
-	
 }
 
 - (void)moveRendererAtIndex:(NSUInteger)src toIndex:(NSUInteger)dest
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
 	if (src == dest)
 		return;
 
-	if (src >= [m_renderList count])
-		src = [m_renderList count] - 1;
+	[self performRenderListUpdate:^(NSMutableArray<DKRasterizer*>* rl) {
+		if ([rl count] == 0)
+			return;
 
-	DKRasterizer* moving = [m_renderList objectAtIndex:src];
+		NSUInteger from = MIN(src, [rl count] - 1);
+		NSUInteger to = dest;
 
-	[m_renderList removeObjectAtIndex:src];
+		DKRasterizer* moving = [rl objectAtIndex:from];
 
-	if (src < dest)
-		--dest;
+		[rl removeObjectAtIndex:from];
 
-	[m_renderList insertObject:moving
-					   atIndex:dest];
-	
-	dispatch_semaphore_signal(m_renderListLock);
+		if (from < to)
+			--to;
+
+		[rl insertObject:moving
+				 atIndex:MIN(to, [rl count])];
+	}];
 }
 
 - (void)insertRenderer:(DKRasterizer*)renderer atIndex:(NSUInteger)indx
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	if (![m_renderList containsObject:renderer]) {
-		[renderer setContainer:self];
-		[m_renderList insertObject:renderer
-						   atIndex:indx];
+	__block BOOL inserted = NO;
+
+	[self performRenderListUpdate:^(NSMutableArray<DKRasterizer*>* rl) {
+		if (![rl containsObject:renderer]) {
+			[renderer setContainer:self];
+			[rl insertObject:renderer
+					 atIndex:indx];
+			inserted = YES;
+		}
+	}];
 
-		// let the root object know so it can start observing
+	// let the root object know so it can start observing. This is done outside the update so that observers are
+	// free to query the group.
 
+	if (inserted)
 		[[self root] observableWasAdded:renderer];
-	}
-	dispatch_semaphore_signal(m_renderListLock);
 }
 
 - (void)removeRendererAtIndex:(NSUInteger)indx
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	DKRasterizer* renderer = [m_renderList objectAtIndex:indx];
-	
-	if ([m_renderList containsObject:renderer]) {
-		// let the root object know so it can stop observing:
-
-		[[self root] observableWillBeRemoved:renderer];
-		[renderer setContainer:nil];
-		[m_renderList removeObjectAtIndex:indx];
-	}
-	dispatch_semaphore_signal(m_renderListLock);
+	[self removeRenderer:[self.renderList objectAtIndex:indx]];
 }
 
 - (NSUInteger)indexOfRenderer:(DKRasterizer*)renderer
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	NSUInteger ret = [m_renderList indexOfObject:renderer];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-	
-	return ret;
+	return [self.renderList indexOfObject:renderer];
 }
 
 #pragma mark -
@@ -194,14 +188,14 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 
 - (DKRasterizer*)rendererWithName:(NSString*)name
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
 	DKRasterizer* ret = nil;
-	for (DKRasterizer* rend in m_renderList) {
+
+	for (DKRasterizer* rend in self.renderList) {
 		if ([[rend name] isEqualToString:name]) {
 			ret = rend;
 		}
 	}
-	dispatch_semaphore_signal(m_renderListLock);
+
 	return ret;
 }
 
@@ -214,71 +208,37 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
  */
 - (NSUInteger)countOfRenderList
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	NSUInteger count = [m_renderList count];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-	
-	return count;
+	return [self.renderList count];
 }
 
 - (BOOL)containsRendererOfClass:(Class)cl
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	BOOL ret = [self containsRendererOfClassUnsafe:cl];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-
-	return ret;
-}
+	for (id rend in self.renderList) {
+		if ([rend isKindOfClass:cl]) // && [rend enabled]  // (should we skip disabled ones? causes some problems with KVO)
+			return YES;
 
-- (BOOL)containsRendererOfClassUnsafe:(Class)cl
-{
-	if ([m_renderList count] > 0) {
-		for (id rend in m_renderList) {
-			if ([rend isKindOfClass:cl]) // && [rend enabled]  // (should we skip disabled ones? causes some problems with KVO)
+		if ([rend isKindOfClass:[DKRastGroup class]]) {
+			if ([rend containsRendererOfClass:cl])
 				return YES;
-
-			if ([rend isKindOfClass:[DKRastGroup class]]) {
-				if ([rend containsRendererOfClassUnsafe:cl])
-					return YES;
-			}
 		}
 	}
-	
-	return NO;
-}
 
-- (NSArray*)renderersOfClass:(Class)cl {
-	int numberOfSecondsForTimeout = 10;
-	dispatch_time_t timeout = dispatch_time(DISPATCH_TIME_NOW, numberOfSecondsForTimeout * NSEC_PER_SEC);
-	// timeout = m_renderListLockTimeOutSecondsload
-	
-	dispatch_semaphore_wait(m_renderListLock, timeout);
-	
-	NSArray* ret = [self renderersOfClassUnsafe:cl];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-	
-	return ret;
+	return NO;
 }
 
-- (NSArray*)renderersOfClassUnsafe:(Class)cl
+- (NSArray*)renderersOfClass:(Class)cl
 {
 	NSArray* ret = nil;
 
-	if ([self containsRendererOfClassUnsafe:cl]) {
-
+	if ([self containsRendererOfClass:cl]) {
 		NSMutableArray* rl = [[NSMutableArray alloc] init];
-		
-		for (id rend in m_renderList) {
+
+		for (id rend in self.renderList) {
 			if ([rend isKindOfClass:cl])
 				[rl addObject:rend];
 
 			if ([rend isKindOfClass:[DKRastGroup class]]) {
-				NSArray* temp = [rend renderersOfClassUnsafe:cl];
+				NSArray* temp = [rend renderersOfClass:cl];
 				[rl addObjectsFromArray:temp];
 			}
 		}
@@ -290,22 +250,18 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 
 - (void)removeAllRenderers
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	for (DKRasterizer* rast in m_renderList) {
+	for (DKRasterizer* rast in self.renderList) {
 		if (![rast isKindOfClass:[DKRastGroup class]]) {
-			[self removeRendererUnsafe:rast];
+			[self removeRenderer:rast];
 		}
 	}
-	
-	dispatch_semaphore_signal(m_renderListLock);
 }
 
 - (void)removeRenderersOfClass:(Class)cl inSubgroups:(BOOL)subs
 {
 	// removes any renderers of the given *exact* class from the group. If <subs> is YES, recurses down to any subgroups below.
 
-	for (DKRasterizer* rast in [self.renderList copy]) {
+	for (DKRasterizer* rast in self.renderList) {
 		if ([rast isMemberOfClass:cl]) {
 			[self removeRenderer:rast];
 		} else if (subs && [rast isKindOfClass:[DKRastGroup class]]) {
@@ -320,28 +276,22 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 
 - (id)objectInRenderListAtIndex:(NSUInteger)indx
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	id ret = [m_renderList objectAtIndex:indx];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-	
-	return ret;
+	return [self.renderList objectAtIndex:indx];
 }
 
 - (void)insertObject:(id)obj inRenderListAtIndex:(NSUInteger)indx
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	[m_renderList insertObject:obj
-					   atIndex:indx];
-	
-	dispatch_semaphore_signal(m_renderListLock);
+	[self performRenderListUpdate:^(NSMutableArray<DKRasterizer*>* rl) {
+		[rl insertObject:obj
+				 atIndex:indx];
+	}];
 }
 
 - (void)removeObjectFromRenderListAtIndex:(NSUInteger)indx
 {
-	[m_renderList removeObjectAtIndex:indx];
+	[self performRenderListUpdate:^(NSMutableArray<DKRasterizer*>* rl) {
+		[rl removeObjectAtIndex:indx];
+	}];
 }
 
 #pragma mark -
@@ -426,13 +376,9 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
  */
 - (BOOL)setUpKVOForObserver:(id)object
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	[m_renderList makeObjectsPerformSelector:@selector(setUpKVOForObserver:)
-									   withObject:object];
-	
-	dispatch_semaphore_signal(m_renderListLock);
-	
+	[self.renderList makeObjectsPerformSelector:@selector(setUpKVOForObserver:)
+									 withObject:object];
+
 	return [super setUpKVOForObserver:object];
 }
 
@@ -444,12 +390,8 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
  */
 - (BOOL)tearDownKVOForObserver:(id)object
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	[m_renderList makeObjectsPerformSelector:@selector(tearDownKVOForObserver:)
-									   withObject:object];
-	
-	dispatch_semaphore_signal(m_renderListLock);
+	[self.renderList makeObjectsPerformSelector:@selector(tearDownKVOForObserver:)
+									 withObject:object];
 
 	return [super tearDownKVOForObserver:object];
 }
@@ -462,11 +404,8 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 	self = [super init];
 	
 	if (self != nil) {
-		m_renderList = [[NSMutableArray alloc] init];
-		m_renderListLock = dispatch_semaphore_create(1);
-		if (m_renderList == nil) {
-			return nil;
-		}
+		m_renderList = @[];
+		m_renderListWriteLock = dispatch_semaphore_create(1);
 	}
 	return self;
 }
@@ -482,9 +421,7 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 	CGSize accSize = NSZeroSize;
 
 	if ([self enabled]) {
-		// m_renderList needs to be immutable here, however render() already has a semaphore open on m_renderListLock
-		// so run this on a copy
-		for (DKRasterizer* rend in [self->m_renderList copy]) {
+		for (DKRasterizer* rend in self.renderList) {
 			NSSize rs = [rend extraSpaceNeeded];
 
 			if (rs.width > accSize.width)
@@ -509,15 +446,11 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 	if (![object conformsToProtocol:@protocol(DKRenderable)])
 		return;
 
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-		[m_renderList makeObjectsPerformSelector:_cmd
-										   withObject:object];
+		[self.renderList makeObjectsPerformSelector:_cmd
+										 withObject:object];
 
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
-
-	dispatch_semaphore_signal(m_renderListLock);
 }
 
 /** @brief Renders the object's path by iterating over the contained renderers
@@ -531,14 +464,10 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 	if (![self enabled])
 		return;
 
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-		[m_renderList makeObjectsPerformSelector:_cmd
-										   withObject:path];
+		[self.renderList makeObjectsPerformSelector:_cmd
+										 withObject:path];
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
-	
-	dispatch_semaphore_signal(m_renderListLock);
 }
 
 /** @brief Queries whther the rasterizer implements a fill or not
@@ -548,20 +477,25 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
  */
 - (BOOL)isFill
 {
-	BOOL ret = NO;
-	
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
-	for (DKRasterizer* rast in m_renderList) {
-		if ([rast isFill]) {
-			ret = YES;
-			break;
-		}
+	for (DKRasterizer* rast in self.renderList) {
+		if ([rast isFill])
+			return YES;
 	}
 
-	dispatch_semaphore_signal(m_renderListLock);
-	
-	return ret;
+	return NO;
+}
+
+/** @brief Queries whether all the enabled rasterizers in the group can be hit-tested geometrically
+ @return YES if every enabled rasterizer supports it, NO if at least one does not
+ */
+- (BOOL)supportsGeometricHitTesting
+{
+	for (DKRasterizer* rast in self.renderList) {
+		if ([rast enabled] && ![rast supportsGeometricHitTesting])
+			return NO;
+	}
+
+	return YES;
 }
 
 #pragma mark -
@@ -586,17 +520,13 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 - (void)encodeWithCoder:(NSCoder*)coder
 {
 	NSAssert(coder != nil, @"Expected valid coder");
-	
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
 
 	[super encodeWithCoder:coder];
 
 	[coder encodeConditionalObject:[self container]
 							forKey:@"DKRastGroup_container"];
-	[coder encodeObject:m_renderList
+	[coder encodeObject:[self renderList]
 				 forKey:@"renderlist"];
-	
-	dispatch_semaphore_signal(m_renderListLock);	
 }
 
 - (instancetype)initWithCoder:(NSCoder*)coder
@@ -604,6 +534,7 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 	NSAssert(coder != nil, @"Expected valid coder");
 	self = [super initWithCoder:coder];
 	if (self != nil) {
+		m_renderListWriteLock = dispatch_semaphore_create(1);
 		[self setContainer:[coder decodeObjectForKey:@"DKRastGroup_container"]];
 		[self setRenderList:[coder decodeObjectForKey:@"renderlist"]];
 	}
@@ -614,16 +545,12 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 #pragma mark As part of NSCopying Protocol
 - (id)copyWithZone:(NSZone*)zone
 {
-	dispatch_semaphore_wait(m_renderListLock, m_renderListLockTimeOutSeconds);
-	
 	DKRastGroup* copy = [super copyWithZone:zone];
 
-	NSArray* rl = [m_renderList deepCopy];
+	NSArray* rl = [self.renderList deepCopy];
 
 	[copy setRenderList:rl];
 
-	dispatch_semaphore_signal(m_renderListLock);
-	
 	return copy;
 }
 
@@ -666,7 +593,7 @@ dispatch_time_t m_renderListLockTimeOutSeconds = 2.0; // infinite is DISPATCH_TI
 {
 	Class classForKey = [self renderClassForKey:key];
 
-	for (DKRasterizer* rend in m_renderList) {
+	for (DKRasterizer* rend in self.renderList) {
 		if ([[rend name] isEqualToString:key] || (classForKey && [rend isKindOfClass:classForKey])) {
 			return rend;
 		}
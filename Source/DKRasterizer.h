@@ -83,6 +83,14 @@ typedef NS_ENUM(NSInteger, DKClippingOption) {
  */
 @property (readonly, getter=isValid) BOOL valid;
 
+/** @brief Queries whether objects using this renderer can be hit-tested from their path alone.
+
+ Renderers whose output is essentially a fill or stroke of the rendering path return \c YES (the default). Renderers that
+ draw content unrelated to the path outline, such as images, text or filtered output, return \c NO, in which case objects
+ using them fall back to the slower bitmap hit-test.
+ */
+@property (readonly) BOOL supportsGeometricHitTesting;
+
 /** @brief Whether the renderer is enabled or not
  
  Disabled renderers won't draw anything, so this can be used to temporarily turn off part of a
@@ -101,7 +109,8 @@ typedef NS_ENUM(NSInteger, DKClippingOption) {
  This method is called internally by render: to obtain the path to be rendered. It is factored to
  allow a delegate to modify the path just before rendering, and to allow special subclasses to
  override it to modify the path for special effects. The normal behaviour is simply to ask the
- object for its rendering path.
+ object for its rendering path. The path may be the one held by the object's geometry cache entry, so it must not be
+ changed - copy it first to set its line width, dash and so on.
  @param object the object to render
  @return the rendering path */
 - (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object;
@@ -5,6 +5,7 @@
 */
 
 #import "DKRasterizer.h"
+#import "DKGeometryCache.h"
 #import "DKStyle.h"
 #import "LogEvent.h"
 #import "NSBezierPath+Geometry.h"
@@ -114,6 +115,15 @@ NSString* const kDKRasterizerChangedPropertyKey = @"kDKRasterizerChangedProperty
  @return the rendering path */
 - (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object
 {
+	// the cached path is shared by every rasterizer, so is handed out as it is. Rasterizers that change the path's attributes copy it first
+
+	if ([object respondsToSelector:@selector(geometryCacheEntry)]) {
+		NSBezierPath* path = [[object geometryCacheEntry] path];
+
+		if (path)
+			return path;
+	}
+
 	return [object renderingPath];
 }
 
@@ -238,6 +248,17 @@ NSString* const kDKRasterizerChangedPropertyKey = @"kDKRasterizerChangedProperty
 	return NO;
 }
 
+/** @brief Queries whether objects using this rasterizer can be hit-tested geometrically
+
+ Default is YES - subclasses that draw something other than a fill or stroke of the path override this
+ to return NO, which forces the bitmap hit-test for any object using them.
+ @return YES if the rasterizer can be approximated by its path for hit-testing
+ */
+- (BOOL)supportsGeometricHitTesting
+{
+	return YES;
+}
+
 #pragma mark -
 #pragma mark As part of NSCoding Protocol
 - (void)encodeWithCoder:(NSCoder*)coder
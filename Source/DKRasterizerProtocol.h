@@ -8,6 +8,8 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class DKGeometryCacheEntry;
+
 /** Objects that can be passed to a renderer must implement the following formal protocol.
  */
 @protocol DKRenderable <NSObject>
@@ -55,6 +57,10 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (nullable NSMutableDictionary*)renderingCache;
 
+/** return the cached geometry for the object's current state, if it's cached - renderers use this in preference to recalculating the rendering path
+ */
+- (nullable DKGeometryCacheEntry*)geometryCacheEntry;
+
 @end
 
 /** renderers must implement the following formal protocol:
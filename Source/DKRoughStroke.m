@@ -113,10 +113,14 @@
 
 - (void)renderPath:(NSBezierPath*)path
 {
+	// the path may be shared with other rasterizers, so the stroke's attributes are applied to a copy
+
+	NSBezierPath* sp = [path copy];
+
 	[[self colour] setFill];
-	[self applyAttributesToPath:path];
+	[self applyAttributesToPath:sp];
 
-	NSBezierPath* pc = [self roughPathFromPath:path];
+	NSBezierPath* pc = [self roughPathFromPath:sp];
 
 	[pc fill];
 }
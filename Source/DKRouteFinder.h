@@ -25,8 +25,14 @@ typedef NS_ENUM(NSInteger, DKDirection) {
 
 /** @brief This object implements an heuristic solution to the travelling salesman problem.
 
- This object implements an heuristic solution to the travelling salesman problem. The algorithm is based on simulated annealing
- and is due to "Numerical Recipes in C", Chapter 10.
+ This object implements an heuristic solution to the travelling salesman problem. An initial route is found either by a directional
+ nearest neighbour search, using a grid of buckets so that each step only looks at points close by, or by simulated annealing, which
+ is due to "Numerical Recipes in C", Chapter 10. The route is then improved by 2-opt and Or-opt moves (reversing stretches of the route,
+ and moving short runs of points elsewhere) for as long as they shorten it. The improvement works on separate stretches of the route
+ concurrently, so makes use of all the available processors.
+
+ By default there is no time limit, so the same points always give the same route. A time budget can be set to stop the improvement
+ early on very large inputs, at the cost of a route that depends on how much was done in the time available.
 
  To use, initialise with an array of <code>NSValue</code>s containing <code>NSPoint</code>s. Then request the <code>shortestRoute</code>. The order of points returned by \c -shortestRoute
  will be the shortest route as determined by the algorithm. The first point object in both input and output arrays is the same - in other words
@@ -45,21 +51,48 @@ resolves to an \c NSPoint return value, and is given by <code>key</code>. The re
 	NSInteger* mOrder; // final sort order (1-based)
 	BOOL mCalculationDone; // flag whether the sort was run
 	id<DKRouteFinderProgressDelegate> __weak mProgressDelegate; // a progress delegate, if any
+	CGFloat* mX; // list of input x coordinates (1-based)
+	CGFloat* mY; // list of input y coordinates (1-based)
+	CGFloat mPathLength; // the path length
+	NSTimeInterval mTimeBudget; // the longest time to spend improving the route
+	CGFloat mProgressBase; // progress reported at the start of the current phase
+	CGFloat mProgressSpan; // share of the overall progress taken by the current phase
 	// for SA
-	CGFloat* mX; // for SA, list of input x coordinates
-	CGFloat* mY; // for SA, list of input y coordinates
 	NSInteger mAnnealingSteps; // for SA, the number of steps in the outer loop
-	CGFloat mPathLength; // the path length
 	// for NN
-	NSMutableArray<NSValue*>* mVisited; // for NN, the list of visited points in visit order
 	DKDirection mDirection; // limit search for NN to this direction
 }
 
 + (nullable DKRouteFinder*)routeFinderWithArrayOfPoints:(NSArray<NSValue*>*)arrayOfPoints NS_REFINED_FOR_SWIFT;
 + (nullable DKRouteFinder*)routeFinderWithObjects:(NSArray*)objects withValueForKey:(NSString*)key;
+
+/** @brief Sorts objects into the shortest route.
+
+ The route is improved for as long as that helps, with no time limit (unless \c defaultTimeBudget has been set), so the same objects
+ always come back in the same order. Fewer than four objects are sorted by trying every order.
+ @param objects the objects to sort
+ @param key the key of an \c NSPoint property of the objects
+ @return a new array of the same objects in route order
+ */
 + (NSArray*)sortedArrayOfObjects:(NSArray*)objects byShortestRouteForKey:(NSString*)key;
+
+/** @brief Sorts objects into the shortest route, spending no more than a given time improving it.
+
+ Unlike +sortedArrayOfObjects:byShortestRouteForKey:, the result may vary from one run to the next, depending on how far the
+ improvement got in the time allowed.
+ @param objects the objects to sort
+ @param key the key of an \c NSPoint property of the objects
+ @param budget the longest time to spend improving the initial route, in seconds. Zero returns the initial route as found, and
+ kDKUnlimitedRouteTimeBudget improves it for as long as that helps.
+ @return a new array of the same objects in route order
+ */
++ (NSArray*)sortedArrayOfObjects:(NSArray*)objects byShortestRouteForKey:(NSString*)key timeBudget:(NSTimeInterval)budget;
 @property (class) DKRouteAlgorithmType algorithm;
 
+/** @brief The time budget given to new route finders, in seconds. The default is kDKUnlimitedRouteTimeBudget.
+ */
+@property (class) NSTimeInterval defaultTimeBudget;
+
 /** @brief returns the original points reordered into the shortest route.
  */
 - (NSArray<NSValue*>*)shortestRoute NS_REFINED_FOR_SWIFT;
@@ -77,11 +110,20 @@ resolves to an \c NSPoint return value, and is given by <code>key</code>. The re
 @property (readonly) CGFloat pathLength;
 @property (readonly) DKRouteAlgorithmType algorithm;
 
+/** @brief The longest time to spend improving the initial route, in seconds.
+
+ Improvement stops sooner if no move can be found that shortens the route further. Zero skips it altogether, and
+ kDKUnlimitedRouteTimeBudget, the default, lets it run until then. Must be set before the route is first requested.
+ */
+@property NSTimeInterval timeBudget;
+
 @property (weak, nullable) id<DKRouteFinderProgressDelegate> progressDelegate;
 
 @end
 
 #define kDKDefaultAnnealingSteps 100
+#define kDKUnlimitedRouteTimeBudget INFINITY
+#define kDKDefaultRouteTimeBudget kDKUnlimitedRouteTimeBudget
 
 /** @brief Protocol that an object can implement to be called back as the route finding progresses.
  \c value is in the range 0..1
@@ -6,17 +6,62 @@
 
 #import "DKRouteFinder.h"
 
+/** @brief A uniform grid of buckets over a set of points, used to find near neighbours without looking at every point.
+
+ Each cell lists the points falling within it. Points can be removed; the remaining ones are kept packed at the front of their cell's
+ list so that removal is a swap.
+ */
+typedef struct {
+	CGFloat minX, minY; // origin of the grid
+	CGFloat cellSize; // width and height of a cell
+	NSInteger cols, rows; // grid dimensions
+	NSInteger* cellStart; // index into items of the first point in each cell
+	NSInteger* cellCount; // number of remaining points in each cell
+	NSInteger* items; // point indexes, grouped by cell
+	NSInteger* slot; // point index -> its index in items
+	NSInteger remaining; // number of points not yet removed
+} DKRouteGrid;
+
+/** @brief State shared by the threads improving separate stretches of a route.
+
+ Positions and point indexes are 1-based, as for the rest of the route finder. Position n + 1 holds the point 0, which stands for
+ the open end of the route and is at zero distance from everything.
+ */
+typedef struct {
+	const CGFloat* x;
+	const CGFloat* y;
+	NSInteger* route; // position -> point, 1..n+1
+	NSInteger* pos; // point -> position
+	const NSInteger* owner; // point -> stretch that may move it, or -1
+	const NSInteger* neighbours; // kDKRouteNeighbourCount nearest points for each point
+	NSInteger n;
+	CFAbsoluteTime deadline;
+} DKRouteImprover;
+
+#define kDKRouteNeighbourCount 8
+#define kDKRouteMinimumStretch 256
+#define kDKRouteMaximumStretches 16
+#define kDKRouteGain 1.0e-9
+
 static CGFloat anneal(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger annealingSteps, const void* context);
 static void progressCallback(CGFloat iteration, CGFloat maxIterations, const void* context);
 static DKDirection directionOfAngle(const CGFloat angle);
 
+static void buildGrid(DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, const NSInteger* points, NSInteger count);
+static void freeGrid(DKRouteGrid* grid);
+static void removeFromGrid(DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, NSInteger point);
+static NSInteger nearestInGrid(const DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, NSPoint cvp, DKDirection direction);
+static void nearestNeighbours(const DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, NSInteger point, NSInteger* result);
+static BOOL improveStretch(DKRouteImprover* r, NSInteger stretch, NSInteger lo, NSInteger hi);
+
 @interface DKRouteFinder ()
 
++ (NSArray*)sortedArrayOfFewObjects:(NSArray*)objects forKey:(NSString*)key;
 - (id)initWithArray:(NSArray<NSValue*>*)array;
 - (void)notifyProgress:(CGFloat)value;
-- (NSUInteger)nearestNeighbourInArray:(NSArray*)arrayOfPoint toPoint:(NSPoint)cvp inDirection:(DKDirection)direction;
-- (NSArray*)sortArrayUsingNearestNeighbour:(NSArray*)points;
-- (CGFloat)pathLengthOfArray:(NSArray*)points;
+- (void)sortUsingNearestNeighbour;
+- (void)improveRoute;
+- (CGFloat)pathLengthOfOrder;
 - (NSUInteger)indexOfTopLeftPointInArray:(NSArray*)points;
 - (void)performSortIfNeeded;
 
@@ -25,6 +70,7 @@ static DKDirection directionOfAngle(const CGFloat angle);
 #pragma mark -
 
 static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimulatedAnnealing;
+static NSTimeInterval s_DefaultTimeBudget = kDKDefaultRouteTimeBudget;
 
 @implementation DKRouteFinder
 
@@ -41,6 +87,16 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 	return s_Algorithm;
 }
 
++ (void)setDefaultTimeBudget:(NSTimeInterval)budget
+{
+	s_DefaultTimeBudget = MAX(0.0, budget);
+}
+
++ (NSTimeInterval)defaultTimeBudget
+{
+	return s_DefaultTimeBudget;
+}
+
 + (DKRouteFinder*)routeFinderWithArrayOfPoints:(NSArray*)arrayOfPoints
 {
 	NSAssert(arrayOfPoints != nil, @"cannot operate on a nil array");
@@ -63,13 +119,28 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 
 + (NSArray*)sortedArrayOfObjects:(NSArray*)objects byShortestRouteForKey:(NSString*)key
 {
-	// ultra-easy method to sort objects into the shortest route based on the key (which must reference a NSPoint property)
+	// ultra-easy method to sort objects into the shortest route based on the key (which must reference a NSPoint property). Unless
+	// a default budget has been set, the route is improved for as long as that helps, so the result doesn't depend on timing
+
+	return [self sortedArrayOfObjects:objects
+				byShortestRouteForKey:key
+						   timeBudget:[self defaultTimeBudget]];
+}
 
++ (NSArray*)sortedArrayOfObjects:(NSArray*)objects byShortestRouteForKey:(NSString*)key timeBudget:(NSTimeInterval)budget
+{
 	NSAssert(objects != nil, @"cannot operate on a nil array");
 	NSAssert(key != nil, @"key was nil, cannot proceed");
 
+	// a route finder needs at least four points
+
+	if ([objects count] < 4)
+		return [self sortedArrayOfFewObjects:objects
+									  forKey:key];
+
 	DKRouteFinder* tsp = [self routeFinderWithObjects:objects
 									  withValueForKey:key];
+	[tsp setTimeBudget:budget];
 	return [tsp sortedArrayFromArray:objects];
 }
 
@@ -148,6 +219,18 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 
 @synthesize algorithm = mAlgorithm;
 
+- (void)setTimeBudget:(NSTimeInterval)budget
+{
+	NSAssert(!mCalculationDone, @"time budget must be set before the route is calculated");
+
+	mTimeBudget = MAX(0.0, budget);
+}
+
+- (NSTimeInterval)timeBudget
+{
+	return mTimeBudget;
+}
+
 @synthesize progressDelegate = mProgressDelegate;
 #if 0
 - (void)setProgressDelegate:(id)aDelegate
@@ -163,6 +246,27 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 #pragma mark -
 #pragma mark - private methods
 
++ (NSArray*)sortedArrayOfFewObjects:(NSArray*)objects forKey:(NSString*)key
+{
+	// with fewer than four objects there are at most two routes from the first one, so just compare them. Ties keep the
+	// original order.
+
+	if ([objects count] < 3)
+		return [objects copy];
+
+	NSPoint a = [[[objects objectAtIndex:0] valueForKey:key] pointValue];
+	NSPoint b = [[[objects objectAtIndex:1] valueForKey:key] pointValue];
+	NSPoint c = [[[objects objectAtIndex:2] valueForKey:key] pointValue];
+
+	CGFloat abc = hypot(b.x - a.x, b.y - a.y) + hypot(c.x - b.x, c.y - b.y);
+	CGFloat acb = hypot(c.x - a.x, c.y - a.y) + hypot(b.x - c.x, b.y - c.y);
+
+	if (acb < abc)
+		return @[ [objects objectAtIndex:0], [objects objectAtIndex:2], [objects objectAtIndex:1] ];
+
+	return [objects copy];
+}
+
 - (instancetype)initWithArray:(NSArray*)array
 {
 	self = [super init];
@@ -170,6 +274,7 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 		NSAssert(array != nil, @"cannot initialise with a nil array");
 
 		mAlgorithm = s_Algorithm;
+		mTimeBudget = s_DefaultTimeBudget;
 
 		// set the initial search direction - east is good when starting at top, left. Or set
 		// kDirectionAny to use non-directional NN algorithm (which is definitely not as good)
@@ -186,40 +291,37 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 		mCalculationDone = NO;
 		mInput = array;
 		mAnnealingSteps = kDKDefaultAnnealingSteps;
+		mProgressBase = 0.0;
+		mProgressSpan = 1.0;
 
 		// prepare for the computation by allocating C arrays and populating them from the input.
-		// for some reason these arrays are 1-based, so must allow for that.
+		// for some reason these arrays are 1-based, so must allow for that. Both algorithms and
+		// the improvement work on these rather than on the NSValues.
 
 		NSUInteger n = [array count] + 1;
 
 		mOrder = malloc(sizeof(NSInteger) * n);
-		NSInteger kludge = 1;
-#if defined(__LP64__) && __LP64__
-		memset_pattern8(mOrder, &kludge, sizeof(NSInteger) * n);
-#else
-		memset_pattern4(mOrder, &kludge, sizeof(NSInteger) * n);
-#endif
+		mX = malloc(sizeof(CGFloat) * n);
+		mY = malloc(sizeof(CGFloat) * n);
 
-		if ((mAlgorithm & kDKUseSimulatedAnnealing) != 0) {
-			mX = malloc(sizeof(CGFloat) * n);
-			mY = malloc(sizeof(CGFloat) * n);
+		mOrder[0] = 0;
+		mX[0] = mY[0] = 0.0;
 
-			NSInteger k = 0;
+		NSInteger k = 0;
 
-			for (NSValue* val in array) {
-				++k; // preincrement, start loading arrays from 1
+		for (NSValue* val in array) {
+			++k; // preincrement, start loading arrays from 1
 
-				if (strcmp([val objCType], @encode(NSPoint)) == 0) {
-					mX[k] = [val pointValue].x;
-					mY[k] = [val pointValue].y;
-				} else {
-					[NSException raise:NSInternalInconsistencyException
-								format:@"NSValue passed did not contain NSPoint"];
-					return nil;
-				}
-
-				mOrder[k] = k;
+			if (strcmp([val objCType], @encode(NSPoint)) == 0) {
+				mX[k] = [val pointValue].x;
+				mY[k] = [val pointValue].y;
+			} else {
+				[NSException raise:NSInternalInconsistencyException
+							format:@"NSValue passed did not contain NSPoint"];
+				return nil;
 			}
+
+			mOrder[k] = k;
 		}
 	}
 
@@ -240,55 +342,20 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 
 - (void)notifyProgress:(CGFloat)value
 {
+	// <value> is the progress through the phase being run, which is mapped onto that phase's share of the whole
+
 	if (mProgressDelegate && [mProgressDelegate respondsToSelector:@selector(routeFinder:progressHasReached:)])
 		[mProgressDelegate routeFinder:self
-					progressHasReached:value];
+					progressHasReached:mProgressBase + value * mProgressSpan];
 
 	//NSLog(@"RF progress: %.3f", value );
 }
 
-- (NSUInteger)nearestNeighbourInArray:(NSArray*)arrayOfPoint toPoint:(NSPoint)cvp inDirection:(DKDirection)direction
+- (void)sortUsingNearestNeighbour
 {
-	// given a list of NSPoint values, this returns the index of the point being the nearest neighbour to the point <p>
-	// this is one step in the nearest-neightbour (NN) algorithm. <p> should not be listed in the array. If <direction> is not any,
-	// this rejects neighbours that fall outside of a region bounded by lines at 45 degrees to the direction specified. If no
-	// neighbours are found under these constraints, the method returns NSNotFound.
-
-	NSUInteger nn = NSNotFound, k;
-	NSPoint p;
-	CGFloat dist, shortestDistanceSoFar = HUGE_VAL;
-
-	for (k = 0; k < [arrayOfPoint count]; ++k) {
-		p = [[arrayOfPoint objectAtIndex:k] pointValue];
-
-		dist = hypot(p.x - cvp.x, p.y - cvp.y);
-
-		if (dist < shortestDistanceSoFar) {
-			// could be a candidate - check whether it falls within the direction limits
-
-			if (direction == kDirectionAny) {
-				shortestDistanceSoFar = dist;
-				nn = k;
-			} else {
-				DKDirection ad = directionOfAngle(atan2(p.y - cvp.y, p.x - cvp.x));
-
-				if (ad == direction) {
-					shortestDistanceSoFar = dist;
-					nn = k;
-				}
-			}
-		}
-	}
-
-	return nn;
-}
-
-- (NSArray*)sortArrayUsingNearestNeighbour:(NSArray*)points
-{
-	// given an array of point values, this sorts them into order according to nearest neighbour (NN)
-	// the MO is to start with the first point and find its nearest neighbour. That point is then added to the visited list
-	// and removed from the working list. The search is repeated until all points have been exhausted. The order of
-	// points in the visited list is the result.
+	// sorts the input points into order according to nearest neighbour (NN), setting mOrder.
+	// the MO is to start with the first point and find its nearest neighbour. That point is then added to the route
+	// and removed from the grid. The search is repeated until all points have been exhausted.
 
 	// A straight NN algorithm is used if mDirection == kDirectionAny. This can return some pretty non-optimal paths. A modified
 	// NN algorithm is used if mDirection is some definite direction (N,S,E or W). In this case, neighbours are only considered if they lie
@@ -297,92 +364,208 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 	// down and alternately east and west, only going north if all other directions have been exhausted. The result is to find a nice scan
 	// route for a regular grid, while still finding a reasonable path for arbitrarily placed objects.
 
-	// this also sets the mOrder array as for a SA sort, so that the same code can be used to extract results from an NN sort.
+	// the points are held in a grid of buckets so that each search only looks at the cells around the current vertex. As points are used up
+	// the grid is rebuilt coarser, so that the search doesn't have to wade through empty cells towards the end.
 
-	NSMutableArray* workingList = [points mutableCopy];
+	NSInteger n = [mInput count];
+	NSInteger* points = malloc(sizeof(NSInteger) * n);
+	NSInteger k;
 
-	// start at point 0, so it has already been "visited"
+	for (k = 0; k < n - 1; ++k)
+		points[k] = k + 2;
 
-	if (mVisited == nil)
-		mVisited = [[NSMutableArray alloc] init];
+	// start at point 1, so it has already been "visited"
 
-	[mVisited removeAllObjects];
-	[mVisited addObject:[points objectAtIndex:0]];
-	[workingList removeObjectAtIndex:0];
-
-	// update progress
+	DKRouteGrid grid;
+	buildGrid(&grid, mX, mY, points, n - 1);
 
 	[self notifyProgress:0.0];
 
+	DKDirection direction = mDirection;
+	NSInteger progressInterval = MAX(1, n / 100);
 	BOOL phase = YES; // sets alternate E/W scan
-	NSUInteger k = 0; // tracks the index into mOrder
+	k = 0; // tracks the index into mOrder
 	mOrder[++k] = 1;
 
 	do {
-		[self notifyProgress:(CGFloat)k / (CGFloat)[points count]];
+		if ((k % progressInterval) == 0)
+			[self notifyProgress:(CGFloat)k / (CGFloat)n];
 
-		NSPoint currentVertex = [[mVisited lastObject] pointValue];
-		NSUInteger nn;
+		NSInteger current = mOrder[k];
+		NSPoint currentVertex = NSMakePoint(mX[current], mY[current]);
+		NSInteger nn;
 
 		do {
-			nn = [self nearestNeighbourInArray:workingList
-									   toPoint:currentVertex
-								   inDirection:mDirection];
+			nn = nearestInGrid(&grid, mX, mY, currentVertex, direction);
 
 			// if nn is not found, there are no more neighbours in the direction being tracked, so switch to another direction and try again.
-			if (mDirection != kDirectionAny) {
-				if (nn == NSNotFound) {
-					if (mDirection == kDirectionEast || mDirection == kDirectionWest)
-						mDirection = kDirectionSouth;
-					else if (mDirection == kDirectionSouth)
-						mDirection = kDirectionNorth;
-					else if (mDirection == kDirectionNorth) {
-						mDirection = phase ? kDirectionWest : kDirectionEast;
+			if (direction != kDirectionAny) {
+				if (nn == 0) {
+					if (direction == kDirectionEast || direction == kDirectionWest)
+						direction = kDirectionSouth;
+					else if (direction == kDirectionSouth)
+						direction = kDirectionNorth;
+					else if (direction == kDirectionNorth) {
+						direction = phase ? kDirectionWest : kDirectionEast;
 						phase = !phase;
 					}
 				} else {
-					if (mDirection == kDirectionSouth || mDirection == kDirectionNorth) {
-						mDirection = phase ? kDirectionWest : kDirectionEast;
+					if (direction == kDirectionSouth || direction == kDirectionNorth) {
+						direction = phase ? kDirectionWest : kDirectionEast;
 						phase = !phase;
 					}
 				}
 			}
-		} while (nn == NSNotFound);
+		} while (nn == 0);
+
+		// this is the current vertex for the next iteration - record it and take it out of the grid
 
-		// move this to the visited list - it is the current vertex for the next iteration.
-		// remove from the working list
+		mOrder[++k] = nn;
+		removeFromGrid(&grid, mX, mY, nn);
 
-		[mVisited addObject:[workingList objectAtIndex:nn]];
-		[workingList removeObjectAtIndex:nn];
+		if (grid.remaining > 64 && grid.remaining * 8 < grid.cols * grid.rows) {
+			NSInteger j, m = 0;
 
-		//NSLog(@"nearest neighbour to point %@ was = %d (k = %d)", NSStringFromPoint( currentVertex), nn, k );
+			for (j = 0; j < grid.cols * grid.rows; ++j) {
+				memcpy(&points[m], &grid.items[grid.cellStart[j]], sizeof(NSInteger) * grid.cellCount[j]);
+				m += grid.cellCount[j];
+			}
 
-		// record order in mOrder. 1-based, so add 1 to index.
+			freeGrid(&grid);
+			buildGrid(&grid, mX, mY, points, m);
+		}
+	} while (grid.remaining > 0);
 
-		mOrder[++k] = [points indexOfObject:[mVisited lastObject]] + 1;
-	} while ([workingList count] > 0);
+	freeGrid(&grid);
+	free(points);
 
 	[self notifyProgress:1.0];
+}
+
+- (void)improveRoute
+{
+	// improves the route in mOrder by 2-opt and Or-opt moves until none can be found or the time budget runs out. The route is
+	// treated as open, starting at point 1, which must already be at mOrder[1].
+
+	// the route is split into stretches which are improved concurrently. The points at either end of each stretch stay put, so
+	// each thread only moves points in its own stretch. The stretches are shifted by half their length on alternate rounds so that
+	// moves across the joins are found as well. When that stops helping the whole route is improved as one. The number of stretches
+	// depends only on the number of points, not on the processors available, so without a deadline the result is the same everywhere.
+
+	NSInteger n = [mInput count];
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+	NSInteger* route = malloc(sizeof(NSInteger) * (n + 2));
+	NSInteger* pos = malloc(sizeof(NSInteger) * (n + 1));
+	NSInteger* owner = malloc(sizeof(NSInteger) * (n + 1));
+	NSInteger* neighbours = malloc(sizeof(NSInteger) * kDKRouteNeighbourCount * (n + 1));
+	NSInteger k;
+
+	route[0] = 0;
+	memcpy(&route[1], &mOrder[1], sizeof(NSInteger) * n);
+	route[n + 1] = 0;
+
+	for (k = 1; k <= n; ++k)
+		pos[route[k]] = k;
 
-	// mVisited is the sorted list of original points
+	// find each point's nearest neighbours, which are the only candidates considered for new connections
 
-	return mVisited;
+	DKRouteGrid grid;
+	buildGrid(&grid, mX, mY, &route[1], n);
+
+	NSInteger chunks = (n + 1023) / 1024;
+	const CGFloat* x = mX;
+	const CGFloat* y = mY;
+
+	dispatch_apply(chunks, queue, ^(size_t chunk) {
+		NSInteger p, last = MIN(n, (NSInteger)(chunk + 1) * 1024);
+
+		for (p = (NSInteger)chunk * 1024 + 1; p <= last; ++p)
+			nearestNeighbours(&grid, x, y, p, &neighbours[p * kDKRouteNeighbourCount]);
+	});
+
+	freeGrid(&grid);
+
+	DKRouteImprover improver = { mX, mY, route, pos, owner, neighbours, n, start + mTimeBudget };
+	DKRouteImprover* ip = &improver;
+
+	NSInteger stretches = MAX(1, MIN(kDKRouteMaximumStretches, n / kDKRouteMinimumStretch));
+	NSInteger stretchLength = (n + stretches - 1) / stretches;
+	NSInteger* bounds = malloc(sizeof(NSInteger) * (stretches + 2));
+	BOOL* improved = malloc(sizeof(BOOL) * (stretches + 1));
+	NSInteger round = 0, quietRounds = 0;
+
+	while (CFAbsoluteTimeGetCurrent() < improver.deadline) {
+		// work out where the stretches start and end, and which points each one may move
+
+		NSInteger b, count = 0, offset = (stretches > 1 && (round & 1)) ? stretchLength / 2 : 0;
+
+		bounds[count++] = 1;
+		for (b = 1 + offset; b <= n; b += stretchLength) {
+			if (b > 1)
+				bounds[count++] = b;
+		}
+		bounds[count] = n + 1;
+
+		for (b = 0; b < count; ++b) {
+			owner[route[bounds[b]]] = -1;
+
+			for (k = bounds[b] + 1; k < bounds[b + 1]; ++k)
+				owner[route[k]] = b;
+		}
+
+		dispatch_apply(count, queue, ^(size_t stretch) {
+			improved[stretch] = improveStretch(ip, stretch, bounds[stretch], bounds[stretch + 1]);
+		});
+
+		++quietRounds;
+		for (b = 0; b < count; ++b) {
+			if (improved[b]) {
+				quietRounds = 0;
+				break;
+			}
+		}
+
+		++round;
+
+		if (isfinite(mTimeBudget))
+			[self notifyProgress:MIN(1.0, (CFAbsoluteTimeGetCurrent() - start) / mTimeBudget)];
+
+		// points near each other in space are often far apart along the route, so once the stretches have nothing more to
+		// offer, finish off with the whole route as a single stretch
+
+		if (quietRounds >= ((stretches > 1) ? 2 : 1)) {
+			if (stretches == 1)
+				break;
+
+			stretches = 1;
+			stretchLength = n;
+			quietRounds = 0;
+		}
+	}
+
+	memcpy(&mOrder[1], &route[1], sizeof(NSInteger) * n);
+
+	free(improved);
+	free(bounds);
+	free(neighbours);
+	free(owner);
+	free(pos);
+	free(route);
+
+	[self notifyProgress:1.0];
 }
 
-- (CGFloat)pathLengthOfArray:(NSArray*)points
+- (CGFloat)pathLengthOfOrder
 {
-	NSEnumerator* iter = [points objectEnumerator];
-	NSValue* val;
-	CGFloat pl = 0.0;
-	NSPoint pp, pt;
+	// the length of the open path through the points in mOrder order
 
-	pp = [[iter nextObject] pointValue];
+	NSInteger k, n = [mInput count];
+	CGFloat pl = 0.0;
 
-	while ((val = [iter nextObject])) {
-		pt = [val pointValue];
-		pl += hypot(pt.x - pp.x, pt.y - pp.y);
-		pp = pt;
-	}
+	for (k = 1; k < n; ++k)
+		pl += hypot(mX[mOrder[k + 1]] - mX[mOrder[k]], mY[mOrder[k + 1]] - mY[mOrder[k]]);
 
 	return pl;
 }
@@ -401,15 +584,44 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 	if (!mCalculationDone) {
 		mCalculationDone = YES;
 
+		// the initial route takes the first half of the progress range if there is improvement to follow
+
+		BOOL improve = mTimeBudget > 0.0;
+
+		mProgressBase = 0.0;
+		mProgressSpan = improve ? 0.5 : 1.0;
+
 		if ((mAlgorithm & kDKUseSimulatedAnnealing) != 0) {
-			anneal(mX, mY, mOrder, [mInput count], mAnnealingSteps, (__bridge const void*)(self));
-			mPathLength = [self pathLengthOfArray:[self shortestRoute]];
+			NSInteger k, n = [mInput count];
+			anneal(mX, mY, mOrder, n, mAnnealingSteps, (__bridge const void*)(self));
+
+			// anneal returns a closed tour - rotate it to start at point 1 so that it can be treated as an open route
+
+			NSInteger* rotated = malloc(sizeof(NSInteger) * n);
+			NSInteger m = 1;
+
+			while (mOrder[m] != 1)
+				++m;
+
+			for (k = 0; k < n; ++k)
+				rotated[k] = mOrder[1 + ((k + m - 1) % n)];
+
+			memcpy(&mOrder[1], rotated, sizeof(NSInteger) * n);
+			free(rotated);
 		}
 
-		if ((mAlgorithm & kDKUseNearestNeighbour) != 0) {
-			[self sortArrayUsingNearestNeighbour:mInput];
-			mPathLength = [self pathLengthOfArray:mVisited];
+		if ((mAlgorithm & kDKUseNearestNeighbour) != 0)
+			[self sortUsingNearestNeighbour];
+
+		if (improve) {
+			mProgressBase = 0.5;
+			mProgressSpan = 0.5;
+			[self improveRoute];
 		}
+
+		mProgressBase = 0.0;
+		mProgressSpan = 1.0;
+		mPathLength = [self pathLengthOfOrder];
 	}
 }
 
@@ -440,6 +652,482 @@ static DKDirection directionOfAngle(const CGFloat angle)
 		return kDirectionNorth;
 }
 
+#pragma mark -
+#pragma mark - grid of buckets
+
+static inline NSInteger gridColumn(const DKRouteGrid* grid, CGFloat x)
+{
+	return (NSInteger)floor((x - grid->minX) / grid->cellSize);
+}
+
+static inline NSInteger gridRow(const DKRouteGrid* grid, CGFloat y)
+{
+	return (NSInteger)floor((y - grid->minY) / grid->cellSize);
+}
+
+void buildGrid(DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, const NSInteger* points, NSInteger count)
+{
+	// sizes the cells so that there are about two points to a cell on average, then sorts the points into the cells
+
+	NSInteger k, cells;
+	CGFloat minX = HUGE_VAL, minY = HUGE_VAL, maxX = -HUGE_VAL, maxY = -HUGE_VAL;
+
+	for (k = 0; k < count; ++k) {
+		minX = MIN(minX, x[points[k]]);
+		maxX = MAX(maxX, x[points[k]]);
+		minY = MIN(minY, y[points[k]]);
+		maxY = MAX(maxY, y[points[k]]);
+	}
+
+	CGFloat width = maxX - minX;
+	CGFloat height = maxY - minY;
+	CGFloat cellSize;
+
+	if (width > 0.0 && height > 0.0)
+		cellSize = sqrt(2.0 * width * height / MAX(count, 1));
+	else if (width > 0.0 || height > 0.0)
+		cellSize = 2.0 * MAX(width, height) / MAX(count, 1);
+	else
+		cellSize = 1.0;
+
+	// very thin sets of points can ask for more cells than are useful
+
+	while ((floor(width / cellSize) + 1) * (floor(height / cellSize) + 1) > 4 * count + 16)
+		cellSize *= 2.0;
+
+	grid->minX = minX;
+	grid->minY = minY;
+	grid->cellSize = cellSize;
+	grid->cols = (NSInteger)floor(width / cellSize) + 1;
+	grid->rows = (NSInteger)floor(height / cellSize) + 1;
+	grid->remaining = count;
+
+	cells = grid->cols * grid->rows;
+	grid->cellStart = calloc(cells + 1, sizeof(NSInteger));
+	grid->cellCount = calloc(cells, sizeof(NSInteger));
+	grid->items = malloc(sizeof(NSInteger) * MAX(count, 1));
+
+	// point indexes can be anything up to the largest in the list, so size the slot table to fit
+
+	NSInteger maxPoint = 0;
+
+	for (k = 0; k < count; ++k)
+		maxPoint = MAX(maxPoint, points[k]);
+
+	grid->slot = malloc(sizeof(NSInteger) * (maxPoint + 1));
+
+	for (k = 0; k < count; ++k) {
+		NSInteger p = points[k];
+		grid->cellCount[gridRow(grid, y[p]) * grid->cols + gridColumn(grid, x[p])]++;
+	}
+
+	for (k = 0; k < cells; ++k)
+		grid->cellStart[k + 1] = grid->cellStart[k] + grid->cellCount[k];
+
+	memset(grid->cellCount, 0, sizeof(NSInteger) * cells);
+
+	for (k = 0; k < count; ++k) {
+		NSInteger p = points[k];
+		NSInteger cell = gridRow(grid, y[p]) * grid->cols + gridColumn(grid, x[p]);
+		NSInteger s = grid->cellStart[cell] + grid->cellCount[cell]++;
+
+		grid->items[s] = p;
+		grid->slot[p] = s;
+	}
+}
+
+void freeGrid(DKRouteGrid* grid)
+{
+	free(grid->cellStart);
+	free(grid->cellCount);
+	free(grid->items);
+	free(grid->slot);
+}
+
+void removeFromGrid(DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, NSInteger point)
+{
+	// swaps <point> with the last remaining point in its cell, then shortens the cell's list by one
+
+	NSInteger cell = gridRow(grid, y[point]) * grid->cols + gridColumn(grid, x[point]);
+	NSInteger s = grid->slot[point];
+	NSInteger last = grid->cellStart[cell] + grid->cellCount[cell] - 1;
+	NSInteger other = grid->items[last];
+
+	grid->items[last] = point;
+	grid->items[s] = other;
+	grid->slot[other] = s;
+	grid->slot[point] = last;
+	grid->cellCount[cell]--;
+	grid->remaining--;
+}
+
+static BOOL cellMayHoldDirection(NSInteger dx, NSInteger dy, DKDirection direction)
+{
+	// whether a cell <dx>, <dy> cells away from the query cell can contain points within 45 degrees of <direction>
+
+	switch (direction) {
+		case kDirectionEast:
+			return dx >= labs(dy) - 1;
+		case kDirectionWest:
+			return -dx >= labs(dy) - 1;
+		case kDirectionSouth:
+			return dy >= labs(dx) - 1;
+		case kDirectionNorth:
+			return -dy >= labs(dx) - 1;
+		default:
+			return YES;
+	}
+}
+
+NSInteger nearestInGrid(const DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, NSPoint cvp, DKDirection direction)
+{
+	// returns the remaining point nearest to <cvp>, searching outwards in rings of cells. If <direction> is not any, this rejects
+	// neighbours that fall outside of a region bounded by lines at 45 degrees to the direction specified. Equidistant points are
+	// resolved in favour of the lowest index. If no neighbours are found under these constraints, the function returns 0.
+
+	if (grid->remaining == 0)
+		return 0;
+
+	NSInteger qx = gridColumn(grid, cvp.x);
+	NSInteger qy = gridRow(grid, cvp.y);
+
+	// rings closer than this don't overlap the grid; rings further than maxRing can't hold anything in the direction wanted
+
+	NSInteger r = MAX(MAX(0, qx - (grid->cols - 1)), MAX(-qx, MAX(qy - (grid->rows - 1), -qy)));
+	NSInteger maxRing = MAX(MAX(qx, grid->cols - 1 - qx), MAX(qy, grid->rows - 1 - qy));
+
+	switch (direction) {
+		case kDirectionEast:
+			maxRing = MIN(maxRing, grid->cols - qx);
+			break;
+		case kDirectionWest:
+			maxRing = MIN(maxRing, qx + 1);
+			break;
+		case kDirectionSouth:
+			maxRing = MIN(maxRing, grid->rows - qy);
+			break;
+		case kDirectionNorth:
+			maxRing = MIN(maxRing, qy + 1);
+			break;
+		default:
+			break;
+	}
+
+	NSInteger nn = 0;
+	CGFloat shortestDistanceSoFar = HUGE_VAL;
+
+	for (; r <= maxRing; ++r) {
+		NSInteger cy, cx, step;
+
+		for (cy = MAX(0, qy - r); cy <= MIN(grid->rows - 1, qy + r); ++cy) {
+			// whole rows at the top and bottom of the ring, only the two ends of the rows in between
+
+			step = (labs(cy - qy) == r) ? 1 : MAX(1, 2 * r);
+
+			for (cx = qx - r; cx <= qx + r; cx += step) {
+				if (cx < 0 || cx >= grid->cols || !cellMayHoldDirection(cx - qx, cy - qy, direction))
+					continue;
+
+				NSInteger cell = cy * grid->cols + cx;
+				NSInteger s, end = grid->cellStart[cell] + grid->cellCount[cell];
+
+				for (s = grid->cellStart[cell]; s < end; ++s) {
+					NSInteger p = grid->items[s];
+					CGFloat dist = hypot(x[p] - cvp.x, y[p] - cvp.y);
+
+					if (dist < shortestDistanceSoFar || (dist == shortestDistanceSoFar && p < nn)) {
+						// could be a candidate - check whether it falls within the direction limits
+
+						if (direction == kDirectionAny || directionOfAngle(atan2(y[p] - cvp.y, x[p] - cvp.x)) == direction) {
+							shortestDistanceSoFar = dist;
+							nn = p;
+						}
+					}
+				}
+			}
+		}
+
+		// points in the next ring out are at least this far away
+
+		if (nn != 0 && shortestDistanceSoFar < r * grid->cellSize)
+			break;
+	}
+
+	return nn;
+}
+
+void nearestNeighbours(const DKRouteGrid* grid, const CGFloat* x, const CGFloat* y, NSInteger point, NSInteger* result)
+{
+	// finds the kDKRouteNeighbourCount points nearest to <point>, closest first. Unused entries are set to 0. The grid is only
+	// read, so this can be called from several threads at once.
+
+	CGFloat dists[kDKRouteNeighbourCount];
+	NSInteger found = 0, k;
+
+	for (k = 0; k < kDKRouteNeighbourCount; ++k)
+		result[k] = 0;
+
+	NSInteger qx = gridColumn(grid, x[point]);
+	NSInteger qy = gridRow(grid, y[point]);
+	NSInteger r, maxRing = MAX(MAX(qx, grid->cols - 1 - qx), MAX(qy, grid->rows - 1 - qy));
+
+	for (r = 0; r <= maxRing; ++r) {
+		NSInteger cy, cx, step;
+
+		for (cy = MAX(0, qy - r); cy <= MIN(grid->rows - 1, qy + r); ++cy) {
+			step = (labs(cy - qy) == r) ? 1 : MAX(1, 2 * r);
+
+			for (cx = qx - r; cx <= qx + r; cx += step) {
+				if (cx < 0 || cx >= grid->cols)
+					continue;
+
+				NSInteger cell = cy * grid->cols + cx;
+				NSInteger s, end = grid->cellStart[cell] + grid->cellCount[cell];
+
+				for (s = grid->cellStart[cell]; s < end; ++s) {
+					NSInteger p = grid->items[s];
+
+					if (p == point)
+						continue;
+
+					CGFloat dist = hypot(x[p] - x[point], y[p] - y[point]);
+
+					if (found == kDKRouteNeighbourCount && dist >= dists[found - 1])
+						continue;
+
+					// insert into the sorted list, dropping the furthest if it is full
+
+					k = MIN(found, kDKRouteNeighbourCount - 1);
+					while (k > 0 && dists[k - 1] > dist) {
+						dists[k] = dists[k - 1];
+						result[k] = result[k - 1];
+						--k;
+					}
+					dists[k] = dist;
+					result[k] = p;
+					found = MIN(found + 1, kDKRouteNeighbourCount);
+				}
+			}
+		}
+
+		if (found == kDKRouteNeighbourCount && dists[found - 1] < r * grid->cellSize)
+			break;
+	}
+}
+
+#pragma mark -
+#pragma mark - 2-opt and Or-opt improvement
+
+static inline CGFloat routeDistance(const DKRouteImprover* r, NSInteger a, NSInteger b)
+{
+	// point 0 is the open end of the route, so costs nothing to reach
+
+	if (a == 0 || b == 0)
+		return 0.0;
+
+	CGFloat dx = r->x[a] - r->x[b];
+	CGFloat dy = r->y[a] - r->y[b];
+
+	return sqrt(dx * dx + dy * dy);
+}
+
+static void reverseRoute(DKRouteImprover* r, NSInteger i, NSInteger j)
+{
+	// reverses the route between positions <i> and <j> inclusive
+
+	for (; i < j; ++i, --j) {
+		NSInteger t = r->route[i];
+		r->route[i] = r->route[j];
+		r->route[j] = t;
+		r->pos[r->route[i]] = i;
+		r->pos[r->route[j]] = j;
+	}
+
+	if (i == j)
+		r->pos[r->route[i]] = i;
+}
+
+static void moveSegment(DKRouteImprover* r, NSInteger i, NSInteger length, NSInteger edge, BOOL reversed)
+{
+	// moves the <length> points starting at position <i> so that they sit between positions <edge> and <edge> + 1, optionally reversing them
+
+	NSInteger segment[3], k, lo, hi;
+
+	memcpy(segment, &r->route[i], sizeof(NSInteger) * length);
+
+	if (edge < i) {
+		memmove(&r->route[edge + 1 + length], &r->route[edge + 1], sizeof(NSInteger) * (i - edge - 1));
+		lo = edge + 1;
+		hi = i + length - 1;
+	} else {
+		memmove(&r->route[i], &r->route[i + length], sizeof(NSInteger) * (edge - i - length + 1));
+		lo = i;
+		hi = edge;
+	}
+
+	NSInteger dest = (edge < i) ? edge + 1 : edge - length + 1;
+
+	for (k = 0; k < length; ++k)
+		r->route[dest + k] = segment[reversed ? length - 1 - k : k];
+
+	for (k = lo; k <= hi; ++k)
+		r->pos[r->route[k]] = k;
+}
+
+BOOL improveStretch(DKRouteImprover* r, NSInteger stretch, NSInteger lo, NSInteger hi)
+{
+	// applies 2-opt and Or-opt moves that shorten the route between positions <lo> and <hi>, whose points stay where they are.
+	// Only points owned by <stretch>, or the two end points, are considered as new connections. Returns YES if any move was made.
+
+	const NSInteger* nbrs = r->neighbours;
+	NSInteger loPoint = r->route[lo];
+	NSInteger hiPoint = r->route[hi];
+	BOOL improvedAny = NO, improved;
+	NSUInteger checks = 0;
+
+#define USABLE(c) ((c) != 0 && (r->owner[(c)] == stretch || (c) == loPoint || (c) == hiPoint))
+
+	do {
+		improved = NO;
+
+		NSInteger i, j, c, d, k, e, edge, length;
+
+		for (i = lo; i <= hi; ++i) {
+			if ((++checks & 255) == 0 && CFAbsoluteTimeGetCurrent() > r->deadline)
+				return improvedAny;
+
+			NSInteger a = r->route[i];
+
+			if (a == 0)
+				continue;
+
+			// 2-opt: replace edges a-b and c-d by a-c and b-d, where b and d both follow, or both precede, a and c
+
+			if (i + 1 <= hi) {
+				NSInteger b = r->route[i + 1];
+				CGFloat dab = routeDistance(r, a, b);
+
+				for (k = 0; k < kDKRouteNeighbourCount; ++k) {
+					c = nbrs[a * kDKRouteNeighbourCount + k];
+					CGFloat dac = routeDistance(r, a, c);
+
+					if (c == 0 || dac >= dab)
+						break;
+					if (!USABLE(c))
+						continue;
+
+					j = r->pos[c];
+					if (j == i || j + 1 > hi)
+						continue;
+
+					d = r->route[j + 1];
+					if (dab + routeDistance(r, c, d) - dac - routeDistance(r, b, d) > kDKRouteGain) {
+						if (j > i)
+							reverseRoute(r, i + 1, j);
+						else
+							reverseRoute(r, j + 1, i);
+
+						improved = YES;
+						break;
+					}
+				}
+			}
+
+			a = r->route[i];
+
+			if (i - 1 >= lo) {
+				NSInteger b = r->route[i - 1];
+				CGFloat dab = routeDistance(r, a, b);
+
+				for (k = 0; k < kDKRouteNeighbourCount; ++k) {
+					c = nbrs[a * kDKRouteNeighbourCount + k];
+					CGFloat dac = routeDistance(r, a, c);
+
+					if (c == 0 || dac >= dab)
+						break;
+					if (!USABLE(c))
+						continue;
+
+					j = r->pos[c];
+					if (j == i || j - 1 < lo)
+						continue;
+
+					d = r->route[j - 1];
+					if (dab + routeDistance(r, c, d) - dac - routeDistance(r, b, d) > kDKRouteGain) {
+						if (j > i)
+							reverseRoute(r, i, j - 1);
+						else
+							reverseRoute(r, j, i - 1);
+
+						improved = YES;
+						break;
+					}
+				}
+			}
+
+			// Or-opt: move a run of up to three points starting here to between two other neighbouring points, either way round
+
+			for (length = 1; length <= 3 && i > lo && i + length - 1 < hi; ++length) {
+				NSInteger s1 = r->route[i];
+				NSInteger sL = r->route[i + length - 1];
+				NSInteger p = r->route[i - 1];
+				NSInteger nx = r->route[i + length];
+				CGFloat removeGain = routeDistance(r, p, s1) + routeDistance(r, sL, nx) - routeDistance(r, p, nx);
+				BOOL moved = NO;
+
+				if (removeGain <= kDKRouteGain || s1 == 0 || sL == 0)
+					continue;
+
+				for (e = 0; e < 2 && !moved; ++e) {
+					NSInteger end = e ? sL : s1;
+
+					for (k = 0; k < kDKRouteNeighbourCount && !moved; ++k) {
+						c = nbrs[end * kDKRouteNeighbourCount + k];
+
+						if (c == 0 || routeDistance(r, end, c) >= removeGain)
+							break;
+						if (!USABLE(c))
+							continue;
+
+						j = r->pos[c];
+						if (j >= i && j < i + length)
+							continue;
+
+						// try the edges either side of c
+
+						for (edge = j - 1; edge <= j && !moved; ++edge) {
+							if (edge < lo || edge + 1 > hi || (edge + 1 > i - 1 && edge < i + length))
+								continue;
+
+							NSInteger u = r->route[edge];
+							NSInteger v = r->route[edge + 1];
+							CGFloat duv = routeDistance(r, u, v);
+							CGFloat forward = routeDistance(r, u, s1) + routeDistance(r, sL, v) - duv;
+							CGFloat backward = routeDistance(r, u, sL) + routeDistance(r, s1, v) - duv;
+
+							if (removeGain - MIN(forward, backward) > kDKRouteGain) {
+								moveSegment(r, i, length, edge, backward < forward);
+								moved = YES;
+							}
+						}
+					}
+				}
+
+				if (moved) {
+					improved = YES;
+					break;
+				}
+			}
+		}
+
+		improvedAny |= improved;
+	} while (improved);
+
+#undef USABLE
+
+	return improvedAny;
+}
+
 #pragma mark -
 #pragma mark - from Numerical Recipes in C(2nd ed.Ch 10. p448)
 
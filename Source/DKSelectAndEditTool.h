@@ -62,6 +62,7 @@ typedef NS_ENUM(NSInteger, DKEditToolDragPhase) {
 	NSImage* mProxyDragImage; // the proxy image being dragged
 	NSRect mProxyDragDestRect; // where it is drawn
 	NSArray* mDraggedObjects; // cache of objects being dragged
+	NSArray<NSValue*>* mDragStartLocations; // where objects dragged as a group started, so the whole move is undone as one task
 	BOOL mWasInLockedObject; // YES if initial mouse down was in a locked object
 }
 
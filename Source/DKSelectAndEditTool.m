@@ -28,6 +28,7 @@
 
 @property (readwrite, copy) NSArray* draggedObjects;
 - (void)proxyDragObjectsAsGroup:(NSArray*)objects inLayer:(DKObjectDrawingLayer*)layer toPoint:(NSPoint)p event:(NSEvent*)event dragPhase:(DKEditToolDragPhase)ph;
+- (void)registerUndoForMoveOfObjects:(NSArray*)objects inLayer:(DKObjectDrawingLayer*)layer;
 - (BOOL)finishUsingToolInLayer:(DKObjectDrawingLayer*)odl delegate:(id)aDel event:(NSEvent*)event;
 
 @end
@@ -375,6 +376,33 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 								event:event
 							dragPhase:ph];
 	} else {
+		// several objects moved together are undone as one task through the layer, rather than each object recording its own moves
+
+		if (multipleObjects) {
+			switch (ph) {
+			case kDKDragMouseDown: {
+				NSMutableArray* locations = [NSMutableArray arrayWithCapacity:[objects count]];
+
+				for (DKDrawableObject* obj in objects)
+					[locations addObject:[NSValue valueWithPoint:[obj location]]];
+
+				ARCRELEASE(mDragStartLocations);
+				mDragStartLocations = ARCRETAIN(locations);
+			} break;
+
+			case kDKDragMouseDragged:
+				[[layer undoManager] disableUndoRegistration];
+				break;
+
+			case kDKDragMouseUp:
+				[self registerUndoForMoveOfObjects:objects
+										   inLayer:layer];
+				break;
+
+			default:
+				break;
+			}
+		}
 
 #if defined(USE_CF_APPLIER_FOR_DRAGGING) && USE_CF_APPLIER_FOR_DRAGGING
 		_dragInfo dragInfo;
@@ -475,6 +503,9 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 			break;
 		}
 #endif
+
+		if (multipleObjects && ph == kDKDragMouseDragged)
+			[[layer undoManager] enableUndoRegistration];
 	}
 
 	// set the undo action to say what we just did for a drag:
@@ -577,6 +608,32 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	return img;
 }
 
+/** @brief Registers a single undo task that returns objects dragged as a group to where they started
+
+ The objects' own moves aren't recorded while they're dragged as a group, so this records the whole drag at once, through the
+ layer's \c -setLocations:ofObjects:. Nothing is recorded if none of them moved.
+ @param objects the objects that were dragged
+ @param layer the layer they belong to
+ */
+- (void)registerUndoForMoveOfObjects:(NSArray*)objects inLayer:(DKObjectDrawingLayer*)layer
+{
+	NSArray* startLocations = mDragStartLocations;
+	NSUInteger i;
+
+	if ([startLocations count] == [objects count]) {
+		for (i = 0; i < [objects count]; ++i) {
+			if (!NSEqualPoints([[startLocations objectAtIndex:i] pointValue], [[objects objectAtIndex:i] location])) {
+				[[[layer undoManager] prepareWithInvocationTarget:layer] setLocations:startLocations
+																			ofObjects:objects];
+				break;
+			}
+		}
+	}
+
+	ARCRELEASE(mDragStartLocations);
+	mDragStartLocations = nil;
+}
+
 /** @brief Perform the proxy drag image for the given objects
 
  Called internally when a proxy drag is detected. This will create the drag image on mouse down,
@@ -643,14 +700,25 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 		dx = p.x - anchor.x;
 		dy = p.y - anchor.y;
 
+		NSMutableArray* locations = [NSMutableArray arrayWithCapacity:[objects count]];
+
 		for (DKDrawableObject* obj in objects) {
-			[obj offsetLocationByX:dx
-							   byY:dy];
+			NSPoint loc = [obj location];
 
-			[[layer undoManager] disableUndoRegistration];
-			[obj setVisible:YES];
-			[[layer undoManager] enableUndoRegistration];
+			loc.x += dx;
+			loc.y += dy;
+			[locations addObject:[NSValue valueWithPoint:loc]];
 		}
+
+		[layer setLocations:locations
+				  ofObjects:objects];
+
+		[[layer undoManager] disableUndoRegistration];
+
+		for (DKDrawableObject* obj in objects)
+			[obj setVisible:YES];
+
+		[[layer undoManager] enableUndoRegistration];
 		mInProxyDrag = NO;
 	} break;
 
@@ -1234,6 +1302,7 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	[mMarqueeStyle release];
 	[mProxyDragImage release];
 	[mDraggedObjects release];
+	[mDragStartLocations release];
 	[super dealloc];
 }
 #endif
@@ -48,8 +48,8 @@ typedef NS_ENUM(NSInteger, DKCreateGroupObjectType) {
 	NSArray<__kindof DKDrawableObject*>* m_objects; // objects in the group
 	NSRect mBounds; // overall bounding rect of the group
 	BOOL m_transformVisually; // if YES, group transform is visual only (like SVG) otherwise it's genuine
-	CGLayerRef mContentCache; // used to cache content
-	NSPDFImageRep* mPDFContentCache; // used to cache content at higher quality
+	id mContentCache; // the cached rendering of the content, shared with other groups whose content is the same
+	NSString* mContentKey; // the key the content cache is shared under, kept until the content changes
 	DKGroupCacheOption mCacheOption; // caching options
 	BOOL mIsWritingToCache; // YES when building cache - modifies transforms
 	BOOL mClipContentToPath; // YES to clip group content to the group's path
@@ -193,6 +193,19 @@ typedef NS_ENUM(NSInteger, DKCreateGroupObjectType) {
 
 // caching:
 
+/** @brief The cache option given to new groups. The default is \c kDKGroupCacheNone.
+ */
+@property (class) DKGroupCacheOption defaultCacheOptions;
+
+/** @brief How the group caches its content for drawing to the screen.
+
+ A cached group renders its content once, in its own coordinates, then draws the result wherever the group is, so moving it
+ doesn't render the content again, nor does resizing or rotating it if it transforms visually. A group that doesn't transform
+ visually draws its objects directly once resized or rotated, since their strokes aren't scaled with their paths. With \c kDKGroupCacheUsingCGLayer a bitmap is made for each zoom
+ level the group is drawn at; with \c kDKGroupCacheUsingPDF the content is kept as PDF, which stays sharp at any scale. With
+ both, the bitmap is drawn while the drawing has its "low quality" hint set and the PDF otherwise. Groups whose content is
+ identical, such as copies of one group, share a single cache. A change to any object in the group discards its cache.
+ */
 @property (nonatomic) DKGroupCacheOption cacheOptions;
 
 // ungrouping:
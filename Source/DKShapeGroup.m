@@ -9,22 +9,73 @@
 #import "DKDrawablePath.h"
 #import "DKDrawing.h"
 #import "DKGeometryUtilities.h"
+#import "DKImageDataManager.h"
 #import "DKObjectDrawingLayer.h"
 #import "DKSelectionPDFView.h"
 #import "DKStyle.h"
 #import "LogEvent.h"
 #import "NSBezierPath+Geometry.h"
 
+/** bitmaps are made for zoom levels that are powers of two within this range */
+static const NSInteger kDKGroupCacheMinLevel = -8;
+static const NSInteger kDKGroupCacheMaxLevel = 8;
+
+/** content that would need a bitmap wider or taller than this many pixels is drawn directly */
+static const CGFloat kDKGroupCacheMaxPixels = 4096.0;
+
+/** @brief The rendered content of a group, shared by every group whose content is the same.
+
+ The content is rendered in the group's own coordinates, so it doesn't depend on the group's position, size or angle. A bitmap is
+ kept for each zoom level the content is drawn at, and a PDF if the group caches using PDF.
+ */
+@interface DKGroupContentCache : NSObject {
+@private
+	NSRect mContentRect;
+	NSCache* mBitmaps; // CGImages, keyed by zoom level
+	NSPDFImageRep* mPDF;
+}
+
+- (instancetype)initWithContentRect:(NSRect)rect;
+
+@property (readonly) NSRect contentRect;
+@property (strong, nullable) NSPDFImageRep* pdf;
+
+- (nullable id)bitmapForLevel:(NSInteger)level;
+- (void)setBitmap:(id)bitmap forLevel:(NSInteger)level;
+
+@end
+
+static DKGroupCacheOption sDefaultGroupCacheOption = kDKGroupCacheNone;
+
+static NSCache* sharedContentCaches(void);
+static NSInteger groupCacheLevelForScale(CGFloat scale);
+
 @interface DKShapeGroup ()
 - (void)invalidateCache;
+- (void)invalidateContentKey;
 - (void)updateCache;
 - (void)drawUntransformedContent;
+- (DKGroupContentCache*)sharedContentCache;
+- (BOOL)drawCachedContent;
+- (BOOL)contentMatchesCache;
+- (nullable CGImageRef)createContentBitmapInRect:(NSRect)rect level:(NSInteger)level CF_RETURNS_RETAINED;
+- (nullable NSPDFImageRep*)contentPDFInRect:(NSRect)rect;
 
 @end
 
 @implementation DKShapeGroup
 #pragma mark As a DKShapeGroup
 
++ (void)setDefaultCacheOptions:(DKGroupCacheOption)option
+{
+	sDefaultGroupCacheOption = option;
+}
+
++ (DKGroupCacheOption)defaultCacheOptions
+{
+	return sDefaultGroupCacheOption;
+}
+
 /** @brief Creates a group of shapes or paths from a list of bezier paths
 
  This constructs a group from a list of bezier paths by wrapping a drawable around each path then
@@ -120,8 +171,7 @@
 
 		NSBezierPath* path = [NSBezierPath bezierPathWithRect:[[self class] unitRectAtOrigin]];
 		[self setPath:path];
-
-		//[self setCacheOptions:kDKGroupCacheUsingCGLayer];
+		[self setCacheOptions:[[self class] defaultCacheOptions]];
 	}
 	return self;
 }
@@ -183,6 +233,7 @@
 											object:m_objects];
 
 		m_objects = [objects copy];
+		[self invalidateContentKey];
 
 		[m_objects makeObjectsPerformSelector:@selector(groupWillAddObject:)
 								   withObject:self];
@@ -311,7 +362,11 @@
 
 - (void)drawGroupContent
 {
-	if (m_transformVisually) {
+	// when writing to the cache the content is drawn in the group's own coordinates, untransformed
+
+	BOOL transform = m_transformVisually && !mIsWritingToCache;
+
+	if (transform) {
 		[NSGraphicsContext saveGraphicsState];
 		NSAffineTransform* tfm = [self contentTransform];
 		[tfm concat];
@@ -325,7 +380,7 @@
 		}
 	}
 
-	if (m_transformVisually)
+	if (transform)
 		[NSGraphicsContext restoreGraphicsState];
 }
 
@@ -389,12 +444,228 @@
 
 - (void)updateCache
 {
-	// currently no-op
+	// the cache is rendered at the scale it's drawn at, so this only finds or makes the shared cache, ready to be drawn into
+
+	if (mCacheOption != kDKGroupCacheNone)
+		[self sharedContentCache];
 }
 
 - (void)invalidateCache
 {
-	// currently no-op
+	// other groups sharing the cache keep it - their content hasn't changed
+
+	mContentCache = nil;
+}
+
+/** @brief Discards the cache and the key it was found under, because the group's content has changed
+ */
+- (void)invalidateContentKey
+{
+	mContentKey = nil;
+	[self invalidateCache];
+}
+
+/** @brief Returns the cache for the group's content, shared with every other group whose content is the same
+
+ Groups are matched by a hash of their archived objects, so identical content is recognised even if it was copied through the
+ pasteboard or saved and reopened. Archiving the objects is costly, so the key is kept until the content changes.
+ @return the content cache
+ */
+- (DKGroupContentCache*)sharedContentCache
+{
+	if (mContentCache == nil) {
+		if (mContentKey == nil) {
+			NSData* archive = [NSKeyedArchiver archivedDataWithRootObject:[self groupObjects]];
+			mContentKey = [NSString stringWithFormat:@"%@/%@", [archive contentHashString], NSStringFromSize(mBounds.size)];
+		}
+
+		NSString* key = mContentKey;
+		NSCache* caches = sharedContentCaches();
+
+		mContentCache = [caches objectForKey:key];
+
+		if (mContentCache == nil) {
+			// the content is laid out around the group's origin at its original size, plus room for the objects' strokes and so on
+
+			NSSize extra = [self extraSpaceNeeded];
+			NSRect cr = NSMakeRect(-0.5 * NSWidth(mBounds), -0.5 * NSHeight(mBounds), NSWidth(mBounds), NSHeight(mBounds));
+
+			mContentCache = [[DKGroupContentCache alloc] initWithContentRect:NSInsetRect(cr, -(extra.width + 1), -(extra.height + 1))];
+			[caches setObject:mContentCache
+					   forKey:key];
+		}
+	}
+
+	return mContentCache;
+}
+
+/** @brief Draws the group's content from its cache, rendering it first if necessary
+
+ The cache is only used for drawing to the screen, and not when hit testing or when the group is itself being drawn into the
+ cache of a group that contains it.
+ @return YES if the content was drawn, NO if it should be drawn directly
+ */
+- (BOOL)drawCachedContent
+{
+	if (mCacheOption == kDKGroupCacheNone || [self isBeingHitTested] || ![NSGraphicsContext currentContextDrawingToScreen] || ![self contentMatchesCache])
+		return NO;
+
+	for (id container = [self container]; [container isKindOfClass:[DKShapeGroup class]]; container = [container container]) {
+		if (((DKShapeGroup*)container)->mIsWritingToCache || ![container contentMatchesCache])
+			return NO;
+	}
+
+	DKGroupContentCache* cache = [self sharedContentCache];
+	NSRect cr = [cache contentRect];
+
+	// the cache is in the group's own coordinates, which the content transform and then any containing group's transform map to the drawing
+
+	NSAffineTransform* tfm = [self contentTransform];
+	[tfm appendTransform:[self containerTransform]];
+
+	BOOL useBitmap = (mCacheOption & kDKGroupCacheUsingCGLayer) != 0 && ((mCacheOption & kDKGroupCacheUsingPDF) == 0 || [[self drawing] lowRenderingQuality]);
+	BOOL drawn = NO;
+
+	[NSGraphicsContext saveGraphicsState];
+	[tfm concat];
+
+	if (useBitmap) {
+		// the bitmap is made for the power of two zoom level at or above the number of device pixels per unit, so it's never enlarged
+
+		CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+		CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform(context);
+		NSInteger level = groupCacheLevelForScale(MAX(hypot(dt.a, dt.b), hypot(dt.c, dt.d)));
+		id bitmap = [cache bitmapForLevel:level];
+
+		if (bitmap == nil) {
+			bitmap = CFBridgingRelease([self createContentBitmapInRect:cr
+																 level:level]);
+			if (bitmap)
+				[cache setBitmap:bitmap
+						forLevel:level];
+		}
+
+		if (bitmap) {
+			CGContextDrawImage(context, NSRectToCGRect(cr), (__bridge CGImageRef)bitmap);
+			drawn = YES;
+		}
+	} else {
+		NSPDFImageRep* pdf = [cache pdf];
+
+		if (pdf == nil) {
+			pdf = [self contentPDFInRect:cr];
+			[cache setPdf:pdf];
+		}
+
+		drawn = [pdf drawInRect:cr
+					   fromRect:NSZeroRect
+					  operation:NSCompositeSourceOver
+					   fraction:1.0
+				 respectFlipped:YES
+						  hints:nil];
+	}
+
+	[NSGraphicsContext restoreGraphicsState];
+
+	return drawn;
+}
+
+/** @brief Whether drawing the cached content through the group's transform looks the same as drawing the objects themselves
+
+ The cache holds the content at the group's original size and angle. A group that transforms visually scales and rotates the content
+ as a picture, so the cache can be transformed in the same way. Otherwise the objects' paths are transformed but their strokes and
+ effects aren't, so the cache only matches while the group is at its original size and angle and has merely been moved.
+ @return YES if the cache can be drawn in place of the objects
+ */
+- (BOOL)contentMatchesCache
+{
+	return [self transformsVisually] || ([self angle] == 0.0 && NSEqualSizes([self size], mBounds.size));
+}
+
+/** @brief Renders the group's content into a bitmap
+
+ The bitmap is rendered unflipped, which the flipped view reverses when it's drawn, so the two agree on where everything goes.
+ @param rect the area of the group's own coordinates to render
+ @param level the zoom level; the bitmap has 2^level pixels per unit
+ @return a new image, or NULL if the bitmap would be too big
+ */
+- (CGImageRef)createContentBitmapInRect:(NSRect)rect level:(NSInteger)level
+{
+	CGFloat scale = ldexp(1.0, (int)level);
+	CGFloat width = ceil(NSWidth(rect) * scale);
+	CGFloat height = ceil(NSHeight(rect) * scale);
+
+	if (width < 1 || height < 1 || width > kDKGroupCacheMaxPixels || height > kDKGroupCacheMaxPixels)
+		return NULL;
+
+	CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+	CGContextRef bm = CGBitmapContextCreate(NULL, (size_t)width, (size_t)height, 8, 0, space, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+
+	CGColorSpaceRelease(space);
+
+	if (bm == NULL)
+		return NULL;
+
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:bm
+																					flipped:YES]];
+
+	NSAffineTransform* tfm = [NSAffineTransform transform];
+	[tfm scaleBy:scale];
+	[tfm translateXBy:-NSMinX(rect)
+				  yBy:-NSMinY(rect)];
+	[tfm concat];
+
+	[self drawUntransformedContent];
+	[NSGraphicsContext restoreGraphicsState];
+
+	CGImageRef image = CGBitmapContextCreateImage(bm);
+	CGContextRelease(bm);
+
+	return image;
+}
+
+/** @brief Renders the group's content as PDF
+
+ The PDF is rendered upright, as PDF is drawn the right way up in a flipped view.
+ @param rect the area of the group's own coordinates to render
+ @return the PDF, or nil if it couldn't be made
+ */
+- (NSPDFImageRep*)contentPDFInRect:(NSRect)rect
+{
+	NSMutableData* pdfData = [NSMutableData data];
+	CGDataConsumerRef consumer = CGDataConsumerCreateWithCFData((__bridge CFMutableDataRef)pdfData);
+	CGRect mediaBox = CGRectMake(0, 0, NSWidth(rect), NSHeight(rect));
+	CGContextRef pdfContext = CGPDFContextCreate(consumer, &mediaBox, NULL);
+
+	CGDataConsumerRelease(consumer);
+
+	if (pdfContext == NULL)
+		return nil;
+
+	CGPDFContextBeginPage(pdfContext, NULL);
+
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:pdfContext
+																					flipped:YES]];
+
+	NSAffineTransform* tfm = [NSAffineTransform transform];
+	[tfm translateXBy:0
+				  yBy:NSHeight(rect)];
+	[tfm scaleXBy:1
+			  yBy:-1];
+	[tfm translateXBy:-NSMinX(rect)
+				  yBy:-NSMinY(rect)];
+	[tfm concat];
+
+	[self drawUntransformedContent];
+	[NSGraphicsContext restoreGraphicsState];
+
+	CGPDFContextEndPage(pdfContext);
+	CGPDFContextClose(pdfContext);
+	CGContextRelease(pdfContext);
+
+	return [NSPDFImageRep imageRepWithData:pdfData];
 }
 
 - (void)drawUntransformedContent
@@ -596,11 +867,18 @@
 	if ([self clipContentToPath])
 		[[self renderingPath] addClip];
 
-	[self drawGroupContent];
+	if (![self drawCachedContent])
+		[self drawGroupContent];
 
 	RESTORE_GRAPHICS_CONTEXT
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	// the group's content is its children, not its path
+	return NO;
+}
+
 /** @brief Draws the objects within the group but using the given style.
 
  Depending on how the group's transforms are set to work, this either sets up the graphics context
@@ -795,7 +1073,7 @@
 	if (self != nil) {
 		NSBezierPath* path = [NSBezierPath bezierPathWithRect:[[self class] unitRectAtOrigin]];
 		[self setPath:path];
-		//[self setCacheOptions:kDKGroupCacheUsingCGLayer];
+		[self setCacheOptions:[[self class] defaultCacheOptions]];
 	}
 	return self;
 }
@@ -810,6 +1088,25 @@
 #pragma mark -
 #pragma mark As part of DKDrawableContainer Protocol
 
+/** @brief Discards the cached content when any object in the group changes, then passes the change on
+
+ @param obj the object that changed, which may be within a group within this one
+ @param rect the area needing redrawing
+ */
+- (void)drawable:(DKDrawableObject*)obj needsDisplayInRect:(NSRect)rect
+{
+	[self invalidateContentKey];
+
+	id<DKDrawableContainer> container = [self container];
+
+	if ([container respondsToSelector:_cmd])
+		[container drawable:obj
+			needsDisplayInRect:rect];
+	else
+		[[self layer] drawable:obj
+			needsDisplayInRect:rect];
+}
+
 /** @brief Returns a transform which is the accumulation of all the parent objects above this one.
 
  Drawables will request and apply this transform when rendering. Either the identity matrix is
@@ -886,6 +1183,7 @@
 		mBounds = [coder decodeRectForKey:@"group_bounds"];
 
 		mClipContentToPath = [coder decodeBoolForKey:@"DKShapeGroup_clipContent"];
+		mCacheOption = [[self class] defaultCacheOptions];
 	}
 
 	return self;
@@ -912,8 +1210,11 @@
 	copy->mBounds = mBounds;
 	copy->mClipContentToPath = mClipContentToPath;
 
+	// the copy looks the same, so it shares the cache
+
 	[copy setCacheOptions:[self cacheOptions]];
-	[copy updateCache];
+	copy->mContentCache = mContentCache;
+	copy->mContentKey = mContentKey;
 
 	return copy;
 }
@@ -939,3 +1240,67 @@
 }
 
 @end
+
+#pragma mark -
+
+@implementation DKGroupContentCache
+
+- (instancetype)initWithContentRect:(NSRect)rect
+{
+	self = [super init];
+	if (self) {
+		mContentRect = rect;
+		mBitmaps = [[NSCache alloc] init];
+		[mBitmaps setCountLimit:4];
+	}
+
+	return self;
+}
+
+@synthesize contentRect = mContentRect;
+@synthesize pdf = mPDF;
+
+- (id)bitmapForLevel:(NSInteger)level
+{
+	return [mBitmaps objectForKey:@(level)];
+}
+
+- (void)setBitmap:(id)bitmap forLevel:(NSInteger)level
+{
+	CGImageRef image = (__bridge CGImageRef)bitmap;
+
+	[mBitmaps setObject:bitmap
+				 forKey:@(level)
+				   cost:CGImageGetBytesPerRow(image) * CGImageGetHeight(image)];
+}
+
+@end
+
+/** @brief Returns the content caches of all groups, keyed by a hash of their content
+
+ Groups keep their own caches, so a cache evicted from here lasts as long as a group uses it; it just isn't found by new groups.
+ */
+static NSCache* sharedContentCaches(void)
+{
+	static NSCache* sCaches = nil;
+	static dispatch_once_t onceToken;
+
+	dispatch_once(&onceToken, ^{
+		sCaches = [[NSCache alloc] init];
+		[sCaches setCountLimit:512];
+	});
+
+	return sCaches;
+}
+
+/** @brief Returns the power of two zoom level that bitmaps are made for, given the device pixels per unit
+
+ Rounding up means a bitmap is only ever reduced to draw it, never enlarged.
+ */
+static NSInteger groupCacheLevelForScale(CGFloat scale)
+{
+	if (scale <= 0)
+		return kDKGroupCacheMinLevel;
+
+	return LIMIT((NSInteger)ceil(log2(scale)), kDKGroupCacheMinLevel, kDKGroupCacheMaxLevel);
+}
@@ -178,7 +178,7 @@
 + (NSArray*)observableKeyPaths
 {
 	return [[super observableKeyPaths] arrayByAddingObjectsFromArray:@[@"colour", @"width", @"dash",
-		@"shadow", @"lineCapStyle", @"lineJoinStyle",
+		@"shadow", @"lineCapStyle", @"lineJoinStyle", @"miterLimit",
 		@"lateralOffset", @"trimLength"]];
 }
 
@@ -197,6 +197,8 @@
 			 forKeyPath:@"lineCapStyle"];
 	[self setActionName:@"#kind# Line Join Style"
 			 forKeyPath:@"lineJoinStyle"];
+	[self setActionName:@"#kind# Mitre Limit"
+			 forKeyPath:@"miterLimit"];
 	[self setActionName:@"#kind# Stroke Offset"
 			 forKeyPath:@"lateralOffset"];
 	[self setActionName:@"#kind# Trim Length"
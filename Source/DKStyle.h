@@ -40,6 +40,7 @@ typedef NS_ENUM(NSInteger, DKDerivedStyleOptions) {
 	NSTimeInterval m_lastModTime; // timestamp to determine when styles have been updated
 	NSUInteger m_clientCount; // keeps count of the clients using the style
 	NSMutableDictionary* mSwatchCache; // cache of swatches at various sizes previously requested
+	id mDisplayList; // the renderers compiled for drawing, NSNull if they can't be, nil until next drawn
 }
 
 // basic standard styles:
@@ -153,6 +154,14 @@ typedef NS_ENUM(NSInteger, DKDerivedStyleOptions) {
  */
 @property (class) BOOL shouldAntialias;
 
+/** @brief Set whether styles draw by replaying a compiled display list of their renderers.
+
+ Default is <code>YES</code>. A style made only of plain fills and strokes compiles them to a \c DKStyleDisplayList the first time it's
+ drawn after a change, and draws objects by replaying it rather than by sending each renderer \c -render:. Other styles are unaffected.
+ Set to \c NO to always render through the renderers.
+ */
+@property (class) BOOL usesDisplayLists;
+
 /** @brief Set whether the style should substitute a simple placeholder when a style is complex and slow to
  render.
 
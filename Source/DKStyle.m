@@ -14,6 +14,7 @@
 #import "DKHatching.h"
 #import "DKImageAdornment.h"
 #import "DKRoughStroke.h"
+#import "DKStyleDisplayList.h"
 #import "DKStyleRegistry.h"
 #import "DKTextAdornment.h"
 #import "DKUndoManager.h"
@@ -53,11 +54,13 @@ static BOOL sStylesShared = YES;
 static NSMutableDictionary* sPasteboardRegistry = nil;
 static BOOL sShouldDrawShadows = YES;
 static BOOL sAntialias = YES;
+static BOOL sUsesDisplayLists = YES;
 static BOOL sSubstitute = NO;
 
 @interface DKStyle ()
 
 - (NSSize)extraSpaceNeededIgnoringMitreLimit;
+- (nullable DKStyleDisplayList*)displayList;
 
 @end
 
@@ -346,6 +349,26 @@ static BOOL sSubstitute = NO;
 	return sAntialias;
 }
 
+/** @brief Set whether styles draw by replaying a compiled display list of their renderers
+
+ Default is YES. Styles that can't be compiled always render through their renderers.
+ @param useLists YES to replay display lists, NO to render through the renderers
+ */
++ (void)setUsesDisplayLists:(BOOL)useLists
+{
+	sUsesDisplayLists = useLists;
+}
+
+/** @brief Set whether styles draw by replaying a compiled display list of their renderers
+
+ Default is YES.
+ @return YES to replay display lists, NO to render through the renderers
+ */
++ (BOOL)usesDisplayLists
+{
+	return sUsesDisplayLists;
+}
+
 /** @brief Set whether the style should substitute a simple placeholder when a style is complex and slow to
  render.
 
@@ -395,6 +418,13 @@ static BOOL sSubstitute = NO;
 
 	[mSwatchCache removeAllObjects];
 
+	// the display list is recompiled when next drawn
+
+	@synchronized(self)
+	{
+		mDisplayList = nil;
+	}
+
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleDidChangeNotification
 														object:self];
 }
@@ -1370,7 +1400,10 @@ static BOOL sSubstitute = NO;
 			m_renderClientRef = object;
 
 			@try {
-				[super render:object];
+				DKStyleDisplayList* list = [self displayList];
+
+				if (list == nil || ![list replayForObject:object])
+					[super render:object];
 			}
 			@catch (NSException* exception) {
 				// exceptions thrown during drawing can cause a lot of problems that multiply a minor bug into a major one.
@@ -1385,6 +1418,29 @@ static BOOL sSubstitute = NO;
 	}
 }
 
+/** @brief Returns the style's renderers compiled to a display list, compiling them if necessary
+
+ Styles that can't be compiled are remembered, so they're only examined once after each change.
+ @return the display list, or nil if the style should render through its renderers
+ */
+- (DKStyleDisplayList*)displayList
+{
+	if (![[self class] usesDisplayLists])
+		return nil;
+
+	@synchronized(self)
+	{
+		if (mDisplayList == nil) {
+			mDisplayList = [DKStyleDisplayList displayListWithRenderGroup:self];
+
+			if (mDisplayList == nil)
+				mDisplayList = [NSNull null];
+		}
+
+		return (mDisplayList != [NSNull null]) ? mDisplayList : nil;
+	}
+}
+
 /** @brief Sets the style's name undoably
 
  Does not inform the client(s) as this is not typically a visual change, but does send a notification */
@@ -0,0 +1,56 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKRasterizerProtocol.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class DKRastGroup;
+
+/** @brief A style's tree of renderers, compiled to a flat list of drawing commands.
+
+ A style's tree of renderers, compiled to a flat list of drawing commands. Compiling walks the tree once, leaving out disabled renderers
+ and resolving each renderer's colours, widths and line attributes up front, so that drawing an object replays the commands straight into
+ the current Quartz context against the object's cached path, with no messages to the renderers and no key-value lookups.
+
+ Only plain fills and strokes, and the groups containing them, can be compiled: fills with a solid colour, a gradient or both, and an
+ optional shadow; strokes with a solid colour and an optional dash and shadow, but no trim or lateral offset. Gradients, dashes and
+ shadows are drawn from the objects themselves, since they can change without the style being told. A tree with anything else in it has no display
+ list, and the style renders it as usual.
+
+ A display list doesn't depend on the object drawn, so a style compiles one for all its clients. It never changes once compiled - the
+ style discards it when it's told that one of its renderers has changed - so it may be replayed on any thread.
+*/
+@interface DKStyleDisplayList : NSObject {
+@private
+	void* mCommands; // the commands, in order
+	NSUInteger mCount;
+	NSArray* mObjects; // shadows, gradients and dashes, referred to by index from the commands
+}
+
+/** @brief Compiles a tree of renderers.
+ @param group the root of the tree, usually a style
+ @return the display list, or nil if the tree contains renderers that can't be compiled
+ */
++ (nullable DKStyleDisplayList*)displayListWithRenderGroup:(DKRastGroup*)group;
+
+/** @brief The number of commands in the list.
+ */
+@property (readonly) NSUInteger countOfCommands;
+
+/** @brief Draws an object by replaying the commands into the current context.
+
+ The object's path is taken from its geometry cache entry (see \c -[DKDrawableObject geometryCacheEntry]).
+ @param object the object to draw
+ @return YES if the object was drawn, NO if it has no cached path, in which case nothing was drawn and the caller should render it
+ the usual way
+ */
+- (BOOL)replayForObject:(id<DKRenderable>)object;
+
+@end
+
+NS_ASSUME_NONNULL_END
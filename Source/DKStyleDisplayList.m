@@ -0,0 +1,418 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKStyleDisplayList.h"
+#import "DKDrawKitMacros.h"
+#import "DKFill.h"
+#import "DKGeometryCache.h"
+#import "DKGradient.h"
+#import "DKRastGroup.h"
+#import "DKStroke.h"
+#import "DKStrokeDash.h"
+#import "DKStyle.h"
+#import "NSBezierPath+Geometry.h"
+#import "NSColor+DKAdditions.h"
+#import "NSShadow+Scaling.h"
+
+/// the largest dash pattern DKStrokeDash holds
+#define kDKDisplayListMaxDashCount 8
+
+typedef NS_ENUM(NSInteger, DKDisplayListOp) {
+	kDKDisplayListSave = 0, // save the graphics state
+	kDKDisplayListBeginFill, // save the graphics state, or skip \c skip commands if the path has no area
+	kDKDisplayListRestore, // restore the graphics state
+	kDKDisplayListClipInside, // clip to the path
+	kDKDisplayListClipOutside, // clip to everything but the path
+	kDKDisplayListShadow, // set the shadow \c object, approximating it for a fill or a stroke of \c width in low quality
+	kDKDisplayListFill, // fill the path with \c colour
+	kDKDisplayListGradient, // fill the path with the gradient \c object, turned by the object's angle if \c tracksAngle
+	kDKDisplayListStroke // stroke the path with \c colour and the line attributes, dashed with \c object if there is one
+};
+
+typedef struct {
+	DKDisplayListOp op;
+	CGColorRef colour; // fill, stroke or shadow colour, device RGB
+	NSUInteger colourObject; // index into mObjects of the shadow colour \c colour was made from
+	CGFloat width; // line width
+	CGFloat miterLimit;
+	CGLineCap cap;
+	CGLineJoin join;
+	NSUInteger object; // index into mObjects, or NSNotFound
+	NSUInteger skip; // commands to skip when a fill has nothing to fill
+	BOOL isStroke; // the shadow is cast by a stroke
+	BOOL tracksAngle;
+} DKDisplayListCommand;
+
+static CGColorRef newCompilableQuartzColor(NSColor* colour);
+
+@interface DKStyleDisplayList ()
+
+- (BOOL)compileRenderer:(DKRasterizer*)renderer;
+- (BOOL)compileFill:(DKFill*)fill;
+- (BOOL)compileStroke:(DKStroke*)stroke;
+- (BOOL)addShadow:(NSShadow*)shadow isStroke:(BOOL)isStroke width:(CGFloat)width;
+- (DKDisplayListCommand*)addCommand:(DKDisplayListOp)op;
+- (NSUInteger)indexOfObject:(id)object;
+
+@end
+
+#pragma mark -
+
+@implementation DKStyleDisplayList
+
++ (DKStyleDisplayList*)displayListWithRenderGroup:(DKRastGroup*)group
+{
+	DKStyleDisplayList* list = [[self alloc] init];
+
+	if (![list compileRenderer:group])
+		return nil;
+
+	return list;
+}
+
+- (NSUInteger)countOfCommands
+{
+	return mCount;
+}
+
+- (BOOL)replayForObject:(id<DKRenderable>)object
+{
+	if (![object respondsToSelector:@selector(geometryCacheEntry)])
+		return NO;
+
+	DKGeometryCacheEntry* entry = [object geometryCacheEntry];
+	NSBezierPath* path = [entry path];
+	CGPathRef quartzPath = [entry quartzPath];
+
+	if (path == nil || quartzPath == NULL)
+		return NO;
+
+	CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+	CGAffineTransform ctm = CGContextGetCTM(context);
+	CGSize unit = CGSizeApplyAffineTransform(CGSizeMake(1, 1), ctm);
+	NSRect bounds = [entry bounds];
+	BOOL hasArea = ![path isEmpty] && bounds.size.width > 0.0 && bounds.size.height > 0.0;
+	BOOL evenOdd = ([path windingRule] == NSEvenOddWindingRule);
+	BOOL lowQuality = [object useLowQualityDrawing];
+	BOOL drawShadows = [DKStyle willDrawShadows];
+
+	const DKDisplayListCommand* commands = mCommands;
+	NSUInteger i;
+
+	CGContextSaveGState(context);
+	CGContextSetFlatness(context, [path flatness]);
+
+	for (i = 0; i < mCount; ++i) {
+		const DKDisplayListCommand* cmd = &commands[i];
+
+		switch (cmd->op) {
+		case kDKDisplayListSave:
+			CGContextSaveGState(context);
+			break;
+
+		case kDKDisplayListBeginFill:
+			if (hasArea)
+				CGContextSaveGState(context);
+			else
+				i += cmd->skip;
+			break;
+
+		case kDKDisplayListRestore:
+			CGContextRestoreGState(context);
+			break;
+
+		case kDKDisplayListClipInside:
+			CGContextAddPath(context, quartzPath);
+			if (evenOdd)
+				CGContextEOClip(context);
+			else
+				CGContextClip(context);
+			break;
+
+		case kDKDisplayListClipOutside:
+			// as -addInverseClip: the clip bounds with the path knocked out of them
+
+			CGContextAddRect(context, CGContextGetClipBoundingBox(context));
+			CGContextAddPath(context, quartzPath);
+			CGContextEOClip(context);
+			break;
+
+		case kDKDisplayListShadow:
+			if (!drawShadows)
+				break;
+
+			if (!lowQuality) {
+				// the shadow is read when drawn, as it can be edited in place without the style being told. Its colour is only
+				// converted again if it's been replaced, and a shadow whose new colour can't be converted isn't drawn
+
+				NSShadow* shadow = mObjects[cmd->object];
+				NSColor* shadowColour = [shadow shadowColor];
+				CGColorRef colour = (shadowColour == mObjects[cmd->colourObject]) ? CGColorRetain(cmd->colour) : newCompilableQuartzColor(shadowColour);
+
+				if (colour) {
+					CGSize offset = CGSizeApplyAffineTransform(NSSizeToCGSize([shadow shadowOffset]), ctm);
+
+					CGContextSetShadowWithColor(context, offset, [shadow shadowBlurRadius] * unit.width, colour);
+					CGColorRelease(colour);
+				}
+			} else
+				[mObjects[cmd->object] drawApproximateShadowWithPath:[path copy]
+														   operation:cmd->isStroke ? kDKShadowDrawStroke : kDKShadowDrawFill
+														 strokeWidth:cmd->width];
+			break;
+
+		case kDKDisplayListFill:
+			CGContextSetFillColorWithColor(context, cmd->colour);
+			CGContextAddPath(context, quartzPath);
+			if (evenOdd)
+				CGContextEOFillPath(context);
+			else
+				CGContextFillPath(context);
+			break;
+
+		case kDKDisplayListGradient: {
+			DKGradient* gradient = mObjects[cmd->object];
+			CGFloat angle = 0.0;
+
+			if (cmd->tracksAngle) {
+				angle = [gradient angle];
+				[gradient setAngleWithoutNotifying:angle + [object angle]];
+			}
+
+			[gradient fillPath:[path copy]];
+
+			if (cmd->tracksAngle)
+				[gradient setAngleWithoutNotifying:angle];
+		} break;
+
+		case kDKDisplayListStroke:
+			CGContextSetStrokeColorWithColor(context, cmd->colour);
+			CGContextSetLineWidth(context, cmd->width);
+			CGContextSetLineCap(context, cmd->cap);
+			CGContextSetLineJoin(context, cmd->join);
+			CGContextSetMiterLimit(context, cmd->miterLimit);
+
+			if (cmd->object != NSNotFound) {
+				// the dash is read when drawn, as its pattern can be edited in place without the style being told
+
+				DKStrokeDash* dash = mObjects[cmd->object];
+				CGFloat pattern[kDKDisplayListMaxDashCount];
+				NSInteger n, count = 0;
+
+				[dash getDashPattern:pattern
+							   count:&count];
+
+				CGFloat scale = [dash scalesToLineWidth] ? cmd->width : 1.0;
+				CGFloat phase = LIMIT([dash phase], 0, [dash length]);
+
+				for (n = 0; n < count; ++n)
+					pattern[n] *= scale;
+
+				CGContextSetLineDash(context, -phase * scale, pattern, count);
+			} else
+				CGContextSetLineDash(context, 0, NULL, 0);
+
+			CGContextAddPath(context, quartzPath);
+			CGContextStrokePath(context);
+			break;
+		}
+	}
+
+	CGContextRestoreGState(context);
+
+	return YES;
+}
+
+#pragma mark -
+
+- (BOOL)compileRenderer:(DKRasterizer*)renderer
+{
+	// subclasses draw in ways the list can't, so only these exact classes are compiled
+
+	if (![renderer enabled])
+		return YES;
+
+	Class cl = [renderer class];
+
+	if (cl == [DKFill class])
+		return [self compileFill:(DKFill*)renderer];
+
+	if (cl == [DKStroke class])
+		return [self compileStroke:(DKStroke*)renderer];
+
+	if (cl == [DKRastGroup class] || cl == [DKStyle class]) {
+		[self addCommand:kDKDisplayListSave];
+
+		for (DKRasterizer* rend in [(DKRastGroup*)renderer renderList]) {
+			if (![self compileRenderer:rend])
+				return NO;
+		}
+
+		[self addCommand:kDKDisplayListRestore];
+		return YES;
+	}
+
+	return NO;
+}
+
+- (BOOL)compileFill:(DKFill*)fill
+{
+	NSUInteger begin = mCount;
+
+	[self addCommand:kDKDisplayListBeginFill];
+
+	if ([fill shadow] && ![self addShadow:[fill shadow]
+								 isStroke:NO
+									width:0])
+		return NO;
+
+	// a nil colour fills with clear, which draws nothing at all, not even a shadow
+
+	if ([fill colour]) {
+		CGColorRef colour = newCompilableQuartzColor([fill colour]);
+
+		if (colour == NULL)
+			return NO;
+
+		[self addCommand:kDKDisplayListFill]->colour = colour;
+	}
+
+	if ([fill gradient]) {
+		DKDisplayListCommand* cmd = [self addCommand:kDKDisplayListGradient];
+
+		cmd->object = [self indexOfObject:[fill gradient]];
+		cmd->tracksAngle = [fill tracksObjectAngle];
+	}
+
+	[self addCommand:kDKDisplayListRestore];
+
+	((DKDisplayListCommand*)mCommands)[begin].skip = mCount - begin - 1;
+
+	return YES;
+}
+
+- (BOOL)compileStroke:(DKStroke*)stroke
+{
+	if ([stroke trimLength] > 0.0 || [stroke lateralOffset] != 0.0)
+		return NO;
+
+	CGColorRef colour = newCompilableQuartzColor([stroke colour]);
+
+	if (colour == NULL)
+		return NO;
+
+	[self addCommand:kDKDisplayListSave];
+
+	if ([stroke shadow] && ![self addShadow:[stroke shadow]
+								   isStroke:YES
+									  width:[stroke width]]) {
+		CGColorRelease(colour);
+		return NO;
+	}
+
+	switch ([stroke clipping]) {
+	default:
+	case kDKClippingNone:
+		break;
+
+	case kDKClippingInsidePath:
+		[self addCommand:kDKDisplayListClipInside];
+		break;
+
+	case kDKClippingOutsidePath:
+		[self addCommand:kDKDisplayListClipOutside];
+		break;
+	}
+
+	DKDisplayListCommand* cmd = [self addCommand:kDKDisplayListStroke];
+
+	cmd->colour = colour;
+	cmd->width = [stroke width];
+	cmd->cap = (CGLineCap)[stroke lineCapStyle];
+	cmd->join = (CGLineJoin)[stroke lineJoinStyle];
+	cmd->miterLimit = [stroke miterLimit];
+
+	if ([stroke dash])
+		cmd->object = [self indexOfObject:[stroke dash]];
+
+	[self addCommand:kDKDisplayListRestore];
+
+	return YES;
+}
+
+- (BOOL)addShadow:(NSShadow*)shadow isStroke:(BOOL)isStroke width:(CGFloat)width
+{
+	CGColorRef colour = newCompilableQuartzColor([shadow shadowColor]);
+
+	if (colour == NULL)
+		return NO;
+
+	DKDisplayListCommand* cmd = [self addCommand:kDKDisplayListShadow];
+
+	cmd->colour = colour;
+	cmd->colourObject = [self indexOfObject:[shadow shadowColor]];
+	cmd->width = width;
+	cmd->isStroke = isStroke;
+	cmd->object = [self indexOfObject:shadow];
+
+	return YES;
+}
+
+- (DKDisplayListCommand*)addCommand:(DKDisplayListOp)op
+{
+	// the array grows in place while compiling; it never changes afterwards
+
+	DKDisplayListCommand* commands = realloc(mCommands, sizeof(DKDisplayListCommand) * (mCount + 1));
+
+	NSAssert(commands != NULL, @"couldn't allocate display list");
+
+	mCommands = commands;
+
+	DKDisplayListCommand* cmd = &commands[mCount++];
+
+	memset(cmd, 0, sizeof(DKDisplayListCommand));
+	cmd->op = op;
+	cmd->object = NSNotFound;
+
+	return cmd;
+}
+
+- (NSUInteger)indexOfObject:(id)object
+{
+	mObjects = [mObjects ?: @[] arrayByAddingObject:object];
+	return [mObjects count] - 1;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	DKDisplayListCommand* commands = mCommands;
+	NSUInteger i;
+
+	for (i = 0; i < mCount; ++i)
+		CGColorRelease(commands[i].colour);
+
+	free(mCommands);
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %lu commands", NSStringFromClass([self class]), (void*)self, (unsigned long)mCount];
+}
+
+@end
+
+static CGColorRef newCompilableQuartzColor(NSColor* colour)
+{
+	// colours that can't be expressed in device RGB, such as patterns, are drawn by the renderer itself
+
+	if (colour == nil || [colour colorUsingColorSpaceName:NSDeviceRGBColorSpace] == nil)
+		return NULL;
+
+	return [colour newQuartzColor];
+}
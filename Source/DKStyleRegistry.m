@@ -296,7 +296,15 @@ static BOOL s_NoDKDefaults = NO;
 
 	NSMutableSet* changedStyles = nil;
 
-	for (DKStyle* style in styles) {
+	// the set may hold more than one style with the same key, as when styles come from separately decoded parts of a document. Which of
+	// those is registered and which merged into it mustn't depend on the set's order, so they're taken in order of key, most recent first
+
+	NSArray* sortedStyles = [[styles allObjects] sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"uniqueKey"
+																											   ascending:YES],
+		[NSSortDescriptor sortDescriptorWithKey:@"lastModificationTimestamp"
+									  ascending:NO]]];
+
+	for (DKStyle* style in sortedStyles) {
 		// this option relates to the old registry's behaviour, and is mostly inappropriate for this one. Whether a style is sharable or not
 		// generally has no connection to how it is registered in the current model.
 
@@ -21,10 +21,11 @@ typedef union pix_int {
 
 @interface DKSweptAngleGradient : DKGradient {
 	CGImageRef m_sa_image;
-	CGContextRef m_sa_bitmap;
 	pix_int* m_sa_colours;
+	NSInteger m_sa_colourCount;
 	NSInteger m_sa_segments;
 	NSPoint m_sa_centre;
+	NSSize m_sa_imageOffset; // shift that puts the image's quantised centre exactly on m_sa_centre
 	CGFloat m_sa_startAngle;
 	NSInteger m_sa_img_width;
 	BOOL m_ditherColours;
@@ -36,9 +37,20 @@ typedef union pix_int {
 @property NSInteger numberOfAngularSegments;
 
 - (void)preloadColours;
+
+/** @brief Makes the image drawn by the gradient for the given rect.
+
+ Images are kept in a cache shared by all swept angle gradients, keyed on their size, centre and colours. Sizes are rounded up
+ so that an object being resized can keep using the same image for a while, and the centre is rounded to a fraction of the size,
+ with the image drawn shifted by the difference, so that moving the centre doesn't need a new image for every pixel either.
+ */
 - (void)createGradientImageWithRect:(NSRect)rect;
 - (void)invalidateCache;
 
+/** @brief The cache of images shared by all swept angle gradients.
+ */
+@property (class, readonly, strong) NSCache* sweptAngleImageCache;
+
 @end
 
 NS_ASSUME_NONNULL_END
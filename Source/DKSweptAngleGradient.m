@@ -7,12 +7,25 @@
 #import "DKSweptAngleGradient.h"
 
 #import "DKGeometryUtilities.h"
-#import "DKRandom.h"
 #import "LogEvent.h"
+#include <simd/simd.h>
 
-@interface DKGradient (Private)
-- (void)private_colorAtValue:(CGFloat)val components:(CGFloat*)components randomAccess:(BOOL)ra;
-@end
+/** @brief The fixed part of the key for a cached swept angle image; the segment colours follow it.
+ */
+typedef struct {
+	int32_t width, height; // image size in pixels
+	int32_t centreX, centreY; // swept centre in pixels
+	int32_t segments; // number of colours
+	int32_t dither; // whether the colours were dithered
+} DKSweptAngleImageKey;
+
+#define kDKSweptAngleImageCacheLimit 16
+#define kDKSweptAngleImageCacheCostLimit (32 * 1024 * 1024)
+#define kDKSweptAngleRowsPerBand 16
+#define kDKSweptAngleCentreSteps 64 // the swept centre is rounded to this fraction of the image size
+
+static NSUInteger sweptAngleImageBucket(NSUInteger size);
+static CGImageRef createSweptAngleImage(NSUInteger width, NSUInteger height, NSInteger cx, NSInteger cy, const pix_int* colours, NSInteger nColours, BOOL dither);
 
 #pragma mark -
 @implementation DKSweptAngleGradient
@@ -50,110 +63,118 @@
 		free(m_sa_colours);
 
 	m_sa_colours = malloc(sizeof(pix_int) * m_sa_segments);
+	m_sa_colourCount = m_sa_colours ? m_sa_segments : 0;
 
 	if (m_sa_colours) {
+		DKGradientColorTable* table = [self colorTable];
 		CGFloat components[4];
 		CGFloat v;
 
 		for (i = 0; i < m_sa_segments; ++i) {
 			v = (CGFloat)i / (CGFloat)(m_sa_segments - 1);
 
-			[self private_colorAtValue:v
-							components:components
-						  randomAccess:NO];
+			// the table's colours are already premultiplied by alpha, as the image needs
 
-			m_sa_colours[i].c.a = components[3] * 255;
-
-			// colours in image are premultiplied by alpha, so do that
+			[table getComponents:components
+						 atValue:v];
 
-			m_sa_colours[i].c.r = components[0] * components[3] * 255;
-			m_sa_colours[i].c.g = components[1] * components[3] * 255;
-			m_sa_colours[i].c.b = components[2] * components[3] * 255;
+			m_sa_colours[i].c.a = components[3] * 255;
+			m_sa_colours[i].c.r = components[0] * 255;
+			m_sa_colours[i].c.g = components[1] * 255;
+			m_sa_colours[i].c.b = components[2] * 255;
 		}
 	}
 }
 
 - (void)createGradientImageWithRect:(NSRect)rect
 {
-	CGColorSpaceRef cSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
-	NSUInteger width, height;
-
-	// directly create a bitmap context of the desired size then convert it to an image - this is much easier than messing about with data
-	// providers, etc
-
-	width = MAX(1, (NSInteger)(rect.size.width * 1.5));
-	height = MAX(1, (NSInteger)(rect.size.height * 1.5));
-
-	NSUInteger bufferSize = 4 * width * (height + 1);
-	unsigned char* buffer;
+	// sets m_sa_image to an image of the gradient large enough to fill <rect> at any rotation, centred on m_sa_centre. The size is
+	// rounded up into buckets so that resizing an object doesn't need a new image on every step. Images are shared through a cache
+	// keyed on everything that goes into them, so any gradient with the same colours and segment count can reuse them.
 
-	buffer = (unsigned char*)malloc(bufferSize);
-
-	if (buffer) {
-		m_sa_bitmap = CGBitmapContextCreate(buffer, width, height, 8, 4 * width, cSpace, kCGImageAlphaPremultipliedFirst);
-
-		LogEvent_(kInfoEvent, @"bitmap = %@", m_sa_bitmap);
-
-		// scan through the buffer and set all the pixels
-
-		NSPoint cp = m_sa_centre;
+	NSUInteger width, height;
 
-		cp.x -= rect.origin.x;
-		cp.y -= rect.origin.y;
+	if (m_sa_colours == NULL)
+		[self preloadColours];
 
-		pix_int* colours = m_sa_colours;
-		NSUInteger nColours = m_sa_segments;
-		CGFloat angle, twopi;
-		NSUInteger x, y, colour;
+	if (m_sa_colourCount < 2)
+		return;
 
-		// offset cp to account for 50% extra size of the image
+	width = sweptAngleImageBucket(MAX(1, (NSInteger)(rect.size.width * 1.5)));
+	height = sweptAngleImageBucket(MAX(1, (NSInteger)(rect.size.height * 1.5)));
 
-		cp.x *= 1.5;
-		cp.y *= 1.5;
-		twopi = 2 * M_PI;
+	// position the swept centre relative to the image centre, which is drawn at the centre of <rect>. The offset is rounded to a
+	// step in proportion to the image size, so that nearby centres share an image, and the image is shifted by what was rounded off
 
-		unsigned int* p = (unsigned int*)buffer;
+	NSInteger stepX = MAX(1, (NSInteger)width / kDKSweptAngleCentreSteps);
+	NSInteger stepY = MAX(1, (NSInteger)height / kDKSweptAngleCentreSteps);
+	CGFloat dx = m_sa_centre.x - NSMidX(rect);
+	CGFloat dy = m_sa_centre.y - NSMidY(rect);
+	NSInteger qx = lround(dx / stepX) * stepX;
+	NSInteger qy = lround(dy / stepY) * stepY;
 
-		for (y = 0; y < height; ++y) {
-			for (x = 0; x < width; ++x) {
-				// need to know angle of x,y relative to centre point which gives us an index into the colour table
+	m_sa_imageOffset = NSMakeSize(dx - qx, dy - qy);
 
-				angle = atan2((CGFloat)y - cp.y, (CGFloat)x - cp.x) + M_PI;
-				colour = (NSUInteger)((angle * (CGFloat)nColours) / twopi);
+	DKSweptAngleImageKey header;
 
-				// add a bit of random dither to the colour
+	header.width = (int32_t)width;
+	header.height = (int32_t)height;
+	header.centreX = (int32_t)((NSInteger)width / 2 + qx);
+	header.centreY = (int32_t)((NSInteger)height / 2 + qy);
+	header.segments = (int32_t)m_sa_colourCount;
+	header.dither = m_ditherColours;
 
-				if (m_ditherColours)
-					colour = (NSInteger)(colour + [DKRandom randomPositiveOrNegativeNumber] * 2.0) % nColours;
+	NSMutableData* key = [NSMutableData dataWithBytes:&header
+											   length:sizeof(header)];
+	[key appendBytes:m_sa_colours
+			  length:sizeof(pix_int) * m_sa_colourCount];
 
-				// write the colour to the image in one fell swoop
+	NSCache* cache = [[self class] sweptAngleImageCache];
+	id cached = [cache objectForKey:key];
+	CGImageRef image;
 
-				*p++ = colours[colour].pixel;
-			}
-		}
+	if (cached != nil)
+		image = CGImageRetain((__bridge CGImageRef)cached);
+	else {
+		image = createSweptAngleImage(width, height, header.centreX, header.centreY, m_sa_colours, m_sa_colourCount, m_ditherColours);
 
-		// convert to an image.
+		if (image == NULL)
+			return;
 
-		m_sa_image = CGBitmapContextCreateImage(m_sa_bitmap);
+		[cache setObject:(__bridge id)image
+				  forKey:key
+					cost:4 * width * height];
 	}
 
-	CGColorSpaceRelease(cSpace);
+	CGImageRelease(m_sa_image);
+	m_sa_image = image;
+
+	LogEvent_(kInfoEvent, @"swept angle image = %@", m_sa_image);
 }
 
 - (void)invalidateCache
 {
-	unsigned char* buffer;
+	// releases the current image. Images stay in the shared cache, so this is cheap to undo
 
 	if (m_sa_image) {
 		CGImageRelease(m_sa_image);
 		m_sa_image = NULL;
-		buffer = CGBitmapContextGetData(m_sa_bitmap);
-		free(buffer);
-		CGContextRelease(m_sa_bitmap);
-		m_sa_bitmap = NULL;
 	}
 }
 
++ (NSCache*)sweptAngleImageCache
+{
+	static NSCache* sSweptAngleImages = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sSweptAngleImages = [[NSCache alloc] init];
+		[sSweptAngleImages setCountLimit:kDKSweptAngleImageCacheLimit];
+		[sSweptAngleImages setTotalCostLimit:kDKSweptAngleImageCacheCostLimit];
+	});
+
+	return sSweptAngleImages;
+}
+
 #pragma mark -
 #pragma mark As a DKGradient
 - (void)fillPath:(NSBezierPath*)path startingAtPoint:(NSPoint)p startRadius:(CGFloat)sr endingAtPoint:(NSPoint)ep endRadius:(CGFloat)er
@@ -165,38 +186,39 @@
 	NSInteger segments = [self numberOfAngularSegments];
 	NSRect rect = [path bounds];
 	CGFloat sa = [self angle];
-	BOOL inval = NO;
+	CGImageRef image;
+	NSSize offset;
 
 	if (segments == 0)
 		segments = 512;
 
-	if (segments != m_sa_segments) {
-		m_sa_segments = MAX(segments, 2);
-		inval = YES;
-	}
-
-	if (m_sa_image != NULL && (rect.size.width > CGImageGetWidth(m_sa_image) || rect.size.height > CGImageGetHeight(m_sa_image)))
-		inval = YES;
+	// the image state may be shared by threads rendering tiles at the same time, so take the image to draw under the lock
 
-	if (m_sa_image == NULL)
-		inval = YES;
+	@synchronized(self)
+	{
+		if (MAX(segments, 2) != m_sa_colourCount || m_sa_colours == NULL) {
+			m_sa_segments = MAX(segments, 2);
+			[self preloadColours];
+		}
 
-	if (inval) {
 		m_sa_centre = p;
-		[self invalidateCache];
-		[self preloadColours];
 		[self createGradientImageWithRect:rect];
+		image = CGImageRetain(m_sa_image);
+		offset = m_sa_imageOffset;
 	}
 
-	// centre the image rect on <rect>, rotated to <sa>
+	if (image == NULL)
+		return;
+
+	// centre the image rect on <rect>, rotated to <sa>, then shift it so that the swept centre falls exactly where it should
 
 	NSPoint rcp = NSMakePoint(NSMidX(rect), NSMidY(rect));
-	NSRect imgRect = NSMakeRect(0, 0, CGImageGetWidth(m_sa_image), CGImageGetHeight(m_sa_image));
+	NSRect imgRect = NSMakeRect(0, 0, CGImageGetWidth(image), CGImageGetHeight(image));
 
 	rect.origin.x = -rect.size.width / 2;
 	rect.origin.y = -rect.size.height / 2;
 
-	NSRect ir = CentreRectInRect(imgRect, rect);
+	NSRect ir = NSOffsetRect(CentreRectInRect(imgRect, rect), offset.width, offset.height);
 
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
 		[path addClip];
@@ -206,8 +228,26 @@
 	CGContextTranslateCTM(context, rcp.x, rcp.y);
 	CGContextRotateCTM(context, sa);
 
-	CGContextDrawImage(context, NSRectToCGRect(ir), m_sa_image);
+	CGContextDrawImage(context, NSRectToCGRect(ir), image);
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
+
+	CGImageRelease(image);
+}
+
+- (void)invalidateColorTable
+{
+	// the segment colours come from the colour table, so must be rebuilt with it
+
+	@synchronized(self)
+	{
+		if (m_sa_colours) {
+			free(m_sa_colours);
+			m_sa_colours = NULL;
+			m_sa_colourCount = 0;
+		}
+	}
+
+	[super invalidateColorTable];
 }
 
 #pragma mark -
@@ -217,7 +257,6 @@
 	self = [super init];
 	if (self != nil) {
 		NSAssert(m_sa_image == nil, @"Expected init to zero");
-		NSAssert(m_sa_bitmap == nil, @"Expected init to zero");
 		NSAssert(m_sa_colours == nil, @"Expected init to zero");
 		NSAssert(m_sa_segments == 0, @"Expected init to zero");
 		NSAssert(NSEqualPoints(m_sa_centre, NSZeroPoint), @"Expected init to zero");
@@ -233,6 +272,111 @@
 - (void)dealloc
 {
 	[self invalidateCache];
+
+	if (m_sa_colours)
+		free(m_sa_colours);
 }
 
 @end
+
+#pragma mark -
+
+static NSUInteger sweptAngleImageBucket(NSUInteger size)
+{
+	// rounds <size> up to a multiple of 16 for small sizes, or of an eighth of its power of two for larger ones. An image is then at most
+	// 12.5% bigger than it needs to be, and an object can be resized a fair way before a new image is needed.
+
+	NSUInteger step = 16;
+
+	while (step * 16 <= size)
+		step *= 2;
+
+	return ((size + step - 1) / step) * step;
+}
+
+static inline simd_float8 fastAtan2(const simd_float8 y, const simd_float8 x)
+{
+	// polynomial approximation of atan2, good to a few millionths of a radian, which is far finer than the angular segments it picks between
+
+	const simd_float8 tiny = 1.0e-30f;
+	simd_float8 ax = simd_abs(x);
+	simd_float8 ay = simd_abs(y);
+	simd_float8 a = simd_min(ax, ay) / simd_max(simd_max(ax, ay), tiny);
+	simd_float8 s = a * a;
+	simd_float8 r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f + s * -0.01172120f)))));
+
+	r = simd_select(r, (float)M_PI_2 - r, ay > ax);
+	r = simd_select(r, (float)M_PI - r, x < 0.0f);
+	r = simd_select(r, -r, y < 0.0f);
+
+	return r;
+}
+
+static void fillSweptAngleRows(uint32_t* pixels, NSUInteger width, NSUInteger firstRow, NSUInteger lastRow, NSInteger cx, NSInteger cy, const pix_int* colours, NSInteger nColours, BOOL dither)
+{
+	// sets the pixels of rows <firstRow> up to <lastRow> to the colour for their angle around the centre, eight at a time
+
+	const simd_float8 lanes = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	const float scale = (float)nColours / (float)(2.0 * M_PI);
+	const simd_int8 lastColour = (int)nColours - 1;
+	uint32_t seed = (uint32_t)(firstRow * 2654435761u) | 1;
+	NSUInteger x, y, k;
+
+	for (y = firstRow; y < lastRow; ++y) {
+		uint32_t* p = pixels + y * width;
+		simd_float8 dy = (float)((NSInteger)y - cy);
+
+		for (x = 0; x < width; x += 8) {
+			simd_float8 dx = lanes + (float)((NSInteger)x - cx);
+			simd_float8 angle = fastAtan2(dy, dx) + (float)M_PI;
+			simd_int8 index = simd_min(simd_int(angle * scale), lastColour);
+			NSUInteger count = MIN(8, width - x);
+
+			for (k = 0; k < count; ++k) {
+				NSInteger colour = index[k];
+
+				if (dither) {
+					// add a bit of random dither to the colour, up to two segments either way
+
+					seed ^= seed << 13;
+					seed ^= seed >> 17;
+					seed ^= seed << 5;
+					colour = (colour + (NSInteger)(seed % 5) - 2 + nColours) % nColours;
+				}
+
+				p[x + k] = colours[colour].pixel;
+			}
+		}
+	}
+}
+
+static CGImageRef createSweptAngleImage(NSUInteger width, NSUInteger height, NSInteger cx, NSInteger cy, const pix_int* colours, NSInteger nColours, BOOL dither)
+{
+	// creates an image with the given colours swept around <cx>, <cy>. Bands of rows are filled concurrently.
+
+	CGColorSpaceRef cSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGContextRef bitmap = CGBitmapContextCreate(NULL, width, height, 8, 4 * width, cSpace, kCGImageAlphaPremultipliedFirst);
+	CGImageRef image = NULL;
+
+	CGColorSpaceRelease(cSpace);
+
+	if (bitmap == NULL)
+		return NULL;
+
+	uint32_t* pixels = CGBitmapContextGetData(bitmap);
+	NSUInteger rowBytes = CGBitmapContextGetBytesPerRow(bitmap);
+
+	if (pixels != NULL && rowBytes == 4 * width) {
+		size_t bands = (height + kDKSweptAngleRowsPerBand - 1) / kDKSweptAngleRowsPerBand;
+
+		dispatch_apply(bands, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t band) {
+			fillSweptAngleRows(pixels, width, band * kDKSweptAngleRowsPerBand, MIN(height, (band + 1) * kDKSweptAngleRowsPerBand), cx, cy, colours, nColours, dither);
+		});
+
+		image = CGBitmapContextCreateImage(bitmap);
+	}
+
+	CGContextRelease(bitmap);
+
+	return image;
+}
@@ -1344,6 +1344,11 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 	return YES;
 }
 
+- (BOOL)supportsGeometricHitTesting
+{
+	return NO;
+}
+
 - (NSSize)extraSpaceNeeded
 {
 	NSSize es = NSZeroSize;
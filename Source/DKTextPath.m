@@ -789,6 +789,12 @@ static NSString* sDefault_string = @"Double-click to edit this text";
 	}
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	// greeked text is drawn when hit-testing, which the path can't describe
+	return NO;
+}
+
 - (void)drawSelectedState
 {
 	if (![[self textAdornment] allTextWasFitted] && [DKTextShape showsTextOverflowIndicator]) {
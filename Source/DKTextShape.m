@@ -1257,6 +1257,12 @@ static NSString* sDefault_string = @"Double-click to edit this text";
 	}
 }
 
+- (BOOL)canHitTestGeometrically
+{
+	// greeked text is drawn when hit-testing, which the path can't describe
+	return NO;
+}
+
 - (void)drawSelectedState
 {
 	// draw a "more text" indicator if the current text can't be fully laid out in the box
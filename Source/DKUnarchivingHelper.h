@@ -8,18 +8,43 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class DKLayer;
+
 /** @brief this helper is used when unarchiving to translate class names from older files to their modern equivalents
 */
 @interface DKUnarchivingHelper : NSObject <NSKeyedUnarchiverDelegate> {
 	NSUInteger mCount;
+	NSUInteger mReportedCount; // the count when progress was last reported
 	NSString* mLastClassnameSubstituted;
 }
 
 - (void)reset;
+
+/** @brief The number of objects decoded since the last reset. May be called from any thread.
+ */
 @property (readonly) NSUInteger numberOfObjectsDecoded;
 
+/** @brief The name of the class most recently replaced by \c DKNullObject. May be called from any thread.
+ */
 @property (readonly, copy, nullable) NSString* lastClassnameSubstituted;
 
+/** @brief Called when a layer that was loaded as a placeholder starts decoding its objects, which may be long after the file was opened.
+
+ Posts \c kDKUnarchiverLayerLoadingStartedNotification on the main thread. The layer's objects are then reported with the usual progress
+ notifications as they're decoded, possibly from another thread.
+ @param unarchiver the unarchiver decoding the layer's objects
+ @param layer the layer
+ */
+- (void)unarchiver:(NSCoder*)unarchiver willLoadLayer:(DKLayer*)layer;
+
+/** @brief Called when a layer that was loaded as a placeholder has added its decoded objects.
+
+ Posts \c kDKUnarchiverLayerLoadingFinishedNotification on the main thread.
+ @param unarchiver the unarchiver that decoded the layer's objects
+ @param layer the layer
+ */
+- (void)unarchiver:(NSCoder*)unarchiver didLoadLayer:(DKLayer*)layer;
+
 @end
 
 /** @brief substitution class for avoiding an exception during dearchiving
@@ -37,5 +62,10 @@ if a substitution would return NSObject, return this insead, which provides a st
 extern NSNotificationName const kDKUnarchiverProgressStartedNotification;
 extern NSNotificationName const kDKUnarchiverProgressContinuedNotification;
 extern NSNotificationName const kDKUnarchiverProgressFinishedNotification;
+extern NSNotificationName const kDKUnarchiverLayerLoadingStartedNotification;
+extern NSNotificationName const kDKUnarchiverLayerLoadingFinishedNotification;
+
+/** progress is reported once every this many objects decoded, rather than for each one */
+extern const NSUInteger kDKUnarchiverProgressBatchSize;
 
 NS_ASSUME_NONNULL_END
@@ -5,46 +5,69 @@
 */
 
 #import "DKUnarchivingHelper.h"
+#import "DKObjectOwnerLayer.h"
 #import "LogEvent.h"
 
 NSString* const kDKUnarchiverProgressStartedNotification = @"kDKUnarchiverProgressStartedNotification";
 NSString* const kDKUnarchiverProgressContinuedNotification = @"kDKUnarchiverProgressContinuedNotification";
 NSString* const kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgressFinishedNotification";
+NSString* const kDKUnarchiverLayerLoadingStartedNotification = @"kDKUnarchiverLayerLoadingStartedNotification";
+NSString* const kDKUnarchiverLayerLoadingFinishedNotification = @"kDKUnarchiverLayerLoadingFinishedNotification";
+
+const NSUInteger kDKUnarchiverProgressBatchSize = 250;
 
 @implementation DKUnarchivingHelper
 
 - (void)reset
 {
-	mCount = 0;
+	@synchronized(self)
+	{
+		mCount = 0;
+		mReportedCount = 0;
+	}
 }
 
-@synthesize numberOfObjectsDecoded = mCount;
+- (NSUInteger)numberOfObjectsDecoded
+{
+	@synchronized(self)
+	{
+		return mCount;
+	}
+}
 
 - (id)unarchiver:(NSKeyedUnarchiver*)unarchiver didDecodeObject:(id)object
 {
 #pragma unused(unarchiver)
 
 	// this method tracks the number of objects decoded and also sends notifications about the dearchiving progress, allowing a dearchiving
-	// to drive a progress bar, etc. The notification is delivered on the main thread in case this is being invoked by a thread.
+	// to drive a progress bar, etc. Objects may be decoded on several threads at once, and hopping to the main thread for every one of them
+	// would cost more than decoding them, so progress is only reported every kDKUnarchiverProgressBatchSize objects. The notification is
+	// delivered on the main thread in case this is being invoked by a thread.
 
-	NSDictionary* userInfo = @{ @"count": @(mCount),
-		@"decoded_object": object };
-	NSNotification* note;
+	NSUInteger count;
+	BOOL starting, report;
 
-	if (mCount == 0)
-		note = [NSNotification notificationWithName:kDKUnarchiverProgressStartedNotification
-											 object:self
-										   userInfo:userInfo];
-	else
-		note = [NSNotification notificationWithName:kDKUnarchiverProgressContinuedNotification
-											 object:self
-										   userInfo:userInfo];
+	@synchronized(self)
+	{
+		count = mCount++;
+		starting = (count == 0);
+		report = starting || (count - mReportedCount >= kDKUnarchiverProgressBatchSize);
 
-	[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
-														   withObject:note
-														waitUntilDone:[NSThread isMainThread]];
+		if (report)
+			mReportedCount = count;
+	}
 
-	++mCount;
+	if (report) {
+		NSDictionary* userInfo = @{ @"count": @(count),
+			@"decoded_object": object };
+		NSNotification* note = [NSNotification notificationWithName:starting ? kDKUnarchiverProgressStartedNotification : kDKUnarchiverProgressContinuedNotification
+															 object:self
+														   userInfo:userInfo];
+
+		[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
+															   withObject:note
+															waitUntilDone:[NSThread isMainThread]];
+	}
 
 	return object;
 }
@@ -53,7 +76,7 @@ NSString* const kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgr
 {
 #pragma unused(unarchiver)
 
-	NSDictionary* userInfo = @{ @"count": @(mCount) };
+	NSDictionary* userInfo = @{ @"count": @([self numberOfObjectsDecoded]) };
 	NSNotification* note = [NSNotification notificationWithName:kDKUnarchiverProgressFinishedNotification
 														 object:self
 													   userInfo:userInfo];
@@ -62,6 +85,34 @@ NSString* const kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgr
 														waitUntilDone:[NSThread isMainThread]];
 }
 
+- (void)unarchiver:(NSCoder*)unarchiver willLoadLayer:(DKLayer*)layer
+{
+#pragma unused(unarchiver)
+
+	NSUInteger count = [layer isKindOfClass:[DKObjectOwnerLayer class]] ? [(DKObjectOwnerLayer*)layer countOfObjects] : 0;
+	NSDictionary* userInfo = @{ @"layer": layer,
+		@"count": @(count) };
+	NSNotification* note = [NSNotification notificationWithName:kDKUnarchiverLayerLoadingStartedNotification
+														 object:self
+													   userInfo:userInfo];
+	[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
+														   withObject:note
+														waitUntilDone:[NSThread isMainThread]];
+}
+
+- (void)unarchiver:(NSCoder*)unarchiver didLoadLayer:(DKLayer*)layer
+{
+#pragma unused(unarchiver)
+
+	NSDictionary* userInfo = @{ @"layer": layer };
+	NSNotification* note = [NSNotification notificationWithName:kDKUnarchiverLayerLoadingFinishedNotification
+														 object:self
+													   userInfo:userInfo];
+	[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
+														   withObject:note
+														waitUntilDone:[NSThread isMainThread]];
+}
+
 - (Class)unarchiver:(NSKeyedUnarchiver*)unarchiver cannotDecodeObjectOfClassName:(NSString*)name originalClasses:(NSArray<NSString*>*)classNames
 {
 #pragma unused(unarchiver)
@@ -121,7 +172,13 @@ NSString* const kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgr
 
 		if ([classname isEqualToString:@"NSObject"]) {
 			classname = @"DKNullObject";
-			mLastClassnameSubstituted = name;
+
+			// layers may be decoded on several threads at once, so this is guarded as the counts are
+
+			@synchronized(self)
+			{
+				mLastClassnameSubstituted = [name copy];
+			}
 		}
 
 		theClass = NSClassFromString(classname);
@@ -135,7 +192,13 @@ NSString* const kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgr
 	return theClass;
 }
 
-@synthesize lastClassnameSubstituted = mLastClassnameSubstituted;
+- (NSString*)lastClassnameSubstituted
+{
+	@synchronized(self)
+	{
+		return mLastClassnameSubstituted;
+	}
+}
 
 @end
 
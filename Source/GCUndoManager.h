@@ -22,6 +22,16 @@ typedef NS_ENUM(NSInteger, GCUndoTaskCoalescingKind) {
 
 @class GCUndoGroup, GCUndoManagerProxy, GCConcreteUndoTask;
 
+/** @brief Objects passed as undo task arguments can adopt this to report how much memory they hold, for the undo manager's memory budget.
+ */
+@protocol GCUndoMemoryCost <NSObject>
+
+/** @brief An estimate of the memory held by the object, in bytes.
+ */
+@property (readonly) NSUInteger undoMemoryCost;
+
+@end
+
 // the undo manager is a public-API compatible replacement for NSUndoManager but features a simpler internal implementation, some bug fixes and less
 // fragility than NSUndoManager. It can be used with NSDocument's -setUndoManager: method (cast to id or NSUndoManager). However its compatibility with
 // Core Data is unknown and untested at this time. See further notes at the end of this file.
@@ -60,6 +70,7 @@ The point of this is to provide an undo manager whose source is openly readable,
 	GCUndoManagerProxy* mProxy; //!< the proxy object returned by \c -prepareWithInvocationTarget: if proxying is used
 	NSInteger mGroupLevel; // current grouping level, 0 = no groups open
 	NSUInteger mLevelsOfUndo; // how many undo actions are added before old ones are discarded, 0 = unlimited
+	NSUInteger mMemoryBudget; // how much memory the stacks may hold before old actions are discarded, 0 = unlimited
 	NSInteger mEnableLevel; // enable ref count, 0 = enabled.
 	NSUInteger mChangeCount; // count of changes (submitting any task increments this)
 	GCUndoManagerState mState; // current undo manager state
@@ -97,6 +108,19 @@ The point of this is to provide an undo manager whose source is openly readable,
  */
 @property (nonatomic) NSUInteger levelsOfUndo;
 
+/** @brief The most memory, in bytes, that the undo and redo stacks may hold before the oldest actions are discarded. 0 (the default) is unlimited.
+
+ Checked whenever a top level group is closed, and when the budget is changed. The most recent action is always kept, however large.
+ */
+@property (nonatomic) NSUInteger memoryBudget;
+
+/** @brief An estimate of the memory held by the undo and redo stacks, in bytes.
+
+ Each task's cost is estimated when it's registered, from the size of its arguments. Arguments that conform to \c GCUndoMemoryCost
+ report their own cost.
+ */
+@property (readonly) NSUInteger memoryUsed;
+
 // performing the undo or redo
 
 @property (readonly) BOOL canUndo;
@@ -230,6 +254,9 @@ The point of this is to provide an undo manager whose source is openly readable,
 
 @property (assign) GCUndoGroup* parentGroup;
 - (void)perform;
+/** @brief An estimate of the memory held by the task, in bytes. For a group, this includes all of its tasks.
+ */
+@property (readonly) NSUInteger cost;
 
 @end
 
@@ -243,7 +270,11 @@ The point of this is to provide an undo manager whose source is openly readable,
 @interface GCUndoGroup : GCUndoTask {
 @private
 	NSString* mActionName;
-	NSMutableArray* mTasks;
+	NSMutableOrderedSet* mTasks;
+	NSMutableArray* mSubgroups; // the groups among mTasks, so that removing by target needn't visit every task
+	NSMapTable* mTasksByTarget; // target address -> the concrete tasks in this group with that target
+	NSHashTable* mTaskKeys; // (target, selector) pairs of the concrete tasks in this group, for coalescing
+	NSUInteger mTaskCost; // total cost of the concrete tasks in this group
 }
 
 - (void)addTask:(GCUndoTask*)aTask;
@@ -251,6 +282,10 @@ The point of this is to provide an undo manager whose source is openly readable,
 @property (readonly, nullable) GCConcreteUndoTask* lastTaskIfConcrete;
 @property (readonly, retain) NSArray<GCUndoTask*>* tasks;
 - (NSArray<GCUndoTask*>*)tasksWithTarget:(nullable id)target selector:(nullable SEL)selector;
+/** return whether this group (but not any subgroups) has a task with the given target and selector. Unlike \c -tasksWithTarget:selector:
+ this is a hash lookup, so it takes the same time however many tasks the group holds.
+ */
+- (BOOL)containsTaskWithTarget:(nullable id)target selector:(SEL)selector;
 /** return whether the group contains any actual tasks. If it only contains other empty groups, returns YES.
  */
 @property (readonly, getter=isEmpty) BOOL empty;
@@ -267,12 +302,17 @@ The point of this is to provide an undo manager whose source is openly readable,
 #pragma mark -
 
 // concrete tasks wrap the NSInvocation which embodies the actual method call that is made when an action is undone or redone.
-// Concrete tasks own the invocation, which is set to always retain its target and arguments.
+// Concrete tasks own the invocation, which is set to always retain its target and arguments. Tasks for methods taking at most a single
+// scalar or small struct argument, such as most geometry and property setters, don't keep the invocation but just the selector and a copy
+// of the argument, and make an invocation only when performed.
 
 @interface GCConcreteUndoTask : GCUndoTask {
 @private
-	NSInvocation* mInvocation;
+	NSInvocation* mInvocation; // nil for compact tasks
 	id mTarget;
+	SEL mSelector;
+	void* mArgument; // the argument of a compact task, or NULL if the method takes none
+	NSUInteger mCost;
 	BOOL mTargetRetained;
 }
 
@@ -5,6 +5,7 @@
 */
 
 #import "GCUndoManager.h"
+#import <objc/runtime.h>
 
 // this proxy object is returned by -prepareWithInvocationTarget: if GCUM_USE_PROXY is 1. This provides a similar behaviour to NSUndoManager
 // on 10.6 so that a wider range of methods can be submitted as undo tasks. Unlike 10.6 however, it does not bypass um's -forwardInvocation:
@@ -34,6 +35,29 @@
 
 #define CALCULATE_GROUPING_LEVEL 0
 
+// groups index their concrete tasks by target and selector so that coalescing and removing tasks by target don't have to search
+// every task in the group, which made moving or deleting many objects at once quadratic.
+
+typedef struct {
+	const void* target;
+	SEL selector;
+} GCUndoTaskKey;
+
+static NSUInteger sizeOfTaskKey(const void* item);
+
+// tasks whose only argument is a scalar or a struct of at most this many bytes (an NSRect) keep a copy of it rather than an invocation
+
+#define kGCUndoCompactArgumentLimit 32
+
+static BOOL isCompactArgumentType(const char* type);
+static NSUInteger costOfArgument(id arg);
+
+@interface GCUndoManager ()
+
+- (void)discardActionsToFitMemoryBudget;
+
+@end
+
 #pragma mark -
 
 @implementation GCUndoManager
@@ -123,6 +147,8 @@
 
 					mIsRemovingTargets = NO;
 				}
+
+				[self discardActionsToFitMemoryBudget];
 			}
 		} else {
 			// closing an inner nested group, so restore its containing group as the open one.
@@ -241,6 +267,52 @@
 
 @synthesize groupsByEvent = mGroupsByEvent;
 @synthesize levelsOfUndo = mLevelsOfUndo;
+
+- (void)setMemoryBudget:(NSUInteger)budget
+{
+	mMemoryBudget = budget;
+	[self discardActionsToFitMemoryBudget];
+}
+
+@synthesize memoryBudget = mMemoryBudget;
+
+- (NSUInteger)memoryUsed
+{
+	NSUInteger used = 0;
+
+	for (GCUndoGroup* group in mUndoStack)
+		used += [group cost];
+
+	for (GCUndoGroup* group in mRedoStack)
+		used += [group cost];
+
+	return used;
+}
+
+- (void)discardActionsToFitMemoryBudget
+{
+	// discards the oldest undo actions, then the furthest redo actions, until the stacks fit the budget. The newest action on each
+	// stack is kept, which also means an open group is never discarded.
+
+	if ([self memoryBudget] == 0 || mIsRemovingTargets)
+		return;
+
+	NSUInteger used = [self memoryUsed];
+
+	mIsRemovingTargets = YES;
+
+	while (used > [self memoryBudget] && [mUndoStack count] > 1) {
+		used -= [[mUndoStack objectAtIndex:0] cost];
+		[mUndoStack removeObjectAtIndex:0];
+	}
+
+	while (used > [self memoryBudget] && [mRedoStack count] > 1) {
+		used -= [[mRedoStack objectAtIndex:0] cost];
+		[mRedoStack removeObjectAtIndex:0];
+	}
+
+	mIsRemovingTargets = NO;
+}
 @synthesize runLoopModes = mRunLoopModes;
 
 - (void)setActionName:(NSString*)actionName
@@ -570,13 +642,9 @@
 
 			if ([lastTask target] == [aTask target] && [lastTask selector] == [aTask selector])
 				return NO;
-		} else {
-			NSArray* matchingTasks = [[self currentGroup] tasksWithTarget:[aTask target]
-																 selector:[aTask selector]];
-
-			if ([matchingTasks count] > 0)
-				return NO;
-		}
+		} else if ([[self currentGroup] containsTaskWithTarget:[aTask target]
+													  selector:[aTask selector]])
+			return NO;
 	}
 
 	// for just-in-time grouping, open a group now if not open already and groupsByEvent is YES
@@ -849,6 +917,11 @@
 	NSAssert(NO, @"-perform must be overridden");
 }
 
+- (NSUInteger)cost
+{
+	return class_getInstanceSize([self class]);
+}
+
 @end
 
 #pragma mark -
@@ -861,6 +934,31 @@
 
 	[mTasks addObject:aTask];
 	[aTask setParentGroup:self];
+
+	if ([aTask isKindOfClass:[GCUndoGroup class]]) {
+		[mSubgroups addObject:aTask];
+		return;
+	}
+
+	mTaskCost += [aTask cost];
+
+	if ([aTask isKindOfClass:[GCConcreteUndoTask class]] && [(GCConcreteUndoTask*)aTask target] != nil) {
+		// tasks with no target are rare, and are found by searching
+
+		id target = [(GCConcreteUndoTask*)aTask target];
+		NSMutableArray* targetTasks = NSMapGet(mTasksByTarget, target);
+
+		if (targetTasks == nil) {
+			targetTasks = [[NSMutableArray alloc] init];
+			NSMapInsertKnownAbsent(mTasksByTarget, target, targetTasks);
+			[targetTasks release];
+		}
+
+		[targetTasks addObject:aTask];
+
+		GCUndoTaskKey key = { target, [(GCConcreteUndoTask*)aTask selector] };
+		NSHashInsert(mTaskKeys, &key);
+	}
 }
 
 - (GCUndoTask*)taskAtIndex:(NSUInteger)indx
@@ -882,7 +980,7 @@
 
 - (NSArray*)tasks
 {
-	return mTasks;
+	return [mTasks array];
 }
 
 - (NSArray*)tasksWithTarget:(id)target selector:(SEL)selector
@@ -896,7 +994,11 @@
 
 	NSMutableArray* tasks = [NSMutableArray array];
 
-	for (GCUndoTask* task in [self tasks]) {
+	// with a target, only that target's tasks need be examined
+
+	NSArray* candidates = (target != nil) ? NSMapGet(mTasksByTarget, target) : [self tasks];
+
+	for (GCUndoTask* task in candidates) {
 		if ([task isKindOfClass:[GCConcreteUndoTask class]]) {
 			id targ = [(GCConcreteUndoTask*)task target];
 			SEL sel = [(GCConcreteUndoTask*)task selector];
@@ -909,22 +1011,27 @@
 	return tasks;
 }
 
+- (BOOL)containsTaskWithTarget:(id)target selector:(SEL)selector
+{
+	if (target == nil)
+		return [[self tasksWithTarget:nil
+							 selector:selector] count] > 0;
+
+	GCUndoTaskKey key = { target, selector };
+
+	return NSHashGet(mTaskKeys, &key) != NULL;
+}
+
 - (BOOL)isEmpty
 {
 	// return whether the group contains any actual tasks. If it only contains other empty groups, returns YES.
 
-	if ([[self tasks] count] == 0)
-		return YES;
-	else {
-		for (GCUndoTask* task in self.tasks) {
-			if ([task isKindOfClass:[self class]]) {
-				// is a group - is that one empty?
+	if ([mTasks count] > [mSubgroups count])
+		return NO;
 
-				if (![(GCUndoGroup*)task isEmpty])
-					return NO;
-			} else
-				return NO;
-		}
+	for (GCUndoGroup* group in mSubgroups) {
+		if (![group isEmpty])
+			return NO;
 	}
 
 	return YES;
@@ -933,20 +1040,30 @@
 - (void)removeTasksWithTarget:(id)aTarget undoManager:(GCUndoManager*)um
 {
 	// Removes all tasks in this group and any subgroups having the given target.
-	// It also removes any subgroups that become empty as a result.
+	// It also removes any subgroups that become empty as a result. Only the target's own tasks and the subgroups are visited.
+
+	NSArray* targetTasks = (aTarget != nil) ? NSMapGet(mTasksByTarget, aTarget) : nil;
+
+	if (targetTasks != nil) {
+		for (GCConcreteUndoTask* task in targetTasks) {
+			GCUndoTaskKey key = { aTarget, [task selector] };
+			NSHashRemove(mTaskKeys, &key);
+			mTaskCost -= [task cost];
+		}
 
-	NSArray* temp = [[self tasks] copy];
+		[mTasks removeObjectsInArray:targetTasks];
+		NSMapRemove(mTasksByTarget, aTarget);
+	}
+
+	NSArray* temp = [mSubgroups copy];
 
-	for (GCUndoTask* task in temp) {
-		if ([task respondsToSelector:_cmd]) {
-			[(GCUndoGroup*)task removeTasksWithTarget:aTarget
-										  undoManager:um];
+	for (GCUndoGroup* group in temp) {
+		[group removeTasksWithTarget:aTarget
+						 undoManager:um];
 
-			if ([(GCUndoGroup*)task isEmpty] && [um currentGroup] != task)
-				[mTasks removeObject:task];
-		} else if ([task respondsToSelector:@selector(target)]) {
-			if (aTarget == [(GCConcreteUndoTask*)task target])
-				[mTasks removeObject:task];
+		if ([group isEmpty] && [um currentGroup] != group) {
+			[mTasks removeObject:group];
+			[mSubgroups removeObjectIdenticalTo:group];
 		}
 	}
 
@@ -958,6 +1075,16 @@
 #pragma mark -
 #pragma mark - as a GCUndoTask
 
+- (NSUInteger)cost
+{
+	NSUInteger cost = [super cost] + mTaskCost + [mTasks count] * sizeof(id);
+
+	for (GCUndoGroup* group in mSubgroups)
+		cost += [group cost];
+
+	return cost;
+}
+
 - (void)perform
 {
 	// cause the tasks in the group to be executed IN REVERSE ORDER. Subgroups are recursively executed.
@@ -975,7 +1102,16 @@
 {
 	self = [super init];
 	if (self) {
-		mTasks = [[NSMutableArray alloc] init];
+		mTasks = [[NSMutableOrderedSet alloc] init];
+		mSubgroups = [[NSMutableArray alloc] init];
+		mTasksByTarget = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality
+												   valueOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPersonality
+													   capacity:0];
+
+		NSPointerFunctions* keyFunctions = [NSPointerFunctions pointerFunctionsWithOptions:NSPointerFunctionsMallocMemory | NSPointerFunctionsStructPersonality | NSPointerFunctionsCopyIn];
+		[keyFunctions setSizeFunction:sizeOfTaskKey];
+		mTaskKeys = [[NSHashTable alloc] initWithPointerFunctions:keyFunctions
+														 capacity:0];
 	}
 
 	return self;
@@ -986,6 +1122,9 @@
 	//NSLog(@"deallocating undo group %@", self );
 
 	[mTasks release];
+	[mSubgroups release];
+	[mTasksByTarget release];
+	[mTaskKeys release];
 	[mActionName release];
 	[super dealloc];
 }
@@ -1012,10 +1151,37 @@
 			// the invocation retains its arguments and target if the target is set at this point. Therefore the target
 			// is set as nil and is managed independently. mTarget is set to the invocation's original target if set.
 
+			NSMethodSignature* sig = [inv methodSignature];
+			NSUInteger i, size = 0;
+
 			mTarget = [inv target];
-			[inv setTarget:nil];
-			[inv retainArguments];
-			mInvocation = [inv retain];
+			mSelector = [inv selector];
+
+			if ([sig numberOfArguments] == 3 && isCompactArgumentType([sig getArgumentTypeAtIndex:2])) {
+				// a compact task copies its argument and drops the invocation
+
+				NSGetSizeAndAlignment([sig getArgumentTypeAtIndex:2], &size, NULL);
+				mArgument = malloc(size);
+				[inv getArgument:mArgument
+						 atIndex:2];
+			} else if ([sig numberOfArguments] > 2) {
+				[inv setTarget:nil];
+				[inv retainArguments];
+				mInvocation = [inv retain];
+
+				size = 64 + [sig frameLength];
+
+				for (i = 2; i < [sig numberOfArguments]; ++i) {
+					if (*[sig getArgumentTypeAtIndex:i] == '@') {
+						id arg = nil;
+						[inv getArgument:&arg
+								 atIndex:i];
+						size += costOfArgument(arg);
+					}
+				}
+			}
+
+			mCost = class_getInstanceSize([self class]) + size;
 		} else {
 			[self autorelease];
 			return nil;
@@ -1070,7 +1236,7 @@
 
 - (SEL)selector
 {
-	return [mInvocation selector];
+	return mSelector;
 }
 
 #pragma mark -
@@ -1082,8 +1248,33 @@
 
 	//NSLog(@"about to invoke task %@", self );
 
-	if (mTarget)
+	if (mTarget == nil)
+		return;
+
+	if (mInvocation)
 		[mInvocation invokeWithTarget:mTarget];
+	else {
+		// a compact task makes its invocation now
+
+		NSMethodSignature* sig = [mTarget methodSignatureForSelector:mSelector];
+
+		THROW_IF_FALSE2(sig != nil, @"undo target %@ doesn't respond to %@", mTarget, NSStringFromSelector(mSelector));
+
+		NSInvocation* inv = [NSInvocation invocationWithMethodSignature:sig];
+
+		[inv setSelector:mSelector];
+
+		if (mArgument)
+			[inv setArgument:mArgument
+					 atIndex:2];
+
+		[inv invokeWithTarget:mTarget];
+	}
+}
+
+- (NSUInteger)cost
+{
+	return mCost;
 }
 
 #pragma mark -
@@ -1098,6 +1289,7 @@
 - (void)dealloc
 {
 	[mInvocation release];
+	free(mArgument);
 
 	if (mTargetRetained)
 		[mTarget release];
@@ -1107,7 +1299,7 @@
 
 - (NSString*)description
 {
-	return [NSString stringWithFormat:@"%@ target = <%@ %p>, selector: %@", [super description], NSStringFromClass([[self target] class]), [self target], NSStringFromSelector([mInvocation selector])];
+	return [NSString stringWithFormat:@"%@ target = <%@ %p>, selector: %@", [super description], NSStringFromClass([[self target] class]), [self target], NSStringFromSelector(mSelector)];
 }
 
 @end
@@ -1152,3 +1344,61 @@
 
 @end
 ;
+
+static NSUInteger sizeOfTaskKey(const void* item)
+{
+#pragma unused(item)
+
+	return sizeof(GCUndoTaskKey);
+}
+
+static BOOL isCompactArgumentType(const char* type)
+{
+	// scalars, and structs of scalars, that are small enough to copy. Pointers of any kind aren't, since what they point to might not last.
+
+	NSUInteger size = 0;
+
+	while (*type && strchr("rnNoORV", *type))
+		++type;
+
+	if (*type == '{') {
+		if (strpbrk(type, "@^*#:?") != NULL)
+			return NO;
+	} else if (strchr("cCsSiIlLqQfdB", *type) == NULL || *type == 0)
+		return NO;
+
+	NSGetSizeAndAlignment(type, &size, NULL);
+
+	return size <= kGCUndoCompactArgumentLimit;
+}
+
+static NSUInteger costOfArgument(id arg)
+{
+	// a rough estimate of what an argument holds onto
+
+	if (arg == nil)
+		return 0;
+
+	if ([arg conformsToProtocol:@protocol(GCUndoMemoryCost)])
+		return [(id<GCUndoMemoryCost>)arg undoMemoryCost];
+
+	if ([arg isKindOfClass:[NSBezierPath class]])
+		return 64 + [(NSBezierPath*)arg elementCount] * (3 * sizeof(NSPoint) + sizeof(NSInteger));
+
+	if ([arg isKindOfClass:[NSData class]])
+		return 32 + [(NSData*)arg length];
+
+	if ([arg isKindOfClass:[NSString class]])
+		return 32 + [(NSString*)arg length] * sizeof(unichar);
+
+	if ([arg isKindOfClass:[NSArray class]] || [arg isKindOfClass:[NSSet class]]) {
+		NSUInteger cost = 32;
+
+		for (id obj in arg)
+			cost += sizeof(id) + costOfArgument(obj);
+
+		return cost;
+	}
+
+	return class_getInstanceSize([arg class]);
+}
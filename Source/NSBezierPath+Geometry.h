@@ -8,6 +8,7 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class DKBezierArcLengthTable;
 @protocol DKBezierElementIterationDelegate;
 
 @interface NSBezierPath (Geometry)
@@ -121,12 +122,30 @@ NS_ASSUME_NONNULL_BEGIN
 
 // finding path lengths for points and points for lengths
 
+/** @brief A table of the lengths of the path's segments, for finding points along it quickly.
+
+ The table is shared, and the same one is returned for as long as the path is unchanged, so code that places many things along a path
+ should get it once and query it rather than calling -pointOnPathAtLength:slope: repeatedly.
+ */
+@property (readonly, strong) DKBezierArcLengthTable* arcLengthTable;
 - (NSPoint)pointOnPathAtLength:(CGFloat)length slope:(nullable CGFloat*)slope;
 @property (readonly) CGFloat slopeStartingPath;
 - (CGFloat)distanceFromStartOfPathAtPoint:(NSPoint)p tolerance:(CGFloat)tol;
 
 - (NSInteger)pointWithinPathRegion:(NSPoint)p;
 
+// analytic hit-testing:
+
+/** @brief Tests whether a rect touches the area that filling and/or stroking the path would paint, without rendering anything.
+
+ The fill test honours the path's winding rule. The stroke is treated as a solid line of the given width, so dashes and caps
+ are ignored - this makes the test slightly generous, which suits hit-testing. A point-sized rect takes a faster route than a larger one.
+ @param rect the rect to test
+ @param filled \c YES to include the interior of the path
+ @param width the stroke width, or 0 for no stroke
+ @return \c YES if the rect hits the painted area, \c NO otherwise */
+- (BOOL)isHitByRect:(NSRect)rect filled:(BOOL)filled strokeWidth:(CGFloat)width;
+
 // clipping utilities:
 
 - (void)addInverseClip;
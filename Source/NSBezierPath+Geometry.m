@@ -4,12 +4,14 @@
  @copyright MPL2; see LICENSE.txt
 */
 
+#import "DKBezierArcLengthTable.h"
 #import "DKDrawKitMacros.h"
 #import "DKGeometryUtilities.h"
 #import "DKRandom.h"
 #import "LogEvent.h"
 #import "NSBezierPath+Editing.h"
 #import "NSBezierPath+Geometry.h"
+#import "NSBezierPath-OAExtensions.h"
 
 // define this to use Omni methods for finding points on paths, etc. Note - I have discovered that these methods, though probably faster, are quite innaccurate
 // and the innaccuracy worsens with longer paths (accumulative rounding error). So if your paths are likely to exceed 1000 points in length, it's better to use
@@ -17,9 +19,9 @@
 
 #define USE_OMNI_METHODS 0
 
-#if USE_OMNI_METHODS
-#import "NSBezierPath-OAExtensions.h"
-#endif
+// the acceptable error when measuring lengths along paths, where none is given
+
+#define DEFAULT_TRIM_EPSILON 0.1
 
 #pragma mark Static Functions
 static void ConvertPathApplierFunction(void* info, const CGPathElement* element);
@@ -48,6 +50,7 @@ static BOOL CornerBevel(const NSPoint pointsIn[3], CGFloat offset, NSBezierPath*
 
 @interface NSBezierPath (Geometry_Private)
 - (NSBezierPath*)paralleloidPathWithOffset3:(CGFloat)delta lineJoinStyle:(NSLineJoinStyle)js;
+- (DKBezierArcLengthTable*)arcLengthTableWithMaximumError:(CGFloat)maxError;
 
 @end
 
@@ -1190,7 +1193,9 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 	BOOL side = 0; // are we zigging or zagging?
 	BOOL doneFirst = NO;
 
-	len = [self length];
+	DKBezierArcLengthTable* table = [self arcLengthTable];
+
+	len = [table length];
 	newPath = [NSBezierPath bezierPath];
 	[newPath moveToPoint:[self firstPoint]];
 	[newPath setWindingRule:[self windingRule]];
@@ -1201,11 +1206,11 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 				zp = [self pointOnPathAtLength:0.0
 										 slope:&slope];
 			else
-				zp = [self pointOnPathAtLength:len
-										 slope:&slope];
+				zp = [table pointAtLength:len
+									slope:&slope];
 		} else
-			zp = [self pointOnPathAtLength:t
-									 slope:&slope];
+			zp = [table pointAtLength:t
+								slope:&slope];
 
 		// calculate position of corner offset from the path
 
@@ -1260,7 +1265,9 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 		BOOL side = 0; // are we zigging or zagging?
 		BOOL doneFirst = NO;
 
-		len = [self length];
+		DKBezierArcLengthTable* table = [self arcLengthTable];
+
+		len = [table length];
 		newPath = [NSBezierPath bezierPath];
 		[newPath moveToPoint:[self firstPoint]];
 		[newPath setWindingRule:[self windingRule]];
@@ -1278,18 +1285,18 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 
 					if (side == 1) {
 						t = (t + len) / 2.0;
-						zp = [self pointOnPathAtLength:t
-												 slope:&slope];
+						zp = [table pointAtLength:t
+											slope:&slope];
 						lambda = MAX(1, len - t);
 					} else
 						zp = [self pointOnPathAtLength:0.0
 												 slope:&slope];
 				} else
-					zp = [self pointOnPathAtLength:len
-											 slope:&slope];
+					zp = [table pointAtLength:len
+										slope:&slope];
 			} else
-				zp = [self pointOnPathAtLength:t
-										 slope:&slope];
+				zp = [table pointAtLength:t
+									slope:&slope];
 
 			// calculate position of peak offset from the path
 
@@ -1595,6 +1602,22 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 }
 
 #pragma mark -
+- (DKBezierArcLengthTable*)arcLengthTable
+{
+	return [DKBezierArcLengthTable arcLengthTableForPath:self];
+}
+
+- (DKBezierArcLengthTable*)arcLengthTableWithMaximumError:(CGFloat)maxError
+{
+	// the shared table is made with the default error, so only a different error needs a table of its own
+
+	if (maxError == DEFAULT_TRIM_EPSILON)
+		return [self arcLengthTable];
+
+	return [[[DKBezierArcLengthTable alloc] initWithPath:self
+											maximumError:maxError] autorelease];
+}
+
 - (NSPoint)pointOnPathAtLength:(CGFloat)length slope:(CGFloat*)slope
 {
 	// Given a length in terms of the distance from the path start, this returns the point and slope
@@ -1603,7 +1626,6 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 
 	NSPoint p = NSZeroPoint;
 	NSPoint ap[3], lp[3];
-	NSBezierPathElement pre, elem;
 
 	if ([self elementCount] < 2)
 		return p;
@@ -1619,33 +1641,11 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 		if (slope)
 			*slope = Slope(ap[0], lp[0]);
 	} else {
-		NSBezierPath* temp = [self bezierPathByTrimmingToLength:length];
-
-		// given the trimmed path, the desired point is at the end of the path.
-
-		NSInteger ec = [temp elementCount];
-		CGFloat slp = 1;
-
-		if (ec > 1) {
-			elem = [temp elementAtIndex:ec - 1
-					   associatedPoints:ap];
-			pre = [temp elementAtIndex:ec - 2
-					  associatedPoints:lp];
-
-			if (pre == NSCurveToBezierPathElement)
-				lp[0] = lp[2];
+		// the shared table is only measured once for the path, but checking it still means a pass over the path - callers wanting many
+		// points on the same path should get the table and keep it rather than calling this repeatedly
 
-			if (elem == NSCurveToBezierPathElement) {
-				slp = Slope(ap[1], ap[2]);
-				p = ap[2];
-			} else {
-				slp = Slope(lp[0], ap[0]);
-				p = ap[0];
-			}
-		}
-
-		if (slope)
-			*slope = slp;
+		p = [[self arcLengthTable] pointAtLength:length
+										   slope:slope];
 	}
 	return p;
 }
@@ -1753,6 +1753,77 @@ static void InterpolatePoints(const NSPoint v[3], NSPoint* cp1, NSPoint* cp2, co
 	}
 }
 
+#pragma mark -
+#pragma mark - analytic hit-testing
+
+static BOOL PathFillContainsPoint(NSBezierPath* path, NSPoint p)
+{
+	// uses Omni's winding count so that the path's own winding rule is honoured. A point exactly on the outline counts as inside.
+
+	NSInteger winding = 0;
+	NSUInteger onPath = 0;
+
+	[path getWinding:&winding
+			  andHit:&onPath
+			forPoint:p];
+
+	if (onPath > 0)
+		return YES;
+
+	if ([path windingRule] == NSEvenOddWindingRule)
+		return (winding & 1) != 0;
+	else
+		return winding != 0;
+}
+
+- (BOOL)isHitByRect:(NSRect)rect filled:(BOOL)filled strokeWidth:(CGFloat)width
+{
+	if ([self isEmpty])
+		return NO;
+
+	// a zero width stroke still draws a hairline, so allow half a point either side of it
+
+	BOOL stroked = (width > 0.0 || !filled);
+	CGFloat padding = stroked ? MAX(width * 0.5, 0.5) : 0.0;
+
+	// trivial rejection against the padded control point bounds. NSIntersectsRect isn't used here because it rejects
+	// zero-height or zero-width bounds, which straight horizontal or vertical lines have.
+
+	NSRect br = NSInsetRect([self controlPointBounds], -padding, -padding);
+
+	if (NSMaxX(rect) < NSMinX(br) || NSMinX(rect) > NSMaxX(br) || NSMaxY(rect) < NSMinY(br) || NSMinY(rect) > NSMaxY(br))
+		return NO;
+
+	NSPoint cp = NSMakePoint(NSMidX(rect), NSMidY(rect));
+	BOOL isPoint = (NSWidth(rect) < 1.0 && NSHeight(rect) < 1.0);
+
+	if (filled) {
+		if (PathFillContainsPoint(self, cp))
+			return YES;
+
+		if (!isPoint) {
+			// the rect hits the fill if any part of the outline lies within it, or if it lies wholly inside the fill. The first
+			// case also covers a path wholly inside the rect, since Omni's test includes segment start points.
+
+			if ([self intersectsRect:rect])
+				return YES;
+
+			if (PathFillContainsPoint(self, rect.origin))
+				return YES;
+		}
+	}
+
+	if (stroked) {
+		if (isPoint)
+			return [self isStrokeHitByPoint:cp
+									padding:padding];
+		else
+			return [self intersectsRect:NSInsetRect(rect, -padding, -padding)];
+	}
+
+	return NO;
+}
+
 #pragma mark -
 #pragma mark - clipping utilities
 - (void)addInverseClip
@@ -1808,31 +1879,6 @@ static void ConvertPathApplierFunction(void* info, const CGPathElement* element)
 
 #pragma mark -
 
-inline static void subdivideBezier(const NSPoint bez[4], NSPoint bez1[4], NSPoint bez2[4])
-{
-	NSPoint q;
-
-	bez1[0].x = bez[0].x;
-	bez1[0].y = bez[0].y;
-	bez2[3].x = bez[3].x;
-	bez2[3].y = bez[3].y;
-
-	q.x = (bez[1].x + bez[2].x) / 2.0;
-	q.y = (bez[1].y + bez[2].y) / 2.0;
-	bez1[1].x = (bez[0].x + bez[1].x) / 2.0;
-	bez1[1].y = (bez[0].y + bez[1].y) / 2.0;
-	bez2[2].x = (bez[2].x + bez[3].x) / 2.0;
-	bez2[2].y = (bez[2].y + bez[3].y) / 2.0;
-
-	bez1[2].x = (bez1[1].x + q.x) / 2.0;
-	bez1[2].y = (bez1[1].y + q.y) / 2.0;
-	bez2[1].x = (q.x + bez2[2].x) / 2.0;
-	bez2[1].y = (q.y + bez2[2].y) / 2.0;
-
-	bez1[3].x = bez2[0].x = (bez1[2].x + bez2[1].x) / 2.0;
-	bez1[3].y = bez2[0].y = (bez1[2].y + bez2[1].y) / 2.0;
-}
-
 inline void subdivideBezierAtT(const NSPoint bez[4], NSPoint bez1[4], NSPoint bez2[4], CGFloat t)
 {
 	NSPoint q;
@@ -1869,62 +1915,7 @@ static inline CGFloat distanceBetween(NSPoint a, NSPoint b)
 static CGFloat lengthOfBezier(const NSPoint bez[4],
 	CGFloat acceptableError)
 {
-	CGFloat polyLen = 0.0;
-	CGFloat chordLen = distanceBetween(bez[0], bez[3]);
-	CGFloat retLen, errLen;
-	NSUInteger n;
-
-	for (n = 0; n < 3; ++n)
-		polyLen += distanceBetween(bez[n], bez[n + 1]);
-
-	errLen = polyLen - chordLen;
-
-	if (errLen > acceptableError) {
-		NSPoint left[4], right[4];
-		subdivideBezier(bez, left, right);
-		retLen = (lengthOfBezier(left, acceptableError)
-			+ lengthOfBezier(right, acceptableError));
-	} else {
-		retLen = 0.5 * (polyLen + chordLen);
-	}
-
-	return retLen;
-}
-
-// Split a curve at a specific length
-static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
-	NSPoint bez1[4],
-	NSPoint bez2[4],
-	CGFloat length,
-	CGFloat acceptableError)
-{
-	CGFloat top = 1.0, bottom = 0.0;
-	CGFloat t, prevT;
-
-	prevT = t = 0.5;
-	for (;;) {
-		CGFloat len1;
-
-		subdivideBezierAtT(bez, bez1, bez2, t);
-
-		len1 = lengthOfBezier(bez1, 0.5 * acceptableError);
-
-		if (fabs(length - len1) < acceptableError)
-			return len1;
-
-		if (length > len1) {
-			bottom = t;
-			t = 0.5 * (t + top);
-		} else if (length < len1) {
-			top = t;
-			t = 0.5 * (bottom + t);
-		}
-
-		if (t == prevT)
-			return len1;
-
-		prevT = t;
-	}
+	return DKBezierLength(bez, acceptableError);
 }
 
 #pragma mark -
@@ -2016,8 +2007,6 @@ static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
 
 #pragma mark -
 
-#define DEFAULT_TRIM_EPSILON 0.1
-
 // Convenience method
 
 - (NSBezierPath*)bezierPathByTrimmingToLength:(CGFloat)trimLength
@@ -2030,86 +2019,13 @@ static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
    of this NSBezierPath. */
 - (NSBezierPath*)bezierPathByTrimmingToLength:(CGFloat)trimLength withMaximumError:(CGFloat)maxError
 {
-	if (trimLength >= [self length])
-		return self;
+	DKBezierArcLengthTable* table = [self arcLengthTableWithMaximumError:maxError];
 
-	NSBezierPath* newPath = [NSBezierPath bezierPath];
-	NSInteger elements = [self elementCount];
-	NSInteger n;
-	CGFloat length = 0.0;
-	NSPoint pointForClose = NSMakePoint(0.0, 0.0);
-	NSPoint lastPoint = NSMakePoint(0.0, 0.0);
-
-	for (n = 0; n < elements; ++n) {
-		NSPoint points[3];
-		NSBezierPathElement element = [self elementAtIndex:n
-										  associatedPoints:points];
-		CGFloat elementLength;
-		CGFloat remainingLength = trimLength - length;
-
-		switch (element) {
-		case NSMoveToBezierPathElement:
-			[newPath moveToPoint:points[0]];
-			pointForClose = lastPoint = points[0];
-			continue;
-
-		case NSLineToBezierPathElement:
-			elementLength = distanceBetween(lastPoint, points[0]);
-
-			if (length + elementLength <= trimLength)
-				[newPath lineToPoint:points[0]];
-			else {
-				CGFloat f = remainingLength / elementLength;
-				[newPath lineToPoint:NSMakePoint(lastPoint.x + f * (points[0].x - lastPoint.x), lastPoint.y + f * (points[0].y - lastPoint.y))];
-				return newPath;
-			}
-
-			length += elementLength;
-			lastPoint = points[0];
-			break;
-
-		case NSCurveToBezierPathElement: {
-			NSPoint bezier[4] = { lastPoint, points[0], points[1], points[2] };
-			elementLength = lengthOfBezier(bezier, maxError);
-
-			if (length + elementLength <= trimLength)
-				[newPath curveToPoint:points[2]
-						controlPoint1:points[0]
-						controlPoint2:points[1]];
-			else {
-				NSPoint bez1[4], bez2[4];
-				subdivideBezierAtLength(bezier, bez1, bez2, remainingLength, maxError);
-				[newPath curveToPoint:bez1[3]
-						controlPoint1:bez1[1]
-						controlPoint2:bez1[2]];
-				return newPath;
-			}
-
-			length += elementLength;
-			lastPoint = points[2];
-			break;
-		}
-
-		case NSClosePathBezierPathElement:
-			elementLength = distanceBetween(lastPoint, pointForClose);
-
-			if (length + elementLength <= trimLength) {
-				[newPath closePath];
-			} else {
-				CGFloat f = remainingLength / elementLength;
-				[newPath lineToPoint:NSMakePoint(lastPoint.x + f * (pointForClose.x - lastPoint.x), lastPoint.y + f * (pointForClose.y - lastPoint.y))];
-				return newPath;
-			}
-
-			length += elementLength;
-			lastPoint = pointForClose;
-			break;
+	if (trimLength >= [table length])
+		return self;
 
-		default:
-			break;
-		}
-	}
-	return newPath;
+	return [table bezierPathFromLength:0
+							  toLength:trimLength];
 }
 
 // Convenience method
@@ -2124,85 +2040,10 @@ static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
 	if (trimLength <= 0)
 		return self;
 
-	NSBezierPath* newPath = [NSBezierPath bezierPath];
-	NSInteger elements = [self elementCount];
-	NSInteger n;
-	CGFloat length = 0.0;
-	NSPoint pointForClose = NSMakePoint(0.0, 0.0);
-	NSPoint lastPoint = NSMakePoint(0.0, 0.0);
-
-	for (n = 0; n < elements; ++n) {
-		NSPoint points[3];
-		NSBezierPathElement element = [self elementAtIndex:n
-										  associatedPoints:points];
-		CGFloat elementLength;
-		CGFloat remainingLength = trimLength - length;
-
-		switch (element) {
-		case NSMoveToBezierPathElement:
-			if (length > trimLength)
-				[newPath moveToPoint:points[0]];
-			pointForClose = lastPoint = points[0];
-			continue;
+	DKBezierArcLengthTable* table = [self arcLengthTableWithMaximumError:maxError];
 
-		case NSLineToBezierPathElement:
-			elementLength = distanceBetween(lastPoint, points[0]);
-
-			if (length > trimLength)
-				[newPath lineToPoint:points[0]];
-			else if (length + elementLength > trimLength) {
-				CGFloat f = remainingLength / elementLength;
-				[newPath moveToPoint:NSMakePoint(lastPoint.x + f * (points[0].x - lastPoint.x), lastPoint.y + f * (points[0].y - lastPoint.y))];
-				[newPath lineToPoint:points[0]];
-			}
-
-			length += elementLength;
-			lastPoint = points[0];
-			break;
-
-		case NSCurveToBezierPathElement: {
-			NSPoint bezier[4] = { lastPoint, points[0], points[1], points[2] };
-			elementLength = lengthOfBezier(bezier, maxError);
-
-			if (length > trimLength)
-				[newPath curveToPoint:points[2]
-						controlPoint1:points[0]
-						controlPoint2:points[1]];
-			else if (length + elementLength > trimLength) {
-				NSPoint bez1[4], bez2[4];
-				subdivideBezierAtLength(bezier, bez1, bez2, remainingLength, maxError);
-				[newPath moveToPoint:bez2[0]];
-				[newPath curveToPoint:bez2[3]
-						controlPoint1:bez2[1]
-						controlPoint2:bez2[2]];
-			}
-
-			length += elementLength;
-			lastPoint = points[2];
-			break;
-		}
-
-		case NSClosePathBezierPathElement:
-			elementLength = distanceBetween(lastPoint, pointForClose);
-
-			if (length > trimLength) {
-				[newPath lineToPoint:pointForClose];
-				[newPath closePath];
-			} else if (length + elementLength > trimLength) {
-				CGFloat f = remainingLength / elementLength;
-				[newPath moveToPoint:NSMakePoint(lastPoint.x + f * (points[0].x - lastPoint.x), lastPoint.y + f * (points[0].y - lastPoint.y))];
-				[newPath lineToPoint:points[0]];
-			}
-
-			length += elementLength;
-			lastPoint = pointForClose;
-			break;
-
-		default:
-			break;
-		}
-	}
-	return newPath;
+	return [table bezierPathFromLength:trimLength
+							  toLength:[table length]];
 }
 
 - (NSBezierPath*)bezierPathByTrimmingFromBothEnds:(CGFloat)trimLength
@@ -2248,10 +2089,14 @@ static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
 
 - (NSBezierPath*)bezierPathByTrimmingFromLength:(CGFloat)startLength toLength:(CGFloat)newLength withMaximumError:(CGFloat)maxError
 {
-	NSBezierPath* temp = [self bezierPathByTrimmingFromLength:startLength
-											 withMaximumError:maxError];
-	return [temp bezierPathByTrimmingToLength:newLength
-							 withMaximumError:maxError];
+	// one lookup in the table for each end, rather than walking the path twice
+
+	DKBezierArcLengthTable* table = [self arcLengthTableWithMaximumError:maxError];
+
+	startLength = MAX(startLength, 0);
+
+	return [table bezierPathFromLength:startLength
+							  toLength:startLength + newLength];
 }
 
 #pragma mark -
@@ -2349,45 +2194,9 @@ static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
 
 - (CGFloat)lengthWithMaximumError:(CGFloat)maxError
 {
-	NSInteger elements = [self elementCount];
-	NSInteger n;
-	CGFloat length = 0.0;
-	NSPoint pointForClose = NSMakePoint(0.0, 0.0);
-	NSPoint lastPoint = NSMakePoint(0.0, 0.0);
-
-	for (n = 0; n < elements; ++n) {
-		NSPoint points[3];
-		NSBezierPathElement element = [self elementAtIndex:n
-										  associatedPoints:points];
-
-		switch (element) {
-		case NSMoveToBezierPathElement:
-			pointForClose = lastPoint = points[0];
-			break;
-
-		case NSLineToBezierPathElement:
-			length += distanceBetween(lastPoint, points[0]);
-			lastPoint = points[0];
-			break;
-
-		case NSCurveToBezierPathElement: {
-			NSPoint bezier[4] = { lastPoint, points[0], points[1], points[2] };
-			length += lengthOfBezier(bezier, maxError);
-			lastPoint = points[2];
-			break;
-		}
-
-		case NSClosePathBezierPathElement:
-			length += distanceBetween(lastPoint, pointForClose);
-			lastPoint = pointForClose;
-			break;
-
-		default:
-			break;
-		}
-	}
+	// the table measures all of the curves in one batch, which is much quicker than measuring them one at a time
 
-	return length;
+	return [[self arcLengthTableWithMaximumError:maxError] length];
 }
 
 @end
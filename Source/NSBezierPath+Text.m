@@ -4,6 +4,7 @@
  @copyright MPL2; see LICENSE.txt
 */
 
+#import "DKBezierArcLengthTable.h"
 #import "DKBezierLayoutManager.h"
 #import "DKGeometryUtilities.h"
 #import "NSBezierPath+Editing.h"
@@ -303,7 +304,6 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	}
 
 	NSTextContainer* tc = [[lm textContainers] lastObject];
-	NSBezierPath* temp;
 	NSUInteger glyphIndex;
 	NSRect gbr;
 	BOOL result = YES;
@@ -323,6 +323,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		// not cached, so work it out and cache it this time
 
 		NSMutableArray* newGlyphCache = [NSMutableArray array];
+		DKBezierArcLengthTable* table = [self arcLengthTable];
+		CGFloat pathLength = [table length];
 		DKPathGlyphInfo* posInfo;
 		CGFloat baseline;
 
@@ -350,20 +352,20 @@ static NSDictionary* s_TOPTextAttributes = nil;
 				// Note that this prevents some kinds of accents from getting drawn - need to work out a fix for that.
 
 				if (half > 0) {
-					// get a shortened path that starts at the character location
+					// find the point on the path at the middle of the character
 
-					temp = [self bezierPathByTrimmingFromLength:NSMinX(lineFragmentRect) + layoutLocation.x + half];
+					CGFloat position = NSMinX(lineFragmentRect) + layoutLocation.x + half;
 
 					// if no more room on path, stop laying glyphs
 
-					if ([temp length] < half) {
+					if (pathLength - position < half) {
 						result = NO;
 						break;
 					}
 
-					[temp elementAtIndex:0
-						associatedPoints:&viewLocation];
-					CGFloat angle = [temp slopeStartingPath];
+					CGFloat angle;
+					viewLocation = [table pointAtLength:position
+												  slope:&angle];
 
 					// view location needs to be offset vertically normal to the path to account for the baseline
 
@@ -489,7 +491,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	// wrap the text within the line length but set the height to some arbitrarily large value.
 	// lines beyond the first are ignored anyway, regardless of lineheight.
 
-	CGFloat pathLength = [self length];
+	CGFloat pathLength = [[self arcLengthTable] length];
 
 	// set container size so that the width is the path's length - this will honour left/right/centre paragraphs setting
 	// and truncate at the end of the last whole word that can be fitted.
@@ -843,6 +845,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		offset += (lineThickness * 0.5);
 	}
 
+	DKBezierArcLengthTable* table = [self arcLengthTable];
 	NSBezierPath* trimmedPath;
 
 	// factor in any descender breaks if we have them. Each break alternates between the start of a break and the resumption of the line.
@@ -862,8 +865,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 			breakOffset = sp + [breakVal pointValue].x - padding + DESCENDER_BREAK_OFFSET;
 
 			if ((breakOffset - pos) > gt || !hadFirst)
-				[trimmedPath appendBezierPath:[self bezierPathByTrimmingFromLength:pos
-																		  toLength:breakOffset - pos]];
+				[trimmedPath appendBezierPath:[table bezierPathFromLength:pos
+																 toLength:breakOffset]];
 
 			breakVal = [iter nextObject];
 			if (breakVal)
@@ -873,11 +876,11 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		}
 
 		if ((sp + length - pos) > gt || !hadFirst)
-			[trimmedPath appendBezierPath:[self bezierPathByTrimmingFromLength:pos
-																	  toLength:sp + length - pos]];
+			[trimmedPath appendBezierPath:[table bezierPathFromLength:pos
+															 toLength:sp + length]];
 	} else
-		trimmedPath = [self bezierPathByTrimmingFromLength:sp
-												  toLength:length];
+		trimmedPath = [table bezierPathFromLength:sp
+										 toLength:sp + length];
 
 	[trimmedPath setFlatness:0.1];
 	CGFloat savedFlatness = [NSBezierPath defaultFlatness];
@@ -957,17 +960,18 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		return nil;
 
 	NSMutableArray* array = [[NSMutableArray alloc] init];
+	DKBezierArcLengthTable* table = [self arcLengthTable];
 	NSPoint p;
 	CGFloat slope, distance, length;
 	id placedObject;
 
 	distance = 0;
 
-	length = [self length];
+	length = [table length];
 
 	while (distance <= length) {
-		p = [self pointOnPathAtLength:distance
-								slope:&slope];
+		p = [table pointAtLength:distance
+						   slope:&slope];
 
 		placedObject = [object placeObjectAtPoint:p
 										   onPath:self
@@ -1023,6 +1027,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		return nil;
 
 	NSBezierPath* newPath = [NSBezierPath bezierPath];
+	DKBezierArcLengthTable* table = [self arcLengthTable];
 	NSBezierPath* temp;
 	NSPoint p;
 	CGFloat slope, distance, length;
@@ -1030,11 +1035,11 @@ static NSDictionary* s_TOPTextAttributes = nil;
 
 	distance = phase;
 
-	length = [self length];
+	length = [table length];
 
 	while (distance <= length) {
-		p = [self pointOnPathAtLength:distance
-								slope:&slope];
+		p = [table pointAtLength:distance
+						   slope:&slope];
 
 		if (alt && ((count & 1) == 1))
 			slope += M_PI;
@@ -1091,6 +1096,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		return nil;
 
 	NSMutableArray* array = [[NSMutableArray alloc] init];
+	DKBezierArcLengthTable* table = [self arcLengthTable];
 	NSInteger linkCount = 0;
 	NSPoint prevLink;
 	NSPoint p = NSZeroPoint;
@@ -1098,7 +1104,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	id placedObject;
 
 	distance = 0;
-	length = [self length];
+	length = [table length];
 	prevLink = [self firstPoint];
 
 	while (distance <= length) {
@@ -1112,8 +1118,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		distance += radius;
 
 		if (distance <= length) {
-			p = [self pointOnPathAtLength:distance
-									slope:NULL];
+			p = [table pointAtLength:distance
+							   slope:NULL];
 
 			// point to use will be in this general direction but ensure link length is correct:
 
@@ -1156,11 +1162,12 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	if (object) {
 		// set the object's position to the start of the path initially
 
+		DKBezierArcLengthTable* table = [self arcLengthTable];
 		NSPoint where;
 		CGFloat slope;
 
-		where = [self pointOnPathAtLength:0
-									slope:&slope];
+		where = [table pointAtLength:0
+							   slope:&slope];
 		if ([object moveObjectTo:where
 						position:0
 						   slope:slope
@@ -1181,7 +1188,9 @@ static NSDictionary* s_TOPTextAttributes = nil;
 
 			[parameters setObject:object
 						   forKey:@"target"];
-			[parameters setObject:@([self length])
+			[parameters setObject:table
+						   forKey:@"table"];
+			[parameters setObject:@([table length])
 						   forKey:@"path_length"];
 			[parameters setObject:@(loop)
 						   forKey:@"loop"];
@@ -1230,8 +1239,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	CGFloat slope;
 	id obj = [params objectForKey:@"target"];
 
-	where = [self pointOnPathAtLength:distance
-								slope:&slope];
+	where = [[params objectForKey:@"table"] pointAtLength:distance
+													slope:&slope];
 	shouldStop |= ![obj moveObjectTo:where
 							position:distance
 							   slope:slope
@@ -5,6 +5,7 @@
 */
 
 #import <DKDrawKit/DKBSPDirectObjectStorage.h>
+#import <DKDrawKit/DKRTreeObjectStorage.h>
 #import <XCTest/XCTest.h>
 
 /** @brief Unit Test for the BSP storage sub-system.
@@ -22,6 +23,12 @@ Unit Test for the BSP storage sub-system. This works by populating a storage ins
  */
 - (void)testBSPStorage;
 - (void)testIndexedBSPStorage;
+- (void)testRTreeStorage;
+
+/** objects inserted, moved and removed low in the Z-order between queries must come back in order from the R-tree storage.
+ */
+- (void)testRTreeLazyRenumbering;
+- (void)testBackgroundTreeRebuild;
 
 - (void)populateStorage:(id<DKObjectStorage>)storage canvasSize:(NSSize)canvasSize;
 - (void)deletionTest:(id<DKObjectStorage>)storage;
@@ -37,6 +44,7 @@ Unit Test for the BSP storage sub-system. This works by populating a storage ins
 - (void)verifyIndexSpotcheck:(DKBSPDirectObjectStorage*)storage;
 
 - (void)verifyIndexedStorageIntegrity:(DKBSPObjectStorage*)storage;
+- (void)verifyRTreeStorageIntegrity:(DKRTreeObjectStorage*)storage canvasSize:(NSSize)canvasSize;
 
 @end
 
@@ -236,6 +236,167 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	NSLog(@"testIndexedBSPStorage complete.");
 }
 
+- (void)testBackgroundTreeRebuild
+{
+	NSLog(@"starting 'testBackgroundTreeRebuild'...");
+
+	srandomdev();
+
+	NSSize canvasSize = NSMakeSize(2000, 2000);
+
+	DKBSPObjectStorage* testStorage = [[DKBSPObjectStorage alloc] init];
+
+	[testStorage setCanvasSize:canvasSize];
+	[self populateStorage:testStorage
+			   canvasSize:canvasSize];
+
+	NSUInteger rebuilds = [testStorage treeRebuildCount];
+
+	// add objects one at a time until the tree has to be deepened. Queries must stay correct while the new tree is being built,
+	// and the changes made meanwhile must find their way into it.
+
+	NSUInteger i, m = NUMBER_OF_OBJECTS * 10;
+
+	for (i = 0; i < m; ++i) {
+		testStorableObject* tso = [[testStorableObject alloc] init];
+		[tso setBounds:NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(1, MAX_OBJECT_SIZE), randomFloat(1, MAX_OBJECT_SIZE))];
+
+		[testStorage insertObject:tso
+				 inObjectsAtIndex:randomUnsigned(0, [testStorage countOfObjects])];
+		[tso release];
+
+		if ((i % NUMBER_OF_OBJECTS) == 0 && [testStorage isRebuildingTree]) {
+			[self retrievalTest:testStorage
+					 canvasSize:canvasSize];
+			[self reorderingTest:testStorage];
+		}
+	}
+
+	[testStorage waitForTreeRebuild];
+
+	XCTAssertFalse([testStorage isRebuildingTree], @"tree rebuild still pending after waiting for it");
+	XCTAssertTrue([testStorage treeRebuildCount] > rebuilds, @"tree was not rebuilt as the number of objects grew");
+
+	[self verifyIndexedStorageIntegrity:testStorage];
+	[self retrievalTest:testStorage
+			 canvasSize:canvasSize];
+	[self pointRetrievalTest:testStorage
+				  canvasSize:canvasSize];
+
+	NSLog(@"%lu tree rebuilds, %g seconds in total", (unsigned long)[testStorage treeRebuildCount], [testStorage treeRebuildDuration]);
+
+	[testStorage release];
+	NSLog(@"testBackgroundTreeRebuild complete.");
+}
+
+- (void)testRTreeStorage
+{
+	NSLog(@"starting 'testRTreeStorage'...");
+
+	srandomdev();
+
+	NSSize canvasSize = NSMakeSize(2000, 2000);
+
+	DKRTreeObjectStorage* testStorage = [[DKRTreeObjectStorage alloc] init];
+
+	[testStorage setCanvasSize:canvasSize];
+
+	[self populateStorage:testStorage
+			   canvasSize:canvasSize];
+	[self verifyRTreeStorageIntegrity:testStorage
+						   canvasSize:canvasSize];
+
+	// bulk load the same objects, which packs the tree, and check nothing was lost
+
+	[testStorage setObjects:[testStorage objects]];
+	[self verifyRTreeStorageIntegrity:testStorage
+						   canvasSize:canvasSize];
+	XCTAssertTrue([testStorage treeHeight] > 1, @"packed tree has only a single level for %lu objects", (unsigned long)[testStorage countOfObjects]);
+
+	NSUInteger v, u = NUMBER_OF_MAIN_TESTS;
+
+	for (v = 0; v < u; ++v) {
+		NSLog(@" =========  beginning main test loop, #%lu =========", (unsigned long)v);
+
+		[self deletionTest:testStorage];
+		[self verifyRTreeStorageIntegrity:testStorage
+							   canvasSize:canvasSize];
+
+		[self insertionTest:testStorage
+				 canvasSize:canvasSize];
+		[self verifyRTreeStorageIntegrity:testStorage
+							   canvasSize:canvasSize];
+
+		[self retrievalTest:testStorage
+				 canvasSize:canvasSize];
+		[self verifyRTreeStorageIntegrity:testStorage
+							   canvasSize:canvasSize];
+
+		[self replacementTest:testStorage
+				   canvasSize:canvasSize];
+		[self verifyRTreeStorageIntegrity:testStorage
+							   canvasSize:canvasSize];
+
+		[self reorderingTest:testStorage];
+		[self verifyRTreeStorageIntegrity:testStorage
+							   canvasSize:canvasSize];
+
+		[self pointRetrievalTest:testStorage
+					  canvasSize:canvasSize];
+		[self verifyRTreeStorageIntegrity:testStorage
+							   canvasSize:canvasSize];
+	}
+
+	// relaxed Z-order must still return the same set of objects
+
+	NSRect canvas = NSMakeRect(0, 0, canvasSize.width, canvasSize.height);
+	NSArray* strict = [testStorage objectsIntersectingRect:canvas
+													inView:nil
+												   options:0];
+	NSArray* relaxed = [testStorage objectsIntersectingRect:canvas
+													 inView:nil
+													options:kDKZOrderMayBeRelaxed];
+
+	XCTAssertEqualObjects([NSSet setWithArray:strict], [NSSet setWithArray:relaxed], @"relaxed Z-order query returned different objects");
+
+	[testStorage release];
+	NSLog(@"testRTreeStorage complete.");
+}
+
+- (void)testRTreeLazyRenumbering
+{
+	// objects inserted one at a time at the bottom of the Z-order, moved and removed between queries must still come back
+	// in Z-order, though the storage only renumbers them when queried
+
+	DKRTreeObjectStorage* testStorage = [[DKRTreeObjectStorage alloc] init];
+	NSRect canvas = NSMakeRect(0, 0, 1000, 1000);
+	NSUInteger i;
+
+	for (i = 0; i < 200; ++i) {
+		testStorableObject* tso = [[testStorableObject alloc] init];
+
+		[tso setBounds:NSMakeRect(randomFloat(0, 900), randomFloat(0, 900), 50, 50)];
+		[testStorage insertObject:tso
+				 inObjectsAtIndex:0];
+		[tso release];
+
+		if ((i % 50) == 49) {
+			[testStorage moveObject:[testStorage objectInObjectsAtIndex:[testStorage countOfObjects] - 1]
+							toIndex:0];
+			[testStorage removeObjectFromObjectsAtIndex:[testStorage countOfObjects] / 2];
+		}
+	}
+
+	NSArray* found = [testStorage objectsIntersectingRect:canvas
+												   inView:nil
+												  options:0];
+
+	XCTAssertEqualObjects(found, [testStorage objects], @"objects found through the tree aren't in Z-order");
+	[self verifyRenumbering:(DKBSPDirectObjectStorage*)testStorage];
+
+	[testStorage release];
+}
+
 - (void)populateStorage:(id<DKObjectStorage>)storage canvasSize:(NSSize)canvasSize
 {
 	NSUInteger i, m = NUMBER_OF_OBJECTS;
@@ -748,6 +909,25 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	}
 }
 
+- (void)verifyRTreeStorageIntegrity:(DKRTreeObjectStorage*)storage canvasSize:(NSSize)canvasSize
+{
+	// the R-tree storage records each object's Z-index, and every object must be reachable through the tree. Indexes are
+	// brought up to date by a query, so the query comes first
+
+	NSLog(@"checking R-tree storage integrity...");
+
+	NSArray* all = [storage objectsIntersectingRect:NSMakeRect(-MAX_OBJECT_SIZE, -MAX_OBJECT_SIZE, canvasSize.width + 2 * MAX_OBJECT_SIZE, canvasSize.height + 2 * MAX_OBJECT_SIZE)
+											 inView:nil
+											options:0];
+
+	XCTAssertEqualObjects(all, [storage objects], @"objects found through the tree do not match the linear array");
+
+	[self verifyRenumbering:(DKBSPDirectObjectStorage*)storage];
+
+	for (testStorableObject* tso in [storage objects])
+		XCTAssertEqual([tso storage], storage, @"a storage back-pointer wasn't pointing to the storage (%@)", tso);
+}
+
 @end
 
 #pragma mark -
@@ -840,7 +1020,12 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 
 - (NSArray*)leaves
 {
-	return mLeaves;
+	NSMutableArray* leaves = [NSMutableArray array];
+
+	for (NSUInteger i = 0; i < [self countOfLeaves]; ++i)
+		[leaves addObject:[self indexesInLeafAtIndex:i]];
+
+	return leaves;
 }
 
 @end
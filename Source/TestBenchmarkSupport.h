@@ -0,0 +1,43 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+/** @brief Timing and reporting shared by the benchmarks.
+
+Timing and reporting shared by the benchmarks. Each workload records one sample per operation, in mach absolute time ticks, into a
+ DKBenchmarkTimings; DKBenchmarkSummary() then turns them into the operation count, total time, operations per second and latency
+ percentiles that every benchmark reports. The remaining functions read the benchmark's settings from the environment and write
+ the results out as JSON, so that runs can be compared to track regressions.
+*/
+
+/// a set of per-operation timings for one workload
+typedef struct {
+	uint64_t* samples;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKBenchmarkTimings;
+
+/** adds one sample, in mach absolute time ticks, to the timings, growing the storage as needed.
+ */
+void DKBenchmarkRecordSample(DKBenchmarkTimings* timings, uint64_t ticks);
+
+/** frees the timings' storage.
+ */
+void DKBenchmarkFreeTimings(DKBenchmarkTimings* timings);
+
+/** summarises the timings, sorting the samples as a side effect. The result has the keys "operations", "seconds", "ops_per_sec",
+ "p50_us", "p90_us", "p99_us" and "max_us", and is mutable so that the benchmark can add the keys identifying the workload.
+ */
+NSMutableDictionary<NSString*, id>* DKBenchmarkSummary(DKBenchmarkTimings* timings);
+
+/** returns the sizes listed, comma-separated, in the environment variable <key>, or <defaultSizes> if it's not set.
+ */
+NSArray<NSNumber*>* DKBenchmarkSizes(NSDictionary<NSString*, NSString*>* env, NSString* key, NSArray<NSNumber*>* defaultSizes);
+
+/** writes the results as a JSON report to <outputPath>, or to the log under <title> if that's nil.
+ */
+BOOL DKBenchmarkWriteReport(NSArray<NSDictionary*>* results, NSString* outputPath, NSString* title, NSError** error);
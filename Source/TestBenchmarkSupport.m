@@ -0,0 +1,121 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestBenchmarkSupport.h"
+#include <mach/mach_time.h>
+
+static double nanosecondsFromTicks(uint64_t ticks);
+static int compareSamples(const void* a, const void* b);
+
+void DKBenchmarkRecordSample(DKBenchmarkTimings* timings, uint64_t ticks)
+{
+	if (timings->count == timings->capacity) {
+		timings->capacity = MAX(timings->capacity * 2, 256U);
+		timings->samples = reallocf(timings->samples, sizeof(uint64_t) * timings->capacity);
+	}
+
+	timings->samples[timings->count++] = ticks;
+}
+
+void DKBenchmarkFreeTimings(DKBenchmarkTimings* timings)
+{
+	free(timings->samples);
+	timings->samples = NULL;
+	timings->count = timings->capacity = 0;
+}
+
+NSMutableDictionary<NSString*, id>* DKBenchmarkSummary(DKBenchmarkTimings* timings)
+{
+	NSMutableDictionary* result = [NSMutableDictionary dictionary];
+	NSUInteger i, count = timings->count;
+	uint64_t total = 0;
+
+	[result setObject:@(count)
+			   forKey:@"operations"];
+
+	if (count == 0)
+		return result;
+
+	for (i = 0; i < count; ++i)
+		total += timings->samples[i];
+
+	qsort(timings->samples, count, sizeof(uint64_t), compareSamples);
+
+	double seconds = nanosecondsFromTicks(total) / 1e9;
+	double (^percentile)(double) = ^double(double p) {
+		NSUInteger ix = MIN((NSUInteger)(p * count), count - 1);
+		return nanosecondsFromTicks(timings->samples[ix]) / 1e3;
+	};
+
+	[result addEntriesFromDictionary:@{ @"seconds" : @(seconds),
+		@"ops_per_sec" : @(seconds > 0 ? count / seconds : 0),
+		@"p50_us" : @(percentile(0.5)),
+		@"p90_us" : @(percentile(0.9)),
+		@"p99_us" : @(percentile(0.99)),
+		@"max_us" : @(percentile(1.0)) }];
+
+	return result;
+}
+
+NSArray<NSNumber*>* DKBenchmarkSizes(NSDictionary<NSString*, NSString*>* env, NSString* key, NSArray<NSNumber*>* defaultSizes)
+{
+	NSString* sizeList = [env objectForKey:key];
+
+	if ([sizeList length] == 0)
+		return defaultSizes;
+
+	NSMutableArray* sizes = [NSMutableArray array];
+
+	for (NSString* size in [sizeList componentsSeparatedByString:@","])
+		[sizes addObject:@([size integerValue])];
+
+	return sizes;
+}
+
+BOOL DKBenchmarkWriteReport(NSArray<NSDictionary*>* results, NSString* outputPath, NSString* title, NSError** error)
+{
+	NSDictionary* report = @{ @"date" : [[NSDate date] description],
+		@"host" : [[NSProcessInfo processInfo] hostName],
+		@"results" : results };
+
+	NSData* json = [NSJSONSerialization dataWithJSONObject:report
+												   options:NSJSONWritingPrettyPrinted
+													 error:error];
+	if (json == nil)
+		return NO;
+
+	if (outputPath)
+		return [json writeToFile:outputPath
+						 options:NSDataWritingAtomic
+						   error:error];
+
+	NSString* str = [[NSString alloc] initWithData:json
+										  encoding:NSUTF8StringEncoding];
+	NSLog(@"%@ results:\n%@", title, str);
+	[str release];
+
+	return YES;
+}
+
+static double nanosecondsFromTicks(uint64_t ticks)
+{
+	static mach_timebase_info_data_t sTimebase;
+	static dispatch_once_t onceToken;
+
+	dispatch_once(&onceToken, ^{
+		mach_timebase_info(&sTimebase);
+	});
+
+	return (double)ticks * sTimebase.numer / sTimebase.denom;
+}
+
+static int compareSamples(const void* a, const void* b)
+{
+	uint64_t sa = *(const uint64_t*)a;
+	uint64_t sb = *(const uint64_t*)b;
+
+	return (sa < sb) ? -1 : (sa > sb) ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <DKDrawKit/DKBinaryArchiver.h>
+#import <XCTest/XCTest.h>
+
+/** @brief Unit Test for the binary archive format.
+
+Unit Test for the binary archive format. Object graphs are written to a temporary file with \c DKBinaryArchiver and read back, either
+ directly with \c DKBinaryUnarchiver or as a drawing, and compared with what was written. Damaged archives must be turned away with an
+ error rather than an exception.
+*/
+@interface TestBinaryArchiver : XCTestCase
+
+/** a drawing with several layers, nested groups and a style shared between layers must come back with the same structure, and with the
+ shared style still shared.
+ */
+- (void)testDrawingRoundTrip;
+
+/** an object encoded in several places must come back as one object, and a conditional reference must come back only if the object it
+ refers to was encoded unconditionally.
+ */
+- (void)testSharedAndConditionalObjects;
+
+/** data objects either side of the size at which they're stored as blobs must come back intact, as must the data of an image shape.
+ */
+- (void)testDataBlobs;
+
+/** an object archived under an obsolete class name must be decoded as its current class, through the unarchiving helper.
+ */
+- (void)testClassSubstitution;
+
+/** layers decoded concurrently that have their own copies of a style must end up sharing one of them, and always the same one.
+ */
+- (void)testConcurrentLayerStyles;
+
+/** a drawing opened with a hidden layer, which is loaded as a placeholder, must be deallocated when released, both before and after
+ the layer has loaded its objects, which must then share the drawing's styles.
+ */
+- (void)testPlaceholderLayerRelease;
+
+/** empty, truncated and corrupt archives must fail with an error, and must not raise.
+ */
+- (void)testDamagedArchives;
+
+@end
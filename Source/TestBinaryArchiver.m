@@ -0,0 +1,588 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestBinaryArchiver.h"
+#import <DKDrawKit/DKDrawing.h>
+#import <DKDrawKit/DKObjectDrawingLayer.h>
+#import <DKDrawKit/DKDrawableShape.h>
+#import <DKDrawKit/DKShapeGroup.h>
+#import <DKDrawKit/DKImageShape.h>
+#import <DKDrawKit/DKStyle.h>
+#import <DKDrawKit/DKStrokeDash.h>
+#import <DKDrawKit/DKUnarchivingHelper.h>
+
+#define SMALL_DATA_LENGTH 1000
+#define LARGE_DATA_LENGTH (200 * 1024)
+#define IMAGE_SIZE 256
+
+/** @brief A minimal object graph node, which encodes its parent conditionally as a tree of views would.
+ */
+@interface TestArchiveNode : NSObject <NSCoding> {
+	NSString* mName;
+	NSArray* mChildren;
+	id mShared;
+	TestArchiveNode* mParent; // not retained
+	id mConditional;
+	NSData* mData;
+}
+
+@property (copy) NSString* name;
+@property (retain) NSArray* children;
+@property (retain) id shared;
+@property (assign) TestArchiveNode* parent;
+@property (retain) id conditional;
+@property (copy) NSData* data;
+
+@end
+
+static NSData* randomData(NSUInteger length)
+{
+	NSMutableData* data = [NSMutableData dataWithLength:length];
+	uint8_t* bytes = [data mutableBytes];
+	NSUInteger i;
+
+	for (i = 0; i < length; ++i)
+		bytes[i] = (uint8_t)random();
+
+	return data;
+}
+
+static NSData* noisyImageData(void)
+{
+	// random pixels don't compress, so the image data is well over the blob size
+
+	NSBitmapImageRep* rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
+																	pixelsWide:IMAGE_SIZE
+																	pixelsHigh:IMAGE_SIZE
+																 bitsPerSample:8
+															   samplesPerPixel:4
+																	  hasAlpha:YES
+																	  isPlanar:NO
+																colorSpaceName:NSDeviceRGBColorSpace
+																   bytesPerRow:IMAGE_SIZE * 4
+																  bitsPerPixel:32];
+	NSData* noise = randomData(IMAGE_SIZE * IMAGE_SIZE * 4);
+
+	memcpy([rep bitmapData], [noise bytes], [noise length]);
+
+	NSData* tiff = [rep TIFFRepresentation];
+	[rep release];
+
+	return tiff;
+}
+
+@interface TestBinaryArchiver ()
+
+- (NSURL*)temporaryURL;
+- (NSData*)archivedDataWithRootObject:(id)object;
+- (id)unarchivedObjectWithData:(NSData*)data;
+- (NSData*)archivedDrawing:(DKDrawing*)drawing;
+
+@end
+
+#pragma mark -
+
+@implementation TestBinaryArchiver
+
+- (void)testDrawingRoundTrip
+{
+	DKDrawing* drawing = [DKDrawing defaultDrawingWithSize:NSMakeSize(500, 500)];
+	DKObjectDrawingLayer* first = [drawing activeLayerOfClass:[DKObjectDrawingLayer class]];
+	DKObjectDrawingLayer* second = [[DKObjectDrawingLayer alloc] init];
+
+	[drawing addLayer:second
+		andActivateIt:NO];
+	[second release];
+
+	XCTAssertNotNil(first, @"default drawing has no drawing layer");
+
+	DKStyle* sharedStyle = [DKStyle styleWithFillColour:[NSColor redColor]
+										   strokeColour:[NSColor blackColor]];
+
+	// a group within a group in the first layer, and a loose shape in each layer, all sharing one style
+
+	DKDrawableShape* a = [DKDrawableShape drawableShapeWithRect:NSMakeRect(10, 10, 50, 50)];
+	DKDrawableShape* b = [DKDrawableShape drawableShapeWithOvalInRect:NSMakeRect(80, 10, 50, 50)];
+	DKDrawableShape* c = [DKDrawableShape drawableShapeWithRect:NSMakeRect(10, 80, 50, 50)];
+	DKDrawableShape* loose = [DKDrawableShape drawableShapeWithRect:NSMakeRect(200, 200, 40, 40)];
+	DKDrawableShape* other = [DKDrawableShape drawableShapeWithRect:NSMakeRect(300, 300, 40, 40)];
+
+	for (DKDrawableShape* shape in @[ a, b, c, loose, other ])
+		[shape setStyle:sharedStyle];
+
+	XCTAssertTrue([a style] == [other style], @"shapes don't share the style before archiving");
+
+	DKShapeGroup* inner = [DKShapeGroup groupWithObjects:@[ a, b ]];
+	DKShapeGroup* outer = [DKShapeGroup groupWithObjects:@[ inner, c ]];
+
+	[first addObjectsFromArray:@[ outer, loose ]];
+	[second addObject:other];
+
+	DKDrawing* copy = [DKDrawing drawingWithBinaryData:[self archivedDrawing:drawing]
+												 error:NULL];
+
+	XCTAssertNotNil(copy, @"drawing didn't round trip");
+
+	NSArray* layers = [copy flattenedLayersOfClass:[DKObjectDrawingLayer class]];
+	XCTAssertEqual([layers count], (NSUInteger)2, @"drawing layers weren't all decoded");
+
+	if ([layers count] != 2)
+		return;
+
+	DKObjectDrawingLayer* firstCopy = [layers objectAtIndex:0];
+	DKObjectDrawingLayer* secondCopy = [layers objectAtIndex:1];
+
+	XCTAssertEqual([[firstCopy objects] count], (NSUInteger)2, @"first layer has the wrong number of objects");
+	XCTAssertEqual([[secondCopy objects] count], (NSUInteger)1, @"second layer has the wrong number of objects");
+
+	DKShapeGroup* outerCopy = [[firstCopy objects] firstObject];
+	XCTAssertTrue([outerCopy isKindOfClass:[DKShapeGroup class]], @"outer group came back as %@", [outerCopy class]);
+
+	NSArray* outerObjects = [outerCopy groupObjects];
+	XCTAssertEqual([outerObjects count], (NSUInteger)2, @"outer group has the wrong number of objects");
+
+	DKShapeGroup* innerCopy = [outerObjects firstObject];
+	XCTAssertTrue([innerCopy isKindOfClass:[DKShapeGroup class]], @"inner group came back as %@", [innerCopy class]);
+	XCTAssertEqual([[innerCopy groupObjects] count], (NSUInteger)2, @"inner group has the wrong number of objects");
+	XCTAssertTrue([innerCopy container] == outerCopy, @"inner group isn't contained by the outer group");
+	XCTAssertTrue(NSEqualRects([outerCopy bounds], [outer bounds]), @"outer group moved");
+
+	DKStyle* styleCopy = [[[innerCopy groupObjects] firstObject] style];
+	DKStyle* otherStyleCopy = [[[secondCopy objects] firstObject] style];
+
+	XCTAssertNotNil(styleCopy, @"style wasn't decoded");
+	XCTAssertTrue(styleCopy == otherStyleCopy, @"shared style was decoded more than once");
+	XCTAssertTrue(styleCopy == [[[firstCopy objects] lastObject] style], @"shared style was decoded more than once");
+	XCTAssertEqualObjects([styleCopy uniqueKey], [sharedStyle uniqueKey], @"style's key changed");
+}
+
+- (void)testSharedAndConditionalObjects
+{
+	TestArchiveNode* root = [[[TestArchiveNode alloc] init] autorelease];
+	TestArchiveNode* left = [[[TestArchiveNode alloc] init] autorelease];
+	TestArchiveNode* right = [[[TestArchiveNode alloc] init] autorelease];
+	NSMutableArray* shared = [NSMutableArray arrayWithObjects:@"one", @"two", nil];
+
+	[root setName:@"root"];
+	[left setName:@"left"];
+	[right setName:@"right"];
+	[left setShared:shared];
+	[right setShared:shared];
+	[left setParent:root];
+	[right setParent:root];
+	[root setChildren:@[ left, right ]];
+
+	// nothing else refers to this, so it must be dropped
+
+	[left setConditional:@"unreferenced"];
+
+	TestArchiveNode* rootCopy = [self unarchivedObjectWithData:[self archivedDataWithRootObject:root]];
+
+	XCTAssertEqualObjects([rootCopy name], @"root", @"root didn't round trip");
+	XCTAssertEqual([[rootCopy children] count], (NSUInteger)2, @"children didn't round trip");
+
+	TestArchiveNode* leftCopy = [[rootCopy children] firstObject];
+	TestArchiveNode* rightCopy = [[rootCopy children] lastObject];
+
+	XCTAssertEqualObjects([leftCopy name], @"left", @"children are out of order");
+	XCTAssertEqualObjects([leftCopy shared], shared, @"shared object changed");
+	XCTAssertTrue([leftCopy shared] == [rightCopy shared], @"shared object was decoded more than once");
+	XCTAssertTrue([leftCopy parent] == rootCopy, @"conditional reference to an encoded object was lost");
+	XCTAssertTrue([rightCopy parent] == rootCopy, @"conditional reference to an encoded object was lost");
+	XCTAssertNil([leftCopy conditional], @"conditional reference to an object that wasn't encoded was kept");
+}
+
+- (void)testDataBlobs
+{
+	srandom(1);
+
+	TestArchiveNode* small = [[[TestArchiveNode alloc] init] autorelease];
+	TestArchiveNode* large = [[[TestArchiveNode alloc] init] autorelease];
+	TestArchiveNode* root = [[[TestArchiveNode alloc] init] autorelease];
+
+	[small setData:randomData(SMALL_DATA_LENGTH)];
+	[large setData:randomData(LARGE_DATA_LENGTH)];
+	[root setChildren:@[ small, large ]];
+
+	TestArchiveNode* rootCopy = [self unarchivedObjectWithData:[self archivedDataWithRootObject:root]];
+
+	XCTAssertEqualObjects([[[rootCopy children] firstObject] data], [small data], @"small data didn't round trip");
+	XCTAssertEqualObjects([[[rootCopy children] lastObject] data], [large data], @"large data didn't round trip");
+
+	// image data goes through the drawing's image manager
+
+	NSData* imageData = noisyImageData();
+	DKImageShape* imageShape = [[DKImageShape alloc] initWithImageData:imageData];
+	DKDrawing* drawing = [DKDrawing defaultDrawingWithSize:NSMakeSize(500, 500)];
+
+	XCTAssertNotNil(imageShape, @"couldn't make an image shape");
+	XCTAssertGreaterThan([imageData length], (NSUInteger)LARGE_DATA_LENGTH, @"image data is too small to be stored as a blob");
+
+	[[drawing activeLayerOfClass:[DKObjectDrawingLayer class]] addObject:imageShape];
+	[imageShape release];
+
+	DKDrawing* copy = [DKDrawing drawingWithBinaryData:[self archivedDrawing:drawing]
+												 error:NULL];
+	DKImageShape* imageShapeCopy = [[[copy activeLayerOfClass:[DKObjectDrawingLayer class]] objects] firstObject];
+
+	XCTAssertTrue([imageShapeCopy isKindOfClass:[DKImageShape class]], @"image shape came back as %@", [imageShapeCopy class]);
+	XCTAssertEqualObjects([imageShapeCopy imageData], imageData, @"image data didn't round trip");
+}
+
+- (void)testClassSubstitution
+{
+	CGFloat pattern[2] = { 5, 3 };
+	DKStrokeDash* dash = [DKStrokeDash dashWithPattern:pattern
+												 count:2];
+
+	// archive the dash under its name from before the GC prefix was changed to DK. The helper must map it back
+
+	[NSKeyedArchiver setClassName:@"GCLineDash"
+						 forClass:[DKStrokeDash class]];
+
+	NSData* data = [self archivedDataWithRootObject:dash];
+
+	[NSKeyedArchiver setClassName:nil
+						 forClass:[DKStrokeDash class]];
+
+	DKBinaryUnarchiver* unarch = [[DKBinaryUnarchiver alloc] initForReadingWithData:data];
+	DKUnarchivingHelper* helper = [[DKUnarchivingHelper alloc] init];
+
+	[unarch setDelegate:helper];
+
+	DKStrokeDash* dashCopy = [unarch decodeObjectForKey:@"root"];
+	[unarch finishDecoding];
+
+	XCTAssertTrue([dashCopy isMemberOfClass:[DKStrokeDash class]], @"obsolete class name was decoded as %@", [dashCopy class]);
+
+	CGFloat patternCopy[8];
+	NSInteger count = 0;
+
+	[dashCopy getDashPattern:patternCopy
+					   count:&count];
+
+	XCTAssertEqual(count, (NSInteger)2, @"dash pattern didn't round trip");
+	XCTAssertEqual(patternCopy[0], pattern[0], @"dash pattern didn't round trip");
+	XCTAssertEqual(patternCopy[1], pattern[1], @"dash pattern didn't round trip");
+
+	[unarch release];
+	[helper release];
+}
+
+- (void)testConcurrentLayerStyles
+{
+	// two instances of one style, told apart by name, each used by the objects of a different layer. Decoded concurrently, each layer
+	// has a copy of its own, and the layers must settle on one of them regardless of which thread finishes first
+
+	DKStyle* style = [DKStyle styleWithFillColour:[NSColor blueColor]
+									 strokeColour:nil];
+	[style setName:@"first"];
+
+	DKStyle* twin = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:style]];
+	[twin setName:@"second"];
+
+	XCTAssertEqualObjects([twin uniqueKey], [style uniqueKey], @"style's twin has a different key");
+
+	DKDrawing* drawing = [DKDrawing defaultDrawingWithSize:NSMakeSize(500, 500)];
+	DKObjectDrawingLayer* first = [drawing activeLayerOfClass:[DKObjectDrawingLayer class]];
+	DKObjectDrawingLayer* second = [[DKObjectDrawingLayer alloc] init];
+	NSUInteger i;
+
+	[drawing addLayer:second
+		andActivateIt:NO];
+	[second release];
+
+	for (i = 0; i < 10; ++i) {
+		DKDrawableShape* shape = [DKDrawableShape drawableShapeWithRect:NSMakeRect(20 * i, 10, 15, 15)];
+		DKDrawableShape* other = [DKDrawableShape drawableShapeWithRect:NSMakeRect(20 * i, 100, 15, 15)];
+
+		[shape setStyle:style];
+		[other setStyle:twin];
+		[first addObject:shape];
+		[second addObject:other];
+	}
+
+	NSData* data = [self archivedDrawing:drawing];
+	BOOL concurrently = [DKDrawing decodesLayersConcurrently];
+	NSString* adoptedName = nil;
+	NSUInteger attempt;
+
+	[DKDrawing setDecodesLayersConcurrently:YES];
+
+	for (attempt = 0; attempt < 10; ++attempt) {
+		DKDrawing* copy = [DKDrawing drawingWithBinaryData:data
+													 error:NULL];
+		NSMutableSet* styles = [NSMutableSet set];
+		DKStyle* adopted = nil;
+
+		for (DKObjectDrawingLayer* layer in [copy flattenedLayersOfClass:[DKObjectDrawingLayer class]]) {
+			for (DKDrawableObject* object in [layer objects]) {
+				if (adopted == nil)
+					adopted = [object style];
+
+				XCTAssertTrue([object style] == adopted, @"layers decoded concurrently don't share one style");
+				[styles addObject:[object style]];
+			}
+		}
+
+		XCTAssertEqual([styles count], (NSUInteger)1, @"layers decoded concurrently don't share one style");
+
+		if (adoptedName == nil)
+			adoptedName = [adopted name];
+		else
+			XCTAssertEqualObjects([adopted name], adoptedName, @"a different copy of the style was kept on attempt %lu", (unsigned long)attempt);
+	}
+
+	[DKDrawing setDecodesLayersConcurrently:concurrently];
+}
+
+- (void)testPlaceholderLayerRelease
+{
+	// a hidden layer is loaded as a placeholder, which must not keep the drawing alive once it's released, whether or not it has loaded
+
+	DKDrawing* drawing = [DKDrawing defaultDrawingWithSize:NSMakeSize(500, 500)];
+	DKObjectDrawingLayer* hidden = [[DKObjectDrawingLayer alloc] init];
+	DKStyle* style = [DKStyle styleWithFillColour:[NSColor redColor]
+									 strokeColour:nil];
+	NSUInteger i;
+
+	[drawing addLayer:hidden
+		andActivateIt:NO];
+	[hidden release];
+
+	for (i = 0; i < 10; ++i) {
+		DKDrawableShape* shape = [DKDrawableShape drawableShapeWithRect:NSMakeRect(20 * i, 10, 15, 15)];
+		DKDrawableShape* other = [DKDrawableShape drawableShapeWithRect:NSMakeRect(20 * i, 100, 15, 15)];
+
+		[shape setStyle:style];
+		[other setStyle:style];
+		[[drawing activeLayerOfClass:[DKObjectDrawingLayer class]] addObject:shape];
+		[hidden addObject:other];
+	}
+
+	[hidden setVisible:NO];
+
+	NSData* data = [self archivedDrawing:drawing];
+	NSHashTable* drawings = [NSHashTable weakObjectsHashTable];
+	NSUInteger pass;
+
+	for (pass = 0; pass < 2; ++pass) {
+		BOOL loads = (pass > 0);
+
+		@autoreleasepool {
+			DKDrawing* copy = [DKDrawing drawingWithBinaryData:data
+														 error:NULL];
+			DKObjectDrawingLayer* placeholder = nil;
+			DKObjectDrawingLayer* shown = nil;
+
+			for (DKObjectDrawingLayer* layer in [copy flattenedLayersOfClass:[DKObjectDrawingLayer class]]) {
+				if ([layer visible])
+					shown = layer;
+				else
+					placeholder = layer;
+			}
+
+			XCTAssertTrue([placeholder hasPendingObjects], @"hidden layer wasn't loaded as a placeholder");
+			XCTAssertEqual([placeholder countOfObjects], (NSUInteger)10, @"placeholder has the wrong object count");
+
+			if (loads) {
+				[placeholder loadPendingObjects];
+
+				XCTAssertFalse([placeholder hasPendingObjects], @"placeholder didn't load its objects");
+				XCTAssertEqual([[placeholder objects] count], (NSUInteger)10, @"placeholder loaded the wrong number of objects");
+
+				for (DKDrawableObject* object in [placeholder objects]) {
+					XCTAssertTrue([object layer] == placeholder, @"loaded object doesn't belong to the layer");
+					XCTAssertTrue([object style] == [[[shown objects] firstObject] style], @"loaded object didn't adopt the drawing's style");
+				}
+			}
+
+			[drawings addObject:copy];
+		}
+
+		XCTAssertEqual([[drawings allObjects] count], (NSUInteger)0, @"drawing with a placeholder layer wasn't deallocated (loaded = %d)", (int)loads);
+	}
+}
+
+- (void)testDamagedArchives
+{
+	DKDrawing* drawing = [DKDrawing defaultDrawingWithSize:NSMakeSize(500, 500)];
+	DKObjectDrawingLayer* layer = [drawing activeLayerOfClass:[DKObjectDrawingLayer class]];
+	NSUInteger i;
+
+	for (i = 0; i < 20; ++i)
+		[layer addObject:[DKDrawableShape drawableShapeWithRect:NSMakeRect(20 * i, 10, 15, 15)]];
+
+	NSData* data = [self archivedDrawing:drawing];
+	NSError* error = nil;
+	DKDrawing* copy = nil;
+
+	XCTAssertNotNil([DKDrawing drawingWithBinaryData:data
+											   error:&error],
+		@"undamaged drawing didn't decode: %@", error);
+
+	// an empty file
+
+	NSURL* url = [self temporaryURL];
+	[[NSData data] writeToURL:url
+				   atomically:NO];
+
+	error = nil;
+	XCTAssertNoThrow(copy = [DKDrawing drawingWithContentsOfURL:url
+														  error:&error]);
+	XCTAssertNil(copy, @"empty file decoded");
+	XCTAssertNotNil(error, @"empty file gave no error");
+
+	[[NSFileManager defaultManager] removeItemAtURL:url
+											  error:NULL];
+
+	// truncated at various points, including within the header
+
+	for (NSUInteger length = 0; length < [data length]; length += MAX([data length] / 16, (NSUInteger)1)) {
+		error = nil;
+		copy = nil;
+
+		XCTAssertNoThrow(copy = [DKDrawing drawingWithBinaryData:[data subdataWithRange:NSMakeRange(0, length)]
+														   error:&error],
+			@"truncated archive of %lu bytes raised", (unsigned long)length);
+		XCTAssertNil(copy, @"archive truncated to %lu bytes decoded", (unsigned long)length);
+		XCTAssertNotNil(error, @"archive truncated to %lu bytes gave no error", (unsigned long)length);
+	}
+
+	// overwritten in the middle. Damage to a part of the file that isn't needed may go unnoticed, but damage that is noticed must be reported
+
+	srandom(2);
+
+	for (i = 0; i < 16; ++i) {
+		NSMutableData* corrupt = [[data mutableCopy] autorelease];
+		NSUInteger start = (NSUInteger)random() % [corrupt length];
+		NSUInteger length = MIN((NSUInteger)64, [corrupt length] - start);
+
+		[corrupt replaceBytesInRange:NSMakeRange(start, length)
+						   withBytes:[randomData(length) bytes]];
+
+		error = nil;
+		copy = nil;
+
+		XCTAssertNoThrow(copy = [DKDrawing drawingWithBinaryData:corrupt
+														   error:&error],
+			@"corrupt archive raised");
+
+		if (copy == nil)
+			XCTAssertNotNil(error, @"corrupt archive gave no error");
+	}
+}
+
+- (NSURL*)temporaryURL
+{
+	NSString* name = [NSString stringWithFormat:@"TestBinaryArchiver-%@.drawing", [[NSUUID UUID] UUIDString]];
+
+	return [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+}
+
+- (NSData*)archivedDataWithRootObject:(id)object
+{
+	NSURL* url = [self temporaryURL];
+	NSError* error = nil;
+
+	XCTAssertTrue([DKBinaryArchiver archiveRootObject:object
+												 toURL:url
+												 error:&error],
+		@"couldn't write archive: %@", error);
+
+	// read into memory rather than mapped, so the file can be removed at once
+
+	NSData* data = [NSData dataWithContentsOfURL:url];
+	[[NSFileManager defaultManager] removeItemAtURL:url
+											  error:NULL];
+
+	return data;
+}
+
+- (id)unarchivedObjectWithData:(NSData*)data
+{
+	DKBinaryUnarchiver* unarch = [[DKBinaryUnarchiver alloc] initForReadingWithData:data];
+
+	XCTAssertNotNil(unarch, @"archive isn't readable");
+
+	id object = [[[unarch decodeObjectForKey:@"root"] retain] autorelease];
+	[unarch finishDecoding];
+	[unarch release];
+
+	return object;
+}
+
+- (NSData*)archivedDrawing:(DKDrawing*)drawing
+{
+	NSURL* url = [self temporaryURL];
+	NSError* error = nil;
+
+	XCTAssertTrue([drawing writeBinaryToURL:url
+									  error:&error],
+		@"couldn't write drawing: %@", error);
+
+	NSData* data = [NSData dataWithContentsOfURL:url];
+	[[NSFileManager defaultManager] removeItemAtURL:url
+											  error:NULL];
+
+	return data;
+}
+
+@end
+
+#pragma mark -
+
+@implementation TestArchiveNode
+
+@synthesize name = mName;
+@synthesize children = mChildren;
+@synthesize shared = mShared;
+@synthesize parent = mParent;
+@synthesize conditional = mConditional;
+@synthesize data = mData;
+
+- (instancetype)initWithCoder:(NSCoder*)coder
+{
+	self = [super init];
+	if (self) {
+		mName = [[coder decodeObjectForKey:@"name"] copy];
+		mChildren = [[coder decodeObjectForKey:@"children"] retain];
+		mShared = [[coder decodeObjectForKey:@"shared"] retain];
+		mParent = [coder decodeObjectForKey:@"parent"];
+		mConditional = [[coder decodeObjectForKey:@"conditional"] retain];
+		mData = [[coder decodeObjectForKey:@"data"] copy];
+	}
+
+	return self;
+}
+
+- (void)encodeWithCoder:(NSCoder*)coder
+{
+	[coder encodeObject:mName
+				 forKey:@"name"];
+	[coder encodeObject:mChildren
+				 forKey:@"children"];
+	[coder encodeObject:mShared
+				 forKey:@"shared"];
+	[coder encodeConditionalObject:mParent
+							forKey:@"parent"];
+	[coder encodeConditionalObject:mConditional
+							forKey:@"conditional"];
+	[coder encodeObject:mData
+				 forKey:@"data"];
+}
+
+- (void)dealloc
+{
+	[mName release];
+	[mChildren release];
+	[mShared release];
+	[mConditional release];
+	[mData release];
+	[super dealloc];
+}
+
+@end
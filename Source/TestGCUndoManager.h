@@ -0,0 +1,34 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <DKDrawKit/GCUndoManager.h>
+#import <XCTest/XCTest.h>
+
+/** @brief Unit Test for GCUndoManager.
+
+Unit Test for GCUndoManager. Changes are made to simple target objects whose setters register their own undo tasks, with grouping
+ by event turned off so that each test opens and closes its groups explicitly.
+*/
+@interface TestGCUndoManager : XCTestCase
+
+/** repeated changes to the same property must be coalesced into one task, whether they're the last task or any task in the group,
+ and undoing the group must restore the values from before the first change.
+ */
+- (void)testCoalescing;
+
+/** removing a target's tasks must reach into nested groups, discard the groups left empty, and leave other targets' tasks working.
+ */
+- (void)testRemoveAllActionsWithTarget;
+
+/** setters taking a rect, a point or a BOOL are recorded as compact tasks, which must undo and redo as an invocation would.
+ */
+- (void)testCompactTasks;
+
+/** a memory budget must discard the oldest undo groups and the furthest redo groups, always keeping the newest group on each stack.
+ */
+- (void)testMemoryBudget;
+
+@end
@@ -0,0 +1,410 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestGCUndoManager.h"
+
+#define PAYLOAD_COST 1000
+
+/** @brief An object whose setters register undo tasks, by invocation or by selector.
+ */
+@interface TestUndoTarget : NSObject {
+	GCUndoManager* mUndoManager; // not retained
+	NSInteger mNumber;
+	NSString* mName;
+	NSRect mFrame;
+	NSPoint mOrigin;
+	BOOL mEnabled;
+	id mPayload;
+}
+
+- (instancetype)initWithUndoManager:(GCUndoManager*)um;
+
+@property (nonatomic) NSInteger number;
+@property (nonatomic, copy) NSString* name;
+@property (nonatomic) NSRect frame;
+@property (nonatomic) NSPoint origin;
+@property (nonatomic) BOOL enabled;
+@property (nonatomic, retain) id payload;
+
+@end
+
+/** @brief An undo argument that reports a large, fixed memory cost.
+ */
+@interface TestUndoPayload : NSObject <GCUndoMemoryCost>
+@end
+
+@interface TestGCUndoManager ()
+
+- (GCUndoManager*)makeUndoManager;
+
+@end
+
+#pragma mark -
+
+@implementation TestGCUndoManager
+
+- (void)testCoalescing
+{
+	GCUndoManager* um = [self makeUndoManager];
+	TestUndoTarget* a = [[[TestUndoTarget alloc] initWithUndoManager:um] autorelease];
+	TestUndoTarget* b = [[[TestUndoTarget alloc] initWithUndoManager:um] autorelease];
+
+	[um enableUndoTaskCoalescing];
+
+	// coalescing the last task only drops a change that directly repeats the one before
+
+	[um setCoalescingKind:kGCCoalesceLastTask];
+	[um beginUndoGrouping];
+
+	[a setNumber:1];
+	[a setNumber:2];
+	[a setName:@"one"];
+	[a setNumber:3];
+
+	XCTAssertEqual([[[um currentGroup] tasks] count], (NSUInteger)3, @"only the repeated task should have been coalesced");
+
+	[um endUndoGrouping];
+	[um undo];
+
+	XCTAssertEqual([a number], (NSInteger)0, @"undo didn't restore the number from before the group");
+	XCTAssertNil([a name], @"undo didn't restore the name from before the group");
+
+	// coalescing all matching tasks drops any change to a target and selector already in the group, but not in its subgroups
+
+	[um setCoalescingKind:kGCCoalesceAllMatchingTasks];
+	[um beginUndoGrouping];
+
+	[a setNumber:1];
+	[a setName:@"one"];
+	[a setNumber:2];
+	[a setName:@"two"];
+	[b setNumber:1];
+	[a setNumber:3];
+
+	GCUndoGroup* group = [um currentGroup];
+
+	XCTAssertEqual([[group tasks] count], (NSUInteger)3, @"matching tasks weren't coalesced");
+	XCTAssertTrue([group containsTaskWithTarget:a
+									   selector:@selector(setNumber:)],
+		@"group doesn't know of a task it holds");
+	XCTAssertTrue([group containsTaskWithTarget:b
+									   selector:@selector(setNumber:)],
+		@"group doesn't know of a task it holds");
+	XCTAssertFalse([group containsTaskWithTarget:b
+										selector:@selector(setName:)],
+		@"group claims a task it doesn't hold");
+	XCTAssertEqual([[group tasksWithTarget:a
+								  selector:@selector(setNumber:)] count],
+		(NSUInteger)1, @"coalesced task was kept");
+
+	[um beginUndoGrouping];
+	[a setNumber:4];
+
+	XCTAssertEqual([[[um currentGroup] tasks] count], (NSUInteger)1, @"task in a subgroup was coalesced with one in its parent");
+
+	[um endUndoGrouping];
+	[um endUndoGrouping];
+
+	XCTAssertEqual([a number], (NSInteger)4, @"number wasn't changed");
+
+	[um undo];
+
+	XCTAssertEqual([a number], (NSInteger)0, @"undo didn't restore the number from before the group");
+	XCTAssertNil([a name], @"undo didn't restore the name from before the group");
+	XCTAssertEqual([b number], (NSInteger)0, @"undo didn't restore the other target");
+
+	[um redo];
+
+	XCTAssertEqual([a number], (NSInteger)4, @"redo didn't restore the last number");
+	XCTAssertEqualObjects([a name], @"two", @"redo didn't restore the last name");
+	XCTAssertEqual([b number], (NSInteger)1, @"redo didn't restore the other target");
+}
+
+- (void)testRemoveAllActionsWithTarget
+{
+	GCUndoManager* um = [self makeUndoManager];
+	TestUndoTarget* a = [[[TestUndoTarget alloc] initWithUndoManager:um] autorelease];
+	TestUndoTarget* b = [[[TestUndoTarget alloc] initWithUndoManager:um] autorelease];
+
+	// a group with tasks for both targets, some in nested subgroups, one of which has only tasks for the target being removed
+
+	[um beginUndoGrouping];
+	[a setNumber:1];
+	[um beginUndoGrouping];
+	[b setNumber:1];
+	[a setName:@"one"];
+	[um beginUndoGrouping];
+	[a setNumber:2];
+	[um endUndoGrouping];
+	[um endUndoGrouping];
+	[um endUndoGrouping];
+
+	GCUndoGroup* mixed = [um peekUndo];
+
+	// a group with only tasks for the target being removed
+
+	[um beginUndoGrouping];
+	[a setNumber:3];
+	[a setName:@"two"];
+	[um endUndoGrouping];
+
+	// and one with only tasks for the other target
+
+	[um beginUndoGrouping];
+	[b setNumber:2];
+	[um endUndoGrouping];
+
+	XCTAssertEqual([um numberOfUndoActions], (NSUInteger)3, @"wrong number of groups before removal");
+
+	[um removeAllActionsWithTarget:a];
+
+	XCTAssertEqual([um numberOfUndoActions], (NSUInteger)2, @"group left empty wasn't removed");
+	XCTAssertTrue([[um undoStack] firstObject] == mixed, @"group with other tasks was removed");
+
+	// the mixed group is left with just the subgroup holding the other target's task
+
+	XCTAssertEqual([[mixed tasks] count], (NSUInteger)1, @"target's task or empty subgroup left in the group");
+
+	GCUndoGroup* subgroup = [[mixed tasks] firstObject];
+
+	XCTAssertTrue([subgroup isKindOfClass:[GCUndoGroup class]], @"subgroup holding another target's task was removed");
+	XCTAssertEqual([[subgroup tasks] count], (NSUInteger)1, @"target's task or empty subgroup left in the subgroup");
+	XCTAssertFalse([subgroup containsTaskWithTarget:a
+										   selector:@selector(setName:)],
+		@"subgroup still claims a removed task");
+	XCTAssertTrue([subgroup containsTaskWithTarget:b
+										  selector:@selector(setNumber:)],
+		@"subgroup lost another target's task");
+
+	// undoing everything restores the other target and leaves the removed one alone
+
+	[um undo];
+	[um undo];
+
+	XCTAssertFalse([um canUndo], @"undo stack isn't empty");
+	XCTAssertEqual([b number], (NSInteger)0, @"other target wasn't restored");
+	XCTAssertEqual([a number], (NSInteger)3, @"removed target was changed by undo");
+	XCTAssertEqualObjects([a name], @"two", @"removed target was changed by undo");
+}
+
+- (void)testCompactTasks
+{
+	GCUndoManager* um = [self makeUndoManager];
+	TestUndoTarget* a = [[[TestUndoTarget alloc] initWithUndoManager:um] autorelease];
+	NSRect frame = NSMakeRect(10.5, -20.25, 300, 400.75);
+	NSPoint origin = NSMakePoint(-7.125, 99.5);
+
+	[um beginUndoGrouping];
+	[a setFrame:frame];
+	[a setOrigin:origin];
+	[a setEnabled:YES];
+	[um endUndoGrouping];
+
+	[um beginUndoGrouping];
+	[a setFrame:NSOffsetRect(frame, 5, 5)];
+	[a setOrigin:NSZeroPoint];
+	[a setEnabled:NO];
+	[um endUndoGrouping];
+
+	[um undo];
+
+	XCTAssertTrue(NSEqualRects([a frame], frame), @"rect wasn't restored by undo: %@", NSStringFromRect([a frame]));
+	XCTAssertTrue(NSEqualPoints([a origin], origin), @"point wasn't restored by undo: %@", NSStringFromPoint([a origin]));
+	XCTAssertTrue([a enabled], @"BOOL wasn't restored by undo");
+
+	[um undo];
+
+	XCTAssertTrue(NSEqualRects([a frame], NSZeroRect), @"rect wasn't restored by undo: %@", NSStringFromRect([a frame]));
+	XCTAssertTrue(NSEqualPoints([a origin], NSZeroPoint), @"point wasn't restored by undo: %@", NSStringFromPoint([a origin]));
+	XCTAssertFalse([a enabled], @"BOOL wasn't restored by undo");
+
+	[um redo];
+	[um redo];
+
+	XCTAssertTrue(NSEqualRects([a frame], NSOffsetRect(frame, 5, 5)), @"rect wasn't restored by redo: %@", NSStringFromRect([a frame]));
+	XCTAssertTrue(NSEqualPoints([a origin], NSZeroPoint), @"point wasn't restored by redo: %@", NSStringFromPoint([a origin]));
+	XCTAssertFalse([a enabled], @"BOOL wasn't restored by redo");
+
+	[um undo];
+
+	XCTAssertTrue(NSEqualRects([a frame], frame), @"rect wasn't restored by undo after redo: %@", NSStringFromRect([a frame]));
+	XCTAssertTrue([a enabled], @"BOOL wasn't restored by undo after redo");
+}
+
+- (void)testMemoryBudget
+{
+	GCUndoManager* um = [self makeUndoManager];
+	TestUndoTarget* a = [[[TestUndoTarget alloc] initWithUndoManager:um] autorelease];
+	NSMutableArray* payloads = [NSMutableArray array];
+	NSUInteger i;
+
+	for (i = 0; i < 10; ++i)
+		[payloads addObject:[[[TestUndoPayload alloc] init] autorelease]];
+
+	// each group holds one expensive argument, so the budget is exceeded long before the levels of undo are
+
+	for (i = 0; i < 5; ++i) {
+		[um beginUndoGrouping];
+		[a setPayload:[payloads objectAtIndex:i]];
+		[um endUndoGrouping];
+	}
+
+	XCTAssertEqual([um numberOfUndoActions], (NSUInteger)5, @"groups were discarded without a budget");
+	XCTAssertGreaterThanOrEqual([um memoryUsed], (NSUInteger)(4 * PAYLOAD_COST), @"argument's cost wasn't counted");
+
+	// a budget that fits nothing still keeps the newest group, which must undo the last change
+
+	[um setMemoryBudget:1];
+
+	XCTAssertEqual([um numberOfUndoActions], (NSUInteger)1, @"oldest groups weren't discarded");
+	XCTAssertLessThan([um memoryUsed], (NSUInteger)(2 * PAYLOAD_COST), @"memory used wasn't reduced");
+
+	[um undo];
+
+	XCTAssertTrue([a payload] == [payloads objectAtIndex:3], @"the group kept wasn't the newest");
+	XCTAssertFalse([um canUndo], @"discarded groups can still be undone");
+
+	// closing a group checks the budget too
+
+	[um redo];
+	[um beginUndoGrouping];
+	[a setPayload:[payloads objectAtIndex:5]];
+	[um endUndoGrouping];
+
+	XCTAssertEqual([um numberOfUndoActions], (NSUInteger)1, @"budget wasn't applied when a group was closed");
+
+	// on the redo stack, the group kept is the one that would be redone next
+
+	[um setMemoryBudget:0];
+	[um removeAllActions];
+
+	for (i = 6; i < 10; ++i) {
+		[um beginUndoGrouping];
+		[a setPayload:[payloads objectAtIndex:i]];
+		[um endUndoGrouping];
+	}
+
+	[um undo];
+	[um undo];
+	[um undo];
+
+	XCTAssertTrue([a payload] == [payloads objectAtIndex:6], @"undo didn't restore the payload");
+	XCTAssertEqual([um numberOfRedoActions], (NSUInteger)3, @"redo groups are missing");
+
+	[um setMemoryBudget:1];
+
+	XCTAssertEqual([um numberOfUndoActions], (NSUInteger)1, @"oldest undo groups weren't discarded");
+	XCTAssertEqual([um numberOfRedoActions], (NSUInteger)1, @"furthest redo groups weren't discarded");
+
+	[um redo];
+
+	XCTAssertTrue([a payload] == [payloads objectAtIndex:7], @"the redo group kept wasn't the next to be redone");
+	XCTAssertFalse([um canRedo], @"discarded groups can still be redone");
+
+	[um undo];
+	[um undo];
+
+	XCTAssertTrue([a payload] == [payloads objectAtIndex:5], @"the undo group kept wasn't the newest");
+}
+
+- (GCUndoManager*)makeUndoManager
+{
+	GCUndoManager* um = [[[GCUndoManager alloc] init] autorelease];
+
+	[um setGroupsByEvent:NO];
+
+	return um;
+}
+
+@end
+
+#pragma mark -
+
+@implementation TestUndoTarget
+
+- (instancetype)initWithUndoManager:(GCUndoManager*)um
+{
+	self = [super init];
+	if (self)
+		mUndoManager = um;
+
+	return self;
+}
+
+- (void)setNumber:(NSInteger)number
+{
+	[[mUndoManager prepareWithInvocationTarget:self] setNumber:mNumber];
+	mNumber = number;
+}
+
+@synthesize number = mNumber;
+
+- (void)setName:(NSString*)name
+{
+	[mUndoManager registerUndoWithTarget:self
+								selector:@selector(setName:)
+								  object:mName];
+	[mName release];
+	mName = [name copy];
+}
+
+@synthesize name = mName;
+
+- (void)setFrame:(NSRect)frame
+{
+	[[mUndoManager prepareWithInvocationTarget:self] setFrame:mFrame];
+	mFrame = frame;
+}
+
+@synthesize frame = mFrame;
+
+- (void)setOrigin:(NSPoint)origin
+{
+	[[mUndoManager prepareWithInvocationTarget:self] setOrigin:mOrigin];
+	mOrigin = origin;
+}
+
+@synthesize origin = mOrigin;
+
+- (void)setEnabled:(BOOL)enabled
+{
+	[[mUndoManager prepareWithInvocationTarget:self] setEnabled:mEnabled];
+	mEnabled = enabled;
+}
+
+@synthesize enabled = mEnabled;
+
+- (void)setPayload:(id)payload
+{
+	[mUndoManager registerUndoWithTarget:self
+								selector:@selector(setPayload:)
+								  object:mPayload];
+	[payload retain];
+	[mPayload release];
+	mPayload = payload;
+}
+
+@synthesize payload = mPayload;
+
+- (void)dealloc
+{
+	[mName release];
+	[mPayload release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation TestUndoPayload
+
+- (NSUInteger)undoMemoryCost
+{
+	return PAYLOAD_COST;
+}
+
+@end
@@ -0,0 +1,26 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <DKDrawKit/DKPathDelta.h>
+#import <XCTest/XCTest.h>
+
+/** @brief Unit Test for DKPathDelta.
+
+Unit Test for DKPathDelta. A delta taken between two paths of the same shape must turn one into the other, and the delta it returns
+ must turn it back. Paths that don't have the same elements must be turned away.
+*/
+@interface TestPathDelta : XCTestCase
+
+/** a delta must record only the elements that moved, turn a copy of the first path into the second, and return the delta that restores
+ the first.
+ */
+- (void)testRoundTrip;
+
+/** paths with a different number or kind of elements have no delta, and a delta applied to a path of the wrong size must leave it alone.
+ */
+- (void)testMismatchedPaths;
+
+@end
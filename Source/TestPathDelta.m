@@ -0,0 +1,149 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestPathDelta.h"
+
+static BOOL pathsHaveEqualElements(NSBezierPath* path, NSBezierPath* otherPath)
+{
+	// compares two paths element by element, including every associated point
+
+	NSInteger i, count = [path elementCount];
+	NSPoint a[3], b[3];
+
+	if (count != [otherPath elementCount])
+		return NO;
+
+	for (i = 0; i < count; ++i) {
+		memset(a, 0, sizeof(a));
+		memset(b, 0, sizeof(b));
+
+		if ([path elementAtIndex:i
+				associatedPoints:a] != [otherPath elementAtIndex:i
+												 associatedPoints:b])
+			return NO;
+
+		if (memcmp(a, b, sizeof(a)) != 0)
+			return NO;
+	}
+
+	return YES;
+}
+
+@interface TestPathDelta ()
+
+- (NSBezierPath*)samplePath;
+
+@end
+
+#pragma mark -
+
+@implementation TestPathDelta
+
+- (void)testRoundTrip
+{
+	NSBezierPath* original = [self samplePath];
+	NSBezierPath* target = [self samplePath];
+	NSPoint cp[3];
+
+	// move the end of the line and the second control point of the curve; the other elements stay put
+
+	[target elementAtIndex:2
+		  associatedPoints:cp];
+	cp[1] = NSMakePoint(cp[1].x + 12, cp[1].y - 3);
+	[target setAssociatedPoints:cp
+						atIndex:2];
+
+	cp[0] = NSMakePoint(40, 75);
+	[target setAssociatedPoints:cp
+						atIndex:1];
+
+	DKPathDelta* delta = [DKPathDelta deltaFromPath:original
+											 toPath:target];
+
+	XCTAssertNotNil(delta, @"paths of the same shape had no delta");
+	XCTAssertEqual([delta countOfChangedElements], (NSUInteger)2, @"delta recorded the wrong number of elements");
+
+	NSBezierPath* path = [[original copy] autorelease];
+	DKPathDelta* inverse = [delta applyToPath:path];
+
+	XCTAssertNotNil(inverse, @"delta wasn't applied");
+	XCTAssertTrue(pathsHaveEqualElements(path, target), @"delta didn't produce the target path");
+	XCTAssertEqual([inverse countOfChangedElements], (NSUInteger)2, @"inverse recorded the wrong number of elements");
+
+	DKPathDelta* redo = [inverse applyToPath:path];
+
+	XCTAssertTrue(pathsHaveEqualElements(path, original), @"inverse didn't restore the original path");
+
+	[redo applyToPath:path];
+
+	XCTAssertTrue(pathsHaveEqualElements(path, target), @"inverse of the inverse didn't produce the target path");
+
+	// identical paths give a delta that changes nothing
+
+	delta = [DKPathDelta deltaFromPath:original
+								toPath:[[original copy] autorelease]];
+
+	XCTAssertNotNil(delta, @"identical paths had no delta");
+	XCTAssertEqual([delta countOfChangedElements], (NSUInteger)0, @"identical paths had changed elements");
+}
+
+- (void)testMismatchedPaths
+{
+	NSBezierPath* original = [self samplePath];
+	NSBezierPath* longer = [self samplePath];
+
+	[longer lineToPoint:NSMakePoint(100, 100)];
+
+	XCTAssertNil([DKPathDelta deltaFromPath:original
+									 toPath:longer],
+		@"paths with different element counts had a delta");
+
+	// same number of elements, but a line where the other has a curve
+
+	NSBezierPath* reshaped = [NSBezierPath bezierPath];
+
+	[reshaped moveToPoint:NSMakePoint(10, 10)];
+	[reshaped lineToPoint:NSMakePoint(50, 80)];
+	[reshaped lineToPoint:NSMakePoint(90, 20)];
+	[reshaped closePath];
+
+	XCTAssertEqual([reshaped elementCount], [original elementCount], @"test paths should have the same element count");
+	XCTAssertNil([DKPathDelta deltaFromPath:original
+									 toPath:reshaped],
+		@"paths with different element kinds had a delta");
+
+	// a delta applied to a path with the wrong number of elements is refused, and the path isn't touched
+
+	NSBezierPath* target = [self samplePath];
+	NSPoint p = NSMakePoint(-5, -5);
+
+	[target setAssociatedPoints:&p
+						atIndex:0];
+
+	DKPathDelta* delta = [DKPathDelta deltaFromPath:original
+											 toPath:target];
+	NSBezierPath* path = [[longer copy] autorelease];
+
+	XCTAssertNotNil(delta, @"paths of the same shape had no delta");
+	XCTAssertNil([delta applyToPath:path], @"delta was applied to a path with a different element count");
+	XCTAssertTrue(pathsHaveEqualElements(path, longer), @"refused delta changed the path");
+}
+
+- (NSBezierPath*)samplePath
+{
+	NSBezierPath* path = [NSBezierPath bezierPath];
+
+	[path moveToPoint:NSMakePoint(10, 10)];
+	[path lineToPoint:NSMakePoint(50, 80)];
+	[path curveToPoint:NSMakePoint(90, 20)
+		 controlPoint1:NSMakePoint(60, 90)
+		 controlPoint2:NSMakePoint(85, 60)];
+	[path closePath];
+
+	return path;
+}
+
+@end
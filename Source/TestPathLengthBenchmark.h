@@ -0,0 +1,28 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <XCTest/XCTest.h>
+
+/** @brief Performance benchmark for measuring lengths along paths.
+
+Performance benchmark for measuring lengths along paths. Long freehand-style paths (random walks smoothed into curves) are measured in total
+ and sampled at many evenly spaced distances, once by recursive subdivision as NSBezierPath+Geometry used to do, and once with the quadrature
+ kernels and DKBezierArcLengthTable. For each, the number of operations per second and the latency percentiles are reported, along with the
+ largest difference between the two methods' results.
+
+ The benchmark is skipped unless the environment variable DK_PATH_BENCHMARK is set. The path sizes, in curve segments, default to 100, 1,000 and
+ 10,000 and may be overridden with a comma-separated list in DK_PATH_BENCHMARK_SIZES. Results are written as JSON to the file named by
+ DK_PATH_BENCHMARK_OUTPUT, or to the log if that's not set.
+*/
+@interface TestPathLengthBenchmark : XCTestCase
+
+/** runs each path size through every workload, and reports the results.
+ */
+- (void)testPathLengthBenchmarks;
+
+- (NSArray<NSDictionary*>*)benchmarkPathWithSegmentCount:(NSUInteger)count;
+
+@end
@@ -0,0 +1,363 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestPathLengthBenchmark.h"
+#import "TestBenchmarkSupport.h"
+#import <DKDrawKit/DKBezierArcLengthTable.h>
+#import <DKDrawKit/NSBezierPath+Geometry.h>
+#include <mach/mach_time.h>
+#include <tgmath.h>
+
+#define MAX_ERROR 0.1
+#define LENGTH_REPEATS 20
+#define POINT_SAMPLES 1000
+#define MAX_TURN 0.6 // the most a freehand stroke turns between one point and the next, in radians
+#define MAX_STEP 20.0
+
+static CGFloat randomUnit(void)
+{
+	return (CGFloat)random() / (CGFloat)0x7FFFFFFF;
+}
+
+static NSBezierPath* freehandPath(NSUInteger count)
+{
+	// a random walk that turns gradually, smoothed into curves in the same way as a freehand drawing
+
+	NSBezierPath* polyline = [NSBezierPath bezierPath];
+	NSPoint p = NSZeroPoint;
+	CGFloat angle = 0;
+	NSUInteger i;
+
+	[polyline moveToPoint:p];
+
+	for (i = 0; i < count; ++i) {
+		CGFloat step = 1.0 + randomUnit() * MAX_STEP;
+
+		angle += (2.0 * randomUnit() - 1.0) * MAX_TURN;
+		p.x += cos(angle) * step;
+		p.y += sin(angle) * step;
+		[polyline lineToPoint:p];
+	}
+
+	return [polyline bezierPathByInterpolatingPath:1.0];
+}
+
+#pragma mark - the previous method, by recursive subdivision
+
+static void referenceSubdivideBezier(const NSPoint bez[4], NSPoint bez1[4], NSPoint bez2[4])
+{
+	NSPoint q;
+
+	bez1[0] = bez[0];
+	bez2[3] = bez[3];
+
+	q.x = (bez[1].x + bez[2].x) / 2.0;
+	q.y = (bez[1].y + bez[2].y) / 2.0;
+	bez1[1].x = (bez[0].x + bez[1].x) / 2.0;
+	bez1[1].y = (bez[0].y + bez[1].y) / 2.0;
+	bez2[2].x = (bez[2].x + bez[3].x) / 2.0;
+	bez2[2].y = (bez[2].y + bez[3].y) / 2.0;
+
+	bez1[2].x = (bez1[1].x + q.x) / 2.0;
+	bez1[2].y = (bez1[1].y + q.y) / 2.0;
+	bez2[1].x = (q.x + bez2[2].x) / 2.0;
+	bez2[1].y = (q.y + bez2[2].y) / 2.0;
+
+	bez1[3].x = bez2[0].x = (bez1[2].x + bez2[1].x) / 2.0;
+	bez1[3].y = bez2[0].y = (bez1[2].y + bez2[1].y) / 2.0;
+}
+
+static void referenceSubdivideBezierAtT(const NSPoint bez[4], NSPoint bez1[4], NSPoint bez2[4], CGFloat t)
+{
+	NSPoint q;
+	CGFloat mt = 1 - t;
+
+	bez1[0] = bez[0];
+	bez2[3] = bez[3];
+
+	q.x = mt * bez[1].x + t * bez[2].x;
+	q.y = mt * bez[1].y + t * bez[2].y;
+	bez1[1].x = mt * bez[0].x + t * bez[1].x;
+	bez1[1].y = mt * bez[0].y + t * bez[1].y;
+	bez2[2].x = mt * bez[2].x + t * bez[3].x;
+	bez2[2].y = mt * bez[2].y + t * bez[3].y;
+
+	bez1[2].x = mt * bez1[1].x + t * q.x;
+	bez1[2].y = mt * bez1[1].y + t * q.y;
+	bez2[1].x = mt * q.x + t * bez2[2].x;
+	bez2[1].y = mt * q.y + t * bez2[2].y;
+
+	bez1[3].x = bez2[0].x = mt * bez1[2].x + t * bez2[1].x;
+	bez1[3].y = bez2[0].y = mt * bez1[2].y + t * bez2[1].y;
+}
+
+static CGFloat referenceLengthOfBezier(const NSPoint bez[4], CGFloat acceptableError)
+{
+	CGFloat polyLen = 0.0;
+	CGFloat chordLen = hypot(bez[3].x - bez[0].x, bez[3].y - bez[0].y);
+	NSUInteger n;
+
+	for (n = 0; n < 3; ++n)
+		polyLen += hypot(bez[n + 1].x - bez[n].x, bez[n + 1].y - bez[n].y);
+
+	if (polyLen - chordLen > acceptableError) {
+		NSPoint left[4], right[4];
+		referenceSubdivideBezier(bez, left, right);
+		return referenceLengthOfBezier(left, acceptableError) + referenceLengthOfBezier(right, acceptableError);
+	}
+
+	return 0.5 * (polyLen + chordLen);
+}
+
+static void referenceSubdivideBezierAtLength(const NSPoint bez[4], NSPoint bez1[4], NSPoint bez2[4], CGFloat length, CGFloat acceptableError)
+{
+	CGFloat top = 1.0, bottom = 0.0;
+	CGFloat t, prevT;
+
+	prevT = t = 0.5;
+	for (;;) {
+		referenceSubdivideBezierAtT(bez, bez1, bez2, t);
+
+		CGFloat len1 = referenceLengthOfBezier(bez1, 0.5 * acceptableError);
+
+		if (fabs(length - len1) < acceptableError)
+			return;
+
+		if (length > len1) {
+			bottom = t;
+			t = 0.5 * (t + top);
+		} else if (length < len1) {
+			top = t;
+			t = 0.5 * (bottom + t);
+		}
+
+		if (t == prevT)
+			return;
+
+		prevT = t;
+	}
+}
+
+static CGFloat referenceLengthOfPath(NSBezierPath* path, CGFloat maxError)
+{
+	NSInteger i, ec = [path elementCount];
+	NSPoint ap[3], lastPoint = NSZeroPoint, pointForClose = NSZeroPoint;
+	CGFloat length = 0;
+
+	for (i = 0; i < ec; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+
+		if (element == NSMoveToBezierPathElement)
+			pointForClose = lastPoint = ap[0];
+		else if (element == NSCurveToBezierPathElement) {
+			NSPoint bez[4] = { lastPoint, ap[0], ap[1], ap[2] };
+			length += referenceLengthOfBezier(bez, maxError);
+			lastPoint = ap[2];
+		} else {
+			NSPoint end = (element == NSClosePathBezierPathElement) ? pointForClose : ap[0];
+			length += hypot(end.x - lastPoint.x, end.y - lastPoint.y);
+			lastPoint = end;
+		}
+	}
+
+	return length;
+}
+
+static NSPoint referencePointOnPathAtLength(NSBezierPath* path, CGFloat target, CGFloat maxError)
+{
+	// walks the path from the start for every point, as trimming the path to the length did (less the cost of building the trimmed path)
+
+	NSInteger i, ec = [path elementCount];
+	NSPoint ap[3], lastPoint = NSZeroPoint, pointForClose = NSZeroPoint;
+	CGFloat length = 0;
+
+	for (i = 0; i < ec; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+
+		if (element == NSMoveToBezierPathElement)
+			pointForClose = lastPoint = ap[0];
+		else if (element == NSCurveToBezierPathElement) {
+			NSPoint bez[4] = { lastPoint, ap[0], ap[1], ap[2] };
+			CGFloat el = referenceLengthOfBezier(bez, maxError);
+
+			if (length + el > target) {
+				NSPoint bez1[4], bez2[4];
+				referenceSubdivideBezierAtLength(bez, bez1, bez2, target - length, maxError);
+				return bez1[3];
+			}
+
+			length += el;
+			lastPoint = ap[2];
+		} else {
+			NSPoint end = (element == NSClosePathBezierPathElement) ? pointForClose : ap[0];
+			CGFloat el = hypot(end.x - lastPoint.x, end.y - lastPoint.y);
+
+			if (length + el > target) {
+				CGFloat f = (target - length) / el;
+				return NSMakePoint(lastPoint.x + f * (end.x - lastPoint.x), lastPoint.y + f * (end.y - lastPoint.y));
+			}
+
+			length += el;
+			lastPoint = end;
+		}
+	}
+
+	return lastPoint;
+}
+
+@interface TestPathLengthBenchmark ()
+
+- (NSDictionary*)resultForWorkload:(NSString*)workload segmentCount:(NSUInteger)count timings:(DKBenchmarkTimings*)timings maximumDifference:(CGFloat)diff;
+
+@end
+
+#pragma mark -
+
+@implementation TestPathLengthBenchmark
+
+- (void)testPathLengthBenchmarks
+{
+	NSDictionary* env = [[NSProcessInfo processInfo] environment];
+
+	if ([env objectForKey:@"DK_PATH_BENCHMARK"] == nil) {
+		NSLog(@"path length benchmarks skipped - set DK_PATH_BENCHMARK to run them");
+		return;
+	}
+
+	srandom(1); // the same paths on every run, so that runs are comparable
+
+	NSArray* sizes = DKBenchmarkSizes(env, @"DK_PATH_BENCHMARK_SIZES", @[ @100, @1000, @10000 ]);
+
+	NSMutableArray* results = [NSMutableArray array];
+
+	for (NSNumber* size in sizes) {
+		@autoreleasepool {
+			NSLog(@"benchmarking path lengths with %@ segments...", size);
+			[results addObjectsFromArray:[self benchmarkPathWithSegmentCount:[size unsignedIntegerValue]]];
+		}
+	}
+
+	NSError* error = nil;
+
+	XCTAssertTrue(DKBenchmarkWriteReport(results, [env objectForKey:@"DK_PATH_BENCHMARK_OUTPUT"], @"path length benchmark", &error), @"could not write benchmark results: %@", error);
+}
+
+- (NSArray*)benchmarkPathWithSegmentCount:(NSUInteger)count
+{
+	NSMutableArray* results = [NSMutableArray array];
+	DKBenchmarkTimings timings = { NULL, 0, 0 };
+	NSBezierPath* path = freehandPath(count);
+	CGFloat refLength = 0, length = 0;
+	uint64_t start;
+	NSUInteger i;
+
+	// total length
+
+	for (i = 0; i < LENGTH_REPEATS; ++i) {
+		start = mach_absolute_time();
+		refLength = referenceLengthOfPath(path, MAX_ERROR);
+		DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+	}
+
+	[results addObject:[self resultForWorkload:@"length_subdivision"
+								  segmentCount:count
+									   timings:&timings
+							 maximumDifference:0]];
+	timings.count = 0;
+
+	for (i = 0; i < LENGTH_REPEATS; ++i) {
+		start = mach_absolute_time();
+		length = [path lengthWithMaximumError:MAX_ERROR];
+		DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+	}
+
+	[results addObject:[self resultForWorkload:@"length_quadrature"
+								  segmentCount:count
+									   timings:&timings
+							 maximumDifference:fabs(length - refLength)]];
+
+	// points at evenly spaced distances - as placing text or motifs along the path does
+
+	NSPoint* refPoints = malloc(sizeof(NSPoint) * POINT_SAMPLES);
+	CGFloat interval = refLength / POINT_SAMPLES;
+	CGFloat diff = 0;
+
+	timings.count = 0;
+
+	for (i = 0; i < POINT_SAMPLES; ++i) {
+		start = mach_absolute_time();
+		refPoints[i] = referencePointOnPathAtLength(path, i * interval, MAX_ERROR);
+		DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+	}
+
+	[results addObject:[self resultForWorkload:@"points_subdivision"
+								  segmentCount:count
+									   timings:&timings
+							 maximumDifference:0]];
+	timings.count = 0;
+
+	for (i = 0; i < POINT_SAMPLES; ++i) {
+		@autoreleasepool {
+			start = mach_absolute_time();
+			NSPoint p = [path pointOnPathAtLength:i * interval
+											slope:NULL];
+			DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+
+			diff = MAX(diff, hypot(p.x - refPoints[i].x, p.y - refPoints[i].y));
+		}
+	}
+
+	[results addObject:[self resultForWorkload:@"points_path"
+								  segmentCount:count
+									   timings:&timings
+							 maximumDifference:diff]];
+
+	// the same, making one table first - the table is included in the first sample
+
+	timings.count = 0;
+	diff = 0;
+
+	start = mach_absolute_time();
+	DKBezierArcLengthTable* table = [[DKBezierArcLengthTable alloc] initWithPath:path
+																	maximumError:MAX_ERROR];
+
+	for (i = 0; i < POINT_SAMPLES; ++i) {
+		NSPoint p = [table pointAtLength:i * interval
+								   slope:NULL];
+		DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+
+		diff = MAX(diff, hypot(p.x - refPoints[i].x, p.y - refPoints[i].y));
+		start = mach_absolute_time();
+	}
+
+	[results addObject:[self resultForWorkload:@"points_table"
+								  segmentCount:count
+									   timings:&timings
+							 maximumDifference:diff]];
+
+	[table release];
+	free(refPoints);
+	DKBenchmarkFreeTimings(&timings);
+
+	return results;
+}
+
+- (NSDictionary*)resultForWorkload:(NSString*)workload segmentCount:(NSUInteger)count timings:(DKBenchmarkTimings*)timings maximumDifference:(CGFloat)diff
+{
+	NSMutableDictionary* result = DKBenchmarkSummary(timings);
+
+	[result addEntriesFromDictionary:@{ @"segments" : @(count),
+		@"workload" : workload,
+		@"max_difference" : @(diff) }];
+
+	NSLog(@"%lu segments %@: %.1f ops/sec, p50 = %.1fus, p99 = %.1fus, max difference = %g", (unsigned long)count, workload, [[result objectForKey:@"ops_per_sec"] doubleValue], [[result objectForKey:@"p50_us"] doubleValue], [[result objectForKey:@"p99_us"] doubleValue], diff);
+
+	return result;
+}
+
+@end
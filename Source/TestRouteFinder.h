@@ -0,0 +1,38 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <DKDrawKit/DKRouteFinder.h>
+#import <XCTest/XCTest.h>
+
+/** @brief Unit Test for the route finder.
+
+Unit Test for the route finder. Points are given as NSValues and sorted by their "pointValue" key, so the tests exercise the route finder's own
+ handling of the points rather than any particular kind of object. Each test checks that every object comes back exactly once, starting with the
+ first, and where the shortest route is known, that it was found.
+*/
+@interface TestRouteFinder : XCTestCase
+
+/** fewer than four objects don't need a route finder, but must still come back sorted.
+ */
+- (void)testTrivialInputs;
+
+/** points along a line, given in a shuffled order, must come back in order along the line.
+ */
+- (void)testCollinearPoints;
+
+/** the corners of a square, starting at one corner, must be visited around the sides rather than across a diagonal.
+ */
+- (void)testSquare;
+
+/** coincident points must each be visited once, at no extra cost.
+ */
+- (void)testDuplicatePoints;
+
+/** without a time budget, the same points must always give the same route.
+ */
+- (void)testRepeatability;
+
+@end
@@ -0,0 +1,209 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestRouteFinder.h"
+#include <tgmath.h>
+
+#define ROUTE_KEY @"pointValue"
+#define LINE_POINTS 40
+#define SCATTERED_POINTS 2000
+
+static NSArray* shuffledPointsAlongLine(NSUInteger count, NSUInteger copies)
+{
+	// the point at the origin first, since the route always starts there, then the rest in a random order
+
+	NSMutableArray* points = [NSMutableArray array];
+	NSUInteger i, c;
+
+	for (i = 1; i < count; ++i) {
+		for (c = 0; c < copies; ++c)
+			[points addObject:[NSValue valueWithPoint:NSMakePoint(10.0 * i, 0)]];
+	}
+
+	for (i = [points count]; i > 1; --i)
+		[points exchangeObjectAtIndex:i - 1
+					withObjectAtIndex:(NSUInteger)random() % i];
+
+	[points insertObject:[NSValue valueWithPoint:NSZeroPoint]
+				 atIndex:0];
+
+	return points;
+}
+
+static CGFloat lengthOfRoute(NSArray* route)
+{
+	CGFloat length = 0;
+	NSUInteger i;
+
+	for (i = 1; i < [route count]; ++i) {
+		NSPoint a = [[route objectAtIndex:i - 1] pointValue];
+		NSPoint b = [[route objectAtIndex:i] pointValue];
+
+		length += hypot(b.x - a.x, b.y - a.y);
+	}
+
+	return length;
+}
+
+@interface TestRouteFinder ()
+
+- (void)verifyRoute:(NSArray*)route ofObjects:(NSArray*)objects;
+
+@end
+
+#pragma mark -
+
+@implementation TestRouteFinder
+
+- (void)testTrivialInputs
+{
+	NSArray* objects = @[];
+	NSArray* route = [DKRouteFinder sortedArrayOfObjects:objects
+								   byShortestRouteForKey:ROUTE_KEY];
+
+	XCTAssertNotNil(route, @"no route for no objects");
+	XCTAssertEqual([route count], (NSUInteger)0, @"route for no objects isn't empty");
+
+	objects = @[ [NSValue valueWithPoint:NSMakePoint(5, 5)] ];
+	route = [DKRouteFinder sortedArrayOfObjects:objects
+						  byShortestRouteForKey:ROUTE_KEY];
+	XCTAssertEqualObjects(route, objects, @"route for one object changed it");
+
+	objects = @[ [NSValue valueWithPoint:NSMakePoint(5, 5)], [NSValue valueWithPoint:NSMakePoint(-20, 3)] ];
+	route = [DKRouteFinder sortedArrayOfObjects:objects
+						  byShortestRouteForKey:ROUTE_KEY];
+	XCTAssertEqualObjects(route, objects, @"route for two objects changed their order");
+
+	// with three, the nearer of the other two must come next
+
+	objects = @[ [NSValue valueWithPoint:NSZeroPoint], [NSValue valueWithPoint:NSMakePoint(10, 0)], [NSValue valueWithPoint:NSMakePoint(1, 0)] ];
+	route = [DKRouteFinder sortedArrayOfObjects:objects
+						  byShortestRouteForKey:ROUTE_KEY];
+
+	NSArray* expected = @[ [objects objectAtIndex:0], [objects objectAtIndex:2], [objects objectAtIndex:1] ];
+	XCTAssertEqualObjects(route, expected, @"route for three objects isn't the shortest");
+}
+
+- (void)testCollinearPoints
+{
+	srandom(1);
+
+	NSArray* objects = shuffledPointsAlongLine(LINE_POINTS, 1);
+	NSArray* route = [DKRouteFinder sortedArrayOfObjects:objects
+								   byShortestRouteForKey:ROUTE_KEY];
+
+	[self verifyRoute:route
+			ofObjects:objects];
+
+	NSUInteger i;
+
+	for (i = 0; i < [route count]; ++i)
+		XCTAssertEqual([[route objectAtIndex:i] pointValue].x, 10.0 * i, @"point %lu is out of order along the line", (unsigned long)i);
+
+	XCTAssertEqualWithAccuracy(lengthOfRoute(route), 10.0 * (LINE_POINTS - 1), 1.0e-6, @"route along the line isn't the shortest");
+}
+
+- (void)testSquare
+{
+	NSArray* objects = @[ [NSValue valueWithPoint:NSZeroPoint],
+		[NSValue valueWithPoint:NSMakePoint(10, 10)],
+		[NSValue valueWithPoint:NSMakePoint(10, 0)],
+		[NSValue valueWithPoint:NSMakePoint(0, 10)] ];
+
+	NSArray* route = [DKRouteFinder sortedArrayOfObjects:objects
+								   byShortestRouteForKey:ROUTE_KEY];
+
+	[self verifyRoute:route
+			ofObjects:objects];
+	XCTAssertEqualWithAccuracy(lengthOfRoute(route), 30.0, 1.0e-6, @"route around the square crosses a diagonal");
+}
+
+- (void)testDuplicatePoints
+{
+	srandom(2);
+
+	NSArray* objects = shuffledPointsAlongLine(LINE_POINTS, 3);
+	NSArray* route = [DKRouteFinder sortedArrayOfObjects:objects
+								   byShortestRouteForKey:ROUTE_KEY];
+
+	[self verifyRoute:route
+			ofObjects:objects];
+	XCTAssertEqualWithAccuracy(lengthOfRoute(route), 10.0 * (LINE_POINTS - 1), 1.0e-6, @"duplicate points lengthened the route");
+
+	// all of the points in the same place
+
+	NSMutableArray* same = [NSMutableArray array];
+	NSUInteger i;
+
+	for (i = 0; i < 10; ++i)
+		[same addObject:[NSValue valueWithPoint:NSMakePoint(7, 7)]];
+
+	route = [DKRouteFinder sortedArrayOfObjects:same
+						  byShortestRouteForKey:ROUTE_KEY];
+
+	[self verifyRoute:route
+			ofObjects:same];
+	XCTAssertEqual(lengthOfRoute(route), 0.0, @"route through coincident points has a length");
+}
+
+- (void)testRepeatability
+{
+	srandom(3);
+
+	NSMutableArray* objects = [NSMutableArray array];
+	NSUInteger i;
+
+	for (i = 0; i < SCATTERED_POINTS; ++i)
+		[objects addObject:[NSValue valueWithPoint:NSMakePoint(random() % 1000, random() % 1000)]];
+
+	NSArray* first = [DKRouteFinder sortedArrayOfObjects:objects
+								   byShortestRouteForKey:ROUTE_KEY];
+	NSArray* second = [DKRouteFinder sortedArrayOfObjects:objects
+									byShortestRouteForKey:ROUTE_KEY];
+
+	[self verifyRoute:first
+			ofObjects:objects];
+
+	for (i = 0; i < [first count]; ++i) {
+		if ([first objectAtIndex:i] != [second objectAtIndex:i]) {
+			XCTFail(@"routes differ from position %lu", (unsigned long)i);
+			break;
+		}
+	}
+
+	// skipping the improvement mustn't lose any objects either
+
+	NSArray* initial = [DKRouteFinder sortedArrayOfObjects:objects
+									 byShortestRouteForKey:ROUTE_KEY
+												timeBudget:0];
+
+	[self verifyRoute:initial
+			ofObjects:objects];
+	XCTAssertLessThanOrEqual(lengthOfRoute(first), lengthOfRoute(initial), @"improvement lengthened the route");
+}
+
+- (void)verifyRoute:(NSArray*)route ofObjects:(NSArray*)objects
+{
+	// every object must appear exactly once, and the first must stay first. Objects are compared by identity, since several
+	// may be equal
+
+	XCTAssertEqual([route count], [objects count], @"route has the wrong number of objects");
+
+	if ([objects count] > 0)
+		XCTAssertTrue([route firstObject] == [objects firstObject], @"route doesn't start with the first object");
+
+	NSHashTable* seen = [NSHashTable hashTableWithOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality];
+
+	for (id object in route)
+		[seen addObject:object];
+
+	XCTAssertEqual([seen count], [objects count], @"route visits some objects more than once");
+
+	for (id object in objects)
+		XCTAssertTrue([seen containsObject:object], @"route leaves out an object");
+}
+
+@end
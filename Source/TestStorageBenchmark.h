@@ -0,0 +1,29 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <DKDrawKit/DKObjectStorageProtocol.h>
+#import <XCTest/XCTest.h>
+
+/** @brief Performance benchmark for the object storage classes.
+
+Performance benchmark for the object storage classes. Each storage class is populated with dummy objects (instances of testStorableObject, as used by
+ TestBSPStorage) and run through a series of workloads modelled on typical use - bulk loading, viewport queries at several zoom levels, point hit-testing,
+ dragging a large selection, changing Z-order and interleaved insertion and deletion. For each, the number of operations per second and the latency
+ percentiles are reported.
+
+ Because the larger runs take a long time, the benchmark is skipped unless the environment variable DK_STORAGE_BENCHMARK is set. The object counts
+ default to 10,000, 100,000 and 1,000,000 and may be overridden with a comma-separated list in DK_STORAGE_BENCHMARK_SIZES. Results are written as JSON
+ to the file named by DK_STORAGE_BENCHMARK_OUTPUT, or to the log if that's not set, so that runs can be compared to track regressions.
+*/
+@interface TestStorageBenchmark : XCTestCase
+
+/** runs every storage class through every workload at each object count, and reports the results.
+ */
+- (void)testStorageBenchmarks;
+
+- (NSArray<NSDictionary*>*)benchmarkStorageClass:(Class)storageClass objectCount:(NSUInteger)count;
+
+@end
@@ -0,0 +1,241 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestStorageBenchmark.h"
+#import "TestBSPStorage.h"
+#import "TestBenchmarkSupport.h"
+#import <DKDrawKit/DKBSPDirectObjectStorage.h>
+#import <DKDrawKit/DKBSPObjectStorage.h>
+#import <DKDrawKit/DKLinearObjectStorage.h>
+#import <DKDrawKit/DKRTreeObjectStorage.h>
+#include <mach/mach_time.h>
+#include <tgmath.h>
+
+#define OBJECT_SPACING 40.0 // average distance between objects - the canvas grows with the object count to keep the density constant
+#define MAX_OBJECT_SIZE 120
+#define VIEWPORT_QUERIES 200
+#define POINT_QUERIES 1000
+#define DRAG_SELECTION_SIZE 5000
+#define DRAG_STEPS 20
+#define REORDER_OPERATIONS 500
+#define INSERT_DELETE_OPERATIONS 1000
+
+static CGFloat randomCoord(CGFloat maxVal)
+{
+	return fmod((CGFloat)random(), maxVal);
+}
+
+static NSRect randomBounds(NSSize canvasSize)
+{
+	return NSMakeRect(randomCoord(canvasSize.width), randomCoord(canvasSize.height), 1 + randomCoord(MAX_OBJECT_SIZE), 1 + randomCoord(MAX_OBJECT_SIZE));
+}
+
+@interface TestStorageBenchmark ()
+
+- (NSDictionary*)resultForWorkload:(NSString*)workload storageClass:(Class)storageClass objectCount:(NSUInteger)count timings:(DKBenchmarkTimings*)timings;
+
+@end
+
+#pragma mark -
+
+@implementation TestStorageBenchmark
+
+- (void)testStorageBenchmarks
+{
+	NSDictionary* env = [[NSProcessInfo processInfo] environment];
+
+	if ([env objectForKey:@"DK_STORAGE_BENCHMARK"] == nil) {
+		NSLog(@"storage benchmarks skipped - set DK_STORAGE_BENCHMARK to run them");
+		return;
+	}
+
+	srandom(1); // the same objects and operations on every run, so that runs are comparable
+
+	NSArray* sizes = DKBenchmarkSizes(env, @"DK_STORAGE_BENCHMARK_SIZES", @[ @10000, @100000, @1000000 ]);
+	NSArray* storageClasses = @[ [DKLinearObjectStorage class], [DKBSPObjectStorage class], [DKBSPDirectObjectStorage class], [DKRTreeObjectStorage class] ];
+	NSMutableArray* results = [NSMutableArray array];
+
+	for (NSNumber* size in sizes) {
+		for (Class storageClass in storageClasses) {
+			@autoreleasepool {
+				NSLog(@"benchmarking %@ with %@ objects...", NSStringFromClass(storageClass), size);
+				[results addObjectsFromArray:[self benchmarkStorageClass:storageClass
+															 objectCount:[size unsignedIntegerValue]]];
+			}
+		}
+	}
+
+	NSError* error = nil;
+
+	XCTAssertTrue(DKBenchmarkWriteReport(results, [env objectForKey:@"DK_STORAGE_BENCHMARK_OUTPUT"], @"storage benchmark", &error), @"could not write benchmark results: %@", error);
+}
+
+- (NSArray*)benchmarkStorageClass:(Class)storageClass objectCount:(NSUInteger)count
+{
+	NSMutableArray* results = [NSMutableArray array];
+	CGFloat side = ceil(sqrt((CGFloat)count) * OBJECT_SPACING);
+	NSSize canvasSize = NSMakeSize(side, side);
+	DKBenchmarkTimings timings = { NULL, 0, 0 };
+	uint64_t start;
+	NSUInteger i;
+
+	id<DKObjectStorage> storage = [[storageClass alloc] init];
+	[storage setCanvasSize:canvasSize];
+
+	// bulk load
+
+	NSMutableArray* objects = [[NSMutableArray alloc] initWithCapacity:count];
+
+	for (i = 0; i < count; ++i) {
+		testStorableObject* tso = [[testStorableObject alloc] init];
+		[tso setBounds:randomBounds(canvasSize)];
+		[objects addObject:tso];
+		[tso release];
+	}
+
+	start = mach_absolute_time();
+	[storage setObjects:objects];
+	DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+
+	[results addObject:[self resultForWorkload:@"bulk_load"
+								  storageClass:storageClass
+								   objectCount:count
+									   timings:&timings]];
+	[objects release];
+
+	// viewport queries at various zooms - each viewport is the given fraction of the canvas across
+
+	for (NSNumber* zoom in @[ @1.0, @0.1, @0.01 ]) {
+		CGFloat vw = side * [zoom doubleValue];
+		timings.count = 0;
+
+		for (i = 0; i < VIEWPORT_QUERIES; ++i) {
+			NSRect viewport = NSMakeRect(randomCoord(MAX(side - vw, 1)), randomCoord(MAX(side - vw, 1)), vw, vw);
+
+			@autoreleasepool {
+				start = mach_absolute_time();
+				[storage objectsIntersectingRect:viewport
+										  inView:nil
+										 options:0];
+				DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+			}
+		}
+
+		[results addObject:[self resultForWorkload:[NSString stringWithFormat:@"viewport_query_%g", [zoom doubleValue]]
+									  storageClass:storageClass
+									   objectCount:count
+										   timings:&timings]];
+	}
+
+	// point hit queries
+
+	timings.count = 0;
+
+	for (i = 0; i < POINT_QUERIES; ++i) {
+		NSPoint p = NSMakePoint(randomCoord(side), randomCoord(side));
+
+		@autoreleasepool {
+			start = mach_absolute_time();
+			[storage objectsContainingPoint:p];
+			DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+		}
+	}
+
+	[results addObject:[self resultForWorkload:@"point_query"
+								  storageClass:storageClass
+								   objectCount:count
+									   timings:&timings]];
+
+	// drag a selection - each step moves every object in the selection a little, as a mouse drag does
+
+	NSUInteger selCount = MIN((NSUInteger)DRAG_SELECTION_SIZE, count);
+	NSUInteger selStart = (NSUInteger)random() % (count - selCount + 1);
+	NSArray* selection = [storage objectsAtIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(selStart, selCount)]];
+
+	timings.count = 0;
+
+	for (i = 0; i < DRAG_STEPS; ++i) {
+		start = mach_absolute_time();
+
+		for (testStorableObject* tso in selection)
+			[tso setBounds:NSOffsetRect([tso bounds], 3, 2)];
+
+		DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+	}
+
+	[results addObject:[self resultForWorkload:@"drag_selection"
+								  storageClass:storageClass
+								   objectCount:count
+									   timings:&timings]];
+
+	// Z-reordering
+
+	timings.count = 0;
+
+	for (i = 0; i < REORDER_OPERATIONS; ++i) {
+		id<DKStorableObject> obj = [storage objectInObjectsAtIndex:(NSUInteger)random() % count];
+		NSUInteger dest = (NSUInteger)random() % count;
+
+		start = mach_absolute_time();
+		[storage moveObject:obj
+					toIndex:dest];
+		DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+	}
+
+	[results addObject:[self resultForWorkload:@"z_reorder"
+								  storageClass:storageClass
+								   objectCount:count
+									   timings:&timings]];
+
+	// interleaved insertion and deletion
+
+	timings.count = 0;
+
+	for (i = 0; i < INSERT_DELETE_OPERATIONS; ++i) {
+		NSUInteger n = [storage countOfObjects];
+
+		if (i & 1) {
+			start = mach_absolute_time();
+			[storage removeObjectFromObjectsAtIndex:(NSUInteger)random() % n];
+			DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+		} else {
+			testStorableObject* tso = [[testStorableObject alloc] init];
+			[tso setBounds:randomBounds(canvasSize)];
+
+			start = mach_absolute_time();
+			[storage insertObject:tso
+				 inObjectsAtIndex:(NSUInteger)random() % (n + 1)];
+			DKBenchmarkRecordSample(&timings, mach_absolute_time() - start);
+
+			[tso release];
+		}
+	}
+
+	[results addObject:[self resultForWorkload:@"insert_delete"
+								  storageClass:storageClass
+								   objectCount:count
+									   timings:&timings]];
+
+	DKBenchmarkFreeTimings(&timings);
+	[storage release];
+
+	return results;
+}
+
+- (NSDictionary*)resultForWorkload:(NSString*)workload storageClass:(Class)storageClass objectCount:(NSUInteger)count timings:(DKBenchmarkTimings*)timings
+{
+	NSMutableDictionary* result = DKBenchmarkSummary(timings);
+
+	[result addEntriesFromDictionary:@{ @"storage" : NSStringFromClass(storageClass),
+		@"objects" : @(count),
+		@"workload" : workload }];
+
+	NSLog(@"%@ %lu %@: %.1f ops/sec, p50 = %.1fus, p99 = %.1fus", NSStringFromClass(storageClass), (unsigned long)count, workload, [[result objectForKey:@"ops_per_sec"] doubleValue], [[result objectForKey:@"p50_us"] doubleValue], [[result objectForKey:@"p99_us"] doubleValue]);
+
+	return result;
+}
+
+@end